@@ -0,0 +1,127 @@
+/******************************************************************************
+
+mdsearch - Lightweight C++ library implementing a collection of
+           multi-dimensional search structures
+
+File:        aligned_allocator.hpp
+Description: Allocator for standard containers that aligns their storage to
+             a given number of bytes, so vectorised kernels can use aligned
+             loads on the contents.
+
+*******************************************************************************
+
+The MIT License (MIT)
+
+Copyright (c) 2014 Donald Whyte
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+******************************************************************************/
+
+#ifndef MDSEARCH_ALIGNED_ALLOCATOR_H
+#define MDSEARCH_ALIGNED_ALLOCATOR_H
+
+#include <cstddef>
+#include <new>
+
+namespace mdsearch
+{
+
+    /** Allocates storage for objects of type T aligned to ALIGNMENT bytes.
+     * ALIGNMENT must be a power of two. If it is no larger than T's own
+     * alignment, this behaves like std::allocator. */
+    template<typename T, std::size_t ALIGNMENT>
+    class AlignedAllocator
+    {
+
+    public:
+        typedef T value_type;
+
+        template<typename U>
+        struct rebind
+        {
+            typedef AlignedAllocator<U, ALIGNMENT> other;
+        };
+
+        AlignedAllocator();
+
+        template<typename U>
+        AlignedAllocator(const AlignedAllocator<U, ALIGNMENT>& other);
+
+        /** Allocate uninitialised storage for 'n' objects. */
+        T* allocate(std::size_t n);
+
+        /** De-allocate storage previously returned by allocate(). */
+        void deallocate(T* p, std::size_t n);
+
+    private:
+        /** Alignment actually used, which is never less than T's. */
+        static const std::size_t STORAGE_ALIGNMENT =
+            (ALIGNMENT > alignof(T)) ? ALIGNMENT : alignof(T);
+
+    };
+
+    template<typename T, std::size_t ALIGNMENT>
+    inline
+    AlignedAllocator<T, ALIGNMENT>::AlignedAllocator()
+    {
+    }
+
+    template<typename T, std::size_t ALIGNMENT>
+    template<typename U>
+    inline
+    AlignedAllocator<T, ALIGNMENT>::AlignedAllocator(
+        const AlignedAllocator<U, ALIGNMENT>&)
+    {
+    }
+
+    template<typename T, std::size_t ALIGNMENT>
+    inline
+    T* AlignedAllocator<T, ALIGNMENT>::allocate(std::size_t n)
+    {
+        return static_cast<T*>(::operator new(n * sizeof(T),
+            std::align_val_t(STORAGE_ALIGNMENT)));
+    }
+
+    template<typename T, std::size_t ALIGNMENT>
+    inline
+    void AlignedAllocator<T, ALIGNMENT>::deallocate(T* p, std::size_t)
+    {
+        ::operator delete(p, std::align_val_t(STORAGE_ALIGNMENT));
+    }
+
+    /** All aligned allocators with the same alignment are interchangeable,
+     * since they have no state. */
+    template<typename T, typename U, std::size_t ALIGNMENT>
+    inline bool operator==(const AlignedAllocator<T, ALIGNMENT>&,
+                           const AlignedAllocator<U, ALIGNMENT>&)
+    {
+        return true;
+    }
+
+    template<typename T, typename U, std::size_t ALIGNMENT>
+    inline bool operator!=(const AlignedAllocator<T, ALIGNMENT>&,
+                           const AlignedAllocator<U, ALIGNMENT>&)
+    {
+        return false;
+    }
+
+}
+
+#endif
@@ -0,0 +1,458 @@
+/******************************************************************************
+
+mdsearch - Lightweight C++ library implementing a collection of
+           multi-dimensional search structures
+
+File:        binary_dataset.hpp
+Description: Defines a compact binary file format for datasets, which
+             stores the points' coordinates in the same representation as
+             they are stored in memory, so files can be memory-mapped and
+             used without parsing or copying.
+
+*******************************************************************************
+
+The MIT License (MIT)
+
+Copyright (c) 2014 Donald Whyte
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+******************************************************************************/
+
+#ifndef MDSEARCH_BINARY_DATASET_H
+#define MDSEARCH_BINARY_DATASET_H
+
+#include "point.hpp"
+#include "boundary.hpp"
+#include "text_parser.hpp"
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace mdsearch
+{
+
+    /** How the coordinates of points are arranged in a binary dataset. */
+    enum BinaryLayout
+    {
+        /** Array of structures: the coordinates of each point are
+         * contiguous, like in a list of Point objects. */
+        AOS_LAYOUT = 0,
+        /** Structure of arrays: the values of each dimension are
+         * contiguous, like the columns the SoA kernels expect. */
+        SOA_LAYOUT = 1
+    };
+
+    /** Codes identifying the type of the coordinates in a binary dataset. */
+    enum BinaryElementType
+    {
+        BINARY_INT8 = 1,
+        BINARY_UINT8 = 2,
+        BINARY_INT16 = 3,
+        BINARY_UINT16 = 4,
+        BINARY_INT32 = 5,
+        BINARY_UINT32 = 6,
+        BINARY_INT64 = 7,
+        BINARY_UINT64 = 8,
+        BINARY_FLOAT32 = 9,
+        BINARY_FLOAT64 = 10
+    };
+
+    /** Maps element types to their code in binary datasets. Only the
+     * types specialised here can be stored in binary datasets. */
+    template<typename ELEM_TYPE>
+    struct BinaryElementTraits;
+
+    template<> struct BinaryElementTraits<int8_t>
+    { static const uint32_t CODE = BINARY_INT8; };
+    template<> struct BinaryElementTraits<uint8_t>
+    { static const uint32_t CODE = BINARY_UINT8; };
+    template<> struct BinaryElementTraits<int16_t>
+    { static const uint32_t CODE = BINARY_INT16; };
+    template<> struct BinaryElementTraits<uint16_t>
+    { static const uint32_t CODE = BINARY_UINT16; };
+    template<> struct BinaryElementTraits<int32_t>
+    { static const uint32_t CODE = BINARY_INT32; };
+    template<> struct BinaryElementTraits<uint32_t>
+    { static const uint32_t CODE = BINARY_UINT32; };
+    template<> struct BinaryElementTraits<int64_t>
+    { static const uint32_t CODE = BINARY_INT64; };
+    template<> struct BinaryElementTraits<uint64_t>
+    { static const uint32_t CODE = BINARY_UINT64; };
+    template<> struct BinaryElementTraits<float>
+    { static const uint32_t CODE = BINARY_FLOAT32; };
+    template<> struct BinaryElementTraits<double>
+    { static const uint32_t CODE = BINARY_FLOAT64; };
+
+    /** Identifies binary dataset files. */
+    static const char BINARY_DATASET_MAGIC[8] = {
+        'M', 'D', 'S', 'E', 'A', 'R', 'C', 'H'
+    };
+    /** Written in the machine's byte order, so files written on machines
+     * with a different byte order are rejected. */
+    static const uint32_t BINARY_BYTE_ORDER_MARK = 0x01020304;
+    static const uint32_t BINARY_DATASET_VERSION = 1;
+    /** The boundary and coordinates start at multiples of this many bytes
+     * from the start of the file, so they are aligned when mapped. */
+    static const uint64_t BINARY_DATASET_ALIGNMENT = 64;
+
+    /** Header at the start of binary dataset files. The boundary, if
+     * present, is stored as D (min, max) pairs of elements. The
+     * coordinates are stored in the given layout:
+     *
+     * AOS_LAYOUT: point i's dth coordinate is element (i * stride + d).
+     * SOA_LAYOUT: point i's dth coordinate is element (d * stride + i).
+     *
+     * In AOS_LAYOUT, the stride is the number of coordinates stored by a
+     * Point, including padding, so the points can be used in place. In
+     * SOA_LAYOUT, each column is padded so it is aligned. */
+    struct BinaryDatasetHeader
+    {
+        char magic[8];
+        uint32_t byteOrder;
+        uint32_t version;
+        uint32_t numDimensions;
+        uint32_t elementType;
+        uint32_t elementSize;
+        uint32_t layout;
+        uint64_t numPoints;
+        /** Number of elements between consecutive points or columns. */
+        uint64_t stride;
+        /** Offset of boundary in bytes, or zero if there is no boundary. */
+        uint64_t boundaryOffset;
+        /** Offset of first coordinate in bytes. */
+        uint64_t dataOffset;
+    };
+
+    /** Return size in bytes of the elements with the given type code, or
+     * 0 if the code isn't valid. */
+    inline uint32_t binaryElementSize(uint32_t elementType)
+    {
+        switch (elementType)
+        {
+        case BINARY_INT8:
+        case BINARY_UINT8:
+            return 1;
+        case BINARY_INT16:
+        case BINARY_UINT16:
+            return 2;
+        case BINARY_INT32:
+        case BINARY_UINT32:
+        case BINARY_FLOAT32:
+            return 4;
+        case BINARY_INT64:
+        case BINARY_UINT64:
+        case BINARY_FLOAT64:
+            return 8;
+        default:
+            return 0;
+        }
+    }
+
+    /** Round offset up to the next multiple of BINARY_DATASET_ALIGNMENT. */
+    inline uint64_t alignBinaryOffset(uint64_t offset)
+    {
+        return (offset + BINARY_DATASET_ALIGNMENT - 1)
+            / BINARY_DATASET_ALIGNMENT * BINARY_DATASET_ALIGNMENT;
+    }
+
+    /** Write points to binary dataset file with the given name, in the
+     * given layout. If 'boundary' is not NULL, it is stored with the
+     * points. Returns true if the file was written successfully. */
+    template<int D, typename ELEM_TYPE>
+    bool writeBinaryDataset(const std::string& filename,
+                            const Point<D, ELEM_TYPE>* points,
+                            std::size_t numPoints, BinaryLayout layout,
+                            const Boundary<D, ELEM_TYPE>* boundary = NULL);
+
+    /** Binary dataset file, memory-mapped so its coordinates can be used
+     * without copying. */
+    class BinaryDatasetFile
+    {
+
+    public:
+        /** Open binary dataset with given name. Use isValid() to check if
+         * the file could be read and has a valid header. */
+        BinaryDatasetFile(const std::string& filename);
+
+        /** Return true if the file is a valid binary dataset. */
+        bool isValid() const;
+        /** Return true if the file contains points with D coordinates of
+         * type ELEM_TYPE. */
+        template<int D, typename ELEM_TYPE>
+        bool matches() const;
+        const BinaryDatasetHeader& header() const;
+
+        /** Return pointer to the first coordinate, whose meaning depends
+         * on the file's layout. ELEM_TYPE must match the file. */
+        template<typename ELEM_TYPE>
+        const ELEM_TYPE* elements() const;
+        /** Return the dth column of a file in SOA_LAYOUT. */
+        template<typename ELEM_TYPE>
+        const ELEM_TYPE* column(unsigned int d) const;
+        /** Return the points of a file in AOS_LAYOUT, or NULL if the
+         * file's stride or alignment doesn't match Point's storage, in
+         * which case the points can't be used in place. */
+        template<int D, typename ELEM_TYPE>
+        const Point<D, ELEM_TYPE>* points() const;
+        /** Copy the ith point out of the file, in either layout. */
+        template<int D, typename ELEM_TYPE>
+        Point<D, ELEM_TYPE> getPoint(std::size_t i) const;
+
+        /** Return true if the file stores the points' boundary. */
+        bool hasBoundary() const;
+        template<int D, typename ELEM_TYPE>
+        Boundary<D, ELEM_TYPE> boundary() const;
+
+    private:
+        MappedFile m_file;
+        BinaryDatasetHeader m_header;
+        bool m_valid;
+
+    };
+
+    template<int D, typename ELEM_TYPE>
+    bool writeBinaryDataset(const std::string& filename,
+                            const Point<D, ELEM_TYPE>* points,
+                            std::size_t numPoints, BinaryLayout layout,
+                            const Boundary<D, ELEM_TYPE>* boundary)
+    {
+        static const std::size_t STORAGE_SIZE =
+            Point<D, ELEM_TYPE>::STORAGE_SIZE;
+        static const uint64_t ELEMENTS_PER_BLOCK =
+            BINARY_DATASET_ALIGNMENT / sizeof(ELEM_TYPE);
+
+        BinaryDatasetHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, BINARY_DATASET_MAGIC, sizeof(header.magic));
+        header.byteOrder = BINARY_BYTE_ORDER_MARK;
+        header.version = BINARY_DATASET_VERSION;
+        header.numDimensions = D;
+        header.elementType = BinaryElementTraits<ELEM_TYPE>::CODE;
+        header.elementSize = sizeof(ELEM_TYPE);
+        header.layout = layout;
+        header.numPoints = numPoints;
+        if (layout == AOS_LAYOUT)
+        {
+            header.stride = STORAGE_SIZE;
+        }
+        else
+        {
+            header.stride = (numPoints + ELEMENTS_PER_BLOCK - 1)
+                / ELEMENTS_PER_BLOCK * ELEMENTS_PER_BLOCK;
+        }
+        uint64_t offset = alignBinaryOffset(sizeof(header));
+        if (boundary != NULL)
+        {
+            header.boundaryOffset = offset;
+            offset = alignBinaryOffset(offset + 2 * D * sizeof(ELEM_TYPE));
+        }
+        header.dataOffset = offset;
+
+        std::ofstream file(filename.c_str(), std::ios::binary);
+        if (!file.is_open())
+            return false;
+        std::vector<char> padding(BINARY_DATASET_ALIGNMENT, 0);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(&padding[0], alignBinaryOffset(sizeof(header))
+            - sizeof(header));
+        if (boundary != NULL)
+        {
+            ELEM_TYPE bounds[2 * D];
+            for (unsigned int d = 0; (d < D); d++)
+            {
+                bounds[2 * d] = (*boundary)[d].min;
+                bounds[2 * d + 1] = (*boundary)[d].max;
+            }
+            file.write(reinterpret_cast<const char*>(bounds), sizeof(bounds));
+            file.write(&padding[0], header.dataOffset
+                - header.boundaryOffset - sizeof(bounds));
+        }
+
+        if (layout == AOS_LAYOUT)
+        {
+            // Points' padding is always zero, so they can be written as is
+            // if they're stored contiguously
+            if (sizeof(Point<D, ELEM_TYPE>) == STORAGE_SIZE * sizeof(ELEM_TYPE))
+            {
+                file.write(reinterpret_cast<const char*>(points),
+                           numPoints * sizeof(Point<D, ELEM_TYPE>));
+            }
+            else
+            {
+                for (std::size_t i = 0; (i < numPoints); i++)
+                {
+                    file.write(reinterpret_cast<const char*>(
+                        points[i].asArray()), STORAGE_SIZE * sizeof(ELEM_TYPE));
+                }
+            }
+        }
+        else
+        {
+            std::vector<ELEM_TYPE> column(header.stride,
+                                          static_cast<ELEM_TYPE>(0));
+            for (unsigned int d = 0; (d < D); d++)
+            {
+                for (std::size_t i = 0; (i < numPoints); i++)
+                    column[i] = points[i][d];
+                if (!column.empty())
+                {
+                    file.write(reinterpret_cast<const char*>(&column[0]),
+                               column.size() * sizeof(ELEM_TYPE));
+                }
+            }
+        }
+        return !file.fail();
+    }
+
+    inline BinaryDatasetFile::BinaryDatasetFile(const std::string& filename)
+    : m_file(filename), m_valid(false)
+    {
+        memset(&m_header, 0, sizeof(m_header));
+        if (!m_file.isOpen() || m_file.size() < sizeof(m_header))
+            return;
+        memcpy(&m_header, m_file.data(), sizeof(m_header));
+
+        const BinaryDatasetHeader& h = m_header;
+        if (memcmp(h.magic, BINARY_DATASET_MAGIC, sizeof(h.magic)) != 0
+            || h.byteOrder != BINARY_BYTE_ORDER_MARK
+            || h.version != BINARY_DATASET_VERSION
+            || h.numDimensions == 0
+            || h.elementSize != binaryElementSize(h.elementType)
+            || (h.layout != AOS_LAYOUT && h.layout != SOA_LAYOUT))
+        {
+            return;
+        }
+        // Check the coordinates and boundary are inside the file. The
+        // header can't be trusted, so sizes are compared by dividing the
+        // space left in the file, since multiplying could overflow.
+        const uint64_t fileSize = m_file.size();
+        const uint64_t minStride = (h.layout == AOS_LAYOUT)
+            ? h.numDimensions : h.numPoints;
+        const uint64_t numStrides = (h.layout == AOS_LAYOUT)
+            ? h.numPoints : h.numDimensions;
+        if (h.stride < minStride || h.dataOffset < sizeof(h)
+            || h.dataOffset % BINARY_DATASET_ALIGNMENT != 0
+            || h.dataOffset > fileSize
+            || (numStrides != 0 && h.stride
+                > (fileSize - h.dataOffset) / h.elementSize / numStrides))
+        {
+            return;
+        }
+        if (h.boundaryOffset != 0 && (h.boundaryOffset < sizeof(h)
+            || h.boundaryOffset % BINARY_DATASET_ALIGNMENT != 0
+            || h.boundaryOffset > fileSize
+            || h.numDimensions
+                > (fileSize - h.boundaryOffset) / h.elementSize / 2))
+        {
+            return;
+        }
+        m_valid = true;
+    }
+
+    inline bool BinaryDatasetFile::isValid() const
+    {
+        return m_valid;
+    }
+
+    template<int D, typename ELEM_TYPE>
+    inline bool BinaryDatasetFile::matches() const
+    {
+        return m_valid && m_header.numDimensions == D
+            && m_header.elementType == BinaryElementTraits<ELEM_TYPE>::CODE
+            && m_header.elementSize == sizeof(ELEM_TYPE);
+    }
+
+    inline const BinaryDatasetHeader& BinaryDatasetFile::header() const
+    {
+        return m_header;
+    }
+
+    template<typename ELEM_TYPE>
+    inline const ELEM_TYPE* BinaryDatasetFile::elements() const
+    {
+        return reinterpret_cast<const ELEM_TYPE*>(
+            m_file.data() + m_header.dataOffset);
+    }
+
+    template<typename ELEM_TYPE>
+    inline const ELEM_TYPE* BinaryDatasetFile::column(unsigned int d) const
+    {
+        return elements<ELEM_TYPE>() + d * m_header.stride;
+    }
+
+    template<int D, typename ELEM_TYPE>
+    const Point<D, ELEM_TYPE>* BinaryDatasetFile::points() const
+    {
+        const ELEM_TYPE* data = elements<ELEM_TYPE>();
+        if (m_header.layout != AOS_LAYOUT
+            || m_header.stride != Point<D, ELEM_TYPE>::STORAGE_SIZE
+            || sizeof(Point<D, ELEM_TYPE>)
+                != m_header.stride * sizeof(ELEM_TYPE)
+            || reinterpret_cast<uintptr_t>(data)
+                % alignof(Point<D, ELEM_TYPE>) != 0)
+        {
+            return NULL;
+        }
+        return reinterpret_cast<const Point<D, ELEM_TYPE>*>(data);
+    }
+
+    template<int D, typename ELEM_TYPE>
+    Point<D, ELEM_TYPE> BinaryDatasetFile::getPoint(std::size_t i) const
+    {
+        const ELEM_TYPE* data = elements<ELEM_TYPE>();
+        Point<D, ELEM_TYPE> p;
+        if (m_header.layout == AOS_LAYOUT)
+        {
+            memcpy(p.asArray(), data + i * m_header.stride,
+                   D * sizeof(ELEM_TYPE));
+        }
+        else
+        {
+            for (unsigned int d = 0; (d < D); d++)
+                p[d] = data[d * m_header.stride + i];
+        }
+        return p;
+    }
+
+    inline bool BinaryDatasetFile::hasBoundary() const
+    {
+        return m_valid && m_header.boundaryOffset != 0;
+    }
+
+    template<int D, typename ELEM_TYPE>
+    Boundary<D, ELEM_TYPE> BinaryDatasetFile::boundary() const
+    {
+        ELEM_TYPE bounds[2 * D];
+        memcpy(bounds, m_file.data() + m_header.boundaryOffset,
+               sizeof(bounds));
+        Boundary<D, ELEM_TYPE> result;
+        for (unsigned int d = 0; (d < D); d++)
+        {
+            result[d].min = bounds[2 * d];
+            result[d].max = bounds[2 * d + 1];
+        }
+        return result;
+    }
+
+}
+
+#endif
@@ -5,7 +5,10 @@ mdsearch - Lightweight C++ library implementing a collection of
 
 File:        boundary.hpp
 Description: Contains class representing spatial boundaries with an arbitrary
-             number of dimensions.
+             number of dimensions, and the geometry kernels used to prune
+             searches with them (containment, intersection and point to
+             boundary distances). Also computes the boundaries of sets of
+             points with a parallel min/max reduction.
 
 *******************************************************************************
 
@@ -36,7 +39,17 @@ THE SOFTWARE.
 #ifndef MDSEARCH_BOUNDARY_H
 #define MDSEARCH_BOUNDARY_H
 
+#include "types.hpp"
+#include "point.hpp"
+#include "distance.hpp"
+#include "simd.hpp"
+#include <algorithm>
+#include <cstring>
 #include <iostream>
+#include <vector>
+#ifdef _OPENMP
+    #include <omp.h>
+#endif
 
 namespace mdsearch
 {
@@ -94,6 +107,17 @@ namespace mdsearch
          * dth dimension. */
         Interval<ELEM_TYPE>& operator[](int d);
 
+        /** Return true if point lies inside the boundary (inclusive). */
+        bool contains(const Point<D, ELEM_TYPE>& p) const;
+
+        /** Return true if the other boundary lies entirely inside this
+         * boundary (inclusive). */
+        bool contains(const Boundary<D, ELEM_TYPE>& other) const;
+
+        /** Return true if the other boundary overlaps this boundary,
+         * including if they only touch. */
+        bool intersects(const Boundary<D, ELEM_TYPE>& other) const;
+
         /** Output all the boundary's intervals to stream. */
         void print(std::ostream& out) const;
 
@@ -157,6 +181,375 @@ namespace mdsearch
         return m_intervals[d];
     }
 
+    /** Number of dimensions Boundary::contains() tests at once, before
+     * checking whether the point is outside of the boundary. */
+    static const unsigned int BOUNDARY_BLOCK_SIZE = 4;
+
+    // The geometry kernels combine the results of each dimension with
+    // bitwise operations instead of branching, so the compiler can
+    // vectorise them.
+
+    template<int D, typename ELEM_TYPE>
+    inline
+    bool Boundary<D, ELEM_TYPE>::contains(const Point<D, ELEM_TYPE>& p) const
+    {
+        // Most points tested by searches are outside of the boundary, so
+        // stop after each block of dimensions if the point is outside
+        unsigned int d = 0;
+        for (; (d + BOUNDARY_BLOCK_SIZE <= D); d += BOUNDARY_BLOCK_SIZE)
+        {
+            bool inside = true;
+            for (unsigned int i = d; (i < d + BOUNDARY_BLOCK_SIZE); i++)
+            {
+                inside &= (p[i] >= m_intervals[i].min)
+                    & (p[i] <= m_intervals[i].max);
+            }
+            if (!inside)
+                return false;
+        }
+        bool inside = true;
+        for (; (d < D); d++)
+        {
+            inside &= (p[d] >= m_intervals[d].min)
+                & (p[d] <= m_intervals[d].max);
+        }
+        return inside;
+    }
+
+    template<int D, typename ELEM_TYPE>
+    inline
+    bool Boundary<D, ELEM_TYPE>::contains(
+        const Boundary<D, ELEM_TYPE>& other) const
+    {
+        bool inside = true;
+        for (unsigned int d = 0; (d < D); d++)
+        {
+            inside &= (other[d].min >= m_intervals[d].min)
+                & (other[d].max <= m_intervals[d].max);
+        }
+        return inside;
+    }
+
+    template<int D, typename ELEM_TYPE>
+    inline
+    bool Boundary<D, ELEM_TYPE>::intersects(
+        const Boundary<D, ELEM_TYPE>& other) const
+    {
+        bool overlaps = true;
+        for (unsigned int d = 0; (d < D); d++)
+        {
+            overlaps &= (other[d].min <= m_intervals[d].max)
+                & (other[d].max >= m_intervals[d].min);
+        }
+        return overlaps;
+    }
+
+    /** Return smallest distance, using given METRIC, between a point and
+     * any point inside the boundary. This is zero if the point is inside
+     * the boundary, and is a lower bound of the distance to every point
+     * stored in a region covered by the boundary. */
+    template<typename METRIC, int D, typename ELEM_TYPE>
+    inline typename DistanceType<ELEM_TYPE>::Type minDistance(
+        const Boundary<D, ELEM_TYPE>& boundary, const Point<D, ELEM_TYPE>& p)
+    {
+        typedef typename DistanceType<ELEM_TYPE>::Type DistanceValue;
+        DistanceValue total = 0;
+        for (unsigned int d = 0; (d < D); d++)
+        {
+            // At most one of these is positive
+            DistanceValue below = difference(boundary[d].min, p[d]);
+            DistanceValue above = difference(p[d], boundary[d].max);
+            DistanceValue gap = std::max(std::max(below, above),
+                                         static_cast<DistanceValue>(0));
+            total = METRIC::combine(total, METRIC::term(gap));
+        }
+        return total;
+    }
+
+    /** Return largest distance, using given METRIC, between a point and
+     * any point inside the boundary, which is the distance to the
+     * boundary's furthest corner. */
+    template<typename METRIC, int D, typename ELEM_TYPE>
+    inline typename DistanceType<ELEM_TYPE>::Type maxDistance(
+        const Boundary<D, ELEM_TYPE>& boundary, const Point<D, ELEM_TYPE>& p)
+    {
+        typedef typename DistanceType<ELEM_TYPE>::Type DistanceValue;
+        DistanceValue total = 0;
+        for (unsigned int d = 0; (d < D); d++)
+        {
+            DistanceValue gap = std::max(difference(p[d], boundary[d].min),
+                                         difference(boundary[d].max, p[d]));
+            total = METRIC::combine(total, METRIC::term(gap));
+        }
+        return total;
+    }
+
+    /** Test which of 'numPoints' points lie inside the boundary, setting
+     * results[i] to 1 if the ith point does and 0 otherwise. Returns the
+     * number of points inside the boundary. */
+    template<int D, typename ELEM_TYPE>
+    MDSEARCH_TARGET_CLONES
+    unsigned int containsPoints(const Boundary<D, ELEM_TYPE>& boundary,
+                                const Point<D, ELEM_TYPE>* points,
+                                unsigned int numPoints,
+                                unsigned char* results)
+    {
+        unsigned int numInside = 0;
+        for (unsigned int i = 0; (i < numPoints); i++)
+        {
+            unsigned char inside = 1;
+            for (unsigned int d = 0; (d < D); d++)
+            {
+                inside &= (points[i][d] >= boundary[d].min)
+                    & (points[i][d] <= boundary[d].max);
+            }
+            results[i] = inside;
+            numInside += inside;
+        }
+        return numInside;
+    }
+
+    /** Test which of 'numPoints' points, stored column by column, lie
+     * inside the boundary. The dth coordinate of the ith point is stored
+     * at columns[d * stride + i]. Sets results[i] to 1 if the ith point
+     * is inside the boundary and 0 otherwise, and returns the number of
+     * points inside the boundary.
+     *
+     * Each dimension is tested for all points at once, so the loops over
+     * points vectorise. */
+    template<int D, typename ELEM_TYPE>
+    MDSEARCH_TARGET_CLONES
+    unsigned int containsColumns(const Boundary<D, ELEM_TYPE>& boundary,
+                                 const ELEM_TYPE* columns, unsigned int stride,
+                                 unsigned int numPoints,
+                                 unsigned char* results)
+    {
+        for (unsigned int i = 0; (i < numPoints); i++)
+            results[i] = 1;
+        for (unsigned int d = 0; (d < D); d++)
+        {
+            const ELEM_TYPE* column = columns + d * stride;
+            const ELEM_TYPE min = boundary[d].min;
+            const ELEM_TYPE max = boundary[d].max;
+            for (unsigned int i = 0; (i < numPoints); i++)
+                results[i] &= (column[i] >= min) & (column[i] <= max);
+        }
+        unsigned int numInside = 0;
+        for (unsigned int i = 0; (i < numPoints); i++)
+            numInside += results[i];
+        return numInside;
+    }
+
+    /** Widen mins[d] and maxs[d] to include the dth coordinate of
+     * 'numPoints' points, for each of the Point::STORAGE_SIZE values the
+     * points store. Both bounds are updated without branches, so the loop
+     * over dimensions vectorises. */
+    template<int D, typename ELEM_TYPE>
+    MDSEARCH_TARGET_CLONES
+    void expandBounds(const Point<D, ELEM_TYPE>* points,
+                      std::size_t numPoints, ELEM_TYPE* mins, ELEM_TYPE* maxs)
+    {
+        static const int SIZE = Point<D, ELEM_TYPE>::STORAGE_SIZE;
+        // Local copies, so the compiler knows they don't alias the points
+        ELEM_TYPE lo[SIZE];
+        ELEM_TYPE hi[SIZE];
+        for (unsigned int d = 0; (d < SIZE); d++)
+        {
+            lo[d] = mins[d];
+            hi[d] = maxs[d];
+        }
+        for (std::size_t i = 0; (i < numPoints); i++)
+        {
+            const ELEM_TYPE* p = points[i].asArray();
+            MDSEARCH_VECTORISE_LOOP
+            for (unsigned int d = 0; (d < SIZE); d++)
+            {
+                lo[d] = (p[d] < lo[d]) ? p[d] : lo[d];
+                hi[d] = (p[d] > hi[d]) ? p[d] : hi[d];
+            }
+        }
+        for (unsigned int d = 0; (d < SIZE); d++)
+        {
+            mins[d] = lo[d];
+            maxs[d] = hi[d];
+        }
+    }
+
+    /** Smallest number of points BoundaryAccumulator::add() splits
+     * between threads. */
+    static const std::size_t MIN_PARALLEL_BOUNDARY_POINTS = 1 << 16;
+
+    /** Computes the minimum bounding hyper-rectangle of points, which can
+     * be added a batch at a time (e.g. as chunks are read from a
+     * DatasetReader). */
+    template<int D, typename ELEM_TYPE>
+    class BoundaryAccumulator
+    {
+
+    public:
+        BoundaryAccumulator();
+
+        /** Expand the boundary to contain the given points. Large batches
+         * are split between OpenMP threads, whose boundaries are merged
+         * in pairs with a tree reduction. */
+        void add(const Point<D, ELEM_TYPE>* points, std::size_t numPoints);
+        void add(const std::vector< Point<D, ELEM_TYPE> >& points);
+        /** Expand the boundary to contain another accumulator's points. */
+        void add(const BoundaryAccumulator& other);
+
+        /** Return true if no points have been added. */
+        bool empty() const;
+        /** Return the boundary of all points added. If no points have
+         * been added, every interval is [0:0]. */
+        Boundary<D, ELEM_TYPE> boundary() const;
+
+    private:
+        static const int SIZE = Point<D, ELEM_TYPE>::STORAGE_SIZE;
+
+        /** Merge the bounds in 'otherMins' and 'otherMaxs' into the bounds
+         * in 'mins' and 'maxs'. */
+        static void merge(ELEM_TYPE* mins, ELEM_TYPE* maxs,
+                          const ELEM_TYPE* otherMins,
+                          const ELEM_TYPE* otherMaxs);
+
+        ELEM_TYPE m_mins[SIZE];
+        ELEM_TYPE m_maxs[SIZE];
+        bool m_empty;
+
+    };
+
+    template<int D, typename ELEM_TYPE>
+    BoundaryAccumulator<D, ELEM_TYPE>::BoundaryAccumulator() : m_empty(true)
+    {
+        for (unsigned int d = 0; (d < SIZE); d++)
+        {
+            m_mins[d] = static_cast<ELEM_TYPE>(0);
+            m_maxs[d] = static_cast<ELEM_TYPE>(0);
+        }
+    }
+
+    template<int D, typename ELEM_TYPE>
+    void BoundaryAccumulator<D, ELEM_TYPE>::add(
+        const Point<D, ELEM_TYPE>* points, std::size_t numPoints)
+    {
+        if (numPoints == 0)
+            return;
+
+        int maxThreads = 1;
+        #ifdef _OPENMP
+        maxThreads = omp_get_max_threads();
+        #endif
+        if (numPoints < MIN_PARALLEL_BOUNDARY_POINTS || maxThreads == 1)
+        {
+            if (m_empty)
+            {
+                memcpy(m_mins, points[0].asArray(), sizeof(m_mins));
+                memcpy(m_maxs, points[0].asArray(), sizeof(m_maxs));
+                m_empty = false;
+            }
+            expandBounds(points, numPoints, m_mins, m_maxs);
+            return;
+        }
+
+        // Each thread computes the bounds of its own range of points
+        std::vector<ELEM_TYPE> mins(maxThreads * SIZE);
+        std::vector<ELEM_TYPE> maxs(maxThreads * SIZE);
+        #pragma omp parallel
+        {
+            int thread = 0;
+            int numThreads = 1;
+            #ifdef _OPENMP
+            thread = omp_get_thread_num();
+            numThreads = omp_get_num_threads();
+            #endif
+
+            const std::size_t start = (numPoints * thread) / numThreads;
+            const std::size_t end = (numPoints * (thread + 1)) / numThreads;
+            ELEM_TYPE* threadMins = &mins[thread * SIZE];
+            ELEM_TYPE* threadMaxs = &maxs[thread * SIZE];
+            memcpy(threadMins, points[start].asArray(),
+                   SIZE * sizeof(ELEM_TYPE));
+            memcpy(threadMaxs, points[start].asArray(),
+                   SIZE * sizeof(ELEM_TYPE));
+            expandBounds(points + start + 1, end - start - 1,
+                         threadMins, threadMaxs);
+
+            // Merge pairs of threads' bounds, halving the number of
+            // bounds left each step until thread 0 has them all
+            for (int step = 1; (step < numThreads); step *= 2)
+            {
+                #pragma omp barrier
+                if (thread % (2 * step) == 0 && thread + step < numThreads)
+                {
+                    merge(threadMins, threadMaxs,
+                          &mins[(thread + step) * SIZE],
+                          &maxs[(thread + step) * SIZE]);
+                }
+            }
+        }
+
+        if (m_empty)
+        {
+            memcpy(m_mins, &mins[0], sizeof(m_mins));
+            memcpy(m_maxs, &maxs[0], sizeof(m_maxs));
+            m_empty = false;
+        }
+        else
+        {
+            merge(m_mins, m_maxs, &mins[0], &maxs[0]);
+        }
+    }
+
+    template<int D, typename ELEM_TYPE>
+    inline void BoundaryAccumulator<D, ELEM_TYPE>::add(
+        const std::vector< Point<D, ELEM_TYPE> >& points)
+    {
+        if (!points.empty())
+            add(&points[0], points.size());
+    }
+
+    template<int D, typename ELEM_TYPE>
+    void BoundaryAccumulator<D, ELEM_TYPE>::add(
+        const BoundaryAccumulator& other)
+    {
+        if (other.m_empty)
+            return;
+        if (m_empty)
+            *this = other;
+        else
+            merge(m_mins, m_maxs, other.m_mins, other.m_maxs);
+    }
+
+    template<int D, typename ELEM_TYPE>
+    inline bool BoundaryAccumulator<D, ELEM_TYPE>::empty() const
+    {
+        return m_empty;
+    }
+
+    template<int D, typename ELEM_TYPE>
+    Boundary<D, ELEM_TYPE> BoundaryAccumulator<D, ELEM_TYPE>::boundary() const
+    {
+        Boundary<D, ELEM_TYPE> result;
+        for (unsigned int d = 0; (d < D); d++)
+        {
+            result[d].min = m_mins[d];
+            result[d].max = m_maxs[d];
+        }
+        return result;
+    }
+
+    template<int D, typename ELEM_TYPE>
+    inline void BoundaryAccumulator<D, ELEM_TYPE>::merge(
+        ELEM_TYPE* mins, ELEM_TYPE* maxs,
+        const ELEM_TYPE* otherMins, const ELEM_TYPE* otherMaxs)
+    {
+        for (unsigned int d = 0; (d < SIZE); d++)
+        {
+            mins[d] = (otherMins[d] < mins[d]) ? otherMins[d] : mins[d];
+            maxs[d] = (otherMaxs[d] > maxs[d]) ? otherMaxs[d] : maxs[d];
+        }
+    }
+
     template<int D, typename ELEM_TYPE>
     inline
     void Boundary<D, ELEM_TYPE>::print(std::ostream& out) const
@@ -43,8 +43,10 @@ THE SOFTWARE.
 
 #include "point.hpp"
 #include "bucket_kdtree_strategies.hpp"
+#include "memory_usage.hpp"
 #include <algorithm>
 #include <cassert>
+#include <new>
 
 namespace mdsearch
 {
@@ -62,20 +64,30 @@ namespace mdsearch
 
     public:
         typedef Point<D, ELEM_TYPE> PointType;
-        typedef std::vector<PointType> PointList;
-
-        /** Construct leaf node with no points. */
-        BucketKDTreeNode(BucketKDTreeNode<D, ELEM_TYPE>* parent);
-        /** Construct leaf node that stores given point. */
-        BucketKDTreeNode(BucketKDTreeNode<D, ELEM_TYPE>* parent,
-                         const PointType& p);
-        /** Construct leaf node that stores given points. */
+        typedef CountingAllocator<PointType> PointAllocator;
+        typedef std::vector<PointType, PointAllocator> PointList;
+        typedef CountingAllocator<BucketKDTreeNode> NodeAllocator;
+
+        /** Construct root leaf node with no points. Nodes are allocated
+         * with 'nodeAllocator' and their points with 'pointAllocator'. */
+        BucketKDTreeNode(const NodeAllocator& nodeAllocator,
+                         const PointAllocator& pointAllocator);
+        /** Construct leaf node that stores given points, using the same
+         * allocators as its parent. */
         BucketKDTreeNode(BucketKDTreeNode<D, ELEM_TYPE>* parent,
                          const PointList& points);
 
         /** Delete node and both of its children. */
         ~BucketKDTreeNode();
 
+        /** Allocate root leaf node with no points. */
+        static BucketKDTreeNode<D, ELEM_TYPE>* createRoot(
+            const NodeAllocator& nodeAllocator,
+            const PointAllocator& pointAllocator);
+        /** Delete given node (and its children) and free its storage. Does
+         * nothing if the node is NULL. */
+        static void destroy(BucketKDTreeNode<D, ELEM_TYPE>* node);
+
         /** Return true if node contains given point. */
         bool contains(const PointType& p);
 
@@ -134,6 +146,9 @@ namespace mdsearch
         bool removePoint(const PointType& p);
 
     private:
+        /** Allocate child node that stores given points. */
+        BucketKDTreeNode<D, ELEM_TYPE>* createChild(const PointList& points);
+
         /** Splits points using a single dimension (D - 1 hyperplane). */
         class SplitPredicate
         {
@@ -167,6 +182,8 @@ namespace mdsearch
         /** Pointer to parent node.
          * Set to NULL if node is the root. */
         BucketKDTreeNode<D, ELEM_TYPE>* m_parent;
+        /** Allocates this node's children. */
+        NodeAllocator m_nodeAllocator;
         /** Total number of points store in subtree rooted at this node. */
         int m_totalPoints;
 
@@ -193,8 +210,10 @@ namespace mdsearch
 
     template<int D, typename ELEM_TYPE>
     BucketKDTreeNode<D, ELEM_TYPE>::BucketKDTreeNode(
-        BucketKDTreeNode<D, ELEM_TYPE>* parent)
-    : m_parent(parent), m_totalPoints(0), m_isLeaf(true),
+        const NodeAllocator& nodeAllocator,
+        const PointAllocator& pointAllocator)
+    : m_parent(NULL), m_nodeAllocator(nodeAllocator), m_totalPoints(0),
+      m_isLeaf(true), m_points(pointAllocator),
       m_leftChild(NULL), m_rightChild(NULL),
       m_cuttingDimension(0), m_cuttingValue(0)
     {
@@ -203,31 +222,50 @@ namespace mdsearch
     template<int D, typename ELEM_TYPE>
     BucketKDTreeNode<D, ELEM_TYPE>::BucketKDTreeNode(
         BucketKDTreeNode<D, ELEM_TYPE>* parent,
-        const Point<D, ELEM_TYPE>& p)
-    : m_parent(parent), m_totalPoints(1), m_isLeaf(true),
+        const PointList& points)
+    : m_parent(parent), m_nodeAllocator(parent->m_nodeAllocator),
+      m_totalPoints(points.size()), m_isLeaf(true), m_points(points),
       m_leftChild(NULL), m_rightChild(NULL),
       m_cuttingDimension(0), m_cuttingValue(0)
     {
-        m_points.push_back(p);
+
     }
 
     template<int D, typename ELEM_TYPE>
-    BucketKDTreeNode<D, ELEM_TYPE>::BucketKDTreeNode(
-        BucketKDTreeNode<D, ELEM_TYPE>* parent,
-        const PointList& points)
-    : m_parent(parent), m_totalPoints(points.size()),
-      m_isLeaf(true), m_points(points),
-      m_leftChild(NULL), m_rightChild(NULL),
-      m_cuttingDimension(0), m_cuttingValue(0)
+    BucketKDTreeNode<D, ELEM_TYPE>::~BucketKDTreeNode()
     {
+        destroy(m_leftChild);
+        destroy(m_rightChild);
+    }
 
+    template<int D, typename ELEM_TYPE>
+    BucketKDTreeNode<D, ELEM_TYPE>* BucketKDTreeNode<D, ELEM_TYPE>::createRoot(
+        const NodeAllocator& nodeAllocator,
+        const PointAllocator& pointAllocator)
+    {
+        NodeAllocator allocator(nodeAllocator);
+        BucketKDTreeNode<D, ELEM_TYPE>* node = allocator.allocate(1);
+        return new (node) BucketKDTreeNode<D, ELEM_TYPE>(
+            nodeAllocator, pointAllocator);
     }
 
     template<int D, typename ELEM_TYPE>
-    BucketKDTreeNode<D, ELEM_TYPE>::~BucketKDTreeNode()
+    BucketKDTreeNode<D, ELEM_TYPE>*
+    BucketKDTreeNode<D, ELEM_TYPE>::createChild(const PointList& points)
     {
-        delete m_leftChild;
-        delete m_rightChild;
+        BucketKDTreeNode<D, ELEM_TYPE>* node = m_nodeAllocator.allocate(1);
+        return new (node) BucketKDTreeNode<D, ELEM_TYPE>(this, points);
+    }
+
+    template<int D, typename ELEM_TYPE>
+    void BucketKDTreeNode<D, ELEM_TYPE>::destroy(
+        BucketKDTreeNode<D, ELEM_TYPE>* node)
+    {
+        if (node == NULL)
+            return;
+        NodeAllocator allocator(node->m_nodeAllocator);
+        node->~BucketKDTreeNode();
+        allocator.deallocate(node, 1);
     }
 
     template<int D, typename ELEM_TYPE>
@@ -329,16 +367,16 @@ namespace mdsearch
             m_points.begin(), m_points.end(), predicate);
 
         // Construct children to hold both partitions
-        m_leftChild = new BucketKDTreeNode<D, ELEM_TYPE>(
-            this, PointList(m_points.begin(), endOfLeft)
+        m_leftChild = createChild(
+            PointList(m_points.begin(), endOfLeft, m_points.get_allocator())
         );
-        m_rightChild = new BucketKDTreeNode<D, ELEM_TYPE>(
-            this, PointList(endOfLeft, m_points.end())
+        m_rightChild = createChild(
+            PointList(endOfLeft, m_points.end(), m_points.get_allocator())
         );
 
-        // Turn node into a non-leaf
+        // Turn node into a non-leaf, releasing the storage of its points
         m_isLeaf = false;
-        m_points.clear();
+        PointList(m_points.get_allocator()).swap(m_points);
 
         // Insert given point into one of the new children
         if (p[m_cuttingDimension] < m_cuttingValue)
@@ -368,8 +406,8 @@ namespace mdsearch
 
 
             m_isLeaf = true;
-            delete m_leftChild;
-            delete m_rightChild;
+            destroy(m_leftChild);
+            destroy(m_rightChild);
             m_leftChild = NULL;
             m_rightChild = NULL;
 
@@ -426,13 +464,28 @@ namespace mdsearch
         /** Return total number of points stored in structure. */
         int totalPoints() const;
 
+        /** Return memory used by the tree's nodes and the points in its
+         * leaves. */
+        MemoryUsage memoryUsage() const;
+
     private:
         typedef BucketKDTreeNode<D, ELEM_TYPE> NodeType;
 
+        // Disable copying, since the allocators count into this tree
+        BucketKDTree(const BucketKDTree& other);
+        BucketKDTree& operator=(const BucketKDTree& other);
+
         /** Find lead node that corresponds to spatial region that contains
          * given point. */
         NodeType* findLeafFor(const Point<D, ELEM_TYPE>& p);
 
+        /** Allocate empty root node. */
+        NodeType* createRoot();
+
+        /** Memory allocated for nodes. */
+        MemoryCounter m_nodeMemory;
+        /** Memory allocated for the points in leaves. */
+        MemoryCounter m_pointMemory;
         /** Root node of tree. */
         NodeType* m_root;
 
@@ -440,21 +493,21 @@ namespace mdsearch
 
     template<int D, typename ELEM_TYPE>
     BucketKDTree<D, ELEM_TYPE>::BucketKDTree()
-    : m_root(new NodeType(NULL))
+    : m_root(createRoot())
     {
     }
 
     template<int D, typename ELEM_TYPE>
     BucketKDTree<D, ELEM_TYPE>::~BucketKDTree()
     {
-        delete m_root;
+        NodeType::destroy(m_root);
     }
 
     template<int D, typename ELEM_TYPE>
     void BucketKDTree<D, ELEM_TYPE>::clear()
     {
-        delete m_root;
-        m_root = new NodeType(NULL);
+        NodeType::destroy(m_root);
+        m_root = createRoot();
     }
 
     template<int D, typename ELEM_TYPE>
@@ -485,6 +538,25 @@ namespace mdsearch
         return m_root->totalPoints();
     }
 
+    template<int D, typename ELEM_TYPE>
+    MemoryUsage BucketKDTree<D, ELEM_TYPE>::memoryUsage() const
+    {
+        MemoryUsage usage;
+        usage.nodes = m_nodeMemory.bytes;
+        usage.payload = totalPoints() * sizeof(Point<D, ELEM_TYPE>);
+        usage.slack = m_pointMemory.bytes - usage.payload;
+        return usage;
+    }
+
+    template<int D, typename ELEM_TYPE>
+    typename BucketKDTree<D, ELEM_TYPE>::NodeType*
+    BucketKDTree<D, ELEM_TYPE>::createRoot()
+    {
+        return NodeType::createRoot(
+            typename NodeType::NodeAllocator(&m_nodeMemory),
+            typename NodeType::PointAllocator(&m_pointMemory));
+    }
+
     template<int D, typename ELEM_TYPE>
     typename BucketKDTree<D, ELEM_TYPE>::NodeType*
     BucketKDTree<D, ELEM_TYPE>::findLeafFor(const Point<D, ELEM_TYPE>& p)
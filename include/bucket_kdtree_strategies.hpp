@@ -40,6 +40,8 @@ THE SOFTWARE.
 
 #include "point.hpp"
 #include <vector>
+#include <limits>
+#include <cmath>
 
 namespace mdsearch
 {
@@ -52,13 +54,16 @@ namespace mdsearch
 
 	public:
 		/** Return dimension with largest range of values. */
+		template<typename ALLOCATOR>
 		static int dimensionWithHighestRange(
-			const std::vector< Point<D, ELEM_TYPE> >& points);
+			const std::vector<Point<D, ELEM_TYPE>, ALLOCATOR>& points);
 
 	private:
-		/** Compute (max - min) range of values for dimension d. */
-		static ELEM_TYPE rangeOfDimension(int d,
-			const std::vector< Point<D, ELEM_TYPE> >& points);
+		/** Compute (max - min) range of values for dimension d. This is
+		 * a Real, so ranges of small integer types don't overflow. */
+		template<typename ALLOCATOR>
+		static Real rangeOfDimension(int d,
+			const std::vector<Point<D, ELEM_TYPE>, ALLOCATOR>& points);
 
 	};
 
@@ -70,15 +75,17 @@ namespace mdsearch
 
 	public:
 		/** Return average value of dth coordinate of given points */
+		template<typename ALLOCATOR>
 		static ELEM_TYPE averageOfDimension(int d,
-			const std::vector< Point<D, ELEM_TYPE> >& points);
+			const std::vector<Point<D, ELEM_TYPE>, ALLOCATOR>& points);
 
 	};
 
     template<int D, typename ELEM_TYPE>
+    template<typename ALLOCATOR>
     inline
-    ELEM_TYPE CuttingDimensionStrategies<D, ELEM_TYPE>::rangeOfDimension(
-    	int d, const std::vector< Point<D, ELEM_TYPE> >& points)
+    Real CuttingDimensionStrategies<D, ELEM_TYPE>::rangeOfDimension(
+    	int d, const std::vector<Point<D, ELEM_TYPE>, ALLOCATOR>& points)
     {
         if (points.empty())
         {
@@ -88,8 +95,9 @@ namespace mdsearch
         {
             ELEM_TYPE min = points[0][d];
             ELEM_TYPE max = min;
-            for (typename std::vector< Point<D, ELEM_TYPE> >::const_iterator
-                iter = points.begin(); iter != points.end(); ++iter)
+            for (typename std::vector<Point<D, ELEM_TYPE>, ALLOCATOR>::
+                const_iterator iter = points.begin(); iter != points.end();
+                ++iter)
             {
                 ELEM_TYPE val = (*iter)[d];
                 if (val < min)
@@ -102,21 +110,22 @@ namespace mdsearch
                 }
             }
 
-            return (max - min);
+            return static_cast<Real>(max) - min;
         }
     }
 
     template<int D, typename ELEM_TYPE>
+    template<typename ALLOCATOR>
     inline
     int CuttingDimensionStrategies<D, ELEM_TYPE>::dimensionWithHighestRange(
-        const std::vector< Point<D, ELEM_TYPE> >& points)
+        const std::vector<Point<D, ELEM_TYPE>, ALLOCATOR>& points)
     {
         int chosenDim = 0;
-        ELEM_TYPE maxRange = rangeOfDimension(0, points);
+        Real maxRange = rangeOfDimension(0, points);
 
         for (int d = 1; d < D; ++d)
         {
-            ELEM_TYPE range = rangeOfDimension(d, points);
+            Real range = rangeOfDimension(d, points);
             if (range > maxRange)
             {
                 chosenDim = d;
@@ -128,17 +137,24 @@ namespace mdsearch
     }
 
     template<int D, typename ELEM_TYPE>
+    template<typename ALLOCATOR>
     inline
     ELEM_TYPE CuttingValueStrategies<D, ELEM_TYPE>::averageOfDimension(int d,
-        const std::vector< Point<D, ELEM_TYPE> >& points)
+        const std::vector<Point<D, ELEM_TYPE>, ALLOCATOR>& points)
     {
-        ELEM_TYPE sum = 0;
-        for (typename std::vector< Point<D, ELEM_TYPE> >::const_iterator iter
-            = points.begin(); iter != points.end(); ++iter)
+        Real sum = 0;
+        for (typename std::vector<Point<D, ELEM_TYPE>, ALLOCATOR>::
+            const_iterator iter = points.begin(); iter != points.end(); ++iter)
         {
             sum += (*iter)[d];
         }
-        return sum / points.size();
+        Real average = sum / points.size();
+        // Round integer averages up, so points with the smallest value are
+        // always below the cutting value and neither side of a split is
+        // left empty
+        if (std::numeric_limits<ELEM_TYPE>::is_integer)
+            average = std::ceil(average);
+        return static_cast<ELEM_TYPE>(average);
     }
 
 }
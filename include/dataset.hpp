@@ -5,7 +5,7 @@ mdsearch - Lightweight C++ library implementing a collection of
 
 File:        dataset.hpp
 Description: Defines functionality for bulk-loading collections of points
-             from arrays or text files.
+             from arrays, text files or binary files.
 
 *******************************************************************************
 
@@ -39,15 +39,21 @@ THE SOFTWARE.
 #include "types.hpp"
 #include "point.hpp"
 #include "boundary.hpp"
-#include <boost/lexical_cast.hpp>
-#include <fstream>
+#include "text_parser.hpp"
+#include "binary_dataset.hpp"
+#include <boost/shared_ptr.hpp>
+#include <algorithm>
 
 namespace mdsearch
 {
 
     /** Sstores a collection of points with the same dimensionaliy.
-     * Provides functionality to load points from std::vector objects or
-     * text files. */
+     * Provides functionality to load points from std::vector objects,
+     * text files or binary files.
+     *
+     * Points loaded from a binary file into an empty dataset are used in
+     * place from the memory-mapped file, without copying them. The
+     * dataset is then "mapped" until more points are loaded into it. */
     template<int D, typename ELEM_TYPE>
     class Dataset
     {
@@ -58,7 +64,7 @@ namespace mdsearch
         /** Add all given points to dataset. */
         void load(const PointList& newPoints);
 
-        /*& Add all points in text file with given name to dataset.
+        /** Add all points in text file with given name to dataset.
          * Format of text file:
          * d n
          * p1_1 p1_2 ... p1_d
@@ -67,25 +73,68 @@ namespace mdsearch
          * pn_1 pn_2 ... pn_d
          *
          * where 'd' is the dimensionality of the points and 'n'
-         * is the number of points in the dataset. */
+         * is the number of points in the dataset. Each point must be on
+         * its own line, and blank lines are ignored. The first D values
+         * of each point are used, and missing values are set to zero.
+         *
+         * The file is memory-mapped and parsed by several threads at
+         * once if OpenMP is enabled (see parsePoints()).
+         *
+         * The file can also be a binary dataset (see binary_dataset.hpp)
+         * containing points with D coordinates of type ELEM_TYPE. If the
+         * dataset is empty and the file's points are stored like Point
+         * objects in AOS_LAYOUT, the file is mapped instead of copied. */
         void load(const std::string& filename);
 
+        /** Write all points in the dataset, and their boundary, to a
+         * binary dataset file with given name. Returns true if the file
+         * was written successfully. */
+        bool save(const std::string& filename,
+                  BinaryLayout layout = AOS_LAYOUT) const;
+
         /** Compute minimum bounding hyper-rectangle that contains all
-         * the points in the dataset. */
+         * the points in the dataset, in parallel if OpenMP is enabled (see
+         * BoundaryAccumulator). If the dataset is empty, every interval is
+         * [0:0]. */
         Boundary<D, ELEM_TYPE> computeBoundary() const;
 
-        /** Retrieve all points stored in dataset. */
+        /** Compute the median of each dimension of the points in the
+         * dataset. If 'sampleSize' is non-zero and smaller than the number
+         * of points, the medians are estimated from an evenly spaced sample
+         * of roughly that many points. If the dataset is empty, a point
+         * with all coordinates set to zero is returned. */
+        Point<D, ELEM_TYPE> computeMedian(unsigned int sampleSize = 0) const;
+
+        /** Retrieve all points stored in dataset. If the dataset is
+         * mapped, the points are copied into a list the first time this
+         * is called. Use data() and size() to access them in place. */
         const PointList& getPoints() const;
 
+        /** Return pointer to the first point in the dataset. */
+        const Point<D, ELEM_TYPE>* data() const;
+        /** Return number of points in the dataset. */
+        std::size_t size() const;
+        /** Return true if the points are used in place from a binary
+         * file. */
+        bool isMapped() const;
+
     private:
-        /** Contains all points in the dataset. */
-        PointList m_points;
+        /** Copy points from the binary file the dataset is mapped to, if
+         * any, into m_points and release the file. */
+        void unmap();
+
+        /** Contains all points in the dataset, unless the dataset is
+         * mapped. Mutable so getPoints() can copy mapped points. */
+        mutable PointList m_points;
+        /** Binary file whose points are used in place, or NULL. */
+        boost::shared_ptr<BinaryDatasetFile> m_file;
 
     };
 
     template<int D, typename ELEM_TYPE>
     void Dataset<D, ELEM_TYPE>::load(const PointList& newPoints)
     {
+        unmap();
         // Pre-allocate memory in one sys call
         m_points.reserve(m_points.size() + newPoints.size());
         // Append given points to end of current point list
@@ -95,91 +144,97 @@ namespace mdsearch
     template<int D, typename ELEM_TYPE>
     void Dataset<D, ELEM_TYPE>::load(const std::string& filename)
     {
+        boost::shared_ptr<BinaryDatasetFile> binaryFile(
+            new BinaryDatasetFile(filename));
+        if (binaryFile->isValid())
+        {
+            if (!binaryFile->matches<D, ELEM_TYPE>())
+                return;
+            if (size() == 0 && binaryFile->points<D, ELEM_TYPE>() != NULL)
+            {
+                m_points.clear();
+                m_file = binaryFile;
+                return;
+            }
+            unmap();
+            const std::size_t numPoints = binaryFile->header().numPoints;
+            const std::size_t firstIndex = m_points.size();
+            m_points.resize(firstIndex + numPoints);
+            const long numPointsLong = static_cast<long>(numPoints);
+            #pragma omp parallel for
+            for (long i = 0; i < numPointsLong; i++)
+            {
+                m_points[firstIndex + i] =
+                    binaryFile->getPoint<D, ELEM_TYPE>(i);
+            }
+            return;
+        }
+        binaryFile.reset();
+
         // Open specified file and just do nothing if
         // the file does not exist
-        std::ifstream file(filename.c_str());
-        if (!file.is_open())
+        MappedFile file(filename);
+        if (!file.isOpen() || file.size() == 0)
             return;
+        const char* end = file.data() + file.size();
 
         // Read header information
-        std::string numDimensionsStr;
-        file >> numDimensionsStr;
-        std::string numPointsStr;
-        file >> numPointsStr;
-        // Convert strings to integers
         int numDimensions = 0;
         int numPoints = 0;
-        try
-        {
-            numDimensions = boost::lexical_cast<int>(numDimensionsStr);
-            numPoints = boost::lexical_cast<int>(numPointsStr);
-        }
-        catch (boost::bad_lexical_cast& ex) // not integers -- invalid file!!
-        {
-            return;
-        }
+        const char* next = parseTextHeader(file.data(), end,
+                                           numDimensions, numPoints);
         // Only continue reading points if the points have at least
         // one dimension and there is at least one point in the dataset
-        if (numDimensions < 1 || numPoints < 1)
+        if (next == NULL || numDimensions < 1 || numPoints < 1)
             return;
 
-        // Pre-allocate memory to store all the specified points
-        m_points.reserve(m_points.size() + numPoints);
-        // Treat the rest of lines as points
-        ELEM_TYPE temp[D]; // temporary stores point's values
-        for (unsigned int i = 0; (i < numPoints); i++)
-        {
-            for (unsigned int j = 0; (j < numDimensions); j++)
-            {
-                file >> temp[j];
-            }
-            m_points.push_back(Point<D, ELEM_TYPE>(temp));
-
-            // If we have reached the end of the file, STOP and don't try
-            // reading any more points
-            if (file.eof())
-            {
-                break;
-            }
-        }
+        // Treat the rest of lines as points, parsing them straight into
+        // the end of the point list
+        unmap();
+        parsePoints(next, end, m_points, static_cast<std::size_t>(numPoints));
     }
 
     template<int D, typename ELEM_TYPE>
     Boundary<D, ELEM_TYPE> Dataset<D, ELEM_TYPE>::computeBoundary() const
     {
-        Boundary<D, ELEM_TYPE> boundary(
-            Interval<ELEM_TYPE>(0, 0)
-        );
+        // Binary files store the boundary of their points
+        if (m_file && m_file->hasBoundary())
+            return m_file->boundary<D, ELEM_TYPE>();
+
+        BoundaryAccumulator<D, ELEM_TYPE> accumulator;
+        accumulator.add(data(), size());
+        return accumulator.boundary();
+    }
+
+    template<int D, typename ELEM_TYPE>
+    Point<D, ELEM_TYPE> Dataset<D, ELEM_TYPE>::computeMedian(
+        unsigned int sampleSize) const
+    {
+        Point<D, ELEM_TYPE> median(static_cast<ELEM_TYPE>(0));
+        const Point<D, ELEM_TYPE>* points = data();
+        const std::size_t numPoints = size();
+        if (numPoints == 0)
+            return median;
 
-        if (!m_points.empty())
+        std::size_t stride = 1;
+        if (sampleSize > 0 && sampleSize < numPoints)
+            stride = numPoints / sampleSize;
+
+        std::vector<ELEM_TYPE> values;
+        values.reserve(numPoints / stride + 1);
+        for (unsigned int d = 0; (d < D); d++)
         {
-            // Use first point for dimensionality and initial boundary
-            const Point<D, ELEM_TYPE>& firstPoint = m_points[0];
-            for (unsigned int d = 0; (d < D); d++)
-            {
-                boundary[d].min = firstPoint[d];
-                boundary[d].max = firstPoint[d];
-            }
-            // Now search through rest of points in dataset to find
-            // minimum and maximum values for each dimension
-            for (typename PointList::const_iterator p = m_points.begin() + 1;
-                (p != m_points.end()); p++)
+            values.clear();
+            for (std::size_t i = 0; (i < numPoints); i += stride)
             {
-                for (unsigned int d = 0; (d < D); d++)
-                {
-                    if ((*p)[d] < boundary[d].min)
-                    {
-                        boundary[d].min = (*p)[d];
-                    }
-                    else if ((*p)[d] > boundary[d].max)
-                    {
-                        boundary[d].max = (*p)[d];
-                    }
-                }
+                values.push_back(points[i][d]);
             }
+            typename std::vector<ELEM_TYPE>::iterator middle =
+                values.begin() + values.size() / 2;
+            std::nth_element(values.begin(), middle, values.end());
+            median[d] = *middle;
         }
-
-        return boundary;
+        return median;
     }
 
     template<int D, typename ELEM_TYPE>
@@ -187,9 +242,69 @@ namespace mdsearch
     const typename Dataset<D, ELEM_TYPE>::PointList&
         Dataset<D, ELEM_TYPE>::getPoints() const
     {
+        if (m_file && m_points.size() != size())
+            m_points.assign(data(), data() + size());
         return m_points;
     }
 
+    template<int D, typename ELEM_TYPE>
+    inline
+    const Point<D, ELEM_TYPE>* Dataset<D, ELEM_TYPE>::data() const
+    {
+        if (m_file)
+            return m_file->points<D, ELEM_TYPE>();
+        return m_points.data();
+    }
+
+    template<int D, typename ELEM_TYPE>
+    inline std::size_t Dataset<D, ELEM_TYPE>::size() const
+    {
+        if (m_file)
+            return m_file->header().numPoints;
+        return m_points.size();
+    }
+
+    template<int D, typename ELEM_TYPE>
+    inline bool Dataset<D, ELEM_TYPE>::isMapped() const
+    {
+        return static_cast<bool>(m_file);
+    }
+
+    template<int D, typename ELEM_TYPE>
+    void Dataset<D, ELEM_TYPE>::unmap()
+    {
+        if (m_file)
+        {
+            getPoints();
+            m_file.reset();
+        }
+    }
+
+    template<int D, typename ELEM_TYPE>
+    bool Dataset<D, ELEM_TYPE>::save(const std::string& filename,
+                                     BinaryLayout layout) const
+    {
+        Boundary<D, ELEM_TYPE> boundary = computeBoundary();
+        return writeBinaryDataset(filename, data(), size(), layout,
+                                  &boundary);
+    }
+
+    /** Convert text file with given name, in the format Dataset::load
+     * reads, to a binary dataset file with the given layout. Returns
+     * false if the text file contains no points or the binary file
+     * couldn't be written. */
+    template<int D, typename ELEM_TYPE>
+    bool convertTextToBinary(const std::string& textFilename,
+                             const std::string& binaryFilename,
+                             BinaryLayout layout = AOS_LAYOUT)
+    {
+        Dataset<D, ELEM_TYPE> dataset;
+        dataset.load(textFilename);
+        if (dataset.size() == 0)
+            return false;
+        return dataset.save(binaryFilename, layout);
+    }
+
 }
 
 #endif
\ No newline at end of file
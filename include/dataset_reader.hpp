@@ -0,0 +1,367 @@
+/******************************************************************************
+
+mdsearch - Lightweight C++ library implementing a collection of
+           multi-dimensional search structures
+
+File:        dataset_reader.hpp
+Description: Reads points from text or binary dataset files in fixed-size
+             chunks, parsing the next chunk in a background thread while
+             the current one is used, so datasets can be loaded into
+             structures without holding every point in memory.
+
+*******************************************************************************
+
+The MIT License (MIT)
+
+Copyright (c) 2014 Donald Whyte
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+******************************************************************************/
+
+#ifndef MDSEARCH_DATASET_READER_H
+#define MDSEARCH_DATASET_READER_H
+
+#include "point.hpp"
+#include "text_parser.hpp"
+#include "binary_dataset.hpp"
+#include <boost/shared_ptr.hpp>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace mdsearch
+{
+
+    /** Number of points in each chunk if no chunk size is given. */
+    static const std::size_t DEFAULT_READER_CHUNK_SIZE = 65536;
+
+    /** Reads the points of a text or binary dataset file (see
+     * Dataset::load) in chunks of at most chunkSize() points.
+     *
+     * Chunks are read ahead by a background thread, double-buffered: the
+     * next chunk is parsed while the caller uses the current one. Chunks
+     * are handed over by swapping vectors, so their memory is reused and
+     * at most three chunks of points are held in memory at once. The
+     * file itself is memory-mapped, so its pages can be evicted by the
+     * OS once they have been read. */
+    template<int D, typename ELEM_TYPE>
+    class DatasetReader
+    {
+
+    public:
+        typedef std::vector< Point<D, ELEM_TYPE> > PointList;
+
+        /** Open dataset file with given name and start reading its first
+         * chunk in the background. */
+        DatasetReader(const std::string& filename,
+                      std::size_t chunkSize = DEFAULT_READER_CHUNK_SIZE);
+        /** Stop the background thread, if it's still reading. */
+        ~DatasetReader();
+
+        /** Return true if the file is a valid dataset of points with D
+         * coordinates of type ELEM_TYPE. */
+        bool isOpen() const;
+        std::size_t chunkSize() const;
+
+        /** Replace the contents of 'chunk' with the next chunk of points.
+         * Returns false, leaving 'chunk' empty, once every point has been
+         * read. Pass the same vector to each call so its memory is reused
+         * for later chunks. */
+        bool next(PointList& chunk);
+
+    private:
+        // Readers own a thread, so they can't be copied
+        DatasetReader(const DatasetReader&);
+        DatasetReader& operator=(const DatasetReader&);
+
+        /** Read chunks in the background until the file is finished or
+         * the reader is destroyed. */
+        void readAhead();
+        /** Read next chunk from the file. Returns false if there are no
+         * more points. */
+        bool readChunk(PointList& chunk);
+
+        std::size_t m_chunkSize;
+        bool m_open;
+
+        /** Text file and position of the next point in it, or NULL if
+         * the file is binary. */
+        boost::shared_ptr<MappedFile> m_textFile;
+        const char* m_next;
+        const char* m_end;
+        /** Binary file, or NULL if the file is text. */
+        boost::shared_ptr<BinaryDatasetFile> m_binaryFile;
+        /** Index of the next point in the binary file. */
+        std::size_t m_nextIndex;
+        /** Number of points left to read, as given in the file's header. */
+        std::size_t m_numRemaining;
+
+        std::thread m_thread;
+        std::mutex m_mutex;
+        std::condition_variable m_condition;
+        /** Chunk read by the background thread which is waiting to be
+         * taken by next(). */
+        PointList m_ready;
+        bool m_readyFull;
+        /** True once the background thread has read every point. */
+        bool m_finished;
+        /** True when the background thread should stop. */
+        bool m_stop;
+
+    };
+
+    /** Insert every point read by 'reader' into any structure, one chunk
+     * at a time. Structures with insertBatch() or bulkLoad() get each
+     * chunk at once; other structures have points inserted one at a time.
+     * Returns number of points inserted. */
+    template<typename STRUCT_TYPE, int D, typename ELEM_TYPE>
+    std::size_t insertStream(STRUCT_TYPE* structure,
+                             DatasetReader<D, ELEM_TYPE>& reader);
+
+    template<int D, typename ELEM_TYPE>
+    DatasetReader<D, ELEM_TYPE>::DatasetReader(const std::string& filename,
+                                               std::size_t chunkSize)
+    : m_chunkSize(std::max<std::size_t>(chunkSize, 1)), m_open(false),
+      m_next(NULL), m_end(NULL), m_nextIndex(0), m_numRemaining(0),
+      m_readyFull(false), m_finished(false), m_stop(false)
+    {
+        m_binaryFile.reset(new BinaryDatasetFile(filename));
+        if (m_binaryFile->isValid())
+        {
+            m_open = m_binaryFile->matches<D, ELEM_TYPE>();
+            m_numRemaining = m_binaryFile->header().numPoints;
+        }
+        else
+        {
+            m_binaryFile.reset();
+            m_textFile.reset(new MappedFile(filename));
+            if (m_textFile->isOpen() && m_textFile->size() > 0)
+            {
+                int numDimensions = 0;
+                int numPoints = 0;
+                m_end = m_textFile->data() + m_textFile->size();
+                m_next = parseTextHeader(m_textFile->data(), m_end,
+                                         numDimensions, numPoints);
+                m_open = (m_next != NULL && numDimensions >= 1
+                    && numPoints >= 1);
+                m_numRemaining = m_open ? numPoints : 0;
+            }
+        }
+
+        if (m_open)
+            m_thread = std::thread(&DatasetReader::readAhead, this);
+        else
+            m_finished = true;
+    }
+
+    template<int D, typename ELEM_TYPE>
+    DatasetReader<D, ELEM_TYPE>::~DatasetReader()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_condition.notify_all();
+        if (m_thread.joinable())
+            m_thread.join();
+    }
+
+    template<int D, typename ELEM_TYPE>
+    inline bool DatasetReader<D, ELEM_TYPE>::isOpen() const
+    {
+        return m_open;
+    }
+
+    template<int D, typename ELEM_TYPE>
+    inline std::size_t DatasetReader<D, ELEM_TYPE>::chunkSize() const
+    {
+        return m_chunkSize;
+    }
+
+    template<int D, typename ELEM_TYPE>
+    bool DatasetReader<D, ELEM_TYPE>::next(PointList& chunk)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (!m_readyFull && !m_finished)
+            m_condition.wait(lock);
+        if (!m_readyFull)
+        {
+            chunk.clear();
+            return false;
+        }
+        // The caller's previous chunk becomes the background thread's
+        // next buffer
+        chunk.swap(m_ready);
+        m_readyFull = false;
+        lock.unlock();
+        m_condition.notify_all();
+        return true;
+    }
+
+    template<int D, typename ELEM_TYPE>
+    void DatasetReader<D, ELEM_TYPE>::readAhead()
+    {
+        PointList working;
+        while (true)
+        {
+            // Parse the next chunk while the caller uses the ready one
+            const bool more = readChunk(working);
+
+            std::unique_lock<std::mutex> lock(m_mutex);
+            while (m_readyFull && !m_stop)
+                m_condition.wait(lock);
+            if (m_stop)
+                return;
+            if (more)
+            {
+                m_ready.swap(working);
+                m_readyFull = true;
+            }
+            else
+            {
+                m_finished = true;
+            }
+            lock.unlock();
+            m_condition.notify_all();
+            if (!more)
+                return;
+        }
+    }
+
+    template<int D, typename ELEM_TYPE>
+    bool DatasetReader<D, ELEM_TYPE>::readChunk(PointList& chunk)
+    {
+        chunk.clear();
+        if (m_numRemaining == 0)
+            return false;
+
+        std::size_t count = 0;
+        if (m_binaryFile)
+        {
+            count = std::min(m_chunkSize, m_numRemaining);
+            chunk.resize(count);
+            for (std::size_t i = 0; (i < count); i++)
+            {
+                chunk[i] = m_binaryFile->getPoint<D, ELEM_TYPE>(
+                    m_nextIndex + i);
+            }
+            m_nextIndex += count;
+        }
+        else
+        {
+            // Find the lines of the chunk's points before parsing them
+            // straight into the chunk
+            const std::size_t maxCount = std::min(m_chunkSize,
+                                                  m_numRemaining);
+            const char* chunkEnd = m_next;
+            while (chunkEnd != m_end && count < maxCount)
+            {
+                const char* lineEnd = findLineEnd(chunkEnd, m_end);
+                if (!isBlankLine(chunkEnd, lineEnd))
+                    count++;
+                chunkEnd = (lineEnd == m_end) ? m_end : lineEnd + 1;
+            }
+            if (count == 0)
+            {
+                m_numRemaining = 0;
+                return false;
+            }
+            chunk.resize(count);
+            parsePointLines(m_next, chunkEnd, &chunk[0], count);
+            m_next = chunkEnd;
+        }
+        m_numRemaining -= count;
+        return true;
+    }
+
+    /** Defines 'value' as true if STRUCT_TYPE has an insertBatch() method
+     * taking a list of points. */
+    template<typename STRUCT_TYPE, typename POINT_LIST, typename = void>
+    struct HasInsertBatch : std::false_type {};
+    template<typename STRUCT_TYPE, typename POINT_LIST>
+    struct HasInsertBatch<STRUCT_TYPE, POINT_LIST,
+        std::void_t<decltype(std::declval<STRUCT_TYPE&>().insertBatch(
+            std::declval<const POINT_LIST&>()))> > : std::true_type {};
+
+    /** Defines 'value' as true if STRUCT_TYPE has a bulkLoad() method
+     * taking a list of points. */
+    template<typename STRUCT_TYPE, typename POINT_LIST, typename = void>
+    struct HasBulkLoad : std::false_type {};
+    template<typename STRUCT_TYPE, typename POINT_LIST>
+    struct HasBulkLoad<STRUCT_TYPE, POINT_LIST,
+        std::void_t<decltype(std::declval<STRUCT_TYPE&>().bulkLoad(
+            std::declval<const POINT_LIST&>()))> > : std::true_type {};
+
+    /** Tags selecting how insertChunk() inserts points. */
+    struct InsertEachPoint {};
+    struct UseBulkLoad {};
+    struct UseInsertBatch {};
+
+    template<typename STRUCT_TYPE, typename POINT_LIST>
+    std::size_t insertChunk(STRUCT_TYPE* structure, const POINT_LIST& chunk,
+                            UseInsertBatch)
+    {
+        return structure->insertBatch(chunk);
+    }
+
+    template<typename STRUCT_TYPE, typename POINT_LIST>
+    std::size_t insertChunk(STRUCT_TYPE* structure, const POINT_LIST& chunk,
+                            UseBulkLoad)
+    {
+        return structure->bulkLoad(chunk);
+    }
+
+    template<typename STRUCT_TYPE, typename POINT_LIST>
+    std::size_t insertChunk(STRUCT_TYPE* structure, const POINT_LIST& chunk,
+                            InsertEachPoint)
+    {
+        std::size_t numInserted = 0;
+        for (std::size_t i = 0; (i < chunk.size()); i++)
+        {
+            if (structure->insert(chunk[i]))
+                numInserted++;
+        }
+        return numInserted;
+    }
+
+    template<typename STRUCT_TYPE, int D, typename ELEM_TYPE>
+    std::size_t insertStream(STRUCT_TYPE* structure,
+                             DatasetReader<D, ELEM_TYPE>& reader)
+    {
+        typedef typename DatasetReader<D, ELEM_TYPE>::PointList PointList;
+        typedef typename std::conditional<
+            HasInsertBatch<STRUCT_TYPE, PointList>::value, UseInsertBatch,
+            typename std::conditional<
+                HasBulkLoad<STRUCT_TYPE, PointList>::value, UseBulkLoad,
+                InsertEachPoint>::type>::type Method;
+
+        std::size_t numInserted = 0;
+        PointList chunk;
+        while (reader.next(chunk))
+            numInserted += insertChunk(structure, chunk, Method());
+        return numInserted;
+    }
+
+}
+
+#endif
@@ -0,0 +1,683 @@
+/******************************************************************************
+
+mdsearch - Lightweight C++ library implementing a collection of
+           multi-dimensional search structures
+
+File:        dispatch.hpp
+Description: Selects the instantiation of templated code for a number of
+             dimensions only known at runtime (e.g. read from a dataset
+             file's header), from a set of dimensionalities compiled in
+             advance. Also defines an index interface independent of the
+             number of dimensions, with a dynamic-dimension fallback for
+             dimensionalities that weren't compiled.
+
+*******************************************************************************
+
+The MIT License (MIT)
+
+Copyright (c) 2014 Donald Whyte
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+******************************************************************************/
+
+#ifndef MDSEARCH_DISPATCH_H
+#define MDSEARCH_DISPATCH_H
+
+#include "types.hpp"
+#include "point.hpp"
+#include "boundary.hpp"
+#include "text_parser.hpp"
+#include "binary_dataset.hpp"
+#include "dataset_reader.hpp"
+#include "kdtree.hpp"
+#include "bucket_kdtree.hpp"
+#include "multigrid.hpp"
+#include "bithash.hpp"
+#include "pyramidtree.hpp"
+#include <boost/functional/hash.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/unordered_map.hpp>
+#include <algorithm>
+#include <queue>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Dimensionalities the dispatcher instantiates templated code for. Define
+// as a comma-separated list (e.g. with cmake -DMDSEARCH_DIMENSIONS=2,3,10)
+// to change them.
+#ifndef MDSEARCH_DIMENSIONS
+    #define MDSEARCH_DIMENSIONS 2, 3, 4, 8, 10, 16, 32, 64
+#endif
+
+namespace mdsearch
+{
+
+    /** List of dimensionalities known at compile time. */
+    template<int... DIMS>
+    struct DimensionList {};
+
+    /** Dimensionalities that dispatchDimensions() instantiates code for. */
+    typedef DimensionList<MDSEARCH_DIMENSIONS> CompiledDimensions;
+
+    template<typename VISITOR>
+    typename VISITOR::ResultType dispatchDimensions(int d, VISITOR& visitor,
+                                                    DimensionList<>)
+    {
+        return visitor.runDynamic(d);
+    }
+
+    template<typename VISITOR, int FIRST, int... REST>
+    typename VISITOR::ResultType dispatchDimensions(int d, VISITOR& visitor,
+        DimensionList<FIRST, REST...>)
+    {
+        if (d == FIRST)
+            return visitor.template run<FIRST>();
+        return dispatchDimensions(d, visitor, DimensionList<REST...>());
+    }
+
+    /** Call visitor.run<D>() if D = 'd' is one of CompiledDimensions, so
+     * the code the visitor runs is instantiated for exactly that many
+     * dimensions. Otherwise, call visitor.runDynamic(d). VISITOR must
+     * define ResultType as the type both methods return. */
+    template<typename VISITOR>
+    typename VISITOR::ResultType dispatchDimensions(int d, VISITOR& visitor)
+    {
+        return dispatchDimensions(d, visitor, CompiledDimensions());
+    }
+
+    /** Return true if 'd' is one of CompiledDimensions. */
+    inline bool isDimensionCompiled(int d)
+    {
+        static const int DIMS[] = { MDSEARCH_DIMENSIONS };
+        const int* end = DIMS + sizeof(DIMS) / sizeof(DIMS[0]);
+        return (std::find(DIMS, end, d) != end);
+    }
+
+    /** Return every dimensionality in CompiledDimensions. */
+    inline std::vector<int> listCompiledDimensions()
+    {
+        static const int DIMS[] = { MDSEARCH_DIMENSIONS };
+        return std::vector<int>(DIMS, DIMS + sizeof(DIMS) / sizeof(DIMS[0]));
+    }
+
+    /** Return the dimensionality given in the header of a text or binary
+     * dataset file, or 0 if the file isn't a valid dataset. */
+    inline int readDatasetDimensions(const std::string& filename)
+    {
+        BinaryDatasetFile binaryFile(filename);
+        if (binaryFile.isValid())
+            return binaryFile.header().numDimensions;
+
+        MappedFile textFile(filename);
+        if (!textFile.isOpen() || textFile.size() == 0)
+            return 0;
+        int numDimensions = 0;
+        int numPoints = 0;
+        if (parseTextHeader(textFile.data(), textFile.data() + textFile.size(),
+                            numDimensions, numPoints) == NULL)
+        {
+            return 0;
+        }
+        return std::max(numDimensions, 0);
+    }
+
+    /** Index of points whose dimensionality is only known at runtime.
+     * Points are passed as arrays of numDimensions() coordinates, and
+     * lists of points are returned as consecutive coordinates. */
+    class DynamicIndex
+    {
+
+    public:
+        virtual ~DynamicIndex() {}
+
+        virtual unsigned int numDimensions() const = 0;
+        /** Return true if the index uses a structure instantiated for its
+         * number of dimensions, instead of the dynamic fallback. */
+        virtual bool isCompiled() const = 0;
+
+        virtual bool insert(const Real* point) = 0;
+        virtual bool remove(const Real* point) = 0;
+        virtual bool query(const Real* point) = 0;
+
+        /** Append the coordinates of all stored points inside the region
+         * [mins, maxs] (inclusive) to 'results'. Returns false if the
+         * structure doesn't support range queries. */
+        virtual bool rangeQuery(const Real* mins, const Real* maxs,
+                                std::vector<Real>& results) = 0;
+        /** Append the coordinates of the k stored points closest to the
+         * given point, sorted by increasing distance, to 'results'.
+         * Returns false if the structure doesn't support kNN queries. */
+        virtual bool knn(const Real* point, unsigned int k,
+                         std::vector<Real>& results) = 0;
+
+        /** Insert every point in the text or binary dataset file with
+         * given name. Returns number of points inserted. */
+        virtual std::size_t insertDataset(const std::string& filename) = 0;
+
+    };
+
+    /** Defines 'value' as true if STRUCT_TYPE has a rangeQuery() method. */
+    template<typename STRUCT_TYPE, typename BOUNDARY_TYPE, typename = void>
+    struct HasRangeQuery : std::false_type {};
+    template<typename STRUCT_TYPE, typename BOUNDARY_TYPE>
+    struct HasRangeQuery<STRUCT_TYPE, BOUNDARY_TYPE,
+        std::void_t<decltype(std::declval<STRUCT_TYPE&>().rangeQuery(
+            std::declval<const BOUNDARY_TYPE&>()))> > : std::true_type {};
+
+    /** Defines 'value' as true if STRUCT_TYPE has a knn() method. */
+    template<typename STRUCT_TYPE, typename POINT_TYPE, typename = void>
+    struct HasKnn : std::false_type {};
+    template<typename STRUCT_TYPE, typename POINT_TYPE>
+    struct HasKnn<STRUCT_TYPE, POINT_TYPE,
+        std::void_t<decltype(std::declval<STRUCT_TYPE&>().knn(
+            std::declval<const POINT_TYPE&>(), 1u))> > : std::true_type {};
+
+    /** Adapts a structure instantiated for D dimensions to the
+     * DynamicIndex interface. */
+    template<int D, typename STRUCT_TYPE>
+    class StaticIndex : public DynamicIndex
+    {
+
+    public:
+        typedef std::vector< Point<D, Real> > PointList;
+
+        /** Wrap given structure, which the index takes ownership of. */
+        StaticIndex(STRUCT_TYPE* structure);
+        virtual ~StaticIndex();
+
+        /** Return the wrapped structure. */
+        STRUCT_TYPE* structure();
+
+        virtual unsigned int numDimensions() const;
+        virtual bool isCompiled() const;
+        virtual bool insert(const Real* point);
+        virtual bool remove(const Real* point);
+        virtual bool query(const Real* point);
+        virtual bool rangeQuery(const Real* mins, const Real* maxs,
+                                std::vector<Real>& results);
+        virtual bool knn(const Real* point, unsigned int k,
+                         std::vector<Real>& results);
+        virtual std::size_t insertDataset(const std::string& filename);
+
+    private:
+        // The index owns its structure, so it can't be copied
+        StaticIndex(const StaticIndex&);
+        StaticIndex& operator=(const StaticIndex&);
+
+        static void appendPoints(const PointList& points,
+                                 std::vector<Real>& results);
+
+        bool rangeQuery(const Real* mins, const Real* maxs,
+                        std::vector<Real>& results, std::true_type);
+        bool rangeQuery(const Real* mins, const Real* maxs,
+                        std::vector<Real>& results, std::false_type);
+        bool knn(const Real* point, unsigned int k,
+                 std::vector<Real>& results, std::true_type);
+        bool knn(const Real* point, unsigned int k,
+                 std::vector<Real>& results, std::false_type);
+
+        STRUCT_TYPE* m_structure;
+
+    };
+
+    /** Stores points with any number of dimensions, for dimensionalities
+     * that weren't compiled. Points are found with a hash table keyed on
+     * their exact coordinates, and range and kNN queries scan every
+     * point, so this is much slower than the compiled structures for
+     * spatial queries. */
+    class DynamicPointSet : public DynamicIndex
+    {
+
+    public:
+        DynamicPointSet(unsigned int numDimensions);
+
+        virtual unsigned int numDimensions() const;
+        virtual bool isCompiled() const;
+        virtual bool insert(const Real* point);
+        virtual bool remove(const Real* point);
+        virtual bool query(const Real* point);
+        virtual bool rangeQuery(const Real* mins, const Real* maxs,
+                                std::vector<Real>& results);
+        virtual bool knn(const Real* point, unsigned int k,
+                         std::vector<Real>& results);
+        virtual std::size_t insertDataset(const std::string& filename);
+
+    private:
+        typedef boost::unordered_multimap<std::size_t, std::size_t> PointIndex;
+
+        std::size_t hashPoint(const Real* point) const;
+        /** Return the entry of the stored point equal to the given one, or
+         * m_index.end() if the point isn't stored. */
+        PointIndex::iterator find(const Real* point, std::size_t hash);
+        const Real* storedPoint(std::size_t i) const;
+
+        unsigned int m_numDimensions;
+        /** Coordinates of every stored point, one point after another. */
+        std::vector<Real> m_coords;
+        /** Maps hashes of points to their index in m_coords. */
+        PointIndex m_index;
+
+    };
+
+    /** Create a DynamicIndex using the structure with the given name
+     * ("kd-tree", "bucket_kd-tree", "multigrid", "bithash" or
+     * "pyramid_tree") and insert every point in the dataset file with the
+     * given name.
+     *
+     * The file's header gives the dimensionality. If it's one of
+     * CompiledDimensions, the structure instantiated for it is used, with
+     * a boundary (if it needs one) stored in the file or computed from a
+     * first pass over it. Otherwise, a DynamicPointSet is used. Returns
+     * NULL if the file or structure name isn't valid. */
+    boost::shared_ptr<DynamicIndex> createIndexForDataset(
+        const std::string& structureName, const std::string& filename);
+
+    template<int D, typename STRUCT_TYPE>
+    StaticIndex<D, STRUCT_TYPE>::StaticIndex(STRUCT_TYPE* structure)
+    : m_structure(structure)
+    {
+    }
+
+    template<int D, typename STRUCT_TYPE>
+    StaticIndex<D, STRUCT_TYPE>::~StaticIndex()
+    {
+        delete m_structure;
+    }
+
+    template<int D, typename STRUCT_TYPE>
+    inline STRUCT_TYPE* StaticIndex<D, STRUCT_TYPE>::structure()
+    {
+        return m_structure;
+    }
+
+    template<int D, typename STRUCT_TYPE>
+    unsigned int StaticIndex<D, STRUCT_TYPE>::numDimensions() const
+    {
+        return D;
+    }
+
+    template<int D, typename STRUCT_TYPE>
+    bool StaticIndex<D, STRUCT_TYPE>::isCompiled() const
+    {
+        return true;
+    }
+
+    template<int D, typename STRUCT_TYPE>
+    bool StaticIndex<D, STRUCT_TYPE>::insert(const Real* point)
+    {
+        return m_structure->insert(Point<D, Real>(point));
+    }
+
+    template<int D, typename STRUCT_TYPE>
+    bool StaticIndex<D, STRUCT_TYPE>::remove(const Real* point)
+    {
+        return m_structure->remove(Point<D, Real>(point));
+    }
+
+    template<int D, typename STRUCT_TYPE>
+    bool StaticIndex<D, STRUCT_TYPE>::query(const Real* point)
+    {
+        return m_structure->query(Point<D, Real>(point));
+    }
+
+    template<int D, typename STRUCT_TYPE>
+    bool StaticIndex<D, STRUCT_TYPE>::rangeQuery(const Real* mins,
+        const Real* maxs, std::vector<Real>& results)
+    {
+        return rangeQuery(mins, maxs, results, std::integral_constant<bool,
+            HasRangeQuery<STRUCT_TYPE, Boundary<D, Real> >::value>());
+    }
+
+    template<int D, typename STRUCT_TYPE>
+    bool StaticIndex<D, STRUCT_TYPE>::knn(const Real* point, unsigned int k,
+                                          std::vector<Real>& results)
+    {
+        return knn(point, k, results, std::integral_constant<bool,
+            HasKnn<STRUCT_TYPE, Point<D, Real> >::value>());
+    }
+
+    template<int D, typename STRUCT_TYPE>
+    std::size_t StaticIndex<D, STRUCT_TYPE>::insertDataset(
+        const std::string& filename)
+    {
+        DatasetReader<D, Real> reader(filename);
+        return insertStream(m_structure, reader);
+    }
+
+    template<int D, typename STRUCT_TYPE>
+    void StaticIndex<D, STRUCT_TYPE>::appendPoints(const PointList& points,
+                                                   std::vector<Real>& results)
+    {
+        results.reserve(results.size() + points.size() * D);
+        for (unsigned int i = 0; (i < points.size()); i++)
+        {
+            const Real* coords = points[i].asArray();
+            results.insert(results.end(), coords, coords + D);
+        }
+    }
+
+    template<int D, typename STRUCT_TYPE>
+    bool StaticIndex<D, STRUCT_TYPE>::rangeQuery(const Real* mins,
+        const Real* maxs, std::vector<Real>& results, std::true_type)
+    {
+        Boundary<D, Real> region;
+        for (unsigned int d = 0; (d < D); d++)
+        {
+            region[d].min = mins[d];
+            region[d].max = maxs[d];
+        }
+        appendPoints(m_structure->rangeQuery(region), results);
+        return true;
+    }
+
+    template<int D, typename STRUCT_TYPE>
+    bool StaticIndex<D, STRUCT_TYPE>::rangeQuery(const Real*,
+        const Real*, std::vector<Real>&, std::false_type)
+    {
+        return false;
+    }
+
+    template<int D, typename STRUCT_TYPE>
+    bool StaticIndex<D, STRUCT_TYPE>::knn(const Real* point, unsigned int k,
+        std::vector<Real>& results, std::true_type)
+    {
+        appendPoints(m_structure->knn(Point<D, Real>(point), k), results);
+        return true;
+    }
+
+    template<int D, typename STRUCT_TYPE>
+    bool StaticIndex<D, STRUCT_TYPE>::knn(const Real*, unsigned int,
+        std::vector<Real>&, std::false_type)
+    {
+        return false;
+    }
+
+    inline DynamicPointSet::DynamicPointSet(unsigned int numDimensions)
+    : m_numDimensions(numDimensions)
+    {
+    }
+
+    inline unsigned int DynamicPointSet::numDimensions() const
+    {
+        return m_numDimensions;
+    }
+
+    inline bool DynamicPointSet::isCompiled() const
+    {
+        return false;
+    }
+
+    inline std::size_t DynamicPointSet::hashPoint(const Real* point) const
+    {
+        return boost::hash_range(point, point + m_numDimensions);
+    }
+
+    inline const Real* DynamicPointSet::storedPoint(std::size_t i) const
+    {
+        return &m_coords[i * m_numDimensions];
+    }
+
+    inline DynamicPointSet::PointIndex::iterator DynamicPointSet::find(
+        const Real* point, std::size_t hash)
+    {
+        std::pair<PointIndex::iterator, PointIndex::iterator> range =
+            m_index.equal_range(hash);
+        for (PointIndex::iterator it = range.first; (it != range.second); ++it)
+        {
+            if (std::equal(point, point + m_numDimensions,
+                           storedPoint(it->second)))
+            {
+                return it;
+            }
+        }
+        return m_index.end();
+    }
+
+    inline bool DynamicPointSet::insert(const Real* point)
+    {
+        const std::size_t hash = hashPoint(point);
+        if (find(point, hash) != m_index.end())
+            return false;
+        m_index.insert(std::make_pair(hash, m_coords.size() / m_numDimensions));
+        m_coords.insert(m_coords.end(), point, point + m_numDimensions);
+        return true;
+    }
+
+    inline bool DynamicPointSet::remove(const Real* point)
+    {
+        PointIndex::iterator entry = find(point, hashPoint(point));
+        if (entry == m_index.end())
+            return false;
+        const std::size_t removed = entry->second;
+        const std::size_t last = m_coords.size() / m_numDimensions - 1;
+        m_index.erase(entry);
+        // Move the last point into the removed point's place
+        if (removed != last)
+        {
+            const Real* lastPoint = storedPoint(last);
+            PointIndex::iterator lastEntry = find(lastPoint,
+                                                  hashPoint(lastPoint));
+            lastEntry->second = removed;
+            std::copy(lastPoint, lastPoint + m_numDimensions,
+                      m_coords.begin() + removed * m_numDimensions);
+        }
+        m_coords.resize(last * m_numDimensions);
+        return true;
+    }
+
+    inline bool DynamicPointSet::query(const Real* point)
+    {
+        return (find(point, hashPoint(point)) != m_index.end());
+    }
+
+    inline bool DynamicPointSet::rangeQuery(const Real* mins,
+        const Real* maxs, std::vector<Real>& results)
+    {
+        const std::size_t numPoints = m_coords.size() / m_numDimensions;
+        for (std::size_t i = 0; (i < numPoints); i++)
+        {
+            const Real* p = storedPoint(i);
+            bool inside = true;
+            for (unsigned int d = 0; (d < m_numDimensions); d++)
+                inside &= (p[d] >= mins[d]) & (p[d] <= maxs[d]);
+            if (inside)
+                results.insert(results.end(), p, p + m_numDimensions);
+        }
+        return true;
+    }
+
+    inline bool DynamicPointSet::knn(const Real* point, unsigned int k,
+                                     std::vector<Real>& results)
+    {
+        // Keep the k closest points seen so far in a max-heap
+        typedef std::pair<Real, std::size_t> Neighbour;
+        std::priority_queue<Neighbour> nearest;
+        const std::size_t numPoints = m_coords.size() / m_numDimensions;
+        for (std::size_t i = 0; (i < numPoints && k > 0); i++)
+        {
+            const Real* p = storedPoint(i);
+            Real distance = 0;
+            for (unsigned int d = 0; (d < m_numDimensions); d++)
+                distance += (p[d] - point[d]) * (p[d] - point[d]);
+            if (nearest.size() < k)
+            {
+                nearest.push(Neighbour(distance, i));
+            }
+            else if (distance < nearest.top().first)
+            {
+                nearest.pop();
+                nearest.push(Neighbour(distance, i));
+            }
+        }
+
+        const std::size_t firstResult = results.size();
+        results.resize(firstResult + nearest.size() * m_numDimensions);
+        for (std::size_t r = nearest.size(); (r > 0); r--)
+        {
+            const Real* p = storedPoint(nearest.top().second);
+            std::copy(p, p + m_numDimensions,
+                      results.begin() + firstResult
+                      + (r - 1) * m_numDimensions);
+            nearest.pop();
+        }
+        return true;
+    }
+
+    inline std::size_t DynamicPointSet::insertDataset(
+        const std::string& filename)
+    {
+        std::size_t numInserted = 0;
+        std::vector<Real> point(m_numDimensions);
+        BinaryDatasetFile binaryFile(filename);
+        if (binaryFile.isValid())
+        {
+            const BinaryDatasetHeader& header = binaryFile.header();
+            if (header.numDimensions != m_numDimensions
+                || header.elementType != BinaryElementTraits<Real>::CODE)
+            {
+                return 0;
+            }
+            const Real* elements = binaryFile.elements<Real>();
+            for (std::size_t i = 0; (i < header.numPoints); i++)
+            {
+                for (unsigned int d = 0; (d < m_numDimensions); d++)
+                {
+                    point[d] = (header.layout == AOS_LAYOUT)
+                        ? elements[i * header.stride + d]
+                        : elements[d * header.stride + i];
+                }
+                numInserted += insert(&point[0]);
+            }
+            return numInserted;
+        }
+
+        MappedFile textFile(filename);
+        if (!textFile.isOpen() || textFile.size() == 0)
+            return 0;
+        const char* end = textFile.data() + textFile.size();
+        int numDimensions = 0;
+        int numPoints = 0;
+        const char* next = parseTextHeader(textFile.data(), end,
+                                           numDimensions, numPoints);
+        if (next == NULL || numPoints < 1)
+            return 0;
+        for (int i = 0; (next != end && i < numPoints); )
+        {
+            const char* lineEnd = findLineEnd(next, end);
+            if (!isBlankLine(next, lineEnd))
+            {
+                parsePointLine(next, lineEnd, &point[0], m_numDimensions);
+                numInserted += insert(&point[0]);
+                i++;
+            }
+            next = (lineEnd == end) ? end : lineEnd + 1;
+        }
+        return numInserted;
+    }
+
+    /** Creates an index for a dataset file with a compiled or dynamic
+     * number of dimensions. Used by createIndexForDataset(). */
+    struct DatasetIndexFactory
+    {
+        typedef boost::shared_ptr<DynamicIndex> ResultType;
+
+        DatasetIndexFactory(const std::string& structureName,
+                            const std::string& filename)
+        : structureName(structureName), filename(filename)
+        {
+        }
+
+        /** Return boundary stored in the file, or computed by reading
+         * every point in it. */
+        template<int D>
+        Boundary<D, Real> datasetBoundary() const
+        {
+            BinaryDatasetFile binaryFile(filename);
+            if (binaryFile.matches<D, Real>() && binaryFile.hasBoundary())
+                return binaryFile.boundary<D, Real>();
+            BoundaryAccumulator<D, Real> accumulator;
+            DatasetReader<D, Real> reader(filename);
+            std::vector< Point<D, Real> > chunk;
+            while (reader.next(chunk))
+                accumulator.add(chunk);
+            return accumulator.boundary();
+        }
+
+        template<int D, typename STRUCT_TYPE>
+        ResultType fill(STRUCT_TYPE* structure) const
+        {
+            ResultType index(new StaticIndex<D, STRUCT_TYPE>(structure));
+            index->insertDataset(filename);
+            return index;
+        }
+
+        template<int D>
+        ResultType run()
+        {
+            if (structureName == "kd-tree")
+                return fill<D>(new KDTree<D, Real>());
+            else if (structureName == "bucket_kd-tree")
+                return fill<D>(new BucketKDTree<D, Real>());
+            else if (structureName == "bithash")
+                return fill<D>(new BitHash<D, Real>());
+            else if (structureName == "multigrid")
+                return fill<D>(new Multigrid<D, Real>(datasetBoundary<D>()));
+            else if (structureName == "pyramid_tree")
+            {
+                // Keep bucket keys ordered, so rangeQuery() doesn't scan
+                // every bucket
+                return fill<D>(new PyramidTree<D, Real>(
+                    datasetBoundary<D>(), true));
+            }
+            return ResultType();
+        }
+
+        ResultType runDynamic(int d)
+        {
+            if (structureName != "kd-tree" && structureName != "bucket_kd-tree"
+                && structureName != "bithash" && structureName != "multigrid"
+                && structureName != "pyramid_tree")
+            {
+                return ResultType();
+            }
+            ResultType index(new DynamicPointSet(d));
+            index->insertDataset(filename);
+            return index;
+        }
+
+        std::string structureName;
+        std::string filename;
+    };
+
+    inline boost::shared_ptr<DynamicIndex> createIndexForDataset(
+        const std::string& structureName, const std::string& filename)
+    {
+        const int numDimensions = readDatasetDimensions(filename);
+        if (numDimensions < 1)
+            return boost::shared_ptr<DynamicIndex>();
+        DatasetIndexFactory factory(structureName, filename);
+        return dispatchDimensions(numDimensions, factory);
+    }
+
+}
+
+#endif
@@ -0,0 +1,361 @@
+/******************************************************************************
+
+mdsearch - Lightweight C++ library implementing a collection of
+           multi-dimensional search structures
+
+File:        distance.hpp
+Description: Distance functions between points, and kernels that compute the
+             distances from a query point to a block of points stored
+             either as an array of points (AoS) or column by column (SoA).
+
+             The kernels are written so the compiler can vectorise them,
+             and are compiled for several instruction sets. The one used
+             is chosen at runtime based on the CPU (see simd.hpp).
+
+*******************************************************************************
+
+The MIT License (MIT)
+
+Copyright (c) 2014 Donald Whyte
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+******************************************************************************/
+
+#ifndef MDSEARCH_DISTANCE_H
+#define MDSEARCH_DISTANCE_H
+
+#include "types.hpp"
+#include "point.hpp"
+#include "simd.hpp"
+#include <algorithm>
+#include <type_traits>
+
+namespace mdsearch
+{
+
+    /** Distance metrics. Each metric computes a term from the difference
+     * of a pair of coordinates and combines the terms of all dimensions.
+     * Combining terms never decreases the distance, so a partial distance
+     * is a lower bound of the full distance. */
+
+    /** Squared Euclidean (L2) distance. The square root is not taken, which
+     * preserves the order of distances. */
+    struct SquaredEuclideanDistance
+    {
+        template<typename ELEM_TYPE>
+        static ELEM_TYPE term(ELEM_TYPE difference)
+        {
+            return difference * difference;
+        }
+
+        template<typename ELEM_TYPE>
+        static ELEM_TYPE combine(ELEM_TYPE total, ELEM_TYPE term)
+        {
+            return total + term;
+        }
+    };
+
+    /** Manhattan (L1) distance. */
+    struct ManhattanDistance
+    {
+        template<typename ELEM_TYPE>
+        static ELEM_TYPE term(ELEM_TYPE difference)
+        {
+            return std::abs(difference);
+        }
+
+        template<typename ELEM_TYPE>
+        static ELEM_TYPE combine(ELEM_TYPE total, ELEM_TYPE term)
+        {
+            return total + term;
+        }
+    };
+
+    /** Chebyshev (L-infinity) distance. */
+    struct ChebyshevDistance
+    {
+        template<typename ELEM_TYPE>
+        static ELEM_TYPE term(ELEM_TYPE difference)
+        {
+            return std::abs(difference);
+        }
+
+        template<typename ELEM_TYPE>
+        static ELEM_TYPE combine(ELEM_TYPE total, ELEM_TYPE term)
+        {
+            return (term > total) ? term : total;
+        }
+    };
+
+    /** Type distances between points whose elements have type ELEM_TYPE
+     * are computed in. Integer coordinates, such as those of quantised
+     * points, would overflow when squared, so distances between them are
+     * computed in Real. */
+    template<typename ELEM_TYPE>
+    struct DistanceType
+    {
+        typedef typename std::conditional<std::is_integral<ELEM_TYPE>::value,
+            Real, ELEM_TYPE>::type Type;
+    };
+
+    /** Return a - b as a DistanceType. */
+    template<typename ELEM_TYPE>
+    inline typename DistanceType<ELEM_TYPE>::Type difference(ELEM_TYPE a,
+                                                             ELEM_TYPE b)
+    {
+        return static_cast<typename DistanceType<ELEM_TYPE>::Type>(a) - b;
+    }
+
+    /** Number of independent partial distances accumulated per point by
+     * the AoS kernels, or points processed together by the SoA kernels.
+     * This is enough to fill an AVX-512 register with floats. */
+    static const unsigned int DISTANCE_LANES = 16;
+
+    /** Return distance between two points using given METRIC. */
+    template<typename METRIC, int D, typename ELEM_TYPE>
+    inline typename DistanceType<ELEM_TYPE>::Type distance(
+        const Point<D, ELEM_TYPE>& a, const Point<D, ELEM_TYPE>& b)
+    {
+        typedef typename DistanceType<ELEM_TYPE>::Type DistanceValue;
+        DistanceValue total = 0;
+        for (unsigned int d = 0; (d < D); d++)
+        {
+            total = METRIC::combine(total,
+                METRIC::term(difference(a[d], b[d])));
+        }
+        return total;
+    }
+
+    /** Compute distance from 'query' to each of the first 'numPoints'
+     * points in 'points', storing the ith distance in results[i].
+     *
+     * The dimensions of each point are split across DISTANCE_LANES partial
+     * distances, which are combined at the end. This means the results can
+     * differ from distance() by rounding. */
+    template<typename METRIC, int D, typename ELEM_TYPE>
+    MDSEARCH_TARGET_CLONES
+    void distancesAoS(const Point<D, ELEM_TYPE>& query,
+                      const Point<D, ELEM_TYPE>* points,
+                      unsigned int numPoints,
+                      typename DistanceType<ELEM_TYPE>::Type* results)
+    {
+        typedef typename DistanceType<ELEM_TYPE>::Type DistanceValue;
+        static const unsigned int NUM_BLOCKS = D / DISTANCE_LANES;
+        const ELEM_TYPE* q = query.asArray();
+        for (unsigned int i = 0; (i < numPoints); i++)
+        {
+            const ELEM_TYPE* p = points[i].asArray();
+            DistanceValue total = 0;
+            if (NUM_BLOCKS > 0)
+            {
+                DistanceValue partial[DISTANCE_LANES] = { 0 };
+                for (unsigned int b = 0; (b < NUM_BLOCKS); b++)
+                {
+                    const unsigned int start = b * DISTANCE_LANES;
+                    MDSEARCH_VECTORISE_LOOP
+                    for (unsigned int l = 0; (l < DISTANCE_LANES); l++)
+                    {
+                        partial[l] = METRIC::combine(partial[l],
+                            METRIC::term(difference(p[start + l],
+                                                    q[start + l])));
+                    }
+                }
+                for (unsigned int l = 0; (l < DISTANCE_LANES); l++)
+                    total = METRIC::combine(total, partial[l]);
+            }
+            for (unsigned int d = NUM_BLOCKS * DISTANCE_LANES; (d < D); d++)
+                total = METRIC::combine(total,
+                    METRIC::term(difference(p[d], q[d])));
+            results[i] = total;
+        }
+    }
+
+    /** Compute distance from 'query' to each of 'numPoints' points stored
+     * column by column, storing the ith distance in results[i]. The dth
+     * coordinate of the ith point is stored at columns[d * stride + i].
+     *
+     * Each point's dimensions are combined in the same order as distance(),
+     * but the compiler may fuse multiplies and adds in the vectorised
+     * code, so results can still differ from distance() by rounding. */
+    template<typename METRIC, int D, typename ELEM_TYPE>
+    MDSEARCH_TARGET_CLONES
+    void distancesSoA(const Point<D, ELEM_TYPE>& query,
+                      const ELEM_TYPE* columns, unsigned int stride,
+                      unsigned int numPoints,
+                      typename DistanceType<ELEM_TYPE>::Type* results)
+    {
+        for (unsigned int i = 0; (i < numPoints); i++)
+            results[i] = 0;
+        for (unsigned int d = 0; (d < D); d++)
+        {
+            const ELEM_TYPE* column = columns + d * stride;
+            const ELEM_TYPE value = query[d];
+            for (unsigned int i = 0; (i < numPoints); i++)
+            {
+                results[i] = METRIC::combine(results[i],
+                    METRIC::term(difference(column[i], value)));
+            }
+        }
+    }
+
+    /** Find the point in 'points' closest to 'query' whose distance is less
+     * than 'bestDistance'. If one is found, its index is returned and
+     * 'bestDistance' is set to its distance. Otherwise, -1 is returned.
+     *
+     * Computing a point's distance stops as soon as its partial distance
+     * reaches the best distance found so far, which saves work in high
+     * dimensions. Distances can differ from distance() by rounding, as
+     * with distancesAoS(). */
+    template<typename METRIC, int D, typename ELEM_TYPE>
+    MDSEARCH_TARGET_CLONES
+    int nearestAoS(const Point<D, ELEM_TYPE>& query,
+                   const Point<D, ELEM_TYPE>* points,
+                   unsigned int numPoints,
+                   typename DistanceType<ELEM_TYPE>::Type& bestDistance)
+    {
+        typedef typename DistanceType<ELEM_TYPE>::Type DistanceValue;
+        static const unsigned int NUM_BLOCKS = D / DISTANCE_LANES;
+        const ELEM_TYPE* q = query.asArray();
+        int bestIndex = -1;
+        for (unsigned int i = 0; (i < numPoints); i++)
+        {
+            const ELEM_TYPE* p = points[i].asArray();
+            DistanceValue total = 0;
+            bool abandoned = false;
+            if (NUM_BLOCKS > 0)
+            {
+                DistanceValue partial[DISTANCE_LANES] = { 0 };
+                for (unsigned int b = 0; (b < NUM_BLOCKS); b++)
+                {
+                    const unsigned int start = b * DISTANCE_LANES;
+                    DistanceValue blockTotal = 0;
+                    MDSEARCH_VECTORISE_LOOP
+                    for (unsigned int l = 0; (l < DISTANCE_LANES); l++)
+                    {
+                        partial[l] = METRIC::combine(partial[l],
+                            METRIC::term(difference(p[start + l],
+                                                    q[start + l])));
+                    }
+                    for (unsigned int l = 0; (l < DISTANCE_LANES); l++)
+                        blockTotal = METRIC::combine(blockTotal, partial[l]);
+                    if (blockTotal >= bestDistance)
+                    {
+                        abandoned = true;
+                        break;
+                    }
+                    total = blockTotal;
+                }
+            }
+            if (abandoned)
+                continue;
+            for (unsigned int d = NUM_BLOCKS * DISTANCE_LANES; (d < D); d++)
+                total = METRIC::combine(total,
+                    METRIC::term(difference(p[d], q[d])));
+            if (total < bestDistance)
+            {
+                bestDistance = total;
+                bestIndex = i;
+            }
+        }
+        return bestIndex;
+    }
+
+    /** Find the point closest to 'query' whose distance is less than
+     * 'bestDistance', out of 'numPoints' points stored column by column
+     * (as in distancesSoA()). If one is found, its index is returned and
+     * 'bestDistance' is set to its distance. Otherwise, -1 is returned.
+     *
+     * Points are processed DISTANCE_LANES at a time. A block of points is
+     * abandoned as soon as the partial distances of all of its points
+     * reach the best distance found so far. */
+    template<typename METRIC, int D, typename ELEM_TYPE>
+    MDSEARCH_TARGET_CLONES
+    int nearestSoA(const Point<D, ELEM_TYPE>& query,
+                   const ELEM_TYPE* columns, unsigned int stride,
+                   unsigned int numPoints,
+                   typename DistanceType<ELEM_TYPE>::Type& bestDistance)
+    {
+        typedef typename DistanceType<ELEM_TYPE>::Type DistanceValue;
+        // Number of dimensions between checks for abandoning a block
+        static const unsigned int CHECK_INTERVAL = 4;
+        int bestIndex = -1;
+        const unsigned int numBlockPoints = numPoints
+            - (numPoints % DISTANCE_LANES);
+        for (unsigned int start = 0; (start < numBlockPoints);
+            start += DISTANCE_LANES)
+        {
+            DistanceValue partial[DISTANCE_LANES] = { 0 };
+            bool abandoned = false;
+            for (unsigned int d = 0; (d < D); d++)
+            {
+                const ELEM_TYPE* column = columns + d * stride + start;
+                const ELEM_TYPE value = query[d];
+                MDSEARCH_VECTORISE_LOOP
+                for (unsigned int l = 0; (l < DISTANCE_LANES); l++)
+                {
+                    partial[l] = METRIC::combine(partial[l],
+                        METRIC::term(difference(column[l], value)));
+                }
+                if ((d + 1) % CHECK_INTERVAL == 0 && d + 1 < D)
+                {
+                    DistanceValue smallest = partial[0];
+                    for (unsigned int l = 1; (l < DISTANCE_LANES); l++)
+                        smallest = std::min(smallest, partial[l]);
+                    if (smallest >= bestDistance)
+                    {
+                        abandoned = true;
+                        break;
+                    }
+                }
+            }
+            if (abandoned)
+                continue;
+            for (unsigned int l = 0; (l < DISTANCE_LANES); l++)
+            {
+                if (partial[l] < bestDistance)
+                {
+                    bestDistance = partial[l];
+                    bestIndex = start + l;
+                }
+            }
+        }
+
+        // Points left over are done one at a time
+        for (unsigned int i = numBlockPoints; (i < numPoints); i++)
+        {
+            DistanceValue total = 0;
+            for (unsigned int d = 0; (d < D && total < bestDistance); d++)
+            {
+                total = METRIC::combine(total,
+                    METRIC::term(difference(columns[d * stride + i],
+                                            query[d])));
+            }
+            if (total < bestDistance)
+            {
+                bestDistance = total;
+                bestIndex = i;
+            }
+        }
+        return bestIndex;
+    }
+
+}
+
+#endif
@@ -0,0 +1,309 @@
+/******************************************************************************
+
+mdsearch - Lightweight C++ library implementing a collection of
+           multi-dimensional search structures
+
+File:        distributions.hpp
+Description: Generates synthetic sets of points from distributions which
+             exercise the weaknesses of index structures, such as clusters,
+             duplicates, grid-aligned coordinates, low intrinsic
+             dimensionality and sorted insertion order.
+
+*******************************************************************************
+
+The MIT License (MIT)
+
+Copyright (c) 2014 Donald Whyte
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+******************************************************************************/
+
+#ifndef MDSEARCH_DISTRIBUTIONS_H
+#define MDSEARCH_DISTRIBUTIONS_H
+
+#include "point.hpp"
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace mdsearch
+{
+
+    enum PointDistribution
+    {
+        /** Coordinates uniformly distributed in [0, 1). */
+        UNIFORM_DISTRIBUTION = 0,
+        /** Uniform coordinates raised to the fourth power, so points are
+         * clustered towards the origin. */
+        SKEWED_DISTRIBUTION,
+        /** Points normally distributed around a few randomly placed
+         * centres, with a small standard deviation. */
+        GAUSSIAN_MIXTURE_DISTRIBUTION,
+        /** Points on a random low-dimensional linear subspace, plus a
+         * little noise, so coordinates are strongly correlated. */
+        LOW_RANK_DISTRIBUTION,
+        /** Coordinates only take a few evenly spaced values, so points lie
+         * on a grid and many are duplicates. */
+        LATTICE_DISTRIBUTION,
+        /** Uniform points sorted by their first coordinate, so they are
+         * inserted in a sweep across space. */
+        SORTED_SWEEP_DISTRIBUTION,
+        /** Coordinates from a Pareto distribution, so most are close to
+         * zero but a few are very large. */
+        HEAVY_TAIL_DISTRIBUTION,
+        NUM_POINT_DISTRIBUTIONS
+    };
+
+    /** Parameters of the non-uniform distributions. */
+    struct DistributionParameters
+    {
+        DistributionParameters();
+
+        /** Number of centres in GAUSSIAN_MIXTURE_DISTRIBUTION. */
+        unsigned int numClusters;
+        /** Standard deviation of each coordinate around its centre in
+         * GAUSSIAN_MIXTURE_DISTRIBUTION. */
+        double clusterDeviation;
+        /** Dimensionality of the subspace in LOW_RANK_DISTRIBUTION. */
+        unsigned int intrinsicDimensions;
+        /** Standard deviation of the noise added to each coordinate in
+         * LOW_RANK_DISTRIBUTION. */
+        double noiseDeviation;
+        /** Number of values each coordinate can take in
+         * LATTICE_DISTRIBUTION. */
+        unsigned int latticeLevels;
+        /** Shape of the Pareto distribution in HEAVY_TAIL_DISTRIBUTION.
+         * Smaller values give heavier tails. */
+        double tailIndex;
+    };
+
+    /** Source of random numbers which gives the same sequence on every
+     * platform for a given seed, unlike the standard library's
+     * distributions. */
+    class RandomSource
+    {
+
+    public:
+        RandomSource(uint64_t seed);
+
+        /** Return uniformly distributed number in [0, 1). */
+        double uniform();
+        /** Return normally distributed number with mean 0 and standard
+         * deviation 1. */
+        double normal();
+        /** Return uniformly distributed integer in [0, n). */
+        uint64_t integer(uint64_t n);
+
+    private:
+        std::mt19937_64 m_generator;
+        /** Second number generated by the last Box-Muller transform. */
+        double m_spareNormal;
+        bool m_hasSpareNormal;
+
+    };
+
+    /** Return name of distribution, as accepted by parseDistribution(). */
+    const char* distributionName(PointDistribution distribution);
+
+    /** Set 'distribution' to the distribution with the given name (e.g.
+     * "gaussian_mixture"). Returns false if there is no such
+     * distribution. */
+    bool parseDistribution(const std::string& name,
+                           PointDistribution& distribution);
+
+    /** Generate 'numPoints' points from the given distribution. The same
+     * seed always gives the same points. */
+    template<int D, typename ELEM_TYPE>
+    std::vector< Point<D, ELEM_TYPE> > generatePoints(
+        PointDistribution distribution, unsigned int numPoints, uint64_t seed,
+        const DistributionParameters& parameters = DistributionParameters());
+
+    inline DistributionParameters::DistributionParameters()
+    : numClusters(8), clusterDeviation(0.02), intrinsicDimensions(2),
+      noiseDeviation(0.001), latticeLevels(8), tailIndex(1.5)
+    {
+    }
+
+    inline RandomSource::RandomSource(uint64_t seed)
+    : m_generator(seed), m_spareNormal(0.0), m_hasSpareNormal(false)
+    {
+    }
+
+    inline double RandomSource::uniform()
+    {
+        // Top 53 bits of the output give every double in [0, 1) with an
+        // interval of 2^-53
+        return (m_generator() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    inline double RandomSource::normal()
+    {
+        if (m_hasSpareNormal)
+        {
+            m_hasSpareNormal = false;
+            return m_spareNormal;
+        }
+        // Box-Muller transform, avoiding log(0)
+        const double radius = std::sqrt(-2.0 * std::log(1.0 - uniform()));
+        const double angle = 6.283185307179586 * uniform();
+        m_spareNormal = radius * std::sin(angle);
+        m_hasSpareNormal = true;
+        return radius * std::cos(angle);
+    }
+
+    inline uint64_t RandomSource::integer(uint64_t n)
+    {
+        return std::min(static_cast<uint64_t>(uniform() * n), n - 1);
+    }
+
+    inline const char* distributionName(PointDistribution distribution)
+    {
+        static const char* NAMES[NUM_POINT_DISTRIBUTIONS] = {
+            "uniform", "skewed", "gaussian_mixture", "low_rank", "lattice",
+            "sorted_sweep", "heavy_tail"
+        };
+        return (distribution < NUM_POINT_DISTRIBUTIONS)
+            ? NAMES[distribution] : "";
+    }
+
+    inline bool parseDistribution(const std::string& name,
+                                  PointDistribution& distribution)
+    {
+        for (int i = 0; (i < NUM_POINT_DISTRIBUTIONS); i++)
+        {
+            if (name == distributionName(static_cast<PointDistribution>(i)))
+            {
+                distribution = static_cast<PointDistribution>(i);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    template<int D, typename ELEM_TYPE>
+    bool lessInFirstCoordinate(const Point<D, ELEM_TYPE>& a,
+                               const Point<D, ELEM_TYPE>& b)
+    {
+        return a[0] < b[0];
+    }
+
+    template<int D, typename ELEM_TYPE>
+    std::vector< Point<D, ELEM_TYPE> > generatePoints(
+        PointDistribution distribution, unsigned int numPoints, uint64_t seed,
+        const DistributionParameters& parameters)
+    {
+        RandomSource random(seed);
+        std::vector< Point<D, ELEM_TYPE> > points(numPoints);
+
+        // Centres of the Gaussian mixture and basis of the low-rank
+        // subspace, both drawn before any points
+        std::vector<double> centres;
+        if (distribution == GAUSSIAN_MIXTURE_DISTRIBUTION)
+        {
+            centres.resize(std::max(parameters.numClusters, 1u) * D);
+            for (unsigned int i = 0; (i < centres.size()); i++)
+                centres[i] = 0.1 + 0.8 * random.uniform();
+        }
+        const unsigned int rank = std::max(parameters.intrinsicDimensions, 1u);
+        std::vector<double> basis;
+        if (distribution == LOW_RANK_DISTRIBUTION)
+        {
+            // Scale so coordinates mostly stay in [0, 1)
+            basis.resize(rank * D);
+            for (unsigned int i = 0; (i < basis.size()); i++)
+                basis[i] = random.normal() / (4.0 * std::sqrt(rank));
+        }
+        const unsigned int levels = std::max(parameters.latticeLevels, 2u);
+
+        std::vector<double> latent(rank);
+        for (unsigned int i = 0; (i < numPoints); i++)
+        {
+            Point<D, ELEM_TYPE>& p = points[i];
+            switch (distribution)
+            {
+            case SKEWED_DISTRIBUTION:
+                for (unsigned int d = 0; (d < D); d++)
+                {
+                    const double value = random.uniform();
+                    p[d] = static_cast<ELEM_TYPE>(value * value * value
+                                                  * value);
+                }
+                break;
+            case GAUSSIAN_MIXTURE_DISTRIBUTION:
+                {
+                    const double* centre = &centres[
+                        random.integer(centres.size() / D) * D];
+                    for (unsigned int d = 0; (d < D); d++)
+                    {
+                        p[d] = static_cast<ELEM_TYPE>(centre[d]
+                            + parameters.clusterDeviation * random.normal());
+                    }
+                }
+                break;
+            case LOW_RANK_DISTRIBUTION:
+                for (unsigned int r = 0; (r < rank); r++)
+                    latent[r] = random.normal();
+                for (unsigned int d = 0; (d < D); d++)
+                {
+                    double value = 0.5;
+                    for (unsigned int r = 0; (r < rank); r++)
+                        value += basis[r * D + d] * latent[r];
+                    p[d] = static_cast<ELEM_TYPE>(value
+                        + parameters.noiseDeviation * random.normal());
+                }
+                break;
+            case LATTICE_DISTRIBUTION:
+                for (unsigned int d = 0; (d < D); d++)
+                {
+                    p[d] = static_cast<ELEM_TYPE>(
+                        static_cast<double>(random.integer(levels))
+                        / (levels - 1));
+                }
+                break;
+            case HEAVY_TAIL_DISTRIBUTION:
+                // Inverse of the Pareto CDF, shifted to start at zero
+                for (unsigned int d = 0; (d < D); d++)
+                {
+                    p[d] = static_cast<ELEM_TYPE>(std::pow(
+                        1.0 - random.uniform(), -1.0 / parameters.tailIndex)
+                        - 1.0);
+                }
+                break;
+            default:
+                for (unsigned int d = 0; (d < D); d++)
+                    p[d] = static_cast<ELEM_TYPE>(random.uniform());
+                break;
+            }
+        }
+
+        if (distribution == SORTED_SWEEP_DISTRIBUTION)
+        {
+            std::stable_sort(points.begin(), points.end(),
+                             lessInFirstCoordinate<D, ELEM_TYPE>);
+        }
+        return points;
+    }
+
+}
+
+#endif
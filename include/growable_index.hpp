@@ -0,0 +1,465 @@
+/******************************************************************************
+
+mdsearch - Lightweight C++ library implementing a collection of
+           multi-dimensional search structures
+
+File:        growable_index.hpp
+Description: Wraps a structure that covers a fixed boundary (such as the
+             Pyramid Tree or Multigrid) so points outside of the boundary
+             can still be stored. Those points are kept in an overflow
+             store until there are enough of them to justify growing the
+             boundary, after which the stored points are gradually
+             re-hashed into a new structure covering the larger boundary.
+
+*******************************************************************************
+
+The MIT License (MIT)
+
+Copyright (c) 2014 Donald Whyte
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+******************************************************************************/
+
+#ifndef MDSEARCH_GROWABLE_INDEX_H
+#define MDSEARCH_GROWABLE_INDEX_H
+
+#include "types.hpp"
+#include "point.hpp"
+#include "boundary.hpp"
+#include "memory_usage.hpp"
+#include <boost/unordered_set.hpp>
+#include <boost/functional/hash.hpp>
+#include <vector>
+#include <algorithm>
+
+namespace mdsearch
+{
+
+    /** Stores points in a structure of type STRUCT_TYPE that covers a
+     * fixed boundary, growing the boundary as points outside of it are
+     * inserted.
+     *
+     * Points outside of the structure's boundary are stored in an overflow
+     * set, hashed on their coordinates. Once the overflow set holds more
+     * than a fraction of all the points, a new structure is created whose
+     * boundary also covers the overflow points (with extra room in the
+     * direction they lie in). The overflow points are moved into it
+     * immediately, and the points in the old structure are moved a few at
+     * a time by each subsequent operation, so no single operation pays for
+     * re-hashing everything.
+     * All operations, including range queries, can be used while points
+     * are being moved. Call migrate() to move more points at once, e.g.
+     * when the index is idle.
+     *
+     * STRUCT_TYPE must be constructible from a Boundary and provide
+     * insert(), remove(), query() and rangeQuery(). Each point is stored
+     * in exactly one of the old structure, new structure and overflow
+     * set.
+     *
+     * NOTE: Operations are not thread-safe. Points are moved while the
+     * operations are running, rather than by a background thread, so the
+     * index can be used from a single thread without any locking. */
+    template<int D, typename ELEM_TYPE, typename STRUCT_TYPE>
+    class GrowableIndex
+    {
+
+    public:
+        typedef std::vector< Point<D, ELEM_TYPE> > PointList;
+
+        /** Construct index that initially covers given boundary.
+         *
+         * \param growthFactor fraction of a dimension's range that is added
+         * to the side of the boundary points overflowed from, when the
+         * boundary grows.
+         * \param overflowFraction the boundary is grown once the overflow
+         * set contains more than this fraction of the stored points (and
+         * at least 'minOverflowPoints' points).
+         * \param minOverflowPoints smallest number of overflow points that
+         * causes the boundary to grow.
+         * \param migrationStep number of points moved to the new structure
+         * by each operation while the boundary is growing. */
+        GrowableIndex(const Boundary<D, ELEM_TYPE>& boundary,
+                      double growthFactor = 0.5,
+                      double overflowFraction = 0.05,
+                      unsigned int minOverflowPoints = 256,
+                      unsigned int migrationStep = 8);
+
+        ~GrowableIndex();
+
+        /** Insert point into index.
+         * Returns true if the point was inserted successfully and
+         * false if the point is already stored in the index. */
+        bool insert(const Point<D, ELEM_TYPE>& point);
+
+        /** Remove point from the index.
+         * Returns true if the point was removed successfully and
+         * false if the point was not being stored. */
+        bool remove(const Point<D, ELEM_TYPE>& point);
+
+        /** Return true if the given point is being stored in the index. */
+        bool query(const Point<D, ELEM_TYPE>& point);
+
+        /** Return all stored points that lie inside the given region
+         * (inclusive). */
+        PointList rangeQuery(const Boundary<D, ELEM_TYPE>& region);
+
+        /** Move up to 'maxPoints' points into the structure covering the
+         * grown boundary, if the boundary is growing. Returns true if
+         * there are still points left to move. */
+        bool migrate(unsigned int maxPoints);
+
+        /** Return true if points are being moved to a grown boundary. */
+        bool isGrowing() const;
+
+        /** Return boundary of the structure new points are inserted into.
+         * Points outside of it are stored in the overflow set. */
+        const Boundary<D, ELEM_TYPE>& boundary() const;
+
+        /** Return total number of points stored in the index. */
+        unsigned int numPoints() const;
+
+        /** Return number of points stored in the overflow set. */
+        unsigned int numOverflowPoints() const;
+
+        /** Return number of times the boundary has grown. */
+        unsigned int numGrowths() const;
+
+        /** Return memory used by the structures, the overflow set and the
+         * list of pending points. STRUCT_TYPE must provide memoryUsage(). */
+        MemoryUsage memoryUsage() const;
+
+    private:
+        typedef std::vector<Point<D, ELEM_TYPE>,
+            CountingAllocator< Point<D, ELEM_TYPE> > > StoredPointList;
+
+        /** Hashes the coordinates of a point. */
+        struct PointHash
+        {
+            std::size_t operator()(const Point<D, ELEM_TYPE>& p) const
+            {
+                return boost::hash_range(p.asArray(), p.asArray() + D);
+            }
+        };
+        typedef boost::unordered_set<Point<D, ELEM_TYPE>, PointHash,
+            std::equal_to< Point<D, ELEM_TYPE> >,
+            CountingAllocator< Point<D, ELEM_TYPE> > > OverflowSet;
+
+        // Disable copying, since the index owns its structures
+        GrowableIndex(const GrowableIndex& other);
+        GrowableIndex& operator=(const GrowableIndex& other);
+
+        /** Start growing the boundary if there are enough overflow points,
+         * otherwise move some points if the boundary is already growing. */
+        void update();
+
+        /** Create structure covering the overflow points and start moving
+         * the stored points into it. */
+        void grow();
+
+        /** Structure points are currently being inserted into. */
+        STRUCT_TYPE* m_structure;
+        Boundary<D, ELEM_TYPE> m_boundary;
+        /** Structure covering the previous boundary, whose points are
+         * being moved into m_structure. NULL if not growing. */
+        STRUCT_TYPE* m_oldStructure;
+        /** Memory allocated for the pending list. */
+        MemoryCounter m_listMemory;
+        /** Memory allocated for the overflow set. */
+        MemoryCounter m_overflowMemory;
+        /** Points that might still be in m_oldStructure. These are moved
+         * from the back of the list. */
+        StoredPointList m_pendingPoints;
+        /** Points outside of m_boundary. */
+        OverflowSet m_overflowPoints;
+
+        double m_growthFactor;
+        double m_overflowFraction;
+        unsigned int m_minOverflowPoints;
+        unsigned int m_migrationStep;
+        unsigned int m_numPoints;
+        unsigned int m_numGrowths;
+
+    };
+
+    template<int D, typename ELEM_TYPE, typename STRUCT_TYPE>
+    GrowableIndex<D, ELEM_TYPE, STRUCT_TYPE>::GrowableIndex(
+        const Boundary<D, ELEM_TYPE>& boundary, double growthFactor,
+        double overflowFraction, unsigned int minOverflowPoints,
+        unsigned int migrationStep)
+    : m_structure(new STRUCT_TYPE(boundary)), m_boundary(boundary),
+      m_oldStructure(NULL),
+      m_pendingPoints(typename StoredPointList::allocator_type(&m_listMemory)),
+      m_overflowPoints(0, PointHash(), std::equal_to< Point<D, ELEM_TYPE> >(),
+          typename OverflowSet::allocator_type(&m_overflowMemory)),
+      m_growthFactor(growthFactor),
+      m_overflowFraction(overflowFraction),
+      m_minOverflowPoints(minOverflowPoints),
+      m_migrationStep(migrationStep), m_numPoints(0), m_numGrowths(0)
+    {
+    }
+
+    template<int D, typename ELEM_TYPE, typename STRUCT_TYPE>
+    GrowableIndex<D, ELEM_TYPE, STRUCT_TYPE>::~GrowableIndex()
+    {
+        delete m_structure;
+        delete m_oldStructure;
+    }
+
+    template<int D, typename ELEM_TYPE, typename STRUCT_TYPE>
+    bool GrowableIndex<D, ELEM_TYPE, STRUCT_TYPE>::insert(
+        const Point<D, ELEM_TYPE>& point)
+    {
+        update();
+
+        bool inserted = false;
+        if (m_boundary.contains(point))
+        {
+            // Point may still be in the old structure if it hasn't been
+            // moved yet
+            if (!(m_oldStructure && m_oldStructure->query(point)))
+                inserted = m_structure->insert(point);
+        }
+        else
+        {
+            inserted = m_overflowPoints.insert(point).second;
+        }
+
+        if (inserted)
+            m_numPoints++;
+        return inserted;
+    }
+
+    template<int D, typename ELEM_TYPE, typename STRUCT_TYPE>
+    bool GrowableIndex<D, ELEM_TYPE, STRUCT_TYPE>::remove(
+        const Point<D, ELEM_TYPE>& point)
+    {
+        update();
+
+        bool removed = false;
+        if (m_boundary.contains(point))
+        {
+            removed = m_structure->remove(point)
+                || (m_oldStructure && m_oldStructure->remove(point));
+        }
+        else
+        {
+            removed = (m_overflowPoints.erase(point) > 0);
+        }
+
+        if (removed)
+            m_numPoints--;
+        return removed;
+    }
+
+    template<int D, typename ELEM_TYPE, typename STRUCT_TYPE>
+    bool GrowableIndex<D, ELEM_TYPE, STRUCT_TYPE>::query(
+        const Point<D, ELEM_TYPE>& point)
+    {
+        update();
+
+        if (m_boundary.contains(point))
+        {
+            return m_structure->query(point)
+                || (m_oldStructure && m_oldStructure->query(point));
+        }
+        else
+        {
+            return (m_overflowPoints.find(point) != m_overflowPoints.end());
+        }
+    }
+
+    template<int D, typename ELEM_TYPE, typename STRUCT_TYPE>
+    typename GrowableIndex<D, ELEM_TYPE, STRUCT_TYPE>::PointList
+    GrowableIndex<D, ELEM_TYPE, STRUCT_TYPE>::rangeQuery(
+        const Boundary<D, ELEM_TYPE>& region)
+    {
+        update();
+
+        PointList results = m_structure->rangeQuery(region);
+        if (m_oldStructure)
+        {
+            PointList oldResults = m_oldStructure->rangeQuery(region);
+            results.insert(results.end(),
+                           oldResults.begin(), oldResults.end());
+        }
+        for (typename OverflowSet::const_iterator it = m_overflowPoints.begin();
+            (it != m_overflowPoints.end()); it++)
+        {
+            if (region.contains(*it))
+                results.push_back(*it);
+        }
+        return results;
+    }
+
+    template<int D, typename ELEM_TYPE, typename STRUCT_TYPE>
+    bool GrowableIndex<D, ELEM_TYPE, STRUCT_TYPE>::migrate(
+        unsigned int maxPoints)
+    {
+        if (!m_oldStructure)
+            return false;
+
+        for (unsigned int i = 0; (i < maxPoints && !m_pendingPoints.empty());
+            i++)
+        {
+            const Point<D, ELEM_TYPE>& p = m_pendingPoints.back();
+            // Points removed since growing started are skipped. The
+            // overflow set hashes exact coordinates, so it may have held a
+            // point which the structure treats as equal to this one, in
+            // which case this point is merged with it.
+            if (m_oldStructure->remove(p) && !m_structure->insert(p))
+                m_numPoints--;
+            m_pendingPoints.pop_back();
+        }
+
+        if (m_pendingPoints.empty())
+        {
+            delete m_oldStructure;
+            m_oldStructure = NULL;
+            // Release memory used by list
+            StoredPointList(m_pendingPoints.get_allocator()).swap(
+                m_pendingPoints);
+            return false;
+        }
+        return true;
+    }
+
+    template<int D, typename ELEM_TYPE, typename STRUCT_TYPE>
+    inline
+    bool GrowableIndex<D, ELEM_TYPE, STRUCT_TYPE>::isGrowing() const
+    {
+        return (m_oldStructure != NULL);
+    }
+
+    template<int D, typename ELEM_TYPE, typename STRUCT_TYPE>
+    inline
+    const Boundary<D, ELEM_TYPE>&
+        GrowableIndex<D, ELEM_TYPE, STRUCT_TYPE>::boundary() const
+    {
+        return m_boundary;
+    }
+
+    template<int D, typename ELEM_TYPE, typename STRUCT_TYPE>
+    inline
+    unsigned int GrowableIndex<D, ELEM_TYPE, STRUCT_TYPE>::numPoints() const
+    {
+        return m_numPoints;
+    }
+
+    template<int D, typename ELEM_TYPE, typename STRUCT_TYPE>
+    inline
+    unsigned int
+        GrowableIndex<D, ELEM_TYPE, STRUCT_TYPE>::numOverflowPoints() const
+    {
+        return m_overflowPoints.size();
+    }
+
+    template<int D, typename ELEM_TYPE, typename STRUCT_TYPE>
+    inline
+    unsigned int GrowableIndex<D, ELEM_TYPE, STRUCT_TYPE>::numGrowths() const
+    {
+        return m_numGrowths;
+    }
+
+    template<int D, typename ELEM_TYPE, typename STRUCT_TYPE>
+    MemoryUsage GrowableIndex<D, ELEM_TYPE, STRUCT_TYPE>::memoryUsage() const
+    {
+        MemoryUsage usage = m_structure->memoryUsage();
+        if (m_oldStructure)
+            usage += m_oldStructure->memoryUsage();
+        // Pending points are copies of points still in the old structure,
+        // so they're bookkeeping rather than payload
+        const std::size_t overflowBytes =
+            m_overflowPoints.size() * sizeof(Point<D, ELEM_TYPE>);
+        const std::size_t pendingBytes =
+            m_pendingPoints.size() * sizeof(Point<D, ELEM_TYPE>);
+        usage.payload += overflowBytes;
+        usage.hashOverhead += m_overflowMemory.bytes - overflowBytes;
+        usage.nodes += pendingBytes;
+        usage.slack += m_listMemory.bytes - pendingBytes;
+        return usage;
+    }
+
+    template<int D, typename ELEM_TYPE, typename STRUCT_TYPE>
+    inline
+    void GrowableIndex<D, ELEM_TYPE, STRUCT_TYPE>::update()
+    {
+        if (m_oldStructure)
+        {
+            migrate(m_migrationStep);
+        }
+        else if (m_overflowPoints.size() >= m_minOverflowPoints
+            && m_overflowPoints.size() > m_overflowFraction * m_numPoints)
+        {
+            grow();
+        }
+    }
+
+    template<int D, typename ELEM_TYPE, typename STRUCT_TYPE>
+    void GrowableIndex<D, ELEM_TYPE, STRUCT_TYPE>::grow()
+    {
+        // Extend each side of the boundary the overflow points lie past,
+        // leaving extra room in that direction for future points
+        Boundary<D, ELEM_TYPE> newBoundary = m_boundary;
+        for (typename OverflowSet::const_iterator it = m_overflowPoints.begin();
+            (it != m_overflowPoints.end()); it++)
+        {
+            for (unsigned int d = 0; (d < D); d++)
+            {
+                newBoundary[d].min = std::min(newBoundary[d].min, (*it)[d]);
+                newBoundary[d].max = std::max(newBoundary[d].max, (*it)[d]);
+            }
+        }
+        for (unsigned int d = 0; (d < D); d++)
+        {
+            ELEM_TYPE range = newBoundary[d].max - newBoundary[d].min;
+            if (range <= 0)
+                range = 1;
+            const ELEM_TYPE extra =
+                static_cast<ELEM_TYPE>(range * m_growthFactor);
+            if (newBoundary[d].min < m_boundary[d].min)
+                newBoundary[d].min -= extra;
+            if (newBoundary[d].max > m_boundary[d].max)
+                newBoundary[d].max += extra;
+        }
+
+        // Every stored point needs to be moved, so take a snapshot of them
+        // to move a few at a time
+        const PointList storedPoints = m_structure->rangeQuery(m_boundary);
+        m_pendingPoints.assign(storedPoints.begin(), storedPoints.end());
+        m_oldStructure = m_structure;
+        m_structure = new STRUCT_TYPE(newBoundary);
+        m_boundary = newBoundary;
+        // The structure may store overflow points which are within
+        // EPSILON of each other as one point
+        for (typename OverflowSet::const_iterator it = m_overflowPoints.begin();
+            (it != m_overflowPoints.end()); it++)
+        {
+            if (!m_structure->insert(*it))
+                m_numPoints--;
+        }
+        // Release memory used by the set's buckets
+        OverflowSet(0, PointHash(), std::equal_to< Point<D, ELEM_TYPE> >(),
+            m_overflowPoints.get_allocator()).swap(m_overflowPoints);
+        m_numGrowths++;
+    }
+
+}
+
+#endif
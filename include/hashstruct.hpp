@@ -43,7 +43,10 @@ THE SOFTWARE.
 
 #include "types.hpp" // for HashType
 #include "point.hpp"
+#include "memory_usage.hpp"
 #include <boost/unordered_map.hpp>
+#include <algorithm>
+#include <functional>
 
 namespace mdsearch
 {
@@ -57,8 +60,9 @@ namespace mdsearch
      * NOTE: This does NOT perform a check to ensure the given index
      * is within the bounds of the vector -- this be done by the calling
      * code. */
-    template <typename T>
-    inline void removeElementAtIndex(std::vector<T>& vec, unsigned int index)
+    template <typename T, typename ALLOCATOR>
+    inline void removeElementAtIndex(std::vector<T, ALLOCATOR>& vec,
+                                     unsigned int index)
     {
         std::iter_swap(vec.begin() + index, vec.end() - 1);
         vec.erase(vec.end() - 1);
@@ -71,6 +75,13 @@ namespace mdsearch
     {
 
     public:
+        typedef std::vector< Point<D, ELEM_TYPE> > PointList;
+
+        /** Construct empty structure. */
+        HashStructure();
+        /** Sub-classes can be deleted through a pointer to this class. */
+        virtual ~HashStructure() {}
+
         /** Clear all points currently stored in the structure. */
         void clear();
 
@@ -87,6 +98,15 @@ namespace mdsearch
         /** Return true if the given point is being stored in the structure. */
         bool query(const Point<D, ELEM_TYPE>& point);
 
+        /** Insert all given points into the structure. Points are hashed in
+         * blocks, so sub-classes can compute the keys of several points at
+         * once. Returns the number of points that were inserted. */
+        unsigned int insertBatch(const PointList& points);
+
+        /** Query all given points. After returning, the ith element of
+         * 'results' is true if the ith point is stored in the structure. */
+        void queryBatch(const PointList& points, std::vector<bool>& results);
+
         /** Return total number of points currently stored in the structure. */
         unsigned int numPointsStored() const;
         /** Return total number of buckets in structure. */
@@ -98,22 +118,47 @@ namespace mdsearch
         /** Return maximum number of points stored in a single bucket. */
         unsigned int maxPointsPerBucket() const;
 
+        /** Return memory used by the hash map, its buckets and the points
+         * stored in them. */
+        MemoryUsage memoryUsage() const;
+
     protected:
+        typedef CountingAllocator< Point<D, ELEM_TYPE> > PointAllocator;
+        typedef CountingAllocator<ELEM_TYPE> SumAllocator;
+
         /** Structure used to store all points with the same hash value. */
         struct Bucket
         {
+            /** Construct empty bucket, whose points and sums are stored
+             * using the given allocator. */
+            explicit Bucket(const PointAllocator& allocator)
+            : points(allocator), pointSums(SumAllocator(allocator))
+            {
+            }
+
             /** Stores all points in bucket. */
-            std::vector< Point<D, ELEM_TYPE> > points;
+            std::vector<Point<D, ELEM_TYPE>, PointAllocator> points;
             /* Vector that corresponds with 'points'. For each point, this
              * stores its summed coordinates. Used for optimisation search
              * through buckets. */
-             std::vector<ELEM_TYPE> pointSums;
+             std::vector<ELEM_TYPE, SumAllocator> pointSums;
         };
 
+        /** Number of points hashed at once by the batch operations. */
+        static const unsigned int HASH_BATCH_SIZE = 256;
+
         /** Retrieve bucket containing given point.
          * Return NULL if no bucket contains the point. */
         Bucket* getContainingBucket(const Point<D, ELEM_TYPE>& point);
 
+        /** Retrieve bucket with given key.
+         * Return NULL if there is no bucket with the key. */
+        Bucket* getBucket(HashType key);
+
+        /** Insert point into the bucket with given key, creating the
+         * bucket if it doesn't exist. 'key' must be the point's hash. */
+        bool insertWithKey(const Point<D, ELEM_TYPE>& point, HashType key);
+
         /** Get index of given point in given bucket.
          * Return -1 if point could not be found in bucket. */
         int getPointIndexInBucket(const Point<D, ELEM_TYPE>& point,
@@ -123,21 +168,52 @@ namespace mdsearch
          * Must be implemented by suc-classes. */
         virtual HashType hashPoint(const Point<D, ELEM_TYPE>& p) = 0;
 
+        /** Hashes each of the given points, storing the ith point's key in
+         * keys[i]. Sub-classes can override this with a faster way of
+         * hashing many points, but must produce the same keys as
+         * hashPoint(). By default, hashPoint() is called for each point. */
+        virtual void hashPoints(const Point<D, ELEM_TYPE>* points,
+                                unsigned int numPoints, HashType* keys);
+
+        /** Called when a new bucket is created for the given key.
+         * Sub-classes can override this to maintain other indices over the
+         * keys of the hash map. Buckets are never destroyed, except when the
+         * structure is cleared. */
+        virtual void bucketCreated(HashType key);
+
         /** Maps 1D hash values to buckets. */
-        typedef boost::unordered_map<HashType, Bucket> OneDMap;
+        typedef boost::unordered_map<HashType, Bucket, boost::hash<HashType>,
+            std::equal_to<HashType>,
+            CountingAllocator< std::pair<const HashType, Bucket> > > OneDMap;
+        /** Memory allocated for the points in buckets and their sums. */
+        MemoryCounter m_pointMemory;
+        /** Memory allocated for the hash map, and any other indices
+         * sub-classes maintain over its keys. */
+        MemoryCounter m_tableMemory;
         /** Unordered_map for storing the points. Key = hashed 1D
          * representation of point, value = list of points. */
         OneDMap m_hashMap;
 
+    private:
+        // Disable copying, since the allocators count into this structure
+        HashStructure(const HashStructure& other);
+        HashStructure& operator=(const HashStructure& other);
+
     };
 
+    template<int D, typename ELEM_TYPE>
+    HashStructure<D, ELEM_TYPE>::HashStructure()
+    : m_hashMap(typename OneDMap::allocator_type(&m_tableMemory))
+    {
+    }
+
     template<int D, typename ELEM_TYPE>
     inline
     void HashStructure<D, ELEM_TYPE>::clear()
     {
         // NOTE: Using assignment not clear() to ensure memory is de-allocated
         // (through destructors of containers)
-        m_hashMap = OneDMap();
+        m_hashMap = OneDMap(m_hashMap.get_allocator());
     }
 
     template<int D, typename ELEM_TYPE>
@@ -145,7 +221,14 @@ namespace mdsearch
     bool HashStructure<D, ELEM_TYPE>::insert(const Point<D, ELEM_TYPE>& point)
     {
         // Retrieve containing bucket by hashing point into key
-        HashType searchKey = hashPoint(point);
+        return insertWithKey(point, hashPoint(point));
+    }
+
+    template<int D, typename ELEM_TYPE>
+    inline
+    bool HashStructure<D, ELEM_TYPE>::insertWithKey(
+        const Point<D, ELEM_TYPE>& point, HashType searchKey)
+    {
         // Search underlying 1D structure to find point's bucket
         Bucket* bucket = NULL;
         typename OneDMap::iterator it = m_hashMap.find(searchKey);
@@ -168,10 +251,11 @@ namespace mdsearch
         }
         else // if bucket does not exist for point, create it!
         {
-            Bucket newBucket;
+            Bucket& newBucket = m_hashMap.try_emplace(searchKey,
+                PointAllocator(&m_pointMemory)).first->second;
             newBucket.points.push_back(point);
             newBucket.pointSums.push_back(point.sum());
-            m_hashMap[searchKey] = newBucket;
+            bucketCreated(searchKey);
             return true;
         }
     }
@@ -216,6 +300,48 @@ namespace mdsearch
         return (bucket && (getPointIndexInBucket(point, bucket) != -1));
     }
 
+    template<int D, typename ELEM_TYPE>
+    unsigned int HashStructure<D, ELEM_TYPE>::insertBatch(
+        const PointList& points)
+    {
+        HashType keys[HASH_BATCH_SIZE];
+        unsigned int numInserted = 0;
+        for (unsigned int start = 0; (start < points.size());
+            start += HASH_BATCH_SIZE)
+        {
+            unsigned int count = std::min<unsigned int>(HASH_BATCH_SIZE,
+                points.size() - start);
+            hashPoints(&points[start], count, keys);
+            for (unsigned int i = 0; (i < count); i++)
+            {
+                if (insertWithKey(points[start + i], keys[i]))
+                    numInserted++;
+            }
+        }
+        return numInserted;
+    }
+
+    template<int D, typename ELEM_TYPE>
+    void HashStructure<D, ELEM_TYPE>::queryBatch(const PointList& points,
+        std::vector<bool>& results)
+    {
+        HashType keys[HASH_BATCH_SIZE];
+        results.resize(points.size());
+        for (unsigned int start = 0; (start < points.size());
+            start += HASH_BATCH_SIZE)
+        {
+            unsigned int count = std::min<unsigned int>(HASH_BATCH_SIZE,
+                points.size() - start);
+            hashPoints(&points[start], count, keys);
+            for (unsigned int i = 0; (i < count); i++)
+            {
+                Bucket* bucket = getBucket(keys[i]);
+                results[start + i] = (bucket
+                    && getPointIndexInBucket(points[start + i], bucket) != -1);
+            }
+        }
+    }
+
     template<int D, typename ELEM_TYPE>
     inline
     unsigned int HashStructure<D, ELEM_TYPE>::numPointsStored() const
@@ -269,6 +395,37 @@ namespace mdsearch
         return maxCount;
     }
 
+    template<int D, typename ELEM_TYPE>
+    MemoryUsage HashStructure<D, ELEM_TYPE>::memoryUsage() const
+    {
+        const std::size_t numPoints = numPointsStored();
+        const std::size_t bucketBytes = numBuckets() * sizeof(Bucket);
+        const std::size_t sumBytes = numPoints * sizeof(ELEM_TYPE);
+        MemoryUsage usage;
+        usage.payload = numPoints * sizeof(Point<D, ELEM_TYPE>);
+        usage.nodes = bucketBytes + sumBytes;
+        usage.hashOverhead = m_tableMemory.bytes - bucketBytes;
+        usage.slack = m_pointMemory.bytes - usage.payload - sumBytes;
+        return usage;
+    }
+
+    template<int D, typename ELEM_TYPE>
+    inline
+    void HashStructure<D, ELEM_TYPE>::bucketCreated(HashType)
+    {
+    }
+
+    template<int D, typename ELEM_TYPE>
+    void HashStructure<D, ELEM_TYPE>::hashPoints(
+        const Point<D, ELEM_TYPE>* points, unsigned int numPoints,
+        HashType* keys)
+    {
+        for (unsigned int i = 0; (i < numPoints); i++)
+        {
+            keys[i] = hashPoint(points[i]);
+        }
+    }
+
     template<int D, typename ELEM_TYPE>
     inline
     typename HashStructure<D, ELEM_TYPE>::Bucket*
@@ -276,7 +433,14 @@ namespace mdsearch
         const Point<D, ELEM_TYPE>& point)
     {
         // Hash point into one-dimensional key
-        HashType searchKey = hashPoint(point);
+        return getBucket(hashPoint(point));
+    }
+
+    template<int D, typename ELEM_TYPE>
+    inline
+    typename HashStructure<D, ELEM_TYPE>::Bucket*
+    HashStructure<D, ELEM_TYPE>::getBucket(HashType searchKey)
+    {
         // Search underlying structure to find point's bucket
         typename OneDMap::iterator it = m_hashMap.find(searchKey);
         if (it != m_hashMap.end())
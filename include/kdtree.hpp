@@ -38,7 +38,9 @@ THE SOFTWARE.
 #define MDSEARCH_KDTREE_H
 
 #include "point.hpp"
+#include "memory_usage.hpp"
 #include <algorithm>
+#include <new>
 
 namespace mdsearch
 {
@@ -69,7 +71,15 @@ namespace mdsearch
         /** Return true if the given point is being stored in the structure. */
         bool query(const Point<D, ELEM_TYPE>& point);
 
+        /** Return memory used by the tree's nodes. Each node stores one
+         * point, so there is no slack. */
+        MemoryUsage memoryUsage() const;
+
     private:
+        // Disable copying, since the node allocator counts into this tree
+        KDTree(const KDTree& other);
+        KDTree& operator=(const KDTree& other);
+
         /* Represents single node in point kd-tree structure. */
         struct Node
         {
@@ -88,14 +98,13 @@ namespace mdsearch
             {
 
             }
-
-            /** Delete node and both of its children. */
-            ~Node()
-            {
-                delete leftChild;
-                delete rightChild;
-            }
         };
+        typedef CountingAllocator<Node> NodeAllocator;
+
+        /** Allocate leaf node that stores given point. */
+        Node* createNode(const Point<D, ELEM_TYPE>& p);
+        /** Delete node and all of its children. */
+        void destroyNode(Node* node);
 
         /** Given the current dimension used to cut the data space, return
          * the next dimension that should be used. */
@@ -116,26 +125,30 @@ namespace mdsearch
                                                unsigned int cuttingDim);
 
     private:
+        /** Memory allocated for nodes. */
+        MemoryCounter m_nodeMemory;
+        NodeAllocator m_nodeAllocator;
         /** Root node of tree. */
         Node* m_root;
 
     };
 
     template<int D, typename ELEM_TYPE>
-    KDTree<D, ELEM_TYPE>::KDTree() : m_root(NULL)
+    KDTree<D, ELEM_TYPE>::KDTree()
+    : m_nodeAllocator(&m_nodeMemory), m_root(NULL)
     {
     }
 
     template<int D, typename ELEM_TYPE>
     KDTree<D, ELEM_TYPE>::~KDTree()
     {
-        delete m_root;
+        destroyNode(m_root);
     }
 
     template<int D, typename ELEM_TYPE>
     void KDTree<D, ELEM_TYPE>::clear()
     {
-        delete m_root;
+        destroyNode(m_root);
         m_root = NULL;
     }
 
@@ -153,7 +166,7 @@ namespace mdsearch
         {
             if (current == NULL)
             {
-                current = new Node(p);
+                current = createNode(p);
                 // Assign parent's correct child pointer to new node
                 if (previous)
                 {
@@ -221,6 +234,34 @@ namespace mdsearch
         return removed;
     }
 
+    template<int D, typename ELEM_TYPE>
+    MemoryUsage KDTree<D, ELEM_TYPE>::memoryUsage() const
+    {
+        MemoryUsage usage;
+        usage.payload = m_nodeMemory.blocks * sizeof(Point<D, ELEM_TYPE>);
+        usage.nodes = m_nodeMemory.bytes - usage.payload;
+        return usage;
+    }
+
+    template<int D, typename ELEM_TYPE>
+    typename KDTree<D, ELEM_TYPE>::Node* KDTree<D, ELEM_TYPE>::createNode(
+        const Point<D, ELEM_TYPE>& p)
+    {
+        Node* node = m_nodeAllocator.allocate(1);
+        return new (node) Node(p);
+    }
+
+    template<int D, typename ELEM_TYPE>
+    void KDTree<D, ELEM_TYPE>::destroyNode(Node* node)
+    {
+        if (node == NULL)
+            return;
+        destroyNode(node->leftChild);
+        destroyNode(node->rightChild);
+        node->~Node();
+        m_nodeAllocator.deallocate(node, 1);
+    }
+
     template<int D, typename ELEM_TYPE>
     inline
     unsigned int KDTree<D, ELEM_TYPE>::nextCuttingDimension(
@@ -245,7 +286,9 @@ namespace mdsearch
             node->leftChild = recursiveRemove(node->leftChild, p,
                 nextCuttingDimension(cuttingDim), removed);
         }
-        else if (p[cuttingDim] > node->point[cuttingDim])
+        // Points with the same coordinate in the cutting dimension are
+        // stored in the right subtree, like insert() does
+        else if (!(p == node->point))
         {
             node->rightChild = recursiveRemove(node->rightChild, p,
                 nextCuttingDimension(cuttingDim), removed);
@@ -257,7 +300,7 @@ namespace mdsearch
             {
                 // Set 'removed' flag to true to signal success
                 *removed = true;
-                delete node;
+                destroyNode(node);
                 return NULL; // to remove reference to node in parent
             }
             else
@@ -0,0 +1,223 @@
+/******************************************************************************
+
+mdsearch - Lightweight C++ library implementing a collection of
+           multi-dimensional search structures
+
+File:        latency_histogram.hpp
+Description: Histogram of latencies with logarithmically sized buckets, which
+             records values in constant time and reports percentiles with a
+             bounded relative error.
+
+*******************************************************************************
+
+The MIT License (MIT)
+
+Copyright (c) 2014 Donald Whyte
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+******************************************************************************/
+
+#ifndef MDSEARCH_LATENCY_HISTOGRAM_H
+#define MDSEARCH_LATENCY_HISTOGRAM_H
+
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace mdsearch
+{
+
+    /** Counts integer values (e.g. latencies in clock ticks) in buckets
+     * laid out like an HDR histogram. Values below 2^PRECISION_BITS each
+     * have their own bucket. Above that, every power of two range is
+     * split into 2^(PRECISION_BITS - 1) equally sized buckets, so the
+     * width of a value's bucket is at most 1 / 2^(PRECISION_BITS - 1) of
+     * the value. Recording a value is a few instructions and memory use is
+     * fixed, regardless of the number or range of values.
+     *
+     * PRECISION_BITS = 7 gives a relative error below 1.6% using ~30KB. */
+    template<int PRECISION_BITS = 7>
+    class LatencyHistogram
+    {
+
+    public:
+        static const uint64_t SUB_BUCKET_COUNT = 1 << PRECISION_BITS;
+        static const uint64_t HALF_SUB_BUCKET_COUNT = SUB_BUCKET_COUNT / 2;
+        static const unsigned int NUM_BUCKETS = (64 - PRECISION_BITS + 1)
+            * HALF_SUB_BUCKET_COUNT + HALF_SUB_BUCKET_COUNT;
+
+        LatencyHistogram();
+
+        /** Add given value to histogram. */
+        void record(uint64_t value);
+        /** Add every value recorded by another histogram to this one. */
+        void merge(const LatencyHistogram& other);
+        /** Remove every recorded value. */
+        void clear();
+
+        /** Return number of values recorded. */
+        uint64_t count() const;
+        /** Return exact smallest value recorded, or 0 if there are none. */
+        uint64_t min() const;
+        /** Return exact largest value recorded, or 0 if there are none. */
+        uint64_t max() const;
+        /** Return exact mean of the values recorded, or 0 if there are
+         * none. */
+        double mean() const;
+        /** Return exact sum of the values recorded. */
+        uint64_t total() const;
+        /** Return smallest value which at least 'percentile' percent of
+         * the recorded values are less than or equal to, rounded up to the
+         * top of its bucket (but never above max()). Returns 0 if no
+         * values have been recorded. */
+        uint64_t valueAtPercentile(double percentile) const;
+
+        /** Return index of bucket that given value is counted in. */
+        static unsigned int bucketIndex(uint64_t value);
+        /** Return largest value counted in the bucket with given index. */
+        static uint64_t bucketUpperBound(unsigned int index);
+
+    private:
+        std::vector<uint64_t> m_counts;
+        uint64_t m_count;
+        uint64_t m_min;
+        uint64_t m_max;
+        uint64_t m_total;
+
+    };
+
+    template<int PRECISION_BITS>
+    LatencyHistogram<PRECISION_BITS>::LatencyHistogram()
+    : m_counts(NUM_BUCKETS, 0), m_count(0), m_min(0), m_max(0), m_total(0)
+    {
+    }
+
+    template<int PRECISION_BITS>
+    inline unsigned int LatencyHistogram<PRECISION_BITS>::bucketIndex(
+        uint64_t value)
+    {
+        if (value < SUB_BUCKET_COUNT)
+            return static_cast<unsigned int>(value);
+        // Shift value so its most significant bit is in the top half of
+        // the sub-buckets
+        const unsigned int highestBit = 63 - __builtin_clzll(value);
+        const unsigned int shift = highestBit - (PRECISION_BITS - 1);
+        return static_cast<unsigned int>(shift * HALF_SUB_BUCKET_COUNT
+            + (value >> shift));
+    }
+
+    template<int PRECISION_BITS>
+    inline uint64_t LatencyHistogram<PRECISION_BITS>::bucketUpperBound(
+        unsigned int index)
+    {
+        if (index < SUB_BUCKET_COUNT)
+            return index;
+        const unsigned int shift = index / HALF_SUB_BUCKET_COUNT - 1;
+        const uint64_t subBucket = index - shift * HALF_SUB_BUCKET_COUNT;
+        return (subBucket << shift) + ((uint64_t(1) << shift) - 1);
+    }
+
+    template<int PRECISION_BITS>
+    inline void LatencyHistogram<PRECISION_BITS>::record(uint64_t value)
+    {
+        m_counts[bucketIndex(value)]++;
+        if (m_count == 0 || value < m_min)
+            m_min = value;
+        m_max = std::max(m_max, value);
+        m_total += value;
+        m_count++;
+    }
+
+    template<int PRECISION_BITS>
+    void LatencyHistogram<PRECISION_BITS>::merge(const LatencyHistogram& other)
+    {
+        if (other.m_count == 0)
+            return;
+        for (unsigned int i = 0; (i < NUM_BUCKETS); i++)
+            m_counts[i] += other.m_counts[i];
+        m_min = (m_count == 0) ? other.m_min : std::min(m_min, other.m_min);
+        m_max = std::max(m_max, other.m_max);
+        m_total += other.m_total;
+        m_count += other.m_count;
+    }
+
+    template<int PRECISION_BITS>
+    void LatencyHistogram<PRECISION_BITS>::clear()
+    {
+        std::fill(m_counts.begin(), m_counts.end(), 0);
+        m_count = 0;
+        m_min = 0;
+        m_max = 0;
+        m_total = 0;
+    }
+
+    template<int PRECISION_BITS>
+    inline uint64_t LatencyHistogram<PRECISION_BITS>::count() const
+    {
+        return m_count;
+    }
+
+    template<int PRECISION_BITS>
+    inline uint64_t LatencyHistogram<PRECISION_BITS>::min() const
+    {
+        return m_min;
+    }
+
+    template<int PRECISION_BITS>
+    inline uint64_t LatencyHistogram<PRECISION_BITS>::max() const
+    {
+        return m_max;
+    }
+
+    template<int PRECISION_BITS>
+    inline double LatencyHistogram<PRECISION_BITS>::mean() const
+    {
+        return (m_count == 0) ? 0.0 : static_cast<double>(m_total) / m_count;
+    }
+
+    template<int PRECISION_BITS>
+    inline uint64_t LatencyHistogram<PRECISION_BITS>::total() const
+    {
+        return m_total;
+    }
+
+    template<int PRECISION_BITS>
+    uint64_t LatencyHistogram<PRECISION_BITS>::valueAtPercentile(
+        double percentile) const
+    {
+        if (m_count == 0)
+            return 0;
+        percentile = std::min(std::max(percentile, 0.0), 100.0);
+        const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(
+            std::ceil(percentile / 100.0 * m_count)));
+        uint64_t seen = 0;
+        for (unsigned int i = bucketIndex(m_min); (i < NUM_BUCKETS); i++)
+        {
+            seen += m_counts[i];
+            if (seen >= rank)
+                return std::min(bucketUpperBound(i), m_max);
+        }
+        return m_max;
+    }
+
+}
+
+#endif
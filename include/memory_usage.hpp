@@ -0,0 +1,235 @@
+/******************************************************************************
+
+mdsearch - Lightweight C++ library implementing a collection of
+           multi-dimensional search structures
+
+File:        memory_usage.hpp
+Description: Allocator for standard containers and nodes that counts the
+             memory they use, and a breakdown of the memory used by an index
+             structure.
+
+*******************************************************************************
+
+The MIT License (MIT)
+
+Copyright (c) 2014 Donald Whyte
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+******************************************************************************/
+
+#ifndef MDSEARCH_MEMORY_USAGE_H
+#define MDSEARCH_MEMORY_USAGE_H
+
+#include "aligned_allocator.hpp"
+#include <cstddef>
+#include <type_traits>
+
+namespace mdsearch
+{
+
+    /** Number of bytes and blocks currently allocated through all the
+     * CountingAllocators that share this counter. */
+    struct MemoryCounter
+    {
+        MemoryCounter();
+
+        /** Bytes currently allocated. */
+        std::size_t bytes;
+        /** Number of allocations which haven't been de-allocated yet. */
+        std::size_t blocks;
+    };
+
+    /** Allocates storage like AlignedAllocator, and adds the size of every
+     * allocation to a MemoryCounter (and subtracts it when de-allocated).
+     * Allocators constructed without a counter count nothing.
+     *
+     * The allocator is propagated when containers are copied, moved or
+     * swapped, so storage always stays with the counter it was counted in.
+     * Structures using it must not be copied, since the allocators of the
+     * copy would still point to the original's counters. */
+    template<typename T, std::size_t ALIGNMENT = 1>
+    class CountingAllocator
+    {
+
+    public:
+        typedef T value_type;
+        typedef std::true_type propagate_on_container_copy_assignment;
+        typedef std::true_type propagate_on_container_move_assignment;
+        typedef std::true_type propagate_on_container_swap;
+        typedef std::false_type is_always_equal;
+
+        template<typename U>
+        struct rebind
+        {
+            typedef CountingAllocator<U, ALIGNMENT> other;
+        };
+
+        /** Construct allocator which doesn't count its allocations. */
+        CountingAllocator();
+        /** Construct allocator which counts its allocations in 'counter'. */
+        explicit CountingAllocator(MemoryCounter* counter);
+
+        template<typename U>
+        CountingAllocator(const CountingAllocator<U, ALIGNMENT>& other);
+
+        /** Allocate uninitialised storage for 'n' objects. */
+        T* allocate(std::size_t n);
+
+        /** De-allocate storage previously returned by allocate(). */
+        void deallocate(T* p, std::size_t n);
+
+        /** Return counter allocations are counted in, or NULL. */
+        MemoryCounter* counter() const;
+
+    private:
+        MemoryCounter* m_counter;
+
+    };
+
+    /** Memory used by an index structure, split by what it's used for. All
+     * values are in bytes. */
+    struct MemoryUsage
+    {
+        MemoryUsage();
+
+        /** Total of all the categories. */
+        std::size_t total() const;
+        /** Return total number of bytes used for each of 'numPoints'
+         * points, or 0 if there are no points. */
+        double bytesPerPoint(std::size_t numPoints) const;
+
+        MemoryUsage& operator+=(const MemoryUsage& other);
+
+        /** Tree nodes and bucket records (excluding the points stored in
+         * them), plus any data cached for each point. */
+        std::size_t nodes;
+        /** Stored points themselves, i.e. the number of points times the
+         * size of each. */
+        std::size_t payload;
+        /** Hash tables' bucket arrays and links, keys and other indices
+         * over the buckets. */
+        std::size_t hashOverhead;
+        /** Storage reserved for points (and their cached data) which isn't
+         * being used. */
+        std::size_t slack;
+    };
+
+    inline MemoryCounter::MemoryCounter() : bytes(0), blocks(0)
+    {
+    }
+
+    template<typename T, std::size_t ALIGNMENT>
+    inline
+    CountingAllocator<T, ALIGNMENT>::CountingAllocator() : m_counter(NULL)
+    {
+    }
+
+    template<typename T, std::size_t ALIGNMENT>
+    inline
+    CountingAllocator<T, ALIGNMENT>::CountingAllocator(MemoryCounter* counter)
+    : m_counter(counter)
+    {
+    }
+
+    template<typename T, std::size_t ALIGNMENT>
+    template<typename U>
+    inline
+    CountingAllocator<T, ALIGNMENT>::CountingAllocator(
+        const CountingAllocator<U, ALIGNMENT>& other)
+    : m_counter(other.counter())
+    {
+    }
+
+    template<typename T, std::size_t ALIGNMENT>
+    inline
+    T* CountingAllocator<T, ALIGNMENT>::allocate(std::size_t n)
+    {
+        T* p = AlignedAllocator<T, ALIGNMENT>().allocate(n);
+        if (m_counter)
+        {
+            m_counter->bytes += n * sizeof(T);
+            m_counter->blocks++;
+        }
+        return p;
+    }
+
+    template<typename T, std::size_t ALIGNMENT>
+    inline
+    void CountingAllocator<T, ALIGNMENT>::deallocate(T* p, std::size_t n)
+    {
+        AlignedAllocator<T, ALIGNMENT>().deallocate(p, n);
+        if (m_counter)
+        {
+            m_counter->bytes -= n * sizeof(T);
+            m_counter->blocks--;
+        }
+    }
+
+    template<typename T, std::size_t ALIGNMENT>
+    inline
+    MemoryCounter* CountingAllocator<T, ALIGNMENT>::counter() const
+    {
+        return m_counter;
+    }
+
+    /** Counting allocators are interchangeable if they count in the same
+     * counter. */
+    template<typename T, typename U, std::size_t ALIGNMENT>
+    inline bool operator==(const CountingAllocator<T, ALIGNMENT>& a,
+                           const CountingAllocator<U, ALIGNMENT>& b)
+    {
+        return (a.counter() == b.counter());
+    }
+
+    template<typename T, typename U, std::size_t ALIGNMENT>
+    inline bool operator!=(const CountingAllocator<T, ALIGNMENT>& a,
+                           const CountingAllocator<U, ALIGNMENT>& b)
+    {
+        return (a.counter() != b.counter());
+    }
+
+    inline MemoryUsage::MemoryUsage()
+    : nodes(0), payload(0), hashOverhead(0), slack(0)
+    {
+    }
+
+    inline std::size_t MemoryUsage::total() const
+    {
+        return nodes + payload + hashOverhead + slack;
+    }
+
+    inline double MemoryUsage::bytesPerPoint(std::size_t numPoints) const
+    {
+        return (numPoints == 0)
+            ? 0.0 : static_cast<double>(total()) / numPoints;
+    }
+
+    inline MemoryUsage& MemoryUsage::operator+=(const MemoryUsage& other)
+    {
+        nodes += other.nodes;
+        payload += other.payload;
+        hashOverhead += other.hashOverhead;
+        slack += other.slack;
+        return *this;
+    }
+
+}
+
+#endif
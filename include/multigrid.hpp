@@ -17,6 +17,16 @@ Description: Contains an implementation of the Multigrid Tree.
              case, all points will be in the same cell, meaning these
              operations will take O(n) time.
 
+             Large collections of points can be bulk loaded. This computes
+             the cell of every point (in parallel if OpenMP is enabled) and
+             sorts the points by cell, so each node of the tree is built
+             once, rather than repeatedly splitting leaves.
+
+             Since the cells preserve the ordering of each coordinate, the
+             grid also supports range queries (by enumerating the cells that
+             overlap the query region) and k-nearest neighbour queries (by
+             searching outwards from the query point's cell, ring by ring).
+
 *******************************************************************************
 
 The MIT License (MIT)
@@ -46,32 +56,75 @@ THE SOFTWARE.
 #ifndef MDSEARCH_MULTIGRID_H
 #define MDSEARCH_MULTIGRID_H
 
+#include "types.hpp"
 #include "point.hpp"
 #include "boundary.hpp"
-#include <stack>
+#include "radix_sort.hpp"
+#include "memory_usage.hpp"
+#include "distance.hpp"
+#include "ordered_index.hpp"
+#include <cmath>
+#include <queue>
+#include <limits>
+#include <utility>
 #include <boost/unordered_map.hpp>
 #include <algorithm>
 
 namespace mdsearch
 {
 
+    /** Node of a Multigrid Tree.
+     *
+     * Leaves store the coordinates of their points inline, in
+     * structure-of-arrays form: the values of the first dimension for all
+     * points in the leaf, followed by the values of the second dimension
+     * and so on. This keeps a leaf's points contiguous in memory, so leaf
+     * scans read sequential values of a single dimension. Each column is
+     * aligned in the same way as the storage of points. */
+    template<int D, typename ELEM_TYPE>
     struct MultigridNode
     {
-        /** Construct empty leaf node. */
-        MultigridNode();
+        /** Maps cell coordinates to child nodes. */
+        typedef boost::unordered_map<HashType, MultigridNode,
+            boost::hash<HashType>, std::equal_to<HashType>,
+            CountingAllocator< std::pair<const HashType, MultigridNode> > >
+            ChildMap;
+        /** Allocates child maps themselves, counting them with the maps'
+         * contents. */
+        typedef CountingAllocator<ChildMap> ChildMapAllocator;
+        /** Allocates coordinates, aligned like points. */
+        typedef CountingAllocator<ELEM_TYPE,
+            PointStorage<D, ELEM_TYPE>::ALIGNMENT> CoordinateAllocator;
+        /** Storage for coordinates. */
+        typedef std::vector<ELEM_TYPE, CoordinateAllocator> CoordinateList;
+
+        /** Construct empty leaf node, whose coordinates are stored using
+         * the given allocator. */
+        explicit MultigridNode(const CoordinateAllocator& allocator);
         /** Recursively delete child nodes. */
         ~MultigridNode();
 
-        /** Add point to node. If node is a leaf and it has enough space,
-         * the point will be stored. If the node is not a leaf, it will
-         * hash the point and store it inside one of its children. */
-        void addPoint(int pointIndex);
+        /** Ensure leaf has space for the given number of points, without
+         * having to re-allocate its storage. Capacity is rounded up so
+         * every column stays aligned. */
+        void reserve(unsigned int newCapacity);
+
+        /** Add point to leaf node. The point is NOT checked for duplicates. */
+        void addPoint(const Point<D, ELEM_TYPE>& p);
+
+        /** Remove point with given index from leaf node. The last point in
+         * the leaf is moved into the removed point's place. */
+        void removePoint(unsigned int index);
+
+        /** Return index of given point in leaf node, or -1 if the point is
+         * not stored in the leaf. */
+        int findPoint(const Point<D, ELEM_TYPE>& p) const;
+
+        /** Return copy of the point with the given index in the leaf. */
+        Point<D, ELEM_TYPE> getPoint(unsigned int index) const;
 
-        /** Remove point with given index from node. If node is not a leaf,
-         * it will try and remove the node from its children.
-         * Return true if point was removed and false if point was not stored
-         * in this node. */
-        bool removePoint(int pointIndex);
+        /** Return values of the dth coordinate of all points in the leaf. */
+        const ELEM_TYPE* column(int d) const;
 
         /** Return number of points stored DIRECTLY in this node. Contents of
          * child nodes are ignored. Hence, this will always return 0 if node
@@ -80,13 +133,20 @@ namespace mdsearch
 
         /** True if node is a leaf, and stores points. */
         bool isLeaf;
-        /** Indices of points contained in bucket.
+        /** Number of points contained in bucket.
          * Only used if node is a leaf. */
-        std::vector<int> pointIndices;
+        unsigned int count;
+        /** Maximum number of points the bucket can store before its
+         * coordinate storage has to grow. */
+        unsigned int capacity;
+        /** Coordinates of points contained in bucket, stored column by
+         * column. Value of dth coordinate of ith point is stored at
+         * (d * capacity + i). Only used if node is a leaf. */
+        CoordinateList coordinates;
 
-        /** Indices of points contained in bucket.
+        /** Child nodes, keyed by the cell the points are contained in.
          * Only used if node is a non-leaf. */
-        boost::unordered_map<HashType, MultigridNode>* children;
+        ChildMap* children;
 
     };
 
@@ -95,24 +155,43 @@ namespace mdsearch
      * by cutting each dimension into B intervals. A cell is defined by
      * the interval of each dimension it is contained in, meaning there
      * are a total of B^d cells, where d is the number of dimensions.
+     *
+     * Each point is quantised into integer cell coordinates once per
+     * operation. The cell coordinates of the first k dimensions are fused
+     * into a single key for the root level of the tree, where k is the
+     * largest number of dimensions whose combined key fits in a HashType.
+     * This means the first k levels are resolved with a single probe.
+     *
+     * NOTE: Points outside of the boundary are clamped into the outermost
+     * cells. Use GrowableIndex to keep them separate and grow the
+     * boundary instead.
     */
     template<int D, typename ELEM_TYPE>
     class Multigrid
     {
 
     public:
+        typedef std::vector< Point<D, ELEM_TYPE> > PointList;
+
         /** Construct Multigrid Tree to cover given boundary.
          *
          * \param m_intervalsPerDimension determines how many buckets will be
          * used for each dimension. More buckets means more discrimination
          * and less points in each bucket, on average.
          *
-         * \param m_bucketSize determines initial amount of memory a bucket
-         * reserves to store points.
+         * \param m_bucketSize is the number of points a bucket stores before
+         * it is split. Buckets start with space for a single point and
+         * double their storage as points are added, so sparse cells don't
+         * reserve space they never use.
+         *
+         * \param maxFusedLevels is the maximum number of dimensions fused
+         * into the root level's key. Less dimensions are fused if the
+         * combined key would not fit into a HashType.
         */
         Multigrid(const Boundary<D, ELEM_TYPE>& boundary,
-            ELEM_TYPE m_intervalsPerDimension = 1000000000,
-            int m_bucketSize = 8);
+            double m_intervalsPerDimension = 1000000000,
+            unsigned int m_bucketSize = 8,
+            int maxFusedLevels = D);
 
         /** Clear all points in Multigrid Tree and reset its spatial
          * boundary. */
@@ -131,32 +210,123 @@ namespace mdsearch
         /** Return true if the given point is being stored in the structure. */
         bool query(const Point<D, ELEM_TYPE>& point);
 
+        /** Insert all given points into the structure. Duplicate points are
+         * only inserted once. Returns number of points inserted.
+         *
+         * If the structure is empty, the tree is built directly from the
+         * points sorted by cell. Each node is created once and leaves are
+         * never split. Otherwise, points are inserted one at a time. */
+        unsigned int bulkLoad(const PointList& points);
+
+        /** Return all stored points that lie inside the given region
+         * (inclusive). Only the cells overlapping the region's interval
+         * in each level's dimension are visited. Root cells are found
+         * with an ordered index of their keys, so the whole root level
+         * doesn't have to be scanned. */
+        PointList rangeQuery(const Boundary<D, ELEM_TYPE>& region);
+
+        /** Return the k stored points closest to the given point (using
+         * Euclidean distance), sorted by increasing distance. If less than
+         * k points are stored, all stored points are returned.
+         *
+         * The search starts with a box around the query point which would
+         * contain about k points if the stored points were spread evenly
+         * over the boundary. The box doubles in size until the k closest
+         * points found are guaranteed to be the k nearest neighbours, and
+         * only the ring added by each doubling is searched. */
+        PointList knn(const Point<D, ELEM_TYPE>& point, unsigned int k);
+
         /** Return total number of points stored. */
         int numPoints() const;
         /** Return total number of buckets stored. */
         int numBuckets() const;
         /** Return average number of points in each bucket. */
         double averageBucketSize() const;
+        /** Return number of dimensions fused into the root level's key. */
+        int numFusedLevels() const;
+
+        /** Return memory used by the tree's nodes, the maps between them
+         * and the coordinates stored in the leaves. */
+        MemoryUsage memoryUsage() const;
 
     private:
+        typedef MultigridNode<D, ELEM_TYPE> NodeType;
         /** Maps 1D point hash values into Multigrid Tree nodes. */
-        typedef boost::unordered_map<HashType, MultigridNode> BucketMap;
+        typedef typename NodeType::ChildMap BucketMap;
+        /** Key of a root node paired with the node, which doesn't move
+         * while it's in the map. */
+        typedef std::pair<HashType, NodeType*> RootEntry;
+        typedef BasicOrderedKeyIndex<RootEntry> RootIndex;
+
+        // Disable copying, since the allocators count into this tree
+        Multigrid(const Multigrid& other);
+        Multigrid& operator=(const Multigrid& other);
+
+        /** Integer coordinates of the cell a point is contained in. */
+        struct Cell
+        {
+            HashType index[D];
+        };
 
         /** Return total number of buckets in given map,by recursively
          * searching through it. */
         int numBuckets(const BucketMap& map) const;
-        /** Insert point into given bucket. The given dimension is used to hash
-         * the point. */
+        /** Point's position in the list of points being bulk loaded, paired
+         * with the key of the cell it's contained in. */
+        typedef std::pair<HashType, unsigned int> KeyedPoint;
+        /** Build node from points being bulk loaded. The range [first, last)
+         * of 'sorted' contains the points that belong in the node.
+         * 'currentDim' is the dimension used to hash the node's children.
+         * Returns number of points inserted. */
+        unsigned int buildNode(NodeType& node,
+                               const PointList& points,
+                               std::vector<KeyedPoint>& sorted,
+                               std::size_t first, std::size_t last,
+                               int currentDim);
+
+        /** Collect all points in the given node (and its children) that are
+         * contained in the given region. 'nextDim' is the dimension used to
+         * hash the keys of the node's children. */
+        void rangeQuery(const NodeType& node,
+                        int nextDim,
+                        const Boundary<D, ELEM_TYPE>& region,
+                        PointList& results) const;
+        /** Collect all points in the root map that are contained in the
+         * given region. */
+        void rangeQueryRoot(const Boundary<D, ELEM_TYPE>& region,
+                            PointList& results) const;
+        /** Collect all points contained in the region 'outer' but not in
+         * the region 'inner', which must be inside 'outer'. */
+        void rangeQueryRing(const Boundary<D, ELEM_TYPE>& outer,
+                            const Boundary<D, ELEM_TYPE>& inner,
+                            PointList& results) const;
+        /** Insert point into given bucket. The given dimension of the
+         * point's cell is used to hash the point. */
         bool insertIntoBucket(const Point<D, ELEM_TYPE>& p,
+                              const Cell& cell,
                               int currentDim,
-                              MultigridNode* currentBucket);
-        /** Normalise value into 0-1 range based on min-max interval. */
-        ELEM_TYPE normaliseCoord(ELEM_TYPE coord, ELEM_TYPE min, ELEM_TYPE max);
-        /** Hash point using the vale of its dth coordinate. */
-        HashType hashPoint(const Point<D, ELEM_TYPE>& p, int d);
+                              NodeType* currentBucket);
+        /** Compute per-dimension scale factors used to quantise points
+         * into cells, using the current boundary. */
+        void computeCellScales();
+        /** Quantise all coordinates of point into the integer coordinates
+         * of its cell. */
+        void computeCell(const Point<D, ELEM_TYPE>& p, Cell& cell) const;
+        /** Quantise a value of the dth coordinate into the integer
+         * coordinate of its cell. */
+        HashType cellIndex(ELEM_TYPE value, int d) const;
+        /** Combine the cell coordinates of the fused dimensions into a
+         * single key for the root level. */
+        HashType rootKey(const Cell& cell) const;
         /** Retrieve pointer to bucket that contains points that have the
          * given hash value. */
-        MultigridNode* getBucketPointer(BucketMap* map, ELEM_TYPE hashValue);
+        NodeType* getBucketPointer(BucketMap* map, HashType hashValue);
+        /** Return bucket in given map with the given hash value, creating
+         * an empty leaf if there isn't one. */
+        NodeType& getOrCreateBucket(BucketMap& map, HashType hashValue);
+        /** Turn given node into a non-leaf with no children. The node's
+         * points must be moved into its children by the caller. */
+        void createChildren(NodeType& node);
 
 
         /** Spatial boundary covered by Multigrid Tree. */
@@ -164,59 +334,198 @@ namespace mdsearch
         /** Determines how many buckets will be used for each dimension.
          * More buckets means more discrimination and less points in each
          * bucket, on average. */
-        ELEM_TYPE m_intervalsPerDimension;
-        /** Determines initial amount of memory a bucket reserves to store
+        HashType m_intervalsPerDimension;
+        /** Number of points a bucket stores before it is split. */
+        unsigned int m_bucketSize;
+        /** Number of dimensions whose cell coordinates are fused into the
+         * root level's key. */
+        int m_numFusedLevels;
+        /** Number of bits each fused dimension's cell coordinate takes up
+         * in the root level's key. */
+        int m_bitsPerDimension;
+        /** Lower bound of each dimension, used to quantise points. */
+        double m_cellOrigin[D];
+        /** Number of cells per unit of each dimension, used to quantise
          * points. */
-        int m_bucketSize;
-        /** Stores root Multigrid Tree nodes. These are accessed by hashing the
-         * value of a point's FIRST coordinate. */
+        double m_cellScale[D];
+        /** Memory allocated for the maps of nodes (including the nodes
+         * themselves, which are stored in the maps). */
+        MemoryCounter m_tableMemory;
+        /** Memory allocated for the coordinates of points in leaves. */
+        MemoryCounter m_pointMemory;
+        /** Stores root Multigrid Tree nodes. These are accessed by fusing
+         * the cell coordinates of a point's first few dimensions. */
         BucketMap m_rootBuckets;
-        /** Contains all points stored in tree. */
-        std::vector< Point<D, ELEM_TYPE> > m_points;
-        /** Marks elements in 'points' vector as being unused. These will be
-         * re-used when points are inserted in the future. */
-        std::stack<int> m_unusedIndices;
+        /** Sorted keys of the root nodes, used to find the root cells a
+         * range query overlaps without probing the map. Root nodes are only
+         * removed when the tree is cleared. */
+        RootIndex m_rootKeys;
+        /** Total number of points stored in tree. */
+        int m_numPoints;
+        /** Total number of nodes in tree. Nodes are only removed when the
+         * tree is cleared. */
+        std::size_t m_numNodes;
 
     };
 
-    MultigridNode::MultigridNode() : isLeaf(true), children(NULL)
+    template<int D, typename ELEM_TYPE>
+    MultigridNode<D, ELEM_TYPE>::MultigridNode(
+        const CoordinateAllocator& allocator)
+    : isLeaf(true), count(0), capacity(0), coordinates(allocator),
+      children(NULL)
+    {
+    }
+
+    template<int D, typename ELEM_TYPE>
+    MultigridNode<D, ELEM_TYPE>::~MultigridNode()
+    {
+        if (children)
+        {
+            ChildMapAllocator allocator(children->get_allocator());
+            children->~ChildMap();
+            allocator.deallocate(children, 1);
+        }
+    }
+
+    template<int D, typename ELEM_TYPE>
+    void MultigridNode<D, ELEM_TYPE>::reserve(unsigned int newCapacity)
+    {
+        if (newCapacity <= capacity)
+            return;
+        static const unsigned int BLOCK_SIZE =
+            PointStorage<D, ELEM_TYPE>::BLOCK_SIZE;
+        newCapacity = ((newCapacity + BLOCK_SIZE - 1) / BLOCK_SIZE)
+            * BLOCK_SIZE;
+
+        // Copy each column into its position in the larger storage
+        CoordinateList newCoordinates(newCapacity * D, ELEM_TYPE(),
+                                      coordinates.get_allocator());
+        for (unsigned int d = 0; (d < D); d++)
+        {
+            std::copy(coordinates.begin() + d * capacity,
+                      coordinates.begin() + d * capacity + count,
+                      newCoordinates.begin() + d * newCapacity);
+        }
+        coordinates.swap(newCoordinates);
+        capacity = newCapacity;
+    }
+
+    template<int D, typename ELEM_TYPE>
+    inline
+    void MultigridNode<D, ELEM_TYPE>::addPoint(const Point<D, ELEM_TYPE>& p)
+    {
+        if (count == capacity)
+            reserve(std::max(1u, capacity * 2));
+        for (unsigned int d = 0; (d < D); d++)
+            coordinates[d * capacity + count] = p[d];
+        count++;
+    }
+
+    template<int D, typename ELEM_TYPE>
+    inline
+    void MultigridNode<D, ELEM_TYPE>::removePoint(unsigned int index)
     {
+        count--;
+        for (unsigned int d = 0; (d < D); d++)
+            coordinates[d * capacity + index] = coordinates[d * capacity + count];
     }
 
-    MultigridNode::~MultigridNode()
+    template<int D, typename ELEM_TYPE>
+    int MultigridNode<D, ELEM_TYPE>::findPoint(
+        const Point<D, ELEM_TYPE>& p) const
     {
-        delete children;
+        // Scan blocks of points, using the first dimension to build a mask
+        // of candidates. The mask is built without branches, so the compiler
+        // can vectorise it. Only candidates have their remaining dimensions
+        // checked.
+        static const unsigned int BLOCK_SIZE = 32;
+        if (count == 0)
+            return -1;
+        const ELEM_TYPE* firstColumn = column(0);
+        const ELEM_TYPE value = p[0];
+        for (unsigned int start = 0; (start < count); start += BLOCK_SIZE)
+        {
+            const unsigned int end = std::min(count, start + BLOCK_SIZE);
+            unsigned int candidates = 0;
+            for (unsigned int i = start; (i < end); i++)
+            {
+                candidates |= static_cast<unsigned int>(
+                    compare(firstColumn[i], value) == 0) << (i - start);
+            }
+
+            for (unsigned int index = start; (candidates); index++)
+            {
+                const bool isCandidate = (candidates & 1);
+                candidates >>= 1;
+                if (!isCandidate)
+                    continue;
+                bool matches = true;
+                for (unsigned int d = 1; (d < D); d++)
+                {
+                    if (compare(coordinates[d * capacity + index], p[d]) != 0)
+                    {
+                        matches = false;
+                        break;
+                    }
+                }
+                if (matches)
+                    return index;
+            }
+        }
+        return -1;
     }
 
+    template<int D, typename ELEM_TYPE>
     inline
-    void MultigridNode::addPoint(int pointIndex)
+    Point<D, ELEM_TYPE> MultigridNode<D, ELEM_TYPE>::getPoint(
+        unsigned int index) const
     {
-        pointIndices.push_back(pointIndex);
+        Point<D, ELEM_TYPE> p;
+        for (unsigned int d = 0; (d < D); d++)
+            p[d] = coordinates[d * capacity + index];
+        return p;
     }
 
+    template<int D, typename ELEM_TYPE>
     inline
-    bool MultigridNode::removePoint(int pointIndex)
+    const ELEM_TYPE* MultigridNode<D, ELEM_TYPE>::column(int d) const
     {
-        pointIndices.erase(
-            std::remove(pointIndices.begin(), pointIndices.end(), pointIndex),
-            pointIndices.end()
-        );
-        return true;
+        return &coordinates[0] + d * capacity;
     }
 
+    template<int D, typename ELEM_TYPE>
     inline
-    std::size_t MultigridNode::numPoints() const
+    std::size_t MultigridNode<D, ELEM_TYPE>::numPoints() const
     {
-        return pointIndices.size();
+        return count;
     }
 
     template<int D, typename ELEM_TYPE>
     Multigrid<D, ELEM_TYPE>::Multigrid(const Boundary<D, ELEM_TYPE>& boundary,
-        ELEM_TYPE m_intervalsPerDimension, int m_bucketSize) :
+        double m_intervalsPerDimension, unsigned int m_bucketSize,
+        int maxFusedLevels) :
         boundary(boundary),
-        m_intervalsPerDimension(m_intervalsPerDimension),
-        m_bucketSize(m_bucketSize)
+        m_intervalsPerDimension(
+            std::max<HashType>(1, static_cast<HashType>(m_intervalsPerDimension))),
+        m_bucketSize(m_bucketSize),
+        m_rootBuckets(typename BucketMap::allocator_type(&m_tableMemory)),
+        m_rootKeys(typename RootIndex::KeyAllocator(&m_tableMemory)),
+        m_numPoints(0),
+        m_numNodes(0)
     {
+        // Fuse as many dimensions as possible into the root key, without
+        // the combined key overflowing
+        m_bitsPerDimension = 1;
+        while (m_bitsPerDimension < 62
+            && (static_cast<HashType>(1) << m_bitsPerDimension)
+                < this->m_intervalsPerDimension)
+        {
+            m_bitsPerDimension++;
+        }
+        m_numFusedLevels = std::max(1, std::min(
+            std::min(maxFusedLevels, D), 63 / m_bitsPerDimension));
+
+        computeCellScales();
     }
 
     template<int D, typename ELEM_TYPE>
@@ -225,59 +534,55 @@ namespace mdsearch
         const Boundary<D, ELEM_TYPE>& newBoundary)
     {
         boundary = newBoundary;
-        m_rootBuckets = BucketMap();
+        computeCellScales();
+        m_rootBuckets = BucketMap(m_rootBuckets.get_allocator());
+        m_rootKeys.clear();
+        m_numPoints = 0;
+        m_numNodes = 0;
     }
 
     template<int D, typename ELEM_TYPE>
     bool Multigrid<D, ELEM_TYPE>::insert(const Point<D, ELEM_TYPE>& p)
     {
-        int currentDim = 0;
-        HashType pyVal = hashPoint(p, currentDim);
+        Cell cell;
+        computeCell(p, cell);
+        HashType key = rootKey(cell);
 
         // Find the next bucket to traverse
-        MultigridNode* nextBucket = getBucketPointer(&m_rootBuckets, pyVal);
+        NodeType* nextBucket = getBucketPointer(&m_rootBuckets, key);
         // If bucket not found, create new bucket and insert point into it
         if (!nextBucket)
         {
-            MultigridNode newBucket;
-            m_points.push_back(p);
-            newBucket.addPoint(m_points.size() - 1);
-            // Add new bucket to this pyramid tree
-            m_rootBuckets[pyVal] = newBucket;
-
+            NodeType& newBucket = getOrCreateBucket(m_rootBuckets, key);
+            newBucket.addPoint(p);
+            m_numPoints++;
             return true;
         }
         else
         {
-            currentDim++;
-            return insertIntoBucket(p, currentDim, nextBucket);
+            return insertIntoBucket(p, cell, m_numFusedLevels, nextBucket);
         }
     }
 
     template<int D, typename ELEM_TYPE>
     bool Multigrid<D, ELEM_TYPE>::query(const Point<D, ELEM_TYPE>& p)
     {
-        int currentDim = 0;
-        HashType pyVal = hashPoint(p, currentDim);
+        Cell cell;
+        computeCell(p, cell);
 
-        MultigridNode* currentBucket = getBucketPointer(&m_rootBuckets, pyVal);
-        currentDim++;
+        NodeType* currentBucket = getBucketPointer(
+            &m_rootBuckets, rootKey(cell));
+        int currentDim = m_numFusedLevels;
         while (currentBucket)
         {
             if (currentBucket->isLeaf)
             {
-                for (unsigned int i = 0; (i < currentBucket->numPoints()); i++)
-                {
-                    if (p == m_points[currentBucket->pointIndices[i]])
-                        return true;
-                }
-                return false;
+                return (currentBucket->findPoint(p) != -1);
             }
             else
             {
-                pyVal = hashPoint(p, currentDim);
                 currentBucket = getBucketPointer(
-                    currentBucket->children, pyVal);
+                    currentBucket->children, cell.index[currentDim]);
                 currentDim++;
             }
         }
@@ -287,31 +592,21 @@ namespace mdsearch
     template<int D, typename ELEM_TYPE>
     bool Multigrid<D, ELEM_TYPE>::remove(const Point<D, ELEM_TYPE>& p)
     {
-        int currentDim = 0;
-        HashType pyVal = hashPoint(p, currentDim);
+        Cell cell;
+        computeCell(p, cell);
 
-        MultigridNode* currentBucket = getBucketPointer(&m_rootBuckets, pyVal);
-        currentDim++;
+        NodeType* currentBucket = getBucketPointer(
+            &m_rootBuckets, rootKey(cell));
+        int currentDim = m_numFusedLevels;
         while (currentBucket)
         {
             if (currentBucket->isLeaf)
             {
-                int index = 0;
-                bool found = false;
-                for (index; (index < currentBucket->numPoints()); index++)
-                {
-                    if (p == m_points[currentBucket->pointIndices[index]])
-                    {
-                        found = true;
-                        break;
-                    }
-                }
-                if (found)
+                int index = currentBucket->findPoint(p);
+                if (index != -1)
                 {
-                    int pointIndex = currentBucket->pointIndices[index];
-                    currentBucket->removePoint(pointIndex);
-                    // Add index of removed point to list of unused indices
-                    m_unusedIndices.push(pointIndex);
+                    currentBucket->removePoint(index);
+                    m_numPoints--;
                     return true;
                 }
                 else
@@ -322,18 +617,181 @@ namespace mdsearch
             else
             {
                 currentBucket = getBucketPointer(currentBucket->children,
-                    hashPoint(p, currentDim));
+                    cell.index[currentDim]);
                 currentDim++;
             }
         }
         return false;
     }
 
+    template<int D, typename ELEM_TYPE>
+    unsigned int Multigrid<D, ELEM_TYPE>::bulkLoad(const PointList& points)
+    {
+        unsigned int numInserted = 0;
+        if (m_numPoints > 0)
+        {
+            for (unsigned int i = 0; (i < points.size()); i++)
+                numInserted += insert(points[i]);
+            return numInserted;
+        }
+
+        // Compute root key of every point in parallel, and sort the points
+        // by key so points in the same root cell are contiguous
+        const long numPoints = static_cast<long>(points.size());
+        std::vector<KeyedPoint> sorted(points.size());
+        #pragma omp parallel for
+        for (long i = 0; i < numPoints; i++)
+        {
+            Cell cell;
+            computeCell(points[i], cell);
+            sorted[i] = KeyedPoint(rootKey(cell), i);
+        }
+        radixSort(sorted);
+
+        // Emit each root cell's node in a single pass
+        std::size_t first = 0;
+        while (first < sorted.size())
+        {
+            std::size_t last = first + 1;
+            while (last < sorted.size() && sorted[last].first == sorted[first].first)
+                last++;
+            NodeType& node = getOrCreateBucket(m_rootBuckets,
+                                               sorted[first].first);
+            numInserted += buildNode(node, points, sorted, first, last,
+                                     m_numFusedLevels);
+            first = last;
+        }
+
+        m_numPoints += numInserted;
+        return numInserted;
+    }
+
+    template<int D, typename ELEM_TYPE>
+    typename Multigrid<D, ELEM_TYPE>::PointList
+    Multigrid<D, ELEM_TYPE>::rangeQuery(const Boundary<D, ELEM_TYPE>& region)
+    {
+        PointList results;
+        rangeQueryRoot(region, results);
+        return results;
+    }
+
+    template<int D, typename ELEM_TYPE>
+    typename Multigrid<D, ELEM_TYPE>::PointList
+    Multigrid<D, ELEM_TYPE>::knn(const Point<D, ELEM_TYPE>& p, unsigned int k)
+    {
+        PointList results;
+        const unsigned int totalPoints = numPoints();
+        if (k == 0 || totalPoints == 0)
+            return results;
+        k = std::min(k, totalPoints);
+
+        // Start with a box which would contain about k points if the
+        // stored points were spread evenly over the boundary
+        typedef typename DistanceType<ELEM_TYPE>::Type DistanceValue;
+        const double fraction = std::pow(
+            static_cast<double>(k) / totalPoints, 1.0 / D);
+        DistanceValue radius = 0;
+        for (unsigned int d = 0; (d < D); d++)
+        {
+            radius = std::max(radius, static_cast<DistanceValue>(fraction
+                * (static_cast<double>(boundary[d].max) - boundary[d].min)));
+        }
+        if (!(radius > 0))
+            radius = EPSILON;
+
+        // Boxes are clamped to the range of ELEM_TYPE, so integer
+        // coordinates don't overflow
+        const DistanceValue lowest = std::numeric_limits<ELEM_TYPE>::lowest();
+        const DistanceValue highest = std::numeric_limits<ELEM_TYPE>::max();
+        const DistanceValue unbounded =
+            std::numeric_limits<DistanceValue>::max();
+
+        // Every point found so far, and a max-heap of (squared distance,
+        // index) pairs containing the k closest of them
+        PointList found;
+        std::vector<DistanceValue> distances;
+        typedef std::pair<DistanceValue, unsigned int> Candidate;
+        std::priority_queue<Candidate> closest;
+        Boundary<D, ELEM_TYPE> searched;
+        while (true)
+        {
+            Boundary<D, ELEM_TYPE> box;
+            for (unsigned int d = 0; (d < D); d++)
+            {
+                box[d].min = static_cast<ELEM_TYPE>(
+                    std::max(lowest, p[d] - radius));
+                box[d].max = static_cast<ELEM_TYPE>(
+                    std::min(highest, p[d] + radius));
+            }
+            const std::size_t numSearched = found.size();
+            if (numSearched == 0)
+                rangeQueryRoot(box, found);
+            else
+                rangeQueryRing(box, searched, found);
+            searched = box;
+
+            const std::size_t numNew = found.size() - numSearched;
+            if (numNew > 0)
+            {
+                distances.resize(numNew);
+                distancesAoS<SquaredEuclideanDistance>(p, &found[numSearched],
+                    numNew, &distances[0]);
+            }
+            for (unsigned int i = 0; (i < numNew); i++)
+            {
+                if (closest.size() < k)
+                {
+                    closest.push(Candidate(distances[i], numSearched + i));
+                }
+                else if (distances[i] < closest.top().first)
+                {
+                    closest.pop();
+                    closest.push(Candidate(distances[i], numSearched + i));
+                }
+            }
+
+            // Every point closer to the query point than the nearest face
+            // of the searched box has been found, so if the kth closest
+            // point is no further away than that, no unsearched point can
+            // be closer. Faces clamped to the range of ELEM_TYPE have no
+            // points beyond them. Also stop if every stored point has
+            // already been found.
+            DistanceValue covered = unbounded;
+            for (unsigned int d = 0; (d < D); d++)
+            {
+                if (searched[d].min > lowest)
+                {
+                    covered = std::min(covered,
+                        static_cast<DistanceValue>(p[d]) - searched[d].min);
+                }
+                if (searched[d].max < highest)
+                {
+                    covered = std::min(covered,
+                        static_cast<DistanceValue>(searched[d].max) - p[d]);
+                }
+            }
+            if ((closest.size() == k && (covered == unbounded
+                    || closest.top().first <= covered * covered))
+                || found.size() >= totalPoints)
+            {
+                results.resize(closest.size());
+                for (int i = closest.size() - 1; (i >= 0); i--)
+                {
+                    results[i] = found[closest.top().second];
+                    closest.pop();
+                }
+                return results;
+            }
+            // Not enough points found yet -- search the next ring out
+            radius *= 2;
+        }
+    }
+
     template<int D, typename ELEM_TYPE>
     inline
     int Multigrid<D, ELEM_TYPE>::numPoints() const
     {
-        return m_points.size();
+        return m_numPoints;
     }
 
     template<int D, typename ELEM_TYPE>
@@ -347,7 +805,27 @@ namespace mdsearch
     inline
     double Multigrid<D, ELEM_TYPE>::averageBucketSize() const
     {
-        return m_points.size() / static_cast<double>(numBuckets());
+        return numPoints() / static_cast<double>(numBuckets());
+    }
+
+    template<int D, typename ELEM_TYPE>
+    inline
+    int Multigrid<D, ELEM_TYPE>::numFusedLevels() const
+    {
+        return m_numFusedLevels;
+    }
+
+    template<int D, typename ELEM_TYPE>
+    MemoryUsage Multigrid<D, ELEM_TYPE>::memoryUsage() const
+    {
+        // Nodes are stored inside the maps' allocations, so the rest of the
+        // maps' memory is their overhead
+        MemoryUsage usage;
+        usage.nodes = m_numNodes * sizeof(NodeType);
+        usage.hashOverhead = m_tableMemory.bytes - usage.nodes;
+        usage.payload = m_numPoints * D * sizeof(ELEM_TYPE);
+        usage.slack = m_pointMemory.bytes - usage.payload;
+        return usage;
     }
 
     template<int D, typename ELEM_TYPE>
@@ -355,7 +833,7 @@ namespace mdsearch
         const Multigrid<D, ELEM_TYPE>::BucketMap& map) const
     {
         int total = 0;
-        for (BucketMap::const_iterator it = map.begin();
+        for (typename BucketMap::const_iterator it = map.begin();
             (it != map.end()); it++)
         {
             if (it->second.isLeaf)
@@ -367,114 +845,424 @@ namespace mdsearch
     }
 
     template<int D, typename ELEM_TYPE>
-    bool Multigrid<D, ELEM_TYPE>::insertIntoBucket(
-        const Point<D, ELEM_TYPE>& p,
-        int currentDim,
-        MultigridNode* currentBucket)
+    unsigned int Multigrid<D, ELEM_TYPE>::buildNode(
+        NodeType& node,
+        const PointList& points,
+        std::vector<KeyedPoint>& sorted,
+        std::size_t first, std::size_t last,
+        int currentDim)
     {
-        if (currentBucket->isLeaf)
+        const std::size_t count = last - first;
+        // Store points directly if they fit in a single leaf (or if there
+        // aren't enough dimensions left to discriminate against)
+        if (count <= m_bucketSize || currentDim >= D)
         {
-            // Insert point into leaf since there's space!
-            // (or if there aren't enough dimensions to discriminate against)
-            if (currentBucket->numPoints() < m_bucketSize || currentDim < D)
+            unsigned int numInserted = 0;
+            node.reserve(count);
+            for (std::size_t i = first; (i < last); i++)
             {
-                for (unsigned int i = 0; (i < currentBucket->numPoints()); i++)
-                    if (p == m_points[currentBucket->pointIndices[i]])
-                        return false;
+                const Point<D, ELEM_TYPE>& p = points[sorted[i].second];
+                if (node.findPoint(p) == -1)
+                {
+                    node.addPoint(p);
+                    numInserted++;
+                }
+            }
+            return numInserted;
+        }
+
+        // Too many points for a leaf, so partition them using the cell
+        // they're contained in for this dimension
+        for (std::size_t i = first; (i < last); i++)
+        {
+            sorted[i].first = cellIndex(points[sorted[i].second][currentDim],
+                                        currentDim);
+        }
+        std::sort(sorted.begin() + first, sorted.begin() + last);
+
+        createChildren(node);
+        unsigned int numInserted = 0;
+        std::size_t childFirst = first;
+        while (childFirst < last)
+        {
+            std::size_t childLast = childFirst + 1;
+            while (childLast < last
+                && sorted[childLast].first == sorted[childFirst].first)
+            {
+                childLast++;
+            }
+            NodeType& child = getOrCreateBucket(*node.children,
+                                                sorted[childFirst].first);
+            numInserted += buildNode(child, points, sorted,
+                                     childFirst, childLast, currentDim + 1);
+            childFirst = childLast;
+        }
+        return numInserted;
+    }
+
+    template<int D, typename ELEM_TYPE>
+    void Multigrid<D, ELEM_TYPE>::rangeQueryRoot(
+        const Boundary<D, ELEM_TYPE>& region,
+        PointList& results) const
+    {
+        // Quantising preserves the order of coordinates, so only cells in
+        // these ranges can contain points inside the region
+        HashType minIndex[D];
+        HashType maxIndex[D];
+        std::size_t numCells = 1;
+        for (int d = 0; (d < m_numFusedLevels); d++)
+        {
+            minIndex[d] = cellIndex(region[d].min, d);
+            maxIndex[d] = cellIndex(region[d].max, d);
+            if (minIndex[d] > maxIndex[d])
+                return;
+            // Stop counting once there are more overlapping cells than
+            // cells stored in the root map
+            if (numCells <= m_rootBuckets.size())
+                numCells *= static_cast<std::size_t>(maxIndex[d] - minIndex[d]) + 1;
+        }
+
+        // Probe each overlapping cell directly if there are fewer of them
+        // than there are cells stored in the map. Otherwise, it is cheaper
+        // to decode each stored cell's key and filter by the ranges.
+        if (numCells <= m_rootBuckets.size())
+        {
+            Cell cell = Cell();
+            for (int d = 0; (d < m_numFusedLevels); d++)
+                cell.index[d] = minIndex[d];
+            while (true)
+            {
+                typename BucketMap::const_iterator it = m_rootBuckets.find(
+                    rootKey(cell));
+                if (it != m_rootBuckets.end())
+                    rangeQuery(it->second, m_numFusedLevels, region, results);
 
-                // Insert point, re-using an element for a removed point if
-                // possible
-                int pointIndex;
-                if (!m_unusedIndices.empty())
+                // Advance to the next cell, varying the last fused
+                // dimension fastest
+                int d = m_numFusedLevels - 1;
+                while (d >= 0 && cell.index[d] == maxIndex[d])
                 {
-                    pointIndex = m_unusedIndices.top();
-                    m_unusedIndices.pop();
+                    cell.index[d] = minIndex[d];
+                    d--;
                 }
+                if (d < 0)
+                    break;
+                cell.index[d]++;
+            }
+        }
+        else
+        {
+            // The first fused dimension is the most significant digit of a
+            // root key, so the keys of all overlapping cells lie between
+            // the keys of the region's lowest and highest cells (only the
+            // fused dimensions are used, but the rest are zeroed)
+            Cell lowest = Cell();
+            Cell highest = Cell();
+            for (int d = 0; (d < m_numFusedLevels); d++)
+            {
+                lowest.index[d] = minIndex[d];
+                highest.index[d] = maxIndex[d];
+            }
+            std::vector<RootEntry> entries;
+            m_rootKeys.findRange(rootKey(lowest), rootKey(highest), entries);
+            const HashType indexMask =
+                (static_cast<HashType>(1) << m_bitsPerDimension) - 1;
+            for (unsigned int i = 0; (i < entries.size()); i++)
+            {
+                // Keys in the range are already inside the region in the
+                // first fused dimension, so only decode the others
+                HashType key = entries[i].first;
+                bool overlaps = true;
+                for (int d = m_numFusedLevels - 1; (d > 0); d--)
+                {
+                    const HashType index = key & indexMask;
+                    key >>= m_bitsPerDimension;
+                    if (index < minIndex[d] || index > maxIndex[d])
+                    {
+                        overlaps = false;
+                        break;
+                    }
+                }
+                if (overlaps)
+                {
+                    rangeQuery(*entries[i].second, m_numFusedLevels, region,
+                               results);
+                }
+            }
+        }
+    }
+
+    template<int D, typename ELEM_TYPE>
+    void Multigrid<D, ELEM_TYPE>::rangeQueryRing(
+        const Boundary<D, ELEM_TYPE>& outer,
+        const Boundary<D, ELEM_TYPE>& inner,
+        PointList& results) const
+    {
+        // Split the ring into two slabs per dimension d, below and above
+        // the inner region. Slabs are inside the inner region in the
+        // dimensions before d, so each point belongs to the slab of the
+        // first dimension it's outside the inner region in.
+        for (unsigned int d = 0; (d < D); d++)
+        {
+            Boundary<D, ELEM_TYPE> slab(outer);
+            for (unsigned int e = 0; (e < d); e++)
+                slab[e] = inner[e];
+            for (unsigned int side = 0; (side < 2); side++)
+            {
+                if (side == 0 && outer[d].min < inner[d].min)
+                    slab[d] = Interval<ELEM_TYPE>(outer[d].min, inner[d].min);
+                else if (side == 1 && inner[d].max < outer[d].max)
+                    slab[d] = Interval<ELEM_TYPE>(inner[d].max, outer[d].max);
                 else
+                    continue;
+
+                // Slabs are inclusive, so drop points on the inner region's
+                // boundary, which belong to it or to a later slab
+                const std::size_t first = results.size();
+                rangeQueryRoot(slab, results);
+                std::size_t numKept = first;
+                for (std::size_t i = first; (i < results.size()); i++)
                 {
-                    pointIndex = m_points.size();
-                    m_points.push_back(p);
+                    if (results[i][d] < inner[d].min
+                        || results[i][d] > inner[d].max)
+                    {
+                        results[numKept++] = results[i];
+                    }
                 }
-                currentBucket->addPoint(pointIndex);
+                results.resize(numKept);
             }
-            // If no more space in bucket, turn into pyramid tree with
-            // (d - 1) dimensions
-            else
+        }
+    }
+
+    template<int D, typename ELEM_TYPE>
+    void Multigrid<D, ELEM_TYPE>::rangeQuery(
+        const NodeType& node,
+        int nextDim,
+        const Boundary<D, ELEM_TYPE>& region,
+        PointList& results) const
+    {
+        if (node.isLeaf)
+        {
+            // Calling the vectorised kernel on the leaf's columns only pays
+            // off for large leaves
+            static const unsigned int MIN_KERNEL_POINTS = 32;
+            static const unsigned int BLOCK_SIZE = 256;
+            if (node.count < MIN_KERNEL_POINTS)
             {
-                currentBucket->children =
-                    new boost::unordered_map<HashType, MultigridNode>();
-                currentBucket->isLeaf = false;
-                // Distribute currently stored points into the map, using the
-                // correct pyramid value
-                for (unsigned int i = 0; (i < currentBucket->numPoints()); i++)
+                for (unsigned int i = 0; (i < node.count); i++)
                 {
-                    insertIntoBucket(
-                        m_points[currentBucket->pointIndices[i]],
-                        currentDim, currentBucket);
+                    Point<D, ELEM_TYPE> p = node.getPoint(i);
+                    if (region.contains(p))
+                        results.push_back(p);
                 }
-                // Now all points have been inserted, clear point index array
-                // for new non-leaf
-                currentBucket->pointIndices.clear();
-                // Now insert the input point
-                insertIntoBucket(p, currentDim, currentBucket);
+                return;
             }
-            return true;
+            unsigned char inside[BLOCK_SIZE];
+            for (unsigned int start = 0; (start < node.count);
+                start += BLOCK_SIZE)
+            {
+                const unsigned int count = std::min(BLOCK_SIZE,
+                                                    node.count - start);
+                if (containsColumns(region, node.column(0) + start,
+                                    node.capacity, count, inside) == 0)
+                {
+                    continue;
+                }
+                for (unsigned int i = 0; (i < count); i++)
+                {
+                    if (inside[i])
+                        results.push_back(node.getPoint(start + i));
+                }
+            }
+            return;
         }
-        else // if non-leaf node - i.e. a pyramid tree!
+
+        const BucketMap& map = *(node.children);
+        HashType minIndex = cellIndex(region[nextDim].min, nextDim);
+        HashType maxIndex = cellIndex(region[nextDim].max, nextDim);
+        if (minIndex > maxIndex)
+            return;
+
+        // Probe each cell in the range directly if there are fewer of them
+        // than there are cells stored in the map. Otherwise, it is cheaper
+        // to filter the map's stored cells by the range.
+        if (static_cast<std::size_t>(maxIndex - minIndex) < map.size())
         {
-            HashType pyVal = hashPoint(p, currentDim);
-            MultigridNode* nextBucket = getBucketPointer(
-                currentBucket->children, pyVal);
-            // If bucket which would contain point does not exist
-            if (!nextBucket)
+            for (HashType index = minIndex; (index <= maxIndex); index++)
+            {
+                typename BucketMap::const_iterator it = map.find(index);
+                if (it != map.end())
+                    rangeQuery(it->second, nextDim + 1, region, results);
+            }
+        }
+        else
+        {
+            for (typename BucketMap::const_iterator it = map.begin();
+                (it != map.end()); it++)
             {
-                // Create new bucket and insert given point into it
-                MultigridNode newBucket;
-                m_points.push_back(p);
-                newBucket.addPoint(m_points.size() - 1);
-                // Add new bucket to this pyramid tree
-                (*currentBucket->children)[pyVal] = newBucket;
+                if (it->first >= minIndex && it->first <= maxIndex)
+                    rangeQuery(it->second, nextDim + 1, region, results);
+            }
+        }
+    }
 
+    template<int D, typename ELEM_TYPE>
+    bool Multigrid<D, ELEM_TYPE>::insertIntoBucket(
+        const Point<D, ELEM_TYPE>& p,
+        const Cell& cell,
+        int currentDim,
+        NodeType* currentBucket)
+    {
+        if (currentBucket->isLeaf)
+        {
+            // Insert point into leaf if it's already stored there, if
+            // there's space or if there aren't enough dimensions left to
+            // discriminate against
+            if (currentBucket->findPoint(p) != -1)
+            {
+                return false;
+            }
+            else if (currentBucket->numPoints() < m_bucketSize
+                || currentDim >= D)
+            {
+                currentBucket->addPoint(p);
+                m_numPoints++;
                 return true;
             }
+            // If no more space in bucket, split it using the next dimension
             else
             {
-                currentDim++;
-                return insertIntoBucket(p, currentDim, nextBucket);
+                createChildren(*currentBucket);
+                // Distribute currently stored points into the children,
+                // using the cell they're contained in for this dimension
+                Cell storedCell;
+                for (unsigned int i = 0; (i < currentBucket->numPoints()); i++)
+                {
+                    Point<D, ELEM_TYPE> stored = currentBucket->getPoint(i);
+                    computeCell(stored, storedCell);
+                    NodeType& child = getOrCreateBucket(
+                        *currentBucket->children, storedCell.index[currentDim]);
+                    child.addPoint(stored);
+                }
+                // Now all points have been moved, release the coordinate
+                // storage of the new non-leaf
+                currentBucket->count = 0;
+                currentBucket->capacity = 0;
+                typename NodeType::CoordinateList(
+                    currentBucket->coordinates.get_allocator()).swap(
+                        currentBucket->coordinates);
+                // Now insert the input point
+                return insertIntoBucket(p, cell, currentDim, currentBucket);
             }
         }
+        else // if non-leaf node
+        {
+            HashType key = cell.index[currentDim];
+            NodeType* nextBucket = getBucketPointer(
+                currentBucket->children, key);
+            // If bucket which would contain point does not exist, create it
+            // and insert given point into it
+            if (!nextBucket)
+                nextBucket = &getOrCreateBucket(*currentBucket->children, key);
+            return insertIntoBucket(p, cell, currentDim + 1, nextBucket);
+        }
+    }
+
+    template<int D, typename ELEM_TYPE>
+    void Multigrid<D, ELEM_TYPE>::computeCellScales()
+    {
+        for (unsigned int d = 0; (d < D); d++)
+        {
+            double extent = static_cast<double>(boundary[d].max)
+                - static_cast<double>(boundary[d].min);
+            m_cellOrigin[d] = static_cast<double>(boundary[d].min);
+            // Degenerate dimensions only have a single cell
+            m_cellScale[d] = (extent > 0)
+                ? (m_intervalsPerDimension / extent) : 0.0;
+        }
     }
 
     template<int D, typename ELEM_TYPE>
     inline
-    ELEM_TYPE Multigrid<D, ELEM_TYPE>::normaliseCoord(ELEM_TYPE coord,
-                                                      ELEM_TYPE min,
-                                                      ELEM_TYPE max)
+    void Multigrid<D, ELEM_TYPE>::computeCell(const Point<D, ELEM_TYPE>& p,
+                                              Cell& cell) const
     {
-        return (coord - min) / (max - min);
+        // Branch-free so the compiler can vectorise it across dimensions.
+        // Points outside of the boundary are clamped into the outermost
+        // cells.
+        const double lastCell = static_cast<double>(m_intervalsPerDimension - 1);
+        for (unsigned int d = 0; (d < D); d++)
+        {
+            double index = (static_cast<double>(p[d]) - m_cellOrigin[d])
+                * m_cellScale[d];
+            index = std::min(std::max(index, 0.0), lastCell);
+            cell.index[d] = static_cast<HashType>(index);
+        }
     }
 
     template<int D, typename ELEM_TYPE>
     inline
-    HashType Multigrid<D, ELEM_TYPE>::hashPoint(const Point<D, ELEM_TYPE>& p,
-                                                int d)
+    HashType Multigrid<D, ELEM_TYPE>::cellIndex(ELEM_TYPE value, int d) const
     {
-        return normaliseCoord(p[d], boundary[d].min, boundary[d].max)
-                 * m_intervalsPerDimension;
+        double index = (static_cast<double>(value) - m_cellOrigin[d])
+            * m_cellScale[d];
+        index = std::min(std::max(index, 0.0),
+                         static_cast<double>(m_intervalsPerDimension - 1));
+        return static_cast<HashType>(index);
     }
 
     template<int D, typename ELEM_TYPE>
     inline
-    MultigridNode* Multigrid<D, ELEM_TYPE>::getBucketPointer(
-        BucketMap* map, ELEM_TYPE hashValue)
+    HashType Multigrid<D, ELEM_TYPE>::rootKey(const Cell& cell) const
     {
-        BucketMap::iterator it = map->find(hashValue);
+        // Concatenate the bits of each cell coordinate. This is exact (and
+        // so can be decoded with shifts) since the number of fused
+        // dimensions is chosen so the key cannot overflow.
+        HashType key = cell.index[0];
+        for (int d = 1; (d < m_numFusedLevels); d++)
+            key = (key << m_bitsPerDimension) | cell.index[d];
+        return key;
+    }
+
+    template<int D, typename ELEM_TYPE>
+    inline
+    typename Multigrid<D, ELEM_TYPE>::NodeType*
+    Multigrid<D, ELEM_TYPE>::getBucketPointer(
+        BucketMap* map, HashType hashValue)
+    {
+        typename BucketMap::iterator it = map->find(hashValue);
         if (it == map->end())
             return NULL;
         else
             return &(it->second);
     }
 
+    template<int D, typename ELEM_TYPE>
+    typename Multigrid<D, ELEM_TYPE>::NodeType&
+    Multigrid<D, ELEM_TYPE>::getOrCreateBucket(BucketMap& map,
+                                               HashType hashValue)
+    {
+        std::pair<typename BucketMap::iterator, bool> result =
+            map.try_emplace(hashValue,
+                typename NodeType::CoordinateAllocator(&m_pointMemory));
+        if (result.second)
+        {
+            m_numNodes++;
+            if (&map == &m_rootBuckets)
+                m_rootKeys.insert(RootEntry(hashValue, &result.first->second));
+        }
+        return result.first->second;
+    }
+
+    template<int D, typename ELEM_TYPE>
+    void Multigrid<D, ELEM_TYPE>::createChildren(NodeType& node)
+    {
+        typename NodeType::ChildMapAllocator allocator(&m_tableMemory);
+        node.children = new (allocator.allocate(1)) BucketMap(
+            typename BucketMap::allocator_type(&m_tableMemory));
+        node.isLeaf = false;
+    }
+
 }
 
 #endif
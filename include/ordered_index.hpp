@@ -0,0 +1,214 @@
+/******************************************************************************
+
+mdsearch - Lightweight C++ library implementing a collection of
+           multi-dimensional search structures
+
+File:        ordered_index.hpp
+Description: Ordered index over one-dimensional hash keys. Hash-based
+             structures can maintain one of these alongside their hash map to
+             support queries over ranges of keys.
+
+             Keys are stored in a sorted array, plus a small unsorted buffer
+             of recently inserted keys. When the buffer fills up, it is sorted
+             and merged into the array. This keeps range searches cache
+             friendly (binary search followed by a sequential scan) while
+             keeping insertions cheap. Each key can be stored with a value,
+             such as a pointer to its bucket, to save looking keys up in the
+             hash map afterwards.
+
+*******************************************************************************
+
+The MIT License (MIT)
+
+Copyright (c) 2014 Donald Whyte
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+******************************************************************************/
+
+#ifndef MDSEARCH_ORDERED_INDEX_H
+#define MDSEARCH_ORDERED_INDEX_H
+
+#include "types.hpp" // for HashType
+#include "memory_usage.hpp"
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+namespace mdsearch
+{
+
+    /** Return the hash key of an entry of an ordered index. */
+    inline HashType entryKey(HashType key)
+    {
+        return key;
+    }
+
+    template<typename VALUE>
+    inline HashType entryKey(const std::pair<HashType, VALUE>& entry)
+    {
+        return entry.first;
+    }
+
+    /** Ordered set of one-dimensional hash keys, stored as a sorted array
+     * plus an unsorted buffer of recently inserted keys. ENTRY is either a
+     * HashType, or a std::pair of a HashType and a value stored with the
+     * key. */
+    template<typename ENTRY>
+    class BasicOrderedKeyIndex
+    {
+
+    public:
+        typedef CountingAllocator<ENTRY> KeyAllocator;
+
+        /** Construct empty index. */
+        BasicOrderedKeyIndex();
+        /** Construct empty index, whose keys are stored using the given
+         * allocator. */
+        explicit BasicOrderedKeyIndex(const KeyAllocator& allocator);
+
+        /** Remove all keys from index. */
+        void clear();
+
+        /** Add entry to index.
+         * ASSUMPTION: the entry's key is not already stored in the index.
+         * If this is not the case, range searches will return the key
+         * twice. */
+        void insert(const ENTRY& entry);
+
+        /** Append all stored entries whose keys are in the range
+         * [minKey, maxKey] to given vector, in no particular order. */
+        void findRange(HashType minKey, HashType maxKey,
+                       std::vector<ENTRY>& entries) const;
+
+        /** Return number of keys stored in index. */
+        std::size_t size() const;
+
+    private:
+        /** Sort buffered keys and merge them into the sorted array. */
+        void mergeBuffer();
+
+        /** Return true if the first entry's key is less than the second's. */
+        static bool lessKey(const ENTRY& a, const ENTRY& b);
+        /** Return true if the entry's key is less than the given key. */
+        static bool lessThanKey(const ENTRY& entry, HashType key);
+
+        /** Minimum number of keys the buffer holds before it's merged. */
+        static const std::size_t MIN_BUFFER_SIZE = 64;
+
+        typedef std::vector<ENTRY, KeyAllocator> KeyList;
+
+        /** Sorted array of keys. */
+        KeyList m_sortedKeys;
+        /** Recently inserted keys, which haven't been merged into the sorted
+         * array yet. */
+        KeyList m_bufferedKeys;
+
+    };
+
+    /** Ordered index of hash keys alone. */
+    typedef BasicOrderedKeyIndex<HashType> OrderedKeyIndex;
+
+    template<typename ENTRY>
+    BasicOrderedKeyIndex<ENTRY>::BasicOrderedKeyIndex()
+    {
+    }
+
+    template<typename ENTRY>
+    BasicOrderedKeyIndex<ENTRY>::BasicOrderedKeyIndex(
+        const KeyAllocator& allocator)
+    : m_sortedKeys(allocator), m_bufferedKeys(allocator)
+    {
+    }
+
+    template<typename ENTRY>
+    void BasicOrderedKeyIndex<ENTRY>::clear()
+    {
+        m_sortedKeys.clear();
+        m_bufferedKeys.clear();
+    }
+
+    template<typename ENTRY>
+    void BasicOrderedKeyIndex<ENTRY>::insert(const ENTRY& entry)
+    {
+        m_bufferedKeys.push_back(entry);
+        // Let buffer grow with the square root of the array's size, so the
+        // cost of merging is amortised over many insertions without making
+        // range searches scan a large buffer
+        std::size_t maxBufferSize = MIN_BUFFER_SIZE;
+        while (maxBufferSize * maxBufferSize < m_sortedKeys.size())
+            maxBufferSize *= 2;
+        if (m_bufferedKeys.size() >= maxBufferSize)
+            mergeBuffer();
+    }
+
+    template<typename ENTRY>
+    void BasicOrderedKeyIndex<ENTRY>::findRange(HashType minKey,
+        HashType maxKey, std::vector<ENTRY>& entries) const
+    {
+        typename KeyList::const_iterator it = std::lower_bound(
+            m_sortedKeys.begin(), m_sortedKeys.end(), minKey, lessThanKey);
+        for (; (it != m_sortedKeys.end() && entryKey(*it) <= maxKey); ++it)
+            entries.push_back(*it);
+        for (std::size_t i = 0; (i < m_bufferedKeys.size()); i++)
+        {
+            HashType key = entryKey(m_bufferedKeys[i]);
+            if (key >= minKey && key <= maxKey)
+                entries.push_back(m_bufferedKeys[i]);
+        }
+    }
+
+    template<typename ENTRY>
+    inline
+    std::size_t BasicOrderedKeyIndex<ENTRY>::size() const
+    {
+        return m_sortedKeys.size() + m_bufferedKeys.size();
+    }
+
+    template<typename ENTRY>
+    void BasicOrderedKeyIndex<ENTRY>::mergeBuffer()
+    {
+        std::sort(m_bufferedKeys.begin(), m_bufferedKeys.end(), lessKey);
+        std::size_t middle = m_sortedKeys.size();
+        m_sortedKeys.insert(m_sortedKeys.end(),
+                            m_bufferedKeys.begin(), m_bufferedKeys.end());
+        std::inplace_merge(m_sortedKeys.begin(),
+                           m_sortedKeys.begin() + middle,
+                           m_sortedKeys.end(), lessKey);
+        m_bufferedKeys.clear();
+    }
+
+    template<typename ENTRY>
+    inline
+    bool BasicOrderedKeyIndex<ENTRY>::lessKey(const ENTRY& a, const ENTRY& b)
+    {
+        return entryKey(a) < entryKey(b);
+    }
+
+    template<typename ENTRY>
+    inline
+    bool BasicOrderedKeyIndex<ENTRY>::lessThanKey(const ENTRY& entry,
+                                                  HashType key)
+    {
+        return entryKey(entry) < key;
+    }
+
+}
+
+#endif
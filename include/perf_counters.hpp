@@ -0,0 +1,313 @@
+/******************************************************************************
+
+mdsearch - Lightweight C++ library implementing a collection of
+           multi-dimensional search structures
+
+File:        perf_counters.hpp
+Description: Reads hardware performance counters (cycles, instructions,
+             cache, branch and TLB misses) of the calling thread with
+             Linux's perf_event_open, when the kernel permits it.
+
+*******************************************************************************
+
+The MIT License (MIT)
+
+Copyright (c) 2014 Donald Whyte
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+******************************************************************************/
+
+#ifndef MDSEARCH_PERF_COUNTERS_H
+#define MDSEARCH_PERF_COUNTERS_H
+
+#if defined(__linux__)
+    #include <linux/perf_event.h>
+    #include <sys/ioctl.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+#endif
+#include <stdint.h>
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace mdsearch
+{
+
+    enum PerfEvent
+    {
+        /** CPU cycles. */
+        CYCLES_EVENT = 0,
+        /** Instructions retired. */
+        INSTRUCTIONS_EVENT,
+        /** Level 1 data cache read misses. */
+        L1D_MISS_EVENT,
+        /** Last level cache misses. */
+        LLC_MISS_EVENT,
+        /** Mispredicted branches. */
+        BRANCH_MISS_EVENT,
+        /** Data TLB read misses. */
+        DTLB_MISS_EVENT,
+        NUM_PERF_EVENTS
+    };
+
+    /** Return short name of event (e.g. "llc_misses"). */
+    const char* perfEventName(PerfEvent event);
+
+    /** Value of every event at one point in time. */
+    struct PerfSample
+    {
+        PerfSample();
+
+        uint64_t values[NUM_PERF_EVENTS];
+    };
+
+    /** Counts hardware events in the calling thread, in user space only.
+     * The events are opened as a single group, so they're all counted over
+     * exactly the same instructions and read with one system call.
+     *
+     * Counters are often not permitted (e.g. if perf_event_paranoid is
+     * above 2 or in containers) or not supported (e.g. in virtual machines
+     * without a PMU, or on other platforms). open() then returns false,
+     * and callers should carry on without counting. Events the CPU doesn't
+     * support are left out of the group, and read as 0. */
+    class PerfCounters
+    {
+
+    public:
+        PerfCounters();
+        /** Close counters, if they're open. */
+        ~PerfCounters();
+
+        /** Open and start every supported event. Returns false if no
+         * events could be counted, in which case error() gives the
+         * reason. */
+        bool open();
+        /** Stop counting and close counters. */
+        void close();
+
+        /** Return true if counters are open. */
+        bool isOpen() const;
+        /** Return true if given event is being counted. */
+        bool isCounted(PerfEvent event) const;
+        /** Return reason the counters couldn't be opened. */
+        const std::string& error() const;
+
+        /** Read current value of every event into 'sample'. Returns false
+         * if the counters aren't open or couldn't be read. Reading costs a
+         * system call, so the events counted between two reads include a
+         * small constant overhead. */
+        bool read(PerfSample& sample);
+
+    private:
+        // Disable copying, since the counters own their file descriptors
+        PerfCounters(const PerfCounters& other);
+        PerfCounters& operator=(const PerfCounters& other);
+
+        /** Descriptor of each event's counter, or -1 if not counted. The
+         * first counted event leads the group. */
+        int m_descriptors[NUM_PERF_EVENTS];
+        /** Position of each event's value in a read of the group. */
+        unsigned int m_positions[NUM_PERF_EVENTS];
+        int m_leader;
+        unsigned int m_numCounted;
+        std::string m_error;
+        /** Buffer for reading the group: the number of values, the time
+         * enabled and running, then each value. */
+        std::vector<uint64_t> m_buffer;
+
+    };
+
+    inline const char* perfEventName(PerfEvent event)
+    {
+        static const char* NAMES[NUM_PERF_EVENTS] = {
+            "cycles", "instructions", "l1d_misses", "llc_misses",
+            "branch_misses", "dtlb_misses"
+        };
+        return (event < NUM_PERF_EVENTS) ? NAMES[event] : "";
+    }
+
+    inline PerfSample::PerfSample()
+    {
+        for (unsigned int e = 0; (e < NUM_PERF_EVENTS); e++)
+            values[e] = 0;
+    }
+
+    inline PerfCounters::PerfCounters()
+    : m_leader(-1), m_numCounted(0)
+    {
+        for (unsigned int e = 0; (e < NUM_PERF_EVENTS); e++)
+        {
+            m_descriptors[e] = -1;
+            m_positions[e] = 0;
+        }
+    }
+
+    inline PerfCounters::~PerfCounters()
+    {
+        close();
+    }
+
+    inline bool PerfCounters::open()
+    {
+        close();
+    #if defined(__linux__)
+        static const uint32_t TYPES[NUM_PERF_EVENTS] = {
+            PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE,
+            PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE
+        };
+        static const uint64_t READ_MISS = (PERF_COUNT_HW_CACHE_OP_READ << 8)
+            | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        static const uint64_t CONFIGS[NUM_PERF_EVENTS] = {
+            PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+            PERF_COUNT_HW_CACHE_L1D | READ_MISS, PERF_COUNT_HW_CACHE_MISSES,
+            PERF_COUNT_HW_BRANCH_MISSES, PERF_COUNT_HW_CACHE_DTLB | READ_MISS
+        };
+
+        int lastErrno = 0;
+        for (unsigned int e = 0; (e < NUM_PERF_EVENTS); e++)
+        {
+            perf_event_attr attributes;
+            std::memset(&attributes, 0, sizeof(attributes));
+            attributes.size = sizeof(attributes);
+            attributes.type = TYPES[e];
+            attributes.config = CONFIGS[e];
+            attributes.read_format = PERF_FORMAT_GROUP
+                | PERF_FORMAT_TOTAL_TIME_ENABLED
+                | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            // Counting kernel events needs more privileges
+            attributes.exclude_kernel = 1;
+            attributes.exclude_hv = 1;
+            // Group is started once every event has been added
+            attributes.disabled = (m_leader == -1);
+
+            const int descriptor = static_cast<int>(syscall(
+                __NR_perf_event_open, &attributes, 0, -1, m_leader, 0));
+            if (descriptor == -1)
+            {
+                lastErrno = errno;
+                continue;
+            }
+            if (m_leader == -1)
+                m_leader = descriptor;
+            m_descriptors[e] = descriptor;
+            m_positions[e] = m_numCounted++;
+        }
+
+        if (m_leader == -1)
+        {
+            m_error = std::string("perf_event_open failed: ")
+                + std::strerror(lastErrno);
+            if (lastErrno == EACCES || lastErrno == EPERM)
+                m_error += " (see /proc/sys/kernel/perf_event_paranoid)";
+            else if (lastErrno == ENOENT || lastErrno == EOPNOTSUPP)
+                m_error += " (no hardware counters available)";
+            return false;
+        }
+        m_buffer.resize(3 + m_numCounted);
+        ioctl(m_leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(m_leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+
+        // If the group is too large for the CPU's counters, it is never
+        // scheduled and nothing is counted
+        PerfSample sample;
+        if (!read(sample))
+        {
+            close();
+            m_error = "hardware counters could not be scheduled";
+            return false;
+        }
+        return true;
+    #else
+        m_error = "performance counters are only supported on Linux";
+        return false;
+    #endif
+    }
+
+    inline void PerfCounters::close()
+    {
+    #if defined(__linux__)
+        if (m_leader != -1)
+            ioctl(m_leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+        // Close members of the group before its leader
+        for (int e = NUM_PERF_EVENTS - 1; (e >= 0); e--)
+        {
+            if (m_descriptors[e] != -1)
+                ::close(m_descriptors[e]);
+        }
+    #endif
+        for (unsigned int e = 0; (e < NUM_PERF_EVENTS); e++)
+            m_descriptors[e] = -1;
+        m_leader = -1;
+        m_numCounted = 0;
+        m_error.clear();
+    }
+
+    inline bool PerfCounters::isOpen() const
+    {
+        return (m_leader != -1);
+    }
+
+    inline bool PerfCounters::isCounted(PerfEvent event) const
+    {
+        return (event < NUM_PERF_EVENTS && m_descriptors[event] != -1);
+    }
+
+    inline const std::string& PerfCounters::error() const
+    {
+        return m_error;
+    }
+
+    inline bool PerfCounters::read(PerfSample& sample)
+    {
+    #if defined(__linux__)
+        if (m_leader == -1)
+            return false;
+        const ssize_t size = m_buffer.size() * sizeof(uint64_t);
+        if (::read(m_leader, &m_buffer[0], size) != size
+            || m_buffer[0] != m_numCounted || m_buffer[2] == 0)
+        {
+            return false;
+        }
+        // If the counters are shared with other users, they're only
+        // running some of the time, so scale counts up to estimate the
+        // total
+        const double scale = static_cast<double>(m_buffer[1]) / m_buffer[2];
+        for (unsigned int e = 0; (e < NUM_PERF_EVENTS); e++)
+        {
+            uint64_t value = 0;
+            if (m_descriptors[e] != -1)
+            {
+                value = m_buffer[3 + m_positions[e]];
+                if (scale > 1.0)
+                    value = static_cast<uint64_t>(value * scale);
+            }
+            sample.values[e] = value;
+        }
+        return true;
+    #else
+        return false;
+    #endif
+    }
+
+}
+
+#endif
@@ -7,6 +7,13 @@ File:        point.hpp
 Description: Contains class representing spatial points with an arbitrary
              number of dimensions.
 
+             The storage of points can be aligned and padded, so that
+             vectorised code can use aligned loads and points don't
+             straddle cache lines. By default, points are not padded.
+             Define MDSEARCH_POINT_ALIGNMENT to set the alignment of all
+             points, or specialise PointAlignment to set it for points with
+             a specific dimensionality and element type.
+
 *******************************************************************************
 
 The MIT License (MIT)
@@ -36,12 +43,139 @@ THE SOFTWARE.
 #ifndef MDSEARCH_POINT_H
 #define MDSEARCH_POINT_H
 
+#include "types.hpp"
+#include "simd.hpp"
 #include <cstring>
 #include <iostream>
 
+// Alignment, in bytes, of the storage of points. 0 means points use the
+// natural alignment of their elements and are not padded.
+#ifndef MDSEARCH_POINT_ALIGNMENT
+    #define MDSEARCH_POINT_ALIGNMENT 0
+#endif
+
 namespace mdsearch
 {
 
+    /** Alignment policy for points with D dimensions of type ELEM_TYPE.
+     * 'value' is the alignment of the points' storage in bytes (e.g. 16,
+     * 32 or 64), or 0 to use the natural alignment of ELEM_TYPE. Storage is
+     * padded to a multiple of the alignment. Specialise this to change the
+     * alignment of specific point types. */
+    template <int D, typename ELEM_TYPE>
+    struct PointAlignment
+    {
+        static const int value = MDSEARCH_POINT_ALIGNMENT;
+    };
+
+    /** Computes the size and alignment of the storage of points, using
+     * the alignment policy. Padding elements are always zero. */
+    template <int D, typename ELEM_TYPE>
+    struct PointStorage
+    {
+        /** Alignment of the points' storage in bytes. */
+        static const int ALIGNMENT = (PointAlignment<D, ELEM_TYPE>::value
+            > static_cast<int>(alignof(ELEM_TYPE)))
+            ? PointAlignment<D, ELEM_TYPE>::value
+            : static_cast<int>(alignof(ELEM_TYPE));
+        /** Number of elements in each aligned block of storage. */
+        static const int BLOCK_SIZE = (ALIGNMENT
+            > static_cast<int>(sizeof(ELEM_TYPE)))
+            ? ALIGNMENT / static_cast<int>(sizeof(ELEM_TYPE)) : 1;
+        /** Number of elements stored, including padding. */
+        static const int SIZE = ((D + BLOCK_SIZE - 1) / BLOCK_SIZE)
+            * BLOCK_SIZE;
+    };
+
+    /** Compares the first N coordinates of two points subject to an error
+     * tolerance, as compare() does. ALIGNMENT is the alignment of the
+     * coordinate arrays in bytes. This generic version compares one
+     * coordinate at a time and stops at the first one that differs. */
+    template <int D, typename ELEM_TYPE, int ALIGNMENT>
+    struct PointComparator
+    {
+        static bool equal(const ELEM_TYPE* a, const ELEM_TYPE* b)
+        {
+            for (unsigned int d = 0; (d < D); d++)
+            {
+                if (compare(a[d], b[d]) != 0)
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+    };
+
+    /** Compares single-precision coordinates without branching. Blocks of
+     * eight (AVX2) or four (SSE2) coordinates are compared at a time and
+     * the results of all blocks are combined, so only one mask is tested
+     * for the whole point. Coordinates left over are compared with scalar
+     * code, which the compiler can also make branch-free. If the arrays are
+     * sufficiently aligned, aligned loads are used. */
+    template <int D, int ALIGNMENT>
+    struct PointComparator<D, float, ALIGNMENT>
+    {
+        static bool equal(const float* a, const float* b)
+        {
+            unsigned int d = 0;
+            bool equal = true;
+            #ifdef MDSEARCH_AVX2
+            if (D >= 8)
+            {
+                const __m256 signMask = _mm256_set1_ps(-0.0f);
+                const __m256 epsilon = _mm256_set1_ps(EPSILON);
+                __m256 within = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+                for (; (d + 8 <= D); d += 8)
+                {
+                    __m256 difference = _mm256_andnot_ps(signMask,
+                        _mm256_sub_ps(load(a + d), load(b + d)));
+                    within = _mm256_and_ps(within,
+                        _mm256_cmp_ps(difference, epsilon, _CMP_LT_OQ));
+                }
+                equal = (_mm256_movemask_ps(within) == 0xFF);
+            }
+            #endif
+            #ifdef MDSEARCH_SSE2
+            if (D - d >= 4)
+            {
+                const __m128 signMask = _mm_set1_ps(-0.0f);
+                const __m128 epsilon = _mm_set1_ps(EPSILON);
+                __m128 within = _mm_castsi128_ps(_mm_set1_epi32(-1));
+                for (; (d + 4 <= D); d += 4)
+                {
+                    __m128 difference = _mm_andnot_ps(signMask,
+                        _mm_sub_ps(load4(a + d), load4(b + d)));
+                    within = _mm_and_ps(within,
+                        _mm_cmplt_ps(difference, epsilon));
+                }
+                equal = equal & (_mm_movemask_ps(within) == 0xF);
+            }
+            #endif
+            for (; (d < D); d++)
+            {
+                equal = equal & (std::fabs(a[d] - b[d]) < EPSILON);
+            }
+            return equal;
+        }
+
+        #ifdef MDSEARCH_AVX2
+        static __m256 load(const float* values)
+        {
+            return (ALIGNMENT >= 32) ? _mm256_load_ps(values)
+                                     : _mm256_loadu_ps(values);
+        }
+        #endif
+
+        #ifdef MDSEARCH_SSE2
+        static __m128 load4(const float* values)
+        {
+            return (ALIGNMENT >= 16) ? _mm_load_ps(values)
+                                     : _mm_loadu_ps(values);
+        }
+        #endif
+    };
+
     /** Represents spatial point with an arbitrary number of dimensions.
      * Can store any type of element, providing it supports the operations
      * required by Point's member functions. */
@@ -50,6 +184,11 @@ namespace mdsearch
     {
 
     public:
+        /** Alignment of point's coordinates in bytes. */
+        static const int ALIGNMENT = PointStorage<D, ELEM_TYPE>::ALIGNMENT;
+        /** Number of coordinates stored, including padding. */
+        static const int STORAGE_SIZE = PointStorage<D, ELEM_TYPE>::SIZE;
+
         /** Constructs new point, but does not initialise its coordinates.
          * The initial values of the coordinates are undefined. */
         Point();
@@ -75,7 +214,9 @@ namespace mdsearch
         /** Retrieve modifiable reference to dth coordinate. */
         ELEM_TYPE& operator[](int d);
 
-        /** Retrieve point's coordinates as unmodifiable C-style array. */
+        /** Retrieve point's coordinates as unmodifiable C-style array.
+         * The array contains STORAGE_SIZE values, where the values after
+         * the first D are padding and are always zero. */
         const ELEM_TYPE* asArray() const;
 
         /** Retrieve point's coordinates as modifiable C-style array. */
@@ -88,14 +229,18 @@ namespace mdsearch
         void print(std::ostream& out) const;
 
     private:
-        /** Values of each coordinate. */
-        ELEM_TYPE m_values[D];
+        /** Set the padding after the coordinates to zero. */
+        void clearPadding();
+
+        /** Values of each coordinate, followed by padding. */
+        alignas(ALIGNMENT) ELEM_TYPE m_values[STORAGE_SIZE];
 
     };
 
     template<int D, typename ELEM_TYPE>
     Point<D, ELEM_TYPE>::Point()
     {
+        clearPadding();
     }
 
     template<int D, typename ELEM_TYPE>
@@ -105,26 +250,25 @@ namespace mdsearch
         {
             m_values[d] = initialValue;
         }
+        clearPadding();
     }
 
     template<int D, typename ELEM_TYPE>
     Point<D, ELEM_TYPE>::Point(const ELEM_TYPE* initialValues)
     {
         memcpy(m_values, initialValues, sizeof(ELEM_TYPE) * D);
+        clearPadding();
     }
 
     template<int D, typename ELEM_TYPE>
     inline
     bool Point<D, ELEM_TYPE>::operator==(const Point& other) const
     {
-        for (unsigned int d = 0; (d < D); d++)
-        {
-            if (compare(m_values[d], other.m_values[d]) != 0)
-            {
-                return false;
-            }
-        }
-        return true;
+        // Padding is zero in both points, so it can be compared too. This
+        // means the comparison needs no scalar code for left over
+        // coordinates when points are padded.
+        return PointComparator<STORAGE_SIZE, ELEM_TYPE, ALIGNMENT>::equal(
+            m_values, other.m_values);
     }
 
     template<int D, typename ELEM_TYPE>
@@ -186,6 +330,16 @@ namespace mdsearch
         out << m_values[D - 1] << ")";
     }
 
+    template<int D, typename ELEM_TYPE>
+    inline
+    void Point<D, ELEM_TYPE>::clearPadding()
+    {
+        for (unsigned int d = D; (d < STORAGE_SIZE); d++)
+        {
+            m_values[d] = 0;
+        }
+    }
+
     template<int D, typename ELEM_TYPE>
     std::ostream& operator<<(std::ostream& out,
                              const Point<D, ELEM_TYPE>& point)
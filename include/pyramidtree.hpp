@@ -8,6 +8,21 @@ Description: Implements the Pyramid Tree from Berchtold et al.'s 1998 paper.
              Instead of using a B+-tree as the underlying one-dimensional index
              structure, a hash map is used instead.
 
+             An ordered index over the hash map's keys can optionally be
+             maintained. This allows range queries to be decomposed into one
+             interval of pyramid values per pyramid, as in the original
+             paper, rather than scanning every bucket.
+
+             The Extended Pyramid Technique from the same paper is also
+             supported. Given a centre for the data (e.g. the median of a
+             sample of the points), each coordinate is mapped so the centre
+             lands at the middle of the boundary, which spreads skewed or
+             clustered data across more pyramid heights.
+
+             Batches of points can be hashed at once. If the CPU supports
+             AVX2, the pyramid values of eight points are computed at a
+             time with a branch-free kernel.
+
 *******************************************************************************
 
 The MIT License (MIT)
@@ -39,6 +54,9 @@ THE SOFTWARE.
 
 #include "hashstruct.hpp"
 #include "boundary.hpp"
+#include "ordered_index.hpp"
+#include "simd.hpp"
+#include <cmath>
 
 // Only define if you want a hack which causes the Pyramid Tree hasher
 // to ignore dimensions when a point is at the min or max boundaries
@@ -48,55 +66,229 @@ THE SOFTWARE.
 namespace mdsearch
 {
 
+    /** Compute the dimension with the largest pyramid height, and that
+     * height, for each of the given points, storing them in 'maxDims' and
+     * 'maxHeights'. 'coords' contains the coordinates of the points, with
+     * 'stride' elements between consecutive points.
+     *
+     * Returns the number of points the heights were computed for, which
+     * is the largest multiple of eight no greater than 'numPoints'. The
+     * results match PyramidTree::hashPoint() exactly. This generic version
+     * is used for element types the kernel doesn't support and computes
+     * nothing. */
+    template<typename ELEM_TYPE>
+    inline unsigned int computePyramidValuesAVX2(const ELEM_TYPE*,
+        unsigned int, unsigned int, unsigned int, const Real*, const Real*,
+        int*, Real*)
+    {
+        return 0;
+    }
+
+    #ifdef MDSEARCH_X86_SIMD
+    /** Computes the pyramid values of eight single-precision points at a
+     * time, one point per lane. The coordinates of each dimension are
+     * gathered from the points, and the running maximum height and its
+     * dimension are updated with blends instead of branches. */
+    __attribute__((target("avx2")))
+    inline unsigned int computePyramidValuesAVX2(const float* coords,
+        unsigned int stride, unsigned int numPoints, unsigned int numDims,
+        const float* mins, const float* invRanges,
+        int* maxDims, float* maxHeights)
+    {
+        const __m256i offsets = _mm256_mullo_epi32(
+            _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+            _mm256_set1_epi32(stride));
+        const __m256 half = _mm256_set1_ps(0.5f);
+        const __m256 signMask = _mm256_set1_ps(-0.0f);
+        #ifdef BOUNDARY_VALUE_HACK
+        const __m256 epsilon = _mm256_set1_ps(EPSILON);
+        #endif
+
+        unsigned int numComputed = numPoints - (numPoints % 8);
+        for (unsigned int i = 0; (i < numComputed); i += 8)
+        {
+            const float* base = coords + i * stride;
+            // Height is |0.5 - (x - min) * (1 / range)|
+            __m256 normalised = _mm256_mul_ps(
+                _mm256_sub_ps(_mm256_i32gather_ps(base, offsets, 4),
+                              _mm256_set1_ps(mins[0])),
+                _mm256_set1_ps(invRanges[0]));
+            __m256 maxHeight = _mm256_andnot_ps(signMask,
+                _mm256_sub_ps(half, normalised));
+            __m256i maxDim = _mm256_setzero_si256();
+            for (unsigned int d = 1; (d < numDims); d++)
+            {
+                normalised = _mm256_mul_ps(
+                    _mm256_sub_ps(_mm256_i32gather_ps(base + d, offsets, 4),
+                                  _mm256_set1_ps(mins[d])),
+                    _mm256_set1_ps(invRanges[d]));
+                __m256 height = _mm256_andnot_ps(signMask,
+                    _mm256_sub_ps(half, normalised));
+                __m256 greater = _mm256_cmp_ps(maxHeight, height,
+                                               _CMP_LT_OQ);
+                #ifdef BOUNDARY_VALUE_HACK
+                // Ignore dimensions where the point is on the boundary
+                __m256 onBoundary = _mm256_cmp_ps(
+                    _mm256_andnot_ps(signMask, _mm256_sub_ps(height, half)),
+                    epsilon, _CMP_LT_OQ);
+                greater = _mm256_andnot_ps(onBoundary, greater);
+                #endif
+                maxHeight = _mm256_blendv_ps(maxHeight, height, greater);
+                maxDim = _mm256_castps_si256(_mm256_blendv_ps(
+                    _mm256_castsi256_ps(maxDim),
+                    _mm256_castsi256_ps(_mm256_set1_epi32(d)), greater));
+            }
+            _mm256_storeu_ps(maxHeights + i, maxHeight);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(maxDims + i),
+                                maxDim);
+        }
+        return numComputed;
+    }
+    #endif
+
     /** Implements the Pyramid Tree from Berchtold et al.'s 1998 paper.
      * Instead of using a B+-tree as the underlying one-dimensional index
      * structure, a hash map is used instead.
      *
-     * NOTE: Points outside of boundary assigned to Pyramid Trees are ignored.
+     * NOTE: Points outside of the boundary are still stored, but their
+     * pyramid values are meaningless and can collide with many other
+     * points. Use GrowableIndex to keep them separate and grow the
+     * boundary instead.
     */
     template<int D, typename ELEM_TYPE>
     class PyramidTree : public HashStructure<D, ELEM_TYPE>
     {
 
     public:
-        /** Construct Pyramid Tree to cover given boundary. */
-        PyramidTree(const Boundary<D, ELEM_TYPE>& boundary);
-
-        /** Clear all points in Pyramid Tree and reset its spatial boundary. */
+        typedef typename HashStructure<D, ELEM_TYPE>::PointList PointList;
+
+        /** Construct Pyramid Tree to cover given boundary.
+         *
+         * \param orderedIndex if true, an ordered index over the pyramid
+         * values of the stored points is maintained, so range queries only
+         * search the buckets that can intersect the query region. */
+        PyramidTree(const Boundary<D, ELEM_TYPE>& boundary,
+                    bool orderedIndex = false);
+
+        /** Construct Pyramid Tree to cover given boundary, using the
+         * Extended Pyramid Technique to centre the pyramids on the given
+         * point instead of the middle of the boundary.
+         *
+         * Each normalised coordinate x is mapped to x^r, where r is chosen
+         * so the centre's normalised coordinate maps to 0.5. The mapping is
+         * monotonic, so range queries are still supported. */
+        PyramidTree(const Boundary<D, ELEM_TYPE>& boundary,
+                    const Point<D, ELEM_TYPE>& centre,
+                    bool orderedIndex = false);
+
+        /** Clear all points in Pyramid Tree and reset its spatial boundary.
+         * If the Pyramid Tree was given a centre, it is kept. */
         void clear(const Boundary<D, ELEM_TYPE>& newBoundary);
 
+        /** Return all stored points that lie inside the given region
+         * (inclusive).
+         *
+         * If the ordered index is maintained, the region is intersected
+         * with each pyramid to find the range of pyramid values the
+         * pyramid's points in the region can have, and only buckets in
+         * those ranges are searched. Otherwise, every bucket is searched. */
+        PointList rangeQuery(const Boundary<D, ELEM_TYPE>& region);
+
     protected:
         /** Uses pyramid value of given point to hash it. */
         virtual HashType hashPoint(const Point<D, ELEM_TYPE>& p);
 
+        /** Hashes a batch of points. Uses the AVX2 kernel if possible. */
+        virtual void hashPoints(const Point<D, ELEM_TYPE>* points,
+                                unsigned int numPoints, HashType* keys);
+
+        /** Adds keys of new buckets to the ordered index, if it's being
+         * maintained. */
+        virtual void bucketCreated(HashType key);
+
     private:
+        typedef typename HashStructure<D, ELEM_TYPE>::Bucket Bucket;
+        typedef typename HashStructure<D, ELEM_TYPE>::OneDMap OneDMap;
         /** This bounds the number of buckets the Pyramid Tree can use to
          * store points. */
-        static const ELEM_TYPE MAX_BUCKET_NUMBER = 30000000000;
+        static const Real MAX_BUCKET_NUMBER;
+
+        /** Normalise value of dth coordinate into 0-1 range based on
+         * the boundary's min-max interval. */
+        Real normaliseCoord(ELEM_TYPE coord, int d) const;
+
+        /** Normalise value of dth coordinate into 0-1 range and, if a
+         * centre was given, map it so the centre's coordinate is at 0.5. */
+        Real centredCoord(ELEM_TYPE coord, int d) const;
 
-        /** Normalise value into 0-1 range based on min-max interval. */
-        ELEM_TYPE normaliseCoord(ELEM_TYPE coord,
-                                 ELEM_TYPE min, ELEM_TYPE max);
+        /** Compute Pyramid height of the dth coordinate of a point, for a
+         * specific pair of pyramid (that are both for the same
+         * dimension). */
+        Real pyramidHeight(ELEM_TYPE coord, int d) const;
 
-        /** Compute Pyramid height of a point, for a specific pair of
-         * pyramid (that are both for the same dimension). */
-        ELEM_TYPE pyramidHeight(ELEM_TYPE coord, ELEM_TYPE min, ELEM_TYPE max);
+        /** Compute the reciprocal of each dimension's range and the
+         * exponent each dimension's normalised coordinates are raised to,
+         * so the centre is mapped to 0.5. */
+        void computeCoordMappings();
+
+        /** Convert the pyramid value of a point, given as the index of its
+         * pyramid and its height in that pyramid, to a hash key. */
+        HashType pyramidValueToKey(int index, Real height) const;
+
+        /** Append all points in bucket that lie inside given region to
+         * given list. */
+        void searchBucket(const Bucket& bucket,
+                          const Boundary<D, ELEM_TYPE>& region,
+                          PointList& results) const;
 
         /** Entire region of space the Pyramid tree covers. */
         Boundary<D, ELEM_TYPE> m_boundary;
         /** Spatial interval between buckets. */
-        ELEM_TYPE m_bucketInterval;
+        Real m_bucketInterval;
+        /** True if the ordered index of keys is being maintained. */
+        bool m_useOrderedIndex;
+        /** Ordered index of the keys of all buckets in the hash map. */
+        OrderedKeyIndex m_orderedIndex;
+        /** True if the Extended Pyramid Technique is being used. */
+        bool m_extended;
+        /** Centre of the data, if using the Extended Pyramid Technique. */
+        Point<D, ELEM_TYPE> m_centre;
+        /** Exponent applied to each dimension's normalised coordinates. */
+        Real m_exponents[D];
+        /** Minimum and reciprocal of the range of each dimension. Stored
+         * contiguously for the batch hashing kernel. */
+        Real m_mins[D];
+        Real m_invRanges[D];
 
     };
 
+    template<int D, typename ELEM_TYPE>
+    const Real PyramidTree<D, ELEM_TYPE>::MAX_BUCKET_NUMBER = 30000000000;
+
     template<int D, typename ELEM_TYPE>
     PyramidTree<D, ELEM_TYPE>::PyramidTree(
-        const Boundary<D, ELEM_TYPE>& boundary)
-    : m_boundary(boundary)
+        const Boundary<D, ELEM_TYPE>& boundary, bool orderedIndex)
+    : m_boundary(boundary), m_useOrderedIndex(orderedIndex),
+      m_orderedIndex(OrderedKeyIndex::KeyAllocator(&this->m_tableMemory)),
+      m_extended(false)
     {
         // Compute the interval between buckets
-        m_bucketInterval = static_cast<ELEM_TYPE>( MAX_BUCKET_NUMBER / (D * 2) );
+        m_bucketInterval = static_cast<Real>( MAX_BUCKET_NUMBER / (D * 2) );
+        m_bucketInterval = floor(m_bucketInterval);
+        computeCoordMappings();
+    }
+
+    template<int D, typename ELEM_TYPE>
+    PyramidTree<D, ELEM_TYPE>::PyramidTree(
+        const Boundary<D, ELEM_TYPE>& boundary,
+        const Point<D, ELEM_TYPE>& centre, bool orderedIndex)
+    : m_boundary(boundary), m_useOrderedIndex(orderedIndex),
+      m_orderedIndex(OrderedKeyIndex::KeyAllocator(&this->m_tableMemory)),
+      m_extended(true), m_centre(centre)
+    {
+        m_bucketInterval = static_cast<Real>( MAX_BUCKET_NUMBER / (D * 2) );
         m_bucketInterval = floor(m_bucketInterval);
+        computeCoordMappings();
     }
 
     template<int D, typename ELEM_TYPE>
@@ -104,23 +296,187 @@ namespace mdsearch
         const Boundary<D, ELEM_TYPE>& newBoundary)
     {
         HashStructure<D, ELEM_TYPE>::clear();
+        m_orderedIndex.clear();
         m_boundary = newBoundary;
+        computeCoordMappings();
+    }
+
+    template<int D, typename ELEM_TYPE>
+    typename PyramidTree<D, ELEM_TYPE>::PointList
+    PyramidTree<D, ELEM_TYPE>::rangeQuery(
+        const Boundary<D, ELEM_TYPE>& region)
+    {
+        PointList results;
+        const OneDMap& hashMap = this->m_hashMap;
+        if (!m_useOrderedIndex)
+        {
+            for (typename OneDMap::const_iterator it = hashMap.begin();
+                (it != hashMap.end()); it++)
+            {
+                searchBucket(it->second, region, results);
+            }
+            return results;
+        }
+
+        // Range of heights each dimension of the region covers. The heights
+        // are computed in the same way as hashPoint() so the bounds are
+        // consistent with the stored points' keys.
+        Real minHeight[D];
+        Real maxHeight[D];
+        for (unsigned int d = 0; (d < D); d++)
+        {
+            if (region[d].min > region[d].max)
+                return results;
+            Real low = centredCoord(region[d].min, d);
+            Real high = centredCoord(region[d].max, d);
+            Real lowHeight = pyramidHeight(region[d].min, d);
+            Real highHeight = pyramidHeight(region[d].max, d);
+            maxHeight[d] = std::max(lowHeight, highHeight);
+            minHeight[d] = (low <= 0.5f && high >= 0.5f)
+                ? 0 : std::min(lowHeight, highHeight);
+        }
+
+        // A point is stored in the pyramid of the dimension with its
+        // largest height, so its height is at least as large as the minimum
+        // height of the region in every other dimension. Dimensions the
+        // boundary value hack might ignore for the region's points can't be
+        // used for this.
+        Real largestMinHeight = 0;
+        Real secondLargestMinHeight = 0;
+        int largestMinHeightDim = -1;
+        for (unsigned int d = 0; (d < D); d++)
+        {
+            #ifdef BOUNDARY_VALUE_HACK
+            if (d != 0 && !(maxHeight[d] < 0.5f
+                && compare(maxHeight[d], 0.5f) != 0))
+            {
+                continue;
+            }
+            #endif
+            if (minHeight[d] > largestMinHeight)
+            {
+                secondLargestMinHeight = largestMinHeight;
+                largestMinHeight = minHeight[d];
+                largestMinHeightDim = d;
+            }
+            else if (minHeight[d] > secondLargestMinHeight)
+            {
+                secondLargestMinHeight = minHeight[d];
+            }
+        }
+
+        std::vector<HashType> keys;
+        for (int d = 0; (d < D); d++)
+        {
+            Real low = centredCoord(region[d].min, d);
+            Real high = centredCoord(region[d].max, d);
+            Real lowHeight = pyramidHeight(region[d].min, d);
+            Real highHeight = pyramidHeight(region[d].max, d);
+            Real otherDimsMinHeight = (d == largestMinHeightDim)
+                ? secondLargestMinHeight : largestMinHeight;
+
+            // Pyramid below the centre of dimension d
+            if (low < 0.5f)
+            {
+                Real fromHeight = (high < 0.5f) ? highHeight : 0;
+                fromHeight = std::max(fromHeight, otherDimsMinHeight);
+                if (fromHeight <= lowHeight)
+                {
+                    m_orderedIndex.findRange(
+                        pyramidValueToKey(d, fromHeight),
+                        pyramidValueToKey(d, lowHeight), keys);
+                }
+            }
+            // Pyramid above the centre of dimension d
+            if (high >= 0.5f)
+            {
+                Real fromHeight = (low >= 0.5f) ? lowHeight : 0;
+                fromHeight = std::max(fromHeight, otherDimsMinHeight);
+                if (fromHeight <= highHeight)
+                {
+                    m_orderedIndex.findRange(
+                        pyramidValueToKey(d + D, fromHeight),
+                        pyramidValueToKey(d + D, highHeight), keys);
+                }
+            }
+        }
+
+        // Pyramid value ranges can overlap after keys are rounded, so make
+        // sure each bucket is only searched once
+        std::sort(keys.begin(), keys.end());
+        keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+        for (unsigned int i = 0; (i < keys.size()); i++)
+        {
+            typename OneDMap::const_iterator it = hashMap.find(keys[i]);
+            if (it != hashMap.end())
+                searchBucket(it->second, region, results);
+        }
+        return results;
+    }
+
+    template<int D, typename ELEM_TYPE>
+    void PyramidTree<D, ELEM_TYPE>::bucketCreated(HashType key)
+    {
+        if (m_useOrderedIndex)
+            m_orderedIndex.insert(key);
+    }
+
+    template<int D, typename ELEM_TYPE>
+    inline
+    Real PyramidTree<D, ELEM_TYPE>::normaliseCoord(ELEM_TYPE coord,
+                                                  int d) const
+    {
+        return (coord - m_mins[d]) * m_invRanges[d];
     }
 
     template<int D, typename ELEM_TYPE>
     inline
-    ELEM_TYPE PyramidTree<D, ELEM_TYPE>::normaliseCoord(ELEM_TYPE coord,
-                                                   ELEM_TYPE min, ELEM_TYPE max)
+    Real PyramidTree<D, ELEM_TYPE>::centredCoord(ELEM_TYPE coord,
+                                                int d) const
     {
-        return (coord - min) / (max - min);
+        Real normalised = normaliseCoord(coord, d);
+        if (m_exponents[d] == 1)
+            return normalised;
+
+        // Clamp so the mapping is defined and stays monotonic for points
+        // outside of the boundary
+        if (normalised <= 0)
+            return 0;
+        else if (normalised >= 1)
+            return 1;
+        return std::pow(normalised, m_exponents[d]);
     }
 
     template<int D, typename ELEM_TYPE>
     inline
-    ELEM_TYPE PyramidTree<D, ELEM_TYPE>::pyramidHeight(ELEM_TYPE coord,
-                                                  ELEM_TYPE min, ELEM_TYPE max)
+    Real PyramidTree<D, ELEM_TYPE>::pyramidHeight(ELEM_TYPE coord,
+                                                 int d) const
     {
-        return std::abs(0.5f - normaliseCoord(coord, min, max));
+        return std::abs(0.5f - centredCoord(coord, d));
+    }
+
+    template<int D, typename ELEM_TYPE>
+    void PyramidTree<D, ELEM_TYPE>::computeCoordMappings()
+    {
+        for (unsigned int d = 0; (d < D); d++)
+        {
+            m_mins[d] = m_boundary[d].min;
+            m_invRanges[d] = 1 / static_cast<Real>(
+                m_boundary[d].max - m_boundary[d].min);
+            m_exponents[d] = 1;
+            if (!m_extended)
+                continue;
+
+            // Solving c^r = 0.5 for the centre's normalised coordinate c
+            // gives r = -1 / log2(c). Degenerate dimensions and centres
+            // on the boundary are left unmapped.
+            double centre = normaliseCoord(m_centre[d], d);
+            if (centre > 0 && centre < 1 && compare(centre, 0.5f) != 0)
+            {
+                m_exponents[d] = static_cast<Real>(
+                    -1.0 / (std::log(centre) / std::log(2.0)));
+            }
+        }
     }
 
     template<int D, typename ELEM_TYPE>
@@ -128,12 +484,10 @@ namespace mdsearch
     {
         int index = 0;
         int dMax = 0;
-        ELEM_TYPE dMaxHeight = pyramidHeight(p[0],
-            m_boundary[0].min, m_boundary[0].max);
+        Real dMaxHeight = pyramidHeight(p[0], 0);
         for (int d = 1; (d < D); d++)
         {
-            ELEM_TYPE currentHeight = pyramidHeight(p[d],
-                m_boundary[d].min, m_boundary[d].max);
+            Real currentHeight = pyramidHeight(p[d], d);
             #ifdef BOUNDARY_VALUE_HACK
             if (compare(currentHeight, 0.5f) == 0)
             {
@@ -148,8 +502,7 @@ namespace mdsearch
             }
         }
 
-        ELEM_TYPE normalisedCoord = normaliseCoord(p[dMax],
-            m_boundary[dMax].min, m_boundary[dMax].max);
+        Real normalisedCoord = centredCoord(p[dMax], dMax);
         if (normalisedCoord < 0.5f)
         {
             index = dMax; // pyramid lower than central point
@@ -159,7 +512,67 @@ namespace mdsearch
             index = dMax + D; // pyramid higher than central point
         }
 
-        return (index + dMaxHeight) * m_bucketInterval;
+        return pyramidValueToKey(index, dMaxHeight);
+    }
+
+    template<int D, typename ELEM_TYPE>
+    void PyramidTree<D, ELEM_TYPE>::hashPoints(
+        const Point<D, ELEM_TYPE>* points, unsigned int numPoints,
+        HashType* keys)
+    {
+        unsigned int numHashed = 0;
+        // The kernel doesn't apply the Extended Pyramid Technique's mapping
+        if (!m_extended && cpuSupportsAVX2())
+        {
+            int maxDims[HashStructure<D, ELEM_TYPE>::HASH_BATCH_SIZE];
+            Real maxHeights[HashStructure<D, ELEM_TYPE>::HASH_BATCH_SIZE];
+            while (numHashed < numPoints)
+            {
+                unsigned int count = std::min<unsigned int>(
+                    numPoints - numHashed,
+                    HashStructure<D, ELEM_TYPE>::HASH_BATCH_SIZE);
+                unsigned int numComputed = computePyramidValuesAVX2(
+                    points[numHashed].asArray(),
+                    sizeof(Point<D, ELEM_TYPE>) / sizeof(ELEM_TYPE),
+                    count, D, m_mins, m_invRanges, maxDims, maxHeights);
+                if (numComputed == 0)
+                    break;
+                for (unsigned int i = 0; (i < numComputed); i++)
+                {
+                    int dMax = maxDims[i];
+                    Real normalisedCoord = normaliseCoord(
+                        points[numHashed + i][dMax], dMax);
+                    int index = (normalisedCoord < 0.5f) ? dMax : dMax + D;
+                    keys[numHashed + i] = pyramidValueToKey(index,
+                        maxHeights[i]);
+                }
+                numHashed += numComputed;
+            }
+        }
+        for (; (numHashed < numPoints); numHashed++)
+        {
+            keys[numHashed] = hashPoint(points[numHashed]);
+        }
+    }
+
+    template<int D, typename ELEM_TYPE>
+    inline
+    HashType PyramidTree<D, ELEM_TYPE>::pyramidValueToKey(int index,
+        Real height) const
+    {
+        return (index + height) * m_bucketInterval;
+    }
+
+    template<int D, typename ELEM_TYPE>
+    inline
+    void PyramidTree<D, ELEM_TYPE>::searchBucket(const Bucket& bucket,
+        const Boundary<D, ELEM_TYPE>& region, PointList& results) const
+    {
+        for (unsigned int i = 0; (i < bucket.points.size()); i++)
+        {
+            if (region.contains(bucket.points[i]))
+                results.push_back(bucket.points[i]);
+        }
     }
 
 }
@@ -0,0 +1,372 @@
+/******************************************************************************
+
+mdsearch - Lightweight C++ library implementing a collection of
+           multi-dimensional search structures
+
+File:        quantised.hpp
+Description: Stores points with small integer coordinates to save memory.
+             Each dimension of a boundary is mapped onto the range of an
+             integer type, and a front-end lets structures storing the
+             integer points be used with Real points and queries.
+
+*******************************************************************************
+
+The MIT License (MIT)
+
+Copyright (c) 2014 Donald Whyte
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+******************************************************************************/
+
+#ifndef MDSEARCH_QUANTISED_H
+#define MDSEARCH_QUANTISED_H
+
+#include "types.hpp"
+#include "point.hpp"
+#include "boundary.hpp"
+#include "memory_usage.hpp"
+#include <vector>
+#include <limits>
+#include <cmath>
+
+namespace mdsearch
+{
+
+    /** Maps Real points onto points whose coordinates are stored as
+     * integers of type QUANTISED_TYPE (e.g. int8_t or int16_t), which
+     * take a half or a quarter of the memory.
+     *
+     * Each dimension of a boundary, usually computed with
+     * Dataset::computeBoundary(), is divided into as many evenly spaced
+     * levels as QUANTISED_TYPE can represent. A coordinate x is stored as
+     * the nearest level, round((x - offset) / scale), where the offset is
+     * the boundary's minimum and the scale is the distance between levels.
+     * Coordinates outside of the boundary are clamped to the nearest
+     * level at its edges.
+     *
+     * Quantising is monotonic, so if x <= y then quantise(x) <=
+     * quantise(y). Distinct points closer together than the scale can
+     * quantise to the same point. */
+    template<int D, typename QUANTISED_TYPE>
+    class Quantiser
+    {
+
+    public:
+        /** Construct quantiser which covers the given boundary. */
+        Quantiser(const Boundary<D, Real>& boundary);
+
+        /** Return quantised version of given point. */
+        Point<D, QUANTISED_TYPE> quantise(const Point<D, Real>& p) const;
+
+        /** Return smallest quantised region which contains the quantised
+         * versions of all points inside the given region. */
+        Boundary<D, QUANTISED_TYPE> quantise(
+            const Boundary<D, Real>& region) const;
+
+        /** Return the Real point the given quantised point represents. */
+        Point<D, Real> dequantise(const Point<D, QUANTISED_TYPE>& p) const;
+
+        /** Return quantised boundary which contains every quantised point.
+         * Structures storing quantised points should cover this. */
+        Boundary<D, QUANTISED_TYPE> boundary() const;
+
+        /** Return distance between consecutive levels of dimension d. */
+        double scale(int d) const;
+
+        /** Return coordinate of the lowest level of dimension d. */
+        double offset(int d) const;
+
+        /** Return largest difference between a coordinate inside the
+         * boundary and its dequantised value, for dimension d. */
+        double maxError(int d) const;
+
+    private:
+        /** Quantise a single coordinate of dimension d. */
+        QUANTISED_TYPE quantiseCoord(Real value, int d) const;
+
+        double m_scales[D];
+        double m_offsets[D];
+
+    };
+
+    template<int D, typename QUANTISED_TYPE>
+    Quantiser<D, QUANTISED_TYPE>::Quantiser(const Boundary<D, Real>& boundary)
+    {
+        const double numSteps =
+            static_cast<double>(std::numeric_limits<QUANTISED_TYPE>::max())
+            - static_cast<double>(std::numeric_limits<QUANTISED_TYPE>::min());
+        for (unsigned int d = 0; (d < D); d++)
+        {
+            m_offsets[d] = boundary[d].min;
+            double range = static_cast<double>(boundary[d].max)
+                - static_cast<double>(boundary[d].min);
+            // Degenerate dimensions only have a single level in use
+            m_scales[d] = (range > 0) ? (range / numSteps) : 1.0;
+        }
+    }
+
+    template<int D, typename QUANTISED_TYPE>
+    Point<D, QUANTISED_TYPE> Quantiser<D, QUANTISED_TYPE>::quantise(
+        const Point<D, Real>& p) const
+    {
+        Point<D, QUANTISED_TYPE> quantised;
+        for (unsigned int d = 0; (d < D); d++)
+        {
+            quantised[d] = quantiseCoord(p[d], d);
+        }
+        return quantised;
+    }
+
+    template<int D, typename QUANTISED_TYPE>
+    Boundary<D, QUANTISED_TYPE> Quantiser<D, QUANTISED_TYPE>::quantise(
+        const Boundary<D, Real>& region) const
+    {
+        // Since quantising is monotonic, quantising the region's corners
+        // gives a region containing every point quantised from inside it
+        Boundary<D, QUANTISED_TYPE> quantised;
+        for (unsigned int d = 0; (d < D); d++)
+        {
+            quantised[d].min = quantiseCoord(region[d].min, d);
+            quantised[d].max = quantiseCoord(region[d].max, d);
+        }
+        return quantised;
+    }
+
+    template<int D, typename QUANTISED_TYPE>
+    Point<D, Real> Quantiser<D, QUANTISED_TYPE>::dequantise(
+        const Point<D, QUANTISED_TYPE>& p) const
+    {
+        const double lowest = std::numeric_limits<QUANTISED_TYPE>::min();
+        Point<D, Real> dequantised;
+        for (unsigned int d = 0; (d < D); d++)
+        {
+            dequantised[d] = static_cast<Real>(
+                m_offsets[d] + (p[d] - lowest) * m_scales[d]);
+        }
+        return dequantised;
+    }
+
+    template<int D, typename QUANTISED_TYPE>
+    Boundary<D, QUANTISED_TYPE> Quantiser<D, QUANTISED_TYPE>::boundary() const
+    {
+        return Boundary<D, QUANTISED_TYPE>(Interval<QUANTISED_TYPE>(
+            std::numeric_limits<QUANTISED_TYPE>::min(),
+            std::numeric_limits<QUANTISED_TYPE>::max()));
+    }
+
+    template<int D, typename QUANTISED_TYPE>
+    inline
+    double Quantiser<D, QUANTISED_TYPE>::scale(int d) const
+    {
+        return m_scales[d];
+    }
+
+    template<int D, typename QUANTISED_TYPE>
+    inline
+    double Quantiser<D, QUANTISED_TYPE>::offset(int d) const
+    {
+        return m_offsets[d];
+    }
+
+    template<int D, typename QUANTISED_TYPE>
+    inline
+    double Quantiser<D, QUANTISED_TYPE>::maxError(int d) const
+    {
+        return m_scales[d] / 2;
+    }
+
+    template<int D, typename QUANTISED_TYPE>
+    inline
+    QUANTISED_TYPE Quantiser<D, QUANTISED_TYPE>::quantiseCoord(Real value,
+                                                              int d) const
+    {
+        const double lowest = std::numeric_limits<QUANTISED_TYPE>::min();
+        const double highest = std::numeric_limits<QUANTISED_TYPE>::max();
+        double level = lowest
+            + std::floor((value - m_offsets[d]) / m_scales[d] + 0.5);
+        // Comparisons are written so NaNs are clamped to the lowest level
+        if (!(level > lowest))
+            return std::numeric_limits<QUANTISED_TYPE>::min();
+        else if (level >= highest)
+            return std::numeric_limits<QUANTISED_TYPE>::max();
+        return static_cast<QUANTISED_TYPE>(level);
+    }
+
+    /** Float front-end to a structure of type STRUCT_TYPE which stores
+     * quantised points, e.g. PyramidTree<D, int16_t>. Points and queries
+     * are given as Real points, which are quantised with a Quantiser
+     * before being passed to the structure. Points returned by spatial
+     * queries are dequantised.
+     *
+     * Since only quantised points are stored, two points which quantise
+     * to the same point are treated as the same point. Range queries
+     * return every stored point whose quantised version lies inside the
+     * quantised region, which can include points up to maxError() outside
+     * of the region. knn() returns the points closest to the quantised
+     * query point, measured in quantised units. This only ranks points by
+     * their Real distance if every dimension has the same scale.
+     *
+     * STRUCT_TYPE must provide insert(), remove() and query(). rangeQuery()
+     * and knn() can only be used if STRUCT_TYPE provides them too. The
+     * index doesn't own the structure, which should cover the quantiser's
+     * boundary(). */
+    template<int D, typename QUANTISED_TYPE, typename STRUCT_TYPE>
+    class QuantisedIndex
+    {
+
+    public:
+        typedef std::vector< Point<D, Real> > PointList;
+
+        /** Construct index which stores points quantised by 'quantiser'
+         * in 'structure'. */
+        QuantisedIndex(const Quantiser<D, QUANTISED_TYPE>& quantiser,
+                       STRUCT_TYPE* structure);
+
+        /** Insert point into index.
+         * Returns true if the point was inserted successfully and false
+         * if a point with the same quantised value is already stored. */
+        bool insert(const Point<D, Real>& point);
+
+        /** Remove point from the index.
+         * Returns true if the point was removed successfully and
+         * false if the point was not being stored. */
+        bool remove(const Point<D, Real>& point);
+
+        /** Return true if the given point is being stored in the index. */
+        bool query(const Point<D, Real>& point);
+
+        /** Return all stored points whose quantised value lies inside the
+         * quantised region. */
+        PointList rangeQuery(const Boundary<D, Real>& region);
+
+        /** Return the k stored points closest to the given point, sorted
+         * by increasing distance. */
+        PointList knn(const Point<D, Real>& point, unsigned int k);
+
+        /** Return quantiser used to quantise points. */
+        const Quantiser<D, QUANTISED_TYPE>& quantiser() const;
+
+        /** Return structure storing the quantised points. */
+        STRUCT_TYPE* structure();
+
+        /** Return memory used by the structure storing the quantised
+         * points. STRUCT_TYPE must provide memoryUsage(). */
+        MemoryUsage memoryUsage() const;
+
+    private:
+        /** Append dequantised versions of quantised points to 'results'. */
+        void dequantiseAll(
+            const std::vector< Point<D, QUANTISED_TYPE> >& quantised,
+            PointList& results) const;
+
+        Quantiser<D, QUANTISED_TYPE> m_quantiser;
+        STRUCT_TYPE* m_structure;
+
+    };
+
+    template<int D, typename QUANTISED_TYPE, typename STRUCT_TYPE>
+    QuantisedIndex<D, QUANTISED_TYPE, STRUCT_TYPE>::QuantisedIndex(
+        const Quantiser<D, QUANTISED_TYPE>& quantiser, STRUCT_TYPE* structure)
+    : m_quantiser(quantiser), m_structure(structure)
+    {
+    }
+
+    template<int D, typename QUANTISED_TYPE, typename STRUCT_TYPE>
+    bool QuantisedIndex<D, QUANTISED_TYPE, STRUCT_TYPE>::insert(
+        const Point<D, Real>& point)
+    {
+        return m_structure->insert(m_quantiser.quantise(point));
+    }
+
+    template<int D, typename QUANTISED_TYPE, typename STRUCT_TYPE>
+    bool QuantisedIndex<D, QUANTISED_TYPE, STRUCT_TYPE>::remove(
+        const Point<D, Real>& point)
+    {
+        return m_structure->remove(m_quantiser.quantise(point));
+    }
+
+    template<int D, typename QUANTISED_TYPE, typename STRUCT_TYPE>
+    bool QuantisedIndex<D, QUANTISED_TYPE, STRUCT_TYPE>::query(
+        const Point<D, Real>& point)
+    {
+        return m_structure->query(m_quantiser.quantise(point));
+    }
+
+    template<int D, typename QUANTISED_TYPE, typename STRUCT_TYPE>
+    typename QuantisedIndex<D, QUANTISED_TYPE, STRUCT_TYPE>::PointList
+    QuantisedIndex<D, QUANTISED_TYPE, STRUCT_TYPE>::rangeQuery(
+        const Boundary<D, Real>& region)
+    {
+        PointList results;
+        dequantiseAll(m_structure->rangeQuery(m_quantiser.quantise(region)),
+                      results);
+        return results;
+    }
+
+    template<int D, typename QUANTISED_TYPE, typename STRUCT_TYPE>
+    typename QuantisedIndex<D, QUANTISED_TYPE, STRUCT_TYPE>::PointList
+    QuantisedIndex<D, QUANTISED_TYPE, STRUCT_TYPE>::knn(
+        const Point<D, Real>& point, unsigned int k)
+    {
+        PointList results;
+        dequantiseAll(m_structure->knn(m_quantiser.quantise(point), k),
+                      results);
+        return results;
+    }
+
+    template<int D, typename QUANTISED_TYPE, typename STRUCT_TYPE>
+    inline
+    const Quantiser<D, QUANTISED_TYPE>&
+    QuantisedIndex<D, QUANTISED_TYPE, STRUCT_TYPE>::quantiser() const
+    {
+        return m_quantiser;
+    }
+
+    template<int D, typename QUANTISED_TYPE, typename STRUCT_TYPE>
+    inline
+    STRUCT_TYPE* QuantisedIndex<D, QUANTISED_TYPE, STRUCT_TYPE>::structure()
+    {
+        return m_structure;
+    }
+
+    template<int D, typename QUANTISED_TYPE, typename STRUCT_TYPE>
+    inline
+    MemoryUsage
+    QuantisedIndex<D, QUANTISED_TYPE, STRUCT_TYPE>::memoryUsage() const
+    {
+        return m_structure->memoryUsage();
+    }
+
+    template<int D, typename QUANTISED_TYPE, typename STRUCT_TYPE>
+    void QuantisedIndex<D, QUANTISED_TYPE, STRUCT_TYPE>::dequantiseAll(
+        const std::vector< Point<D, QUANTISED_TYPE> >& quantised,
+        PointList& results) const
+    {
+        results.reserve(results.size() + quantised.size());
+        for (typename std::vector< Point<D, QUANTISED_TYPE> >::const_iterator
+            it = quantised.begin(); (it != quantised.end()); it++)
+        {
+            results.push_back(m_quantiser.dequantise(*it));
+        }
+    }
+
+}
+
+#endif
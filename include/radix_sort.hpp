@@ -0,0 +1,147 @@
+/******************************************************************************
+
+mdsearch - Lightweight C++ library implementing a collection of
+           multi-dimensional search structures
+
+File:        radix_sort.hpp
+Description: Parallel least-significant-digit radix sort, used to sort large
+             collections of items by integer keys (such as cell keys or
+             space-filling curve keys) when bulk loading structures.
+
+             Threads are used if OpenMP is enabled. Otherwise, the sort runs
+             on a single thread.
+
+*******************************************************************************
+
+The MIT License (MIT)
+
+Copyright (c) 2014 Donald Whyte
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+******************************************************************************/
+
+#ifndef MDSEARCH_RADIX_SORT_H
+#define MDSEARCH_RADIX_SORT_H
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+#ifdef _OPENMP
+    #include <omp.h>
+#endif
+
+namespace mdsearch
+{
+
+    /** Sort (key, value) pairs by increasing key. The sort is stable.
+     *
+     * KEY_TYPE must be an integral type and all keys must be non-negative.
+     * Only as many 8-bit digits as are needed to represent the largest key
+     * are sorted, so small keys sort in fewer passes.
+     *
+     * Each pass builds a histogram of digits for each thread's chunk of
+     * items, computes the position of each (digit, thread) pair with a
+     * prefix sum and then scatters items to their positions in parallel. */
+    template<typename KEY_TYPE, typename VALUE_TYPE>
+    void radixSort(std::vector< std::pair<KEY_TYPE, VALUE_TYPE> >& items)
+    {
+        typedef std::pair<KEY_TYPE, VALUE_TYPE> Item;
+        static const int DIGIT_BITS = 8;
+        static const std::size_t NUM_DIGITS = 1 << DIGIT_BITS;
+
+        const long numItems = static_cast<long>(items.size());
+        if (numItems < 2)
+            return;
+
+        // Determine how many passes are required to sort the largest key
+        unsigned long long maxKey = 0;
+        for (long i = 0; (i < numItems); i++)
+        {
+            maxKey = std::max(maxKey,
+                static_cast<unsigned long long>(items[i].first));
+        }
+        int numPasses = 0;
+        while (maxKey)
+        {
+            numPasses++;
+            maxKey >>= DIGIT_BITS;
+        }
+
+        std::vector<Item> buffer(items.size());
+        std::vector<std::size_t> offsets;
+        for (int pass = 0; (pass < numPasses); pass++)
+        {
+            const int shift = pass * DIGIT_BITS;
+
+            #pragma omp parallel
+            {
+                int thread = 0;
+                int numThreads = 1;
+                #ifdef _OPENMP
+                thread = omp_get_thread_num();
+                numThreads = omp_get_num_threads();
+                #endif
+
+                #pragma omp single
+                offsets.assign(numThreads * NUM_DIGITS, 0);
+                // (implicit barrier after single construct)
+
+                const long start = (numItems * thread) / numThreads;
+                const long end = (numItems * (thread + 1)) / numThreads;
+                std::size_t* threadOffsets = &offsets[thread * NUM_DIGITS];
+                for (long i = start; (i < end); i++)
+                {
+                    const std::size_t digit = (static_cast<unsigned long long>(
+                        items[i].first) >> shift) & (NUM_DIGITS - 1);
+                    threadOffsets[digit]++;
+                }
+
+                #pragma omp barrier
+                #pragma omp single
+                {
+                    // Items with lower digits come first. Items with the
+                    // same digit are ordered by thread, keeping sort stable.
+                    std::size_t total = 0;
+                    for (std::size_t digit = 0; (digit < NUM_DIGITS); digit++)
+                    {
+                        for (int t = 0; (t < numThreads); t++)
+                        {
+                            std::size_t count = offsets[t * NUM_DIGITS + digit];
+                            offsets[t * NUM_DIGITS + digit] = total;
+                            total += count;
+                        }
+                    }
+                }
+
+                for (long i = start; (i < end); i++)
+                {
+                    const std::size_t digit = (static_cast<unsigned long long>(
+                        items[i].first) >> shift) & (NUM_DIGITS - 1);
+                    buffer[threadOffsets[digit]++] = items[i];
+                }
+            }
+
+            items.swap(buffer);
+        }
+    }
+
+}
+
+#endif
@@ -0,0 +1,111 @@
+/******************************************************************************
+
+mdsearch - Lightweight C++ library implementing a collection of
+           multi-dimensional search structures
+
+File:        simd.hpp
+Description: Detects which SIMD instruction sets can be used by the
+             vectorised kernels in the library.
+
+             Kernels are compiled for specific instruction sets using
+             function target attributes, so the rest of the library can be
+             built for a generic CPU. Whether a kernel can be used is
+             checked at runtime. Define MDSEARCH_NO_SIMD to disable all
+             vectorised kernels.
+
+             Kernels written as plain loops that the compiler can vectorise
+             are marked with MDSEARCH_TARGET_CLONES instead. The compiler
+             builds a copy of each for AVX-512, AVX2 and the default
+             instruction set (SSE2 on x86-64), and the copy to use is picked
+             when the program is loaded.
+
+             Small functions that are inlined into inner loops, such as
+             point comparison, can't afford a runtime check. These use the
+             instruction sets the compiler is targeting instead, which are
+             given by the MDSEARCH_SSE2 and MDSEARCH_AVX2 macros. SSE2 is
+             always available on x86-64. AVX2 needs -mavx2 or -march=native.
+
+*******************************************************************************
+
+The MIT License (MIT)
+
+Copyright (c) 2014 Donald Whyte
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+******************************************************************************/
+
+#ifndef MDSEARCH_SIMD_H
+#define MDSEARCH_SIMD_H
+
+#if !defined(MDSEARCH_NO_SIMD) && defined(__GNUC__) \
+    && (defined(__x86_64__) || defined(__i386__))
+    #define MDSEARCH_X86_SIMD 1
+    #include <immintrin.h>
+    #ifdef __SSE2__
+        #define MDSEARCH_SSE2 1
+    #endif
+    #ifdef __AVX2__
+        #define MDSEARCH_AVX2 1
+    #endif
+    #define MDSEARCH_TARGET_CLONES \
+        __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+    #define MDSEARCH_TARGET_CLONES
+#endif
+
+// Fixed-length loops over vector lanes are completely unrolled by GCC before
+// they can be vectorised, which leaves scalar code. This stops that.
+#if defined(__GNUC__) && !defined(__clang__)
+    #define MDSEARCH_VECTORISE_LOOP _Pragma("GCC unroll 1")
+#else
+    #define MDSEARCH_VECTORISE_LOOP
+#endif
+
+namespace mdsearch
+{
+
+    /** Return true if the CPU running the program supports AVX2
+     * instructions and the AVX2 kernels have been compiled. */
+    inline bool cpuSupportsAVX2()
+    {
+        #ifdef MDSEARCH_X86_SIMD
+        static const bool supported = __builtin_cpu_supports("avx2");
+        return supported;
+        #else
+        return false;
+        #endif
+    }
+
+    /** Return true if the CPU running the program supports the BMI2 bit
+     * manipulation instructions (e.g. pdep) and x86 kernels have been
+     * compiled. */
+    inline bool cpuSupportsBMI2()
+    {
+        #ifdef MDSEARCH_X86_SIMD
+        static const bool supported = __builtin_cpu_supports("bmi2");
+        return supported;
+        #else
+        return false;
+        #endif
+    }
+
+}
+
+#endif
@@ -0,0 +1,481 @@
+/******************************************************************************
+
+mdsearch - Lightweight C++ library implementing a collection of
+           multi-dimensional search structures
+
+File:        space_filling_curve.hpp
+Description: Computes Z-order (Morton) and Hilbert curve keys of points,
+             relative to a boundary. Points with close keys are close in
+             space, so the keys can be used to sort points for
+             locality-preserving bulk loads, or as hash keys.
+
+*******************************************************************************
+
+The MIT License (MIT)
+
+Copyright (c) 2014 Donald Whyte
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+******************************************************************************/
+
+#ifndef MDSEARCH_SPACE_FILLING_CURVE_H
+#define MDSEARCH_SPACE_FILLING_CURVE_H
+
+#include "types.hpp"
+#include "point.hpp"
+#include "boundary.hpp"
+#include "dataset.hpp"
+#include "hashstruct.hpp"
+#include "radix_sort.hpp"
+#include "simd.hpp"
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+namespace mdsearch
+{
+
+    /** Largest number of bits a space-filling curve key can contain. Keys
+     * are stored in HashTypes and kept non-negative, so they can be sorted
+     * with radixSort(). */
+    static const unsigned int MAX_CURVE_KEY_BITS = 63;
+
+    /** Largest number of bits of each cell coordinate in a key. */
+    static const unsigned int MAX_CURVE_BITS_PER_DIMENSION = 32;
+
+    /** Interleaves the bits of grid coordinates, so the bth bit of the dth
+     * coordinate becomes bit (b * numDims + d) of the key. Uses the BMI2
+     * pdep instruction to deposit each coordinate's bits at once if the
+     * CPU supports it. */
+    class BitInterleaver
+    {
+
+    public:
+        /** Construct interleaver for 'numDims' coordinates that have
+         * 'bitsPerDim' bits each. numDims * bitsPerDim must not exceed
+         * MAX_CURVE_KEY_BITS. */
+        BitInterleaver(unsigned int numDims, unsigned int bitsPerDim);
+
+        /** Return key made by interleaving the given coordinates. */
+        HashType interleave(const unsigned long long* coords) const;
+
+    private:
+        /** Deposit each coordinate's bits with pdep. */
+        #ifdef MDSEARCH_X86_SIMD
+        __attribute__((target("bmi2")))
+        HashType interleaveBMI2(const unsigned long long* coords) const;
+        #endif
+
+        unsigned int m_numDims;
+        unsigned int m_bitsPerDim;
+        /** Mask of the key bits each coordinate's bits are deposited in. */
+        std::vector<unsigned long long> m_masks;
+        bool m_useBMI2;
+
+    };
+
+    inline BitInterleaver::BitInterleaver(unsigned int numDims,
+                                          unsigned int bitsPerDim)
+    : m_numDims(numDims), m_bitsPerDim(bitsPerDim), m_masks(numDims, 0),
+      m_useBMI2(cpuSupportsBMI2())
+    {
+        for (unsigned int d = 0; (d < numDims); d++)
+        {
+            for (unsigned int b = 0; (b < bitsPerDim); b++)
+                m_masks[d] |= 1ULL << (b * numDims + d);
+        }
+    }
+
+    inline HashType BitInterleaver::interleave(
+        const unsigned long long* coords) const
+    {
+        #ifdef MDSEARCH_X86_SIMD
+        if (m_useBMI2)
+            return interleaveBMI2(coords);
+        #endif
+
+        unsigned long long key = 0;
+        for (unsigned int b = 0; (b < m_bitsPerDim); b++)
+        {
+            for (unsigned int d = 0; (d < m_numDims); d++)
+                key |= ((coords[d] >> b) & 1ULL) << (b * m_numDims + d);
+        }
+        return static_cast<HashType>(key);
+    }
+
+    #ifdef MDSEARCH_X86_SIMD
+    __attribute__((target("bmi2")))
+    inline HashType BitInterleaver::interleaveBMI2(
+        const unsigned long long* coords) const
+    {
+        unsigned long long key = 0;
+        for (unsigned int d = 0; (d < m_numDims); d++)
+            key |= _pdep_u64(coords[d], m_masks[d]);
+        return static_cast<HashType>(key);
+    }
+    #endif
+
+    /** Map the first 'numDims' coordinates of a point, with 'bitsPerDim'
+     * bits each, from Hilbert curve axes to the transposed Hilbert index
+     * in place, using Skilling's algorithm ("Programming the Hilbert
+     * curve", 2004). Interleaving the bits of the result, with coords[0]
+     * as the most significant coordinate, gives the Hilbert index. */
+    inline void hilbertTranspose(unsigned long long* coords,
+                                 unsigned int numDims, unsigned int bitsPerDim)
+    {
+        const unsigned long long top = 1ULL << (bitsPerDim - 1);
+        // Inverse undo of the excess work done by the Gray code
+        for (unsigned long long q = top; (q > 1); q >>= 1)
+        {
+            const unsigned long long p = q - 1;
+            for (unsigned int i = 0; (i < numDims); i++)
+            {
+                // If bit q of coords[i] is set, invert the low bits of
+                // coords[0]. Otherwise, exchange the low bits of coords[0]
+                // and coords[i]. Masks are used instead of branches, since
+                // the bits are unpredictable.
+                const unsigned long long set = 0ULL - ((coords[i] & q) != 0);
+                const unsigned long long t = (coords[0] ^ coords[i]) & p;
+                coords[0] ^= (p & set) | (t & ~set);
+                coords[i] ^= t & ~set;
+            }
+        }
+        // Gray encode
+        for (unsigned int i = 1; (i < numDims); i++)
+            coords[i] ^= coords[i - 1];
+        unsigned long long t = 0;
+        for (unsigned long long q = top; (q > 1); q >>= 1)
+        {
+            if (coords[numDims - 1] & q)
+                t ^= q - 1;
+        }
+        for (unsigned int i = 0; (i < numDims); i++)
+            coords[i] ^= t;
+    }
+
+    /** Divides each dimension of a boundary into 2^bitsPerDimension() equal
+     * cells and computes the cell coordinates of points. Base of the
+     * space-filling curves. Points outside of the boundary are clamped to
+     * the cells at its edges.
+     *
+     * At most MAX_CURVE_KEY_BITS bits are used in total. If D is larger
+     * than that, only the first MAX_CURVE_KEY_BITS dimensions contribute
+     * to keys. */
+    template<int D, typename ELEM_TYPE>
+    class SpaceFillingCurve
+    {
+
+    public:
+        /** Number of dimensions that contribute to keys. */
+        static const unsigned int NUM_KEY_DIMENSIONS =
+            (D < static_cast<int>(MAX_CURVE_KEY_BITS)) ? D : MAX_CURVE_KEY_BITS;
+
+        /** Construct curve covering given boundary. If 'bitsPerDimension'
+         * is zero, or would make keys too long, the most bits that fit in
+         * a key (up to MAX_CURVE_BITS_PER_DIMENSION) are used. */
+        SpaceFillingCurve(const Boundary<D, ELEM_TYPE>& boundary,
+                          unsigned int bitsPerDimension = 0);
+
+        /** Return number of bits of each coordinate in keys. */
+        unsigned int bitsPerDimension() const;
+
+    protected:
+        /** Store cell coordinates of first NUM_KEY_DIMENSIONS dimensions of
+         * point in 'coords'. */
+        void cellCoordinates(const Point<D, ELEM_TYPE>& p,
+                             unsigned long long* coords) const;
+
+        unsigned int m_bitsPerDimension;
+        BitInterleaver m_interleaver;
+
+    private:
+        /** Return number of bits to use per dimension when 'requested'
+         * bits are asked for. */
+        static unsigned int chooseBitsPerDimension(unsigned int requested);
+
+        Real m_mins[NUM_KEY_DIMENSIONS];
+        /** Number of cells per unit in each dimension. */
+        double m_scales[NUM_KEY_DIMENSIONS];
+        double m_maxCell;
+
+    };
+
+    /** Z-order (Morton) curve. Keys are made by interleaving the bits of
+     * cell coordinates, which is cheap but makes large jumps in space
+     * between some consecutive keys. */
+    template<int D, typename ELEM_TYPE>
+    class MortonCurve : public SpaceFillingCurve<D, ELEM_TYPE>
+    {
+
+    public:
+        MortonCurve(const Boundary<D, ELEM_TYPE>& boundary,
+                    unsigned int bitsPerDimension = 0);
+
+        /** Return Morton key of point. */
+        HashType key(const Point<D, ELEM_TYPE>& p) const;
+
+    };
+
+    /** Hilbert curve. Cells with consecutive keys are always adjacent, so
+     * locality is better preserved than with the Morton curve, at the
+     * cost of computing keys more slowly. */
+    template<int D, typename ELEM_TYPE>
+    class HilbertCurve : public SpaceFillingCurve<D, ELEM_TYPE>
+    {
+
+    public:
+        HilbertCurve(const Boundary<D, ELEM_TYPE>& boundary,
+                     unsigned int bitsPerDimension = 0);
+
+        /** Return Hilbert key of point. */
+        HashType key(const Point<D, ELEM_TYPE>& p) const;
+
+    };
+
+    /** Compute keys of 'numPoints' points on the given CURVE, storing the
+     * ith key in keys[i]. Keys are computed in parallel if OpenMP is
+     * enabled. */
+    template<typename CURVE, int D, typename ELEM_TYPE>
+    void computeCurveKeys(const CURVE& curve,
+                          const Point<D, ELEM_TYPE>* points,
+                          unsigned int numPoints, HashType* keys);
+
+    /** Compute keys of all points in dataset on the given CURVE. */
+    template<typename CURVE, int D, typename ELEM_TYPE>
+    void computeCurveKeys(const CURVE& curve,
+                          const Dataset<D, ELEM_TYPE>& dataset,
+                          std::vector<HashType>& keys);
+
+    /** Sort points by their keys on the given CURVE, so points close
+     * together in the list are close together in space. */
+    template<typename CURVE, int D, typename ELEM_TYPE>
+    void sortByCurve(const CURVE& curve,
+                     std::vector< Point<D, ELEM_TYPE> >& points);
+
+    /** Insert points into any structure in the order of their keys on the
+     * given CURVE, which improves the locality of memory accesses while
+     * loading. Returns number of points inserted. */
+    template<typename STRUCT_TYPE, typename CURVE, int D, typename ELEM_TYPE>
+    unsigned int insertInCurveOrder(STRUCT_TYPE* structure,
+        const CURVE& curve, const std::vector< Point<D, ELEM_TYPE> >& points);
+
+    /** Hash structure which hashes points to their keys on a CURVE, such as
+     * MortonCurve or HilbertCurve. Points in the same bucket lie in the
+     * same cell, so buckets can be large if the cells are. */
+    template<int D, typename ELEM_TYPE, typename CURVE>
+    class CurveHash : public HashStructure<D, ELEM_TYPE>
+    {
+
+    public:
+        /** Construct hash structure with given curve covering a boundary. */
+        CurveHash(const Boundary<D, ELEM_TYPE>& boundary,
+                  unsigned int bitsPerDimension = 0);
+
+    protected:
+        /** Return point's key on the curve. */
+        virtual HashType hashPoint(const Point<D, ELEM_TYPE>& p);
+
+        /** Hash a batch of points, without the virtual call per point. */
+        virtual void hashPoints(const Point<D, ELEM_TYPE>* points,
+                                unsigned int numPoints, HashType* keys);
+
+    private:
+        CURVE m_curve;
+
+    };
+
+    template<int D, typename ELEM_TYPE>
+    const unsigned int SpaceFillingCurve<D, ELEM_TYPE>::NUM_KEY_DIMENSIONS;
+
+    template<int D, typename ELEM_TYPE>
+    SpaceFillingCurve<D, ELEM_TYPE>::SpaceFillingCurve(
+        const Boundary<D, ELEM_TYPE>& boundary, unsigned int bitsPerDimension)
+    : m_bitsPerDimension(chooseBitsPerDimension(bitsPerDimension)),
+      m_interleaver(NUM_KEY_DIMENSIONS, m_bitsPerDimension)
+    {
+        const double numCells = static_cast<double>(1ULL << m_bitsPerDimension);
+        m_maxCell = numCells - 1;
+        for (unsigned int d = 0; (d < NUM_KEY_DIMENSIONS); d++)
+        {
+            m_mins[d] = boundary[d].min;
+            double range = static_cast<double>(boundary[d].max)
+                - static_cast<double>(boundary[d].min);
+            m_scales[d] = (range > 0) ? (numCells / range) : 0.0;
+        }
+    }
+
+    template<int D, typename ELEM_TYPE>
+    unsigned int SpaceFillingCurve<D, ELEM_TYPE>::chooseBitsPerDimension(
+        unsigned int requested)
+    {
+        unsigned int maxBits = std::min(MAX_CURVE_BITS_PER_DIMENSION,
+            MAX_CURVE_KEY_BITS / NUM_KEY_DIMENSIONS);
+        return (requested > 0 && requested < maxBits) ? requested : maxBits;
+    }
+
+    template<int D, typename ELEM_TYPE>
+    inline
+    unsigned int SpaceFillingCurve<D, ELEM_TYPE>::bitsPerDimension() const
+    {
+        return m_bitsPerDimension;
+    }
+
+    template<int D, typename ELEM_TYPE>
+    inline
+    void SpaceFillingCurve<D, ELEM_TYPE>::cellCoordinates(
+        const Point<D, ELEM_TYPE>& p, unsigned long long* coords) const
+    {
+        for (unsigned int d = 0; (d < NUM_KEY_DIMENSIONS); d++)
+        {
+            double cell = (static_cast<double>(p[d]) - m_mins[d])
+                * m_scales[d];
+            // Written so NaNs are clamped to the first cell
+            if (!(cell > 0))
+                cell = 0;
+            else if (cell > m_maxCell)
+                cell = m_maxCell;
+            coords[d] = static_cast<unsigned long long>(cell);
+        }
+    }
+
+    template<int D, typename ELEM_TYPE>
+    MortonCurve<D, ELEM_TYPE>::MortonCurve(
+        const Boundary<D, ELEM_TYPE>& boundary, unsigned int bitsPerDimension)
+    : SpaceFillingCurve<D, ELEM_TYPE>(boundary, bitsPerDimension)
+    {
+    }
+
+    template<int D, typename ELEM_TYPE>
+    inline
+    HashType MortonCurve<D, ELEM_TYPE>::key(const Point<D, ELEM_TYPE>& p) const
+    {
+        unsigned long long coords[SpaceFillingCurve<D, ELEM_TYPE>
+            ::NUM_KEY_DIMENSIONS];
+        this->cellCoordinates(p, coords);
+        return this->m_interleaver.interleave(coords);
+    }
+
+    template<int D, typename ELEM_TYPE>
+    HilbertCurve<D, ELEM_TYPE>::HilbertCurve(
+        const Boundary<D, ELEM_TYPE>& boundary, unsigned int bitsPerDimension)
+    : SpaceFillingCurve<D, ELEM_TYPE>(boundary, bitsPerDimension)
+    {
+    }
+
+    template<int D, typename ELEM_TYPE>
+    inline
+    HashType HilbertCurve<D, ELEM_TYPE>::key(
+        const Point<D, ELEM_TYPE>& p) const
+    {
+        static const unsigned int NUM_DIMS =
+            SpaceFillingCurve<D, ELEM_TYPE>::NUM_KEY_DIMENSIONS;
+        unsigned long long coords[NUM_DIMS];
+        this->cellCoordinates(p, coords);
+        hilbertTranspose(coords, NUM_DIMS, this->m_bitsPerDimension);
+        // The interleaver treats the last coordinate as most significant
+        std::reverse(coords, coords + NUM_DIMS);
+        return this->m_interleaver.interleave(coords);
+    }
+
+    template<typename CURVE, int D, typename ELEM_TYPE>
+    void computeCurveKeys(const CURVE& curve,
+                          const Point<D, ELEM_TYPE>* points,
+                          unsigned int numPoints, HashType* keys)
+    {
+        const long n = static_cast<long>(numPoints);
+        #pragma omp parallel for schedule(static)
+        for (long i = 0; i < n; i++)
+        {
+            keys[i] = curve.key(points[i]);
+        }
+    }
+
+    template<typename CURVE, int D, typename ELEM_TYPE>
+    void computeCurveKeys(const CURVE& curve,
+                          const Dataset<D, ELEM_TYPE>& dataset,
+                          std::vector<HashType>& keys)
+    {
+        keys.resize(dataset.size());
+        if (dataset.size() > 0)
+            computeCurveKeys(curve, dataset.data(), dataset.size(), &keys[0]);
+    }
+
+    template<typename CURVE, int D, typename ELEM_TYPE>
+    void sortByCurve(const CURVE& curve,
+                     std::vector< Point<D, ELEM_TYPE> >& points)
+    {
+        if (points.size() < 2)
+            return;
+        std::vector<HashType> keys(points.size());
+        computeCurveKeys(curve, &points[0], points.size(), &keys[0]);
+
+        std::vector< std::pair<HashType, unsigned int> > sorted(points.size());
+        for (unsigned int i = 0; (i < points.size()); i++)
+            sorted[i] = std::make_pair(keys[i], i);
+        radixSort(sorted);
+
+        std::vector< Point<D, ELEM_TYPE> > reordered;
+        reordered.reserve(points.size());
+        for (unsigned int i = 0; (i < sorted.size()); i++)
+            reordered.push_back(points[sorted[i].second]);
+        points.swap(reordered);
+    }
+
+    template<typename STRUCT_TYPE, typename CURVE, int D, typename ELEM_TYPE>
+    unsigned int insertInCurveOrder(STRUCT_TYPE* structure,
+        const CURVE& curve, const std::vector< Point<D, ELEM_TYPE> >& points)
+    {
+        std::vector< Point<D, ELEM_TYPE> > sorted(points);
+        sortByCurve(curve, sorted);
+        unsigned int numInserted = 0;
+        for (unsigned int i = 0; (i < sorted.size()); i++)
+        {
+            if (structure->insert(sorted[i]))
+                numInserted++;
+        }
+        return numInserted;
+    }
+
+    template<int D, typename ELEM_TYPE, typename CURVE>
+    CurveHash<D, ELEM_TYPE, CURVE>::CurveHash(
+        const Boundary<D, ELEM_TYPE>& boundary, unsigned int bitsPerDimension)
+    : m_curve(boundary, bitsPerDimension)
+    {
+    }
+
+    template<int D, typename ELEM_TYPE, typename CURVE>
+    HashType CurveHash<D, ELEM_TYPE, CURVE>::hashPoint(
+        const Point<D, ELEM_TYPE>& p)
+    {
+        return m_curve.key(p);
+    }
+
+    template<int D, typename ELEM_TYPE, typename CURVE>
+    void CurveHash<D, ELEM_TYPE, CURVE>::hashPoints(
+        const Point<D, ELEM_TYPE>* points, unsigned int numPoints,
+        HashType* keys)
+    {
+        for (unsigned int i = 0; (i < numPoints); i++)
+            keys[i] = m_curve.key(points[i]);
+    }
+
+}
+
+#endif
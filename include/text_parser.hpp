@@ -0,0 +1,412 @@
+/******************************************************************************
+
+mdsearch - Lightweight C++ library implementing a collection of
+           multi-dimensional search structures
+
+File:        text_parser.hpp
+Description: Parses points from text files. Files are memory-mapped and
+             split into line-aligned chunks, which are parsed in parallel
+             straight into the final list of points.
+
+*******************************************************************************
+
+The MIT License (MIT)
+
+Copyright (c) 2014 Donald Whyte
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+******************************************************************************/
+
+#ifndef MDSEARCH_TEXT_PARSER_H
+#define MDSEARCH_TEXT_PARSER_H
+
+#include "point.hpp"
+#include <boost/lexical_cast.hpp>
+#include <charconv>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+#if defined(__unix__)
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+#ifdef _OPENMP
+    #include <omp.h>
+#endif
+
+namespace mdsearch
+{
+
+    /** Smallest number of bytes parsed by each chunk of a file. Smaller
+     * files are split into fewer chunks. */
+    static const std::size_t MIN_TEXT_CHUNK_SIZE = 1 << 20;
+
+    /** Read-only view of the contents of a file. The file is
+     * memory-mapped if the platform supports it, otherwise its contents
+     * are read into a buffer. */
+    class MappedFile
+    {
+
+    public:
+        /** Open file with given name. Use isOpen() to check if the file
+         * could be read. */
+        MappedFile(const std::string& filename);
+        ~MappedFile();
+
+        /** Return true if the file's contents could be read. */
+        bool isOpen() const;
+        /** Return pointer to the first byte of the file. */
+        const char* data() const;
+        /** Return size of the file in bytes. */
+        std::size_t size() const;
+
+    private:
+        // Mappings can't be copied
+        MappedFile(const MappedFile&);
+        MappedFile& operator=(const MappedFile&);
+
+        bool readIntoBuffer(const std::string& filename);
+
+        const char* m_data;
+        std::size_t m_size;
+        bool m_open;
+        /** True if m_data points to a mapping that must be unmapped. */
+        bool m_mapped;
+        /** Contents of the file, if it couldn't be mapped. */
+        std::vector<char> m_buffer;
+
+    };
+
+    inline MappedFile::MappedFile(const std::string& filename)
+    : m_data(NULL), m_size(0), m_open(false), m_mapped(false)
+    {
+        #if defined(__unix__)
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd == -1)
+            return;
+        struct stat info;
+        if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode))
+        {
+            m_size = static_cast<std::size_t>(info.st_size);
+            m_open = true;
+            // Empty files can't be mapped, but there's nothing to read
+            if (m_size > 0)
+            {
+                void* mapping = mmap(NULL, m_size, PROT_READ, MAP_PRIVATE,
+                                     fd, 0);
+                if (mapping != MAP_FAILED)
+                {
+                    madvise(mapping, m_size, MADV_SEQUENTIAL);
+                    m_data = static_cast<const char*>(mapping);
+                    m_mapped = true;
+                }
+                else
+                {
+                    m_open = readIntoBuffer(filename);
+                }
+            }
+        }
+        close(fd);
+        #else
+        m_open = readIntoBuffer(filename);
+        #endif
+    }
+
+    inline MappedFile::~MappedFile()
+    {
+        #if defined(__unix__)
+        if (m_mapped)
+            munmap(const_cast<char*>(m_data), m_size);
+        #endif
+    }
+
+    inline bool MappedFile::readIntoBuffer(const std::string& filename)
+    {
+        std::ifstream file(filename.c_str(), std::ios::binary);
+        if (!file.is_open())
+            return false;
+        file.seekg(0, std::ios::end);
+        m_buffer.resize(static_cast<std::size_t>(file.tellg()));
+        file.seekg(0, std::ios::beg);
+        if (!m_buffer.empty())
+            file.read(&m_buffer[0], m_buffer.size());
+        m_data = m_buffer.empty() ? NULL : &m_buffer[0];
+        m_size = m_buffer.size();
+        return !file.fail();
+    }
+
+    inline bool MappedFile::isOpen() const
+    {
+        return m_open;
+    }
+
+    inline const char* MappedFile::data() const
+    {
+        return m_data;
+    }
+
+    inline std::size_t MappedFile::size() const
+    {
+        return m_size;
+    }
+
+    /** Return true if character separates values on the same line. */
+    inline bool isValueSeparator(char c)
+    {
+        return (c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f');
+    }
+
+    /** Parses a single value from text. Arithmetic types are parsed with
+     * std::from_chars, which doesn't allocate or depend on the locale.
+     * Other types are converted with boost::lexical_cast. */
+    template<typename ELEM_TYPE,
+             bool IS_ARITHMETIC = std::is_arithmetic<ELEM_TYPE>::value>
+    struct ValueParser
+    {
+        /** Parse value at the start of [begin, end), which must not start
+         * with whitespace. Returns pointer to the first character after
+         * the value, or NULL if there is no valid value. */
+        static const char* parse(const char* begin, const char* end,
+                                 ELEM_TYPE& value)
+        {
+            const char* tokenEnd = begin;
+            while (tokenEnd != end && !isValueSeparator(*tokenEnd)
+                && *tokenEnd != '\n')
+            {
+                tokenEnd++;
+            }
+            try
+            {
+                value = boost::lexical_cast<ELEM_TYPE>(
+                    begin, static_cast<std::size_t>(tokenEnd - begin));
+            }
+            catch (boost::bad_lexical_cast& ex)
+            {
+                return NULL;
+            }
+            return tokenEnd;
+        }
+    };
+
+    template<typename ELEM_TYPE>
+    struct ValueParser<ELEM_TYPE, true>
+    {
+        static const char* parse(const char* begin, const char* end,
+                                 ELEM_TYPE& value)
+        {
+            // from_chars doesn't accept an explicit plus sign
+            if (*begin == '+' && begin + 1 != end)
+                begin++;
+            std::from_chars_result result = std::from_chars(begin, end, value);
+            if (result.ec != std::errc())
+                return NULL;
+            return result.ptr;
+        }
+    };
+
+    /** Parse the header of a text dataset at the start of [begin, end),
+     * which contains the dimensionality of the points and the number of
+     * points. Returns pointer to the first character after the header, or
+     * NULL if the header isn't two integers. */
+    inline const char* parseTextHeader(const char* begin, const char* end,
+                                       int& numDimensions, int& numPoints)
+    {
+        int* header[2] = { &numDimensions, &numPoints };
+        for (unsigned int i = 0; (i < 2); i++)
+        {
+            while (begin != end
+                && (isValueSeparator(*begin) || *begin == '\n'))
+            {
+                begin++;
+            }
+            if (begin == end)
+                return NULL;
+            begin = ValueParser<int>::parse(begin, end, *header[i]);
+            if (begin == NULL)
+                return NULL;
+        }
+        return begin;
+    }
+
+    /** Return pointer to the end of the line starting at 'begin', which
+     * is either the line's newline character or 'end'. */
+    inline const char* findLineEnd(const char* begin, const char* end)
+    {
+        const void* newline = memchr(begin, '\n', end - begin);
+        return (newline != NULL) ? static_cast<const char*>(newline) : end;
+    }
+
+    /** Return true if the line [begin, lineEnd) only contains
+     * whitespace. */
+    inline bool isBlankLine(const char* begin, const char* lineEnd)
+    {
+        while (begin != lineEnd && isValueSeparator(*begin))
+            begin++;
+        return (begin == lineEnd);
+    }
+
+    /** Count the lines in [begin, end) which are not blank. Each of these
+     * lines contains one point. */
+    inline std::size_t countPointLines(const char* begin, const char* end)
+    {
+        std::size_t count = 0;
+        while (begin != end)
+        {
+            const char* lineEnd = findLineEnd(begin, end);
+            if (!isBlankLine(begin, lineEnd))
+                count++;
+            begin = (lineEnd == end) ? end : lineEnd + 1;
+        }
+        return count;
+    }
+
+    /** Parse the point on the line [begin, lineEnd) into 'values'. The
+     * first 'numDimensions' values on the line are used. Missing values
+     * are set to zero, as are values that can't be parsed. */
+    template<typename ELEM_TYPE>
+    void parsePointLine(const char* begin, const char* lineEnd,
+                        ELEM_TYPE* values, unsigned int numDimensions)
+    {
+        for (unsigned int d = 0; (d < numDimensions); d++)
+        {
+            while (begin != lineEnd && isValueSeparator(*begin))
+                begin++;
+            if (begin == lineEnd)
+            {
+                values[d] = static_cast<ELEM_TYPE>(0);
+                continue;
+            }
+            const char* valueEnd = ValueParser<ELEM_TYPE>::parse(
+                begin, lineEnd, values[d]);
+            if (valueEnd == NULL)
+            {
+                // Skip the invalid value
+                values[d] = static_cast<ELEM_TYPE>(0);
+                while (begin != lineEnd && !isValueSeparator(*begin))
+                    begin++;
+            }
+            else
+            {
+                begin = valueEnd;
+            }
+        }
+    }
+
+    /** Parse points in [begin, end), one per non-blank line, into
+     * 'points'. At most 'maxPoints' points are parsed. Each line is parsed
+     * with parsePointLine(). Returns number of points parsed. */
+    template<int D, typename ELEM_TYPE>
+    std::size_t parsePointLines(const char* begin, const char* end,
+                                Point<D, ELEM_TYPE>* points,
+                                std::size_t maxPoints)
+    {
+        std::size_t numParsed = 0;
+        while (begin != end && numParsed < maxPoints)
+        {
+            const char* lineEnd = findLineEnd(begin, end);
+            if (!isBlankLine(begin, lineEnd))
+            {
+                parsePointLine(begin, lineEnd, points[numParsed].asArray(), D);
+                numParsed++;
+            }
+            begin = (lineEnd == end) ? end : lineEnd + 1;
+        }
+        return numParsed;
+    }
+
+    /** Parse points in [begin, end), one per non-blank line, and append
+     * them to 'points'. At most 'maxPoints' points are parsed.
+     *
+     * The text is split into 'numChunks' chunks that start at the
+     * beginning of a line. If 'numChunks' is zero, a few chunks are used
+     * for each OpenMP thread. The points in each chunk are counted in
+     * parallel, so the position of each chunk's first point is known, and
+     * then each chunk is parsed in parallel straight into the list, which
+     * is only resized once. Returns number of points appended. */
+    template<int D, typename ELEM_TYPE>
+    std::size_t parsePoints(const char* begin, const char* end,
+                            std::vector< Point<D, ELEM_TYPE> >& points,
+                            std::size_t maxPoints,
+                            unsigned int numChunks = 0)
+    {
+        const std::size_t numBytes = end - begin;
+        if (numChunks == 0)
+        {
+            numChunks = 1;
+            #ifdef _OPENMP
+            numChunks = omp_get_max_threads() * 4;
+            #endif
+            numChunks = std::min<std::size_t>(numChunks,
+                numBytes / MIN_TEXT_CHUNK_SIZE + 1);
+        }
+
+        // Move each chunk boundary forward to the start of the next line
+        std::vector<const char*> chunkStarts(numChunks + 1, end);
+        chunkStarts[0] = begin;
+        for (unsigned int c = 1; (c < numChunks); c++)
+        {
+            const char* start = begin + (numBytes * c) / numChunks;
+            if (start < chunkStarts[c - 1])
+                start = chunkStarts[c - 1];
+            if (start != begin && start != end && *(start - 1) != '\n')
+            {
+                start = findLineEnd(start, end);
+                if (start != end)
+                    start++;
+            }
+            chunkStarts[c] = start;
+        }
+
+        const long numChunksLong = static_cast<long>(numChunks);
+        std::vector<std::size_t> chunkOffsets(numChunks + 1, 0);
+        #pragma omp parallel for schedule(dynamic)
+        for (long c = 0; c < numChunksLong; c++)
+        {
+            chunkOffsets[c + 1] = countPointLines(chunkStarts[c],
+                                                  chunkStarts[c + 1]);
+        }
+        for (unsigned int c = 0; (c < numChunks); c++)
+            chunkOffsets[c + 1] += chunkOffsets[c];
+        const std::size_t numPoints = std::min(chunkOffsets[numChunks],
+                                               maxPoints);
+
+        const std::size_t firstIndex = points.size();
+        points.resize(firstIndex + numPoints);
+        Point<D, ELEM_TYPE>* output = points.data() + firstIndex;
+        #pragma omp parallel for schedule(dynamic)
+        for (long c = 0; c < numChunksLong; c++)
+        {
+            if (chunkOffsets[c] < numPoints)
+            {
+                parsePointLines(chunkStarts[c], chunkStarts[c + 1],
+                                output + chunkOffsets[c],
+                                numPoints - chunkOffsets[c]);
+            }
+        }
+        return numPoints;
+    }
+
+}
+
+#endif
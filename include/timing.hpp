@@ -43,6 +43,10 @@ THE SOFTWARE.
 #else
     #error No timing mechanism supported for this platform
 #endif
+#if defined(__x86_64__) || defined(__i386__)
+    #include <x86intrin.h>
+#endif
+#include <stdint.h>
 
 namespace mdsearch
 {
@@ -62,6 +66,61 @@ namespace mdsearch
         return 0.0;
     #endif
     }
+
+    /** Return time in seconds since an arbitrary point, which never goes
+     * backwards. Use this rather than getTime() to time short intervals,
+     * since it isn't affected by changes to the system clock. */
+    inline double getMonotonicTime()
+    {
+    #if defined(__unix__)
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<double>(ts.tv_sec) + (static_cast<double>(ts.tv_nsec) / 1000000000.0);
+    #else
+        return getTime();
+    #endif
+    }
+
+    /** Return a timestamp in ticks which is as cheap to read as possible,
+     * for timing individual operations. On x86 this is the CPU's
+     * timestamp counter, otherwise it's the monotonic clock in
+     * nanoseconds. Use timestampTicksPerSecond() to convert ticks to
+     * seconds. */
+    inline uint64_t readTimestamp()
+    {
+    #if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+    #elif defined(__unix__)
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    #else
+        return static_cast<uint64_t>(getTime() * 1000000000.0);
+    #endif
+    }
+
+    /** Return the number of readTimestamp() ticks per second. On x86, the
+     * rate of the timestamp counter is measured against the monotonic
+     * clock the first time this is called, which takes ~20ms. */
+    inline double timestampTicksPerSecond()
+    {
+    #if defined(__x86_64__) || defined(__i386__)
+        static double ticksPerSecond = 0.0;
+        if (ticksPerSecond == 0.0)
+        {
+            const double startTime = getMonotonicTime();
+            const uint64_t startTicks = readTimestamp();
+            double elapsed = 0.0;
+            while (elapsed < 0.02)
+                elapsed = getMonotonicTime() - startTime;
+            ticksPerSecond = (readTimestamp() - startTicks) / elapsed;
+        }
+        return ticksPerSecond;
+    #else
+        return 1000000000.0;
+    #endif
+    }
+
 }
 
-#endif
\ No newline at end of file
+#endif
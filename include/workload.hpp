@@ -0,0 +1,365 @@
+/******************************************************************************
+
+mdsearch - Lightweight C++ library implementing a collection of
+           multi-dimensional search structures
+
+File:        workload.hpp
+Description: Generates streams of mixed insert, query, remove, range and kNN
+             operations on a set of points, with configurable key popularity,
+             for benchmarking index structures under realistic traffic.
+
+*******************************************************************************
+
+The MIT License (MIT)
+
+Copyright (c) 2014 Donald Whyte
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+******************************************************************************/
+
+#ifndef MDSEARCH_WORKLOAD_H
+#define MDSEARCH_WORKLOAD_H
+
+#include "distributions.hpp"
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace mdsearch
+{
+
+    /** Types of operation in a workload. LOAD_OPERATION is the insertion
+     * of one of the initial points, before the stream of operations. */
+    enum OperationType
+    {
+        LOAD_OPERATION = 0,
+        INSERT_OPERATION,
+        QUERY_OPERATION,
+        REMOVE_OPERATION,
+        RANGE_OPERATION,
+        KNN_OPERATION,
+        NUM_OPERATION_TYPES
+    };
+
+    /** How points are chosen for operations on existing points. */
+    enum KeyPopularity
+    {
+        /** Every point is equally likely to be chosen. */
+        UNIFORM_POPULARITY,
+        /** A few points are chosen far more often than the rest, with
+         * probabilities following Zipf's law. Popularity ranks are a
+         * random permutation of the points, so popular points are spread
+         * across the whole set (like YCSB's scrambled Zipfian
+         * distribution). Each inserted point swaps ranks with a random
+         * point. */
+        ZIPFIAN_POPULARITY,
+        /** A fixed fraction of operations choose uniformly from a fixed
+         * fraction of points (the oldest ones), and the rest choose
+         * uniformly from the other points. */
+        HOTSPOT_POPULARITY
+    };
+
+    /** An operation on the point with the given index. */
+    struct WorkloadOperation
+    {
+        OperationType type;
+        unsigned int point;
+    };
+
+    struct WorkloadOptions
+    {
+        WorkloadOptions();
+
+        /** Number of points loaded before the stream of operations. */
+        unsigned int numInitialPoints;
+        unsigned int numOperations;
+        /** Relative frequency of each operation type in the stream. The
+         * weight of LOAD_OPERATION is ignored. */
+        double weights[NUM_OPERATION_TYPES];
+        KeyPopularity popularity;
+        /** Skew of ZIPFIAN_POPULARITY, in (0, 1). YCSB uses 0.99. */
+        double zipfianConstant;
+        /** Fraction of points that are hot in HOTSPOT_POPULARITY. */
+        double hotPointFraction;
+        /** Fraction of operations on hot points in HOTSPOT_POPULARITY. */
+        double hotOperationFraction;
+        /** Fraction of queries and removals of points which have never
+         * been inserted. */
+        double negativeFraction;
+        uint64_t seed;
+    };
+
+    /** Chooses integers in [0, numItems) with probabilities following
+     * Zipf's law, using the method of Gray et al., "Quickly Generating
+     * Billion-Record Synthetic Databases" (as in YCSB). The number of
+     * items can grow, which updates the normalisation constant
+     * incrementally. */
+    class ZipfianGenerator
+    {
+
+    public:
+        ZipfianGenerator(uint64_t numItems, double zipfianConstant);
+
+        /** Increase number of items to given number. Fewer items than
+         * before are ignored. */
+        void grow(uint64_t numItems);
+        /** Return rank of chosen item, where 0 is the most popular item,
+         * given a uniform random number in [0, 1). */
+        uint64_t next(double uniform) const;
+
+        uint64_t numItems() const;
+
+    private:
+        void updateEta();
+
+        uint64_t m_numItems;
+        double m_theta;
+        double m_alpha;
+        double m_zeta2;
+        double m_zetaN;
+        double m_eta;
+
+    };
+
+    /** Generates a workload: a stream of operations run after the initial
+     * points (numbered 0 to numInitialPoints - 1) are loaded.
+     *
+     * Inserted points are numbered from numInitialPoints in order of
+     * insertion. Queries, removals and the centres of range and kNN
+     * queries choose a point from every point inserted so far according
+     * to the key popularity, so they can choose points which have since
+     * been removed. A fraction of queries and removals are of points
+     * which are never inserted, which are numbered after all the inserted
+     * points.
+     *
+     * Random numbers come from a RandomSource, so the same seed gives the
+     * same stream on every platform. */
+    class WorkloadGenerator
+    {
+
+    public:
+        WorkloadGenerator(const WorkloadOptions& options);
+
+        /** Return the stream of operations. */
+        const std::vector<WorkloadOperation>& operations() const;
+        /** Return number of points the workload refers to, including the
+         * initial points, inserted points and never inserted points. */
+        unsigned int numPoints() const;
+        /** Return number of points inserted by the load phase and the
+         * stream. Points with indices from this onwards are never
+         * inserted. */
+        unsigned int numInsertedPoints() const;
+
+    private:
+        unsigned int choosePoint();
+        /** Add a point to the popularity ranks, at a random rank. */
+        void rankPoint(unsigned int point);
+
+        WorkloadOptions m_options;
+        RandomSource m_random;
+        ZipfianGenerator m_zipfian;
+        /** Points in order of popularity, used by ZIPFIAN_POPULARITY. */
+        std::vector<unsigned int> m_rankedPoints;
+        unsigned int m_numInserted;
+        std::vector<WorkloadOperation> m_operations;
+        unsigned int m_numPoints;
+
+    };
+
+    inline WorkloadOptions::WorkloadOptions()
+    : numInitialPoints(100000), numOperations(100000),
+      popularity(UNIFORM_POPULARITY), zipfianConstant(0.99),
+      hotPointFraction(0.2), hotOperationFraction(0.8), negativeFraction(0.0),
+      seed(1)
+    {
+        weights[LOAD_OPERATION] = 0.0;
+        weights[INSERT_OPERATION] = 0.25;
+        weights[QUERY_OPERATION] = 0.5;
+        weights[REMOVE_OPERATION] = 0.25;
+        weights[RANGE_OPERATION] = 0.0;
+        weights[KNN_OPERATION] = 0.0;
+    }
+
+    inline ZipfianGenerator::ZipfianGenerator(uint64_t numItems,
+                                              double zipfianConstant)
+    : m_numItems(0), m_theta(zipfianConstant),
+      m_alpha(1.0 / (1.0 - zipfianConstant)),
+      m_zeta2(1.0 + std::pow(0.5, zipfianConstant)), m_zetaN(0.0), m_eta(0.0)
+    {
+        grow(numItems);
+    }
+
+    inline void ZipfianGenerator::grow(uint64_t numItems)
+    {
+        for (uint64_t i = m_numItems + 1; (i <= numItems); i++)
+            m_zetaN += 1.0 / std::pow(static_cast<double>(i), m_theta);
+        if (numItems > m_numItems)
+        {
+            m_numItems = numItems;
+            updateEta();
+        }
+    }
+
+    inline void ZipfianGenerator::updateEta()
+    {
+        m_eta = (1.0 - std::pow(2.0 / m_numItems, 1.0 - m_theta))
+            / (1.0 - m_zeta2 / m_zetaN);
+    }
+
+    inline uint64_t ZipfianGenerator::next(double uniform) const
+    {
+        const double uz = uniform * m_zetaN;
+        if (uz < 1.0 || m_numItems < 2)
+            return 0;
+        if (uz < 1.0 + std::pow(0.5, m_theta))
+            return 1;
+        const uint64_t rank = static_cast<uint64_t>(m_numItems
+            * std::pow(m_eta * uniform - m_eta + 1.0, m_alpha));
+        return (rank < m_numItems) ? rank : m_numItems - 1;
+    }
+
+    inline uint64_t ZipfianGenerator::numItems() const
+    {
+        return m_numItems;
+    }
+
+    inline WorkloadGenerator::WorkloadGenerator(const WorkloadOptions& options)
+    : m_options(options), m_random(options.seed),
+      m_zipfian(options.numInitialPoints, options.zipfianConstant),
+      m_numInserted(options.numInitialPoints),
+      m_operations(options.numOperations), m_numPoints(0)
+    {
+        double totalWeight = 0.0;
+        for (unsigned int op = INSERT_OPERATION; (op < NUM_OPERATION_TYPES);
+             op++)
+        {
+            totalWeight += options.weights[op];
+        }
+
+        for (unsigned int i = 0; (i < options.numInitialPoints); i++)
+            rankPoint(i);
+
+        // Never inserted points are numbered from 0 until every inserted
+        // point is known, then moved after them
+        std::vector<bool> isNegative(options.numOperations, false);
+        unsigned int numNegative = 0;
+        for (unsigned int i = 0; (i < options.numOperations); i++)
+        {
+            WorkloadOperation& operation = m_operations[i];
+            double choice = m_random.uniform() * totalWeight;
+            operation.type = INSERT_OPERATION;
+            for (unsigned int op = INSERT_OPERATION;
+                 (op < NUM_OPERATION_TYPES); op++)
+            {
+                if (options.weights[op] > 0.0)
+                {
+                    operation.type = static_cast<OperationType>(op);
+                    if (choice < options.weights[op])
+                        break;
+                    choice -= options.weights[op];
+                }
+            }
+
+            if (operation.type == INSERT_OPERATION || m_numInserted == 0)
+            {
+                operation.type = INSERT_OPERATION;
+                operation.point = m_numInserted++;
+                rankPoint(operation.point);
+                continue;
+            }
+            if ((operation.type == QUERY_OPERATION
+                || operation.type == REMOVE_OPERATION)
+                && m_random.uniform() < options.negativeFraction)
+            {
+                isNegative[i] = true;
+                operation.point = numNegative++;
+                continue;
+            }
+            operation.point = choosePoint();
+        }
+
+        for (unsigned int i = 0; (i < options.numOperations); i++)
+        {
+            if (isNegative[i])
+                m_operations[i].point += m_numInserted;
+        }
+        m_numPoints = m_numInserted + numNegative;
+    }
+
+    inline const std::vector<WorkloadOperation>&
+    WorkloadGenerator::operations() const
+    {
+        return m_operations;
+    }
+
+    inline unsigned int WorkloadGenerator::numPoints() const
+    {
+        return m_numPoints;
+    }
+
+    inline unsigned int WorkloadGenerator::numInsertedPoints() const
+    {
+        return m_numInserted;
+    }
+
+    inline unsigned int WorkloadGenerator::choosePoint()
+    {
+        const unsigned int n = m_numInserted;
+        switch (m_options.popularity)
+        {
+        case ZIPFIAN_POPULARITY:
+            {
+                m_zipfian.grow(n);
+                return m_rankedPoints[m_zipfian.next(m_random.uniform())];
+            }
+        case HOTSPOT_POPULARITY:
+            {
+                unsigned int numHot = static_cast<unsigned int>(
+                    m_options.hotPointFraction * n);
+                numHot = std::min(std::max(numHot, 1u), n);
+                const bool hot = (numHot == n)
+                    || m_random.uniform() < m_options.hotOperationFraction;
+                const unsigned int first = hot ? 0 : numHot;
+                const unsigned int count = hot ? numHot : n - numHot;
+                return first + static_cast<unsigned int>(
+                    m_random.integer(count));
+            }
+        default:
+            return static_cast<unsigned int>(m_random.integer(n));
+        }
+    }
+
+    inline void WorkloadGenerator::rankPoint(unsigned int point)
+    {
+        if (m_options.popularity != ZIPFIAN_POPULARITY)
+            return;
+        // Inside-out Fisher-Yates shuffle, so ranks stay a uniformly
+        // random permutation as points are added
+        const std::size_t size = m_rankedPoints.size();
+        const std::size_t rank = static_cast<std::size_t>(
+            m_random.integer(size + 1));
+        m_rankedPoints.push_back(point);
+        std::swap(m_rankedPoints[rank], m_rankedPoints[size]);
+    }
+
+}
+
+#endif
@@ -0,0 +1,980 @@
+/******************************************************************************
+
+mdsearch - Lightweight C++ library implementing a collection of
+           multi-dimensional search structures
+
+File:        bench.cpp
+Description: Configurable benchmark which runs the same stream of operations
+             on each chosen index structure and reports the throughput of
+             the load and the stream and the latency percentiles of each
+             type of operation.
+
+*******************************************************************************
+
+The MIT License (MIT)
+
+Copyright (c) 2014 Donald Whyte
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+******************************************************************************/
+
+#include "types.hpp"
+#include "point.hpp"
+#include "boundary.hpp"
+#include "dispatch.hpp"
+#include "timing.hpp"
+#include "latency_histogram.hpp"
+#include "memory_usage.hpp"
+#include "perf_counters.hpp"
+#include "workload.hpp"
+#include "distributions.hpp"
+#include "kdtree.hpp"
+#include "bucket_kdtree.hpp"
+#include "multigrid.hpp"
+#include "bithash.hpp"
+#include "pyramidtree.hpp"
+#include <boost/program_options.hpp>
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace mdsearch;
+namespace po = boost::program_options;
+
+namespace
+{
+
+    static const char* OPERATION_NAMES[NUM_OPERATION_TYPES] = {
+        "load", "insert", "query", "remove", "range", "knn"
+    };
+
+    static const char* STRUCTURE_NAMES[] = {
+        "kd-tree", "bucket_kd-tree", "multigrid", "bithash", "pyramid_tree"
+    };
+    static const unsigned int NUM_STRUCTURES = 5;
+
+    static const char* POPULARITY_NAMES[] = { "uniform", "zipfian", "hotspot" };
+    static const unsigned int NUM_POPULARITIES = 3;
+
+    struct BenchmarkOptions
+    {
+        std::vector<std::string> structures;
+        int numDimensions;
+        std::vector<PointDistribution> distributions;
+        /* Number of points, operation mix, key popularity and seed */
+        WorkloadOptions workload;
+        /* Width of range query regions in each dimension, as a fraction
+         * of the width of the points' boundary. */
+        double rangeWidth;
+        unsigned int k;
+        unsigned int repetitions;
+        unsigned int warmup;
+        /* Latency is measured for one in every 'sampleInterval'
+         * operations of each phase. */
+        unsigned int sampleInterval;
+        bool csv;
+        /* Hardware counters read around each sampled operation, or NULL
+         * if events aren't being counted, and the events counted by two
+         * reads with only the timestamps between them. */
+        PerfCounters* counters;
+        PerfSample counterOverhead;
+    };
+
+    /* Number of operations of each type and the latencies, in timestamp
+     * ticks, of the sampled ones, and the wall clock time taken by the load
+     * and the stream of operations. */
+    struct OperationTimes
+    {
+        OperationTimes()
+        {
+            for (unsigned int op = 0; (op < NUM_OPERATION_TYPES); op++)
+            {
+                count[op] = 0;
+                supported[op] = true;
+                numCounted[op] = 0;
+                for (unsigned int e = 0; (e < NUM_PERF_EVENTS); e++)
+                    events[op][e] = 0;
+            }
+            loadSeconds = 0.0;
+            streamSeconds = 0.0;
+            checksum = 0;
+            numLoaded = 0;
+        }
+
+        /* Add events counted by a sampled operation of given type, less
+         * the overhead of reading the counters. */
+        void addEvents(unsigned int op, const PerfSample& before,
+                       const PerfSample& after, const PerfSample& overhead)
+        {
+            for (unsigned int e = 0; (e < NUM_PERF_EVENTS); e++)
+            {
+                const uint64_t counted = after.values[e] - before.values[e];
+                if (counted > overhead.values[e])
+                    events[op][e] += counted - overhead.values[e];
+            }
+            numCounted[op]++;
+        }
+
+        unsigned long count[NUM_OPERATION_TYPES];
+        LatencyHistogram<> latencies[NUM_OPERATION_TYPES];
+        bool supported[NUM_OPERATION_TYPES];
+        /* Seconds taken to load the initial points and to run the stream,
+         * including the cost of timing and counting sampled operations. */
+        double loadSeconds;
+        double streamSeconds;
+        /* Total number of points found by every operation, which should
+         * be the same for every structure given the same stream. */
+        unsigned long checksum;
+        /* Memory used by the structure once the initial points are loaded,
+         * and the number of them that were inserted (duplicates aren't). */
+        MemoryUsage memory;
+        unsigned long numLoaded;
+        /* Total hardware events counted by the sampled operations of each
+         * type, and the number of operations they were counted for. */
+        uint64_t events[NUM_OPERATION_TYPES][NUM_PERF_EVENTS];
+        unsigned long numCounted[NUM_OPERATION_TYPES];
+    };
+
+    static std::vector<std::string> splitList(const std::string& list)
+    {
+        std::vector<std::string> items;
+        std::stringstream stream(list);
+        std::string item;
+        while (std::getline(stream, item, ','))
+        {
+            if (!item.empty())
+                items.push_back(item);
+        }
+        return items;
+    }
+
+    static bool isOneOf(const std::string& name, const char* const* names,
+                        unsigned int numNames)
+    {
+        for (unsigned int i = 0; (i < numNames); i++)
+        {
+            if (name == names[i])
+                return true;
+        }
+        return false;
+    }
+
+    static bool readCounters(const BenchmarkOptions& options,
+                             PerfSample& sample)
+    {
+        return (options.counters != NULL && options.counters->read(sample));
+    }
+
+    /* Return the fewest events counted between two reads of the counters
+     * with only a pair of timestamps between them, as done around each
+     * sampled operation. */
+    static PerfSample measureCounterOverhead(PerfCounters& counters)
+    {
+        static const unsigned int NUM_TRIALS = 1000;
+        PerfSample overhead;
+        PerfSample before;
+        PerfSample after;
+        bool measured = false;
+        for (unsigned int i = 0; (i < NUM_TRIALS); i++)
+        {
+            if (!counters.read(before))
+                continue;
+            volatile uint64_t ticks = readTimestamp();
+            ticks = readTimestamp() - ticks;
+            if (!counters.read(after))
+                continue;
+            for (unsigned int e = 0; (e < NUM_PERF_EVENTS); e++)
+            {
+                const uint64_t counted = after.values[e] - before.values[e];
+                if (!measured || counted < overhead.values[e])
+                    overhead.values[e] = counted;
+            }
+            measured = true;
+        }
+        return overhead;
+    }
+
+    template<typename STRUCT_TYPE, typename BOUNDARY_TYPE>
+    static std::size_t runRangeQuery(STRUCT_TYPE* structure,
+                                     const BOUNDARY_TYPE& region,
+                                     std::true_type)
+    {
+        return structure->rangeQuery(region).size();
+    }
+
+    template<typename STRUCT_TYPE, typename BOUNDARY_TYPE>
+    static std::size_t runRangeQuery(STRUCT_TYPE*, const BOUNDARY_TYPE&,
+                                     std::false_type)
+    {
+        return 0;
+    }
+
+    template<typename STRUCT_TYPE, typename POINT_TYPE>
+    static std::size_t runKnn(STRUCT_TYPE* structure, const POINT_TYPE& point,
+                              unsigned int k, std::true_type)
+    {
+        return structure->knn(point, k).size();
+    }
+
+    template<typename STRUCT_TYPE, typename POINT_TYPE>
+    static std::size_t runKnn(STRUCT_TYPE*, const POINT_TYPE&, unsigned int,
+                              std::false_type)
+    {
+        return 0;
+    }
+
+    /* Load the initial points into the structure, then
+     * run every operation in the stream on it, recording the time taken by
+     * each phase and the latencies of sampled operations in 'times'.
+     * Hardware counters are read outside the timestamps, so they don't add
+     * to the latencies. */
+    template<int D, typename STRUCT_TYPE>
+    static void runOperations(STRUCT_TYPE* structure,
+                              const BenchmarkOptions& options,
+                              const std::vector< Point<D, Real> >& points,
+                              const Boundary<D, Real>& boundary,
+                              const std::vector<WorkloadOperation>& operations,
+                              OperationTimes& times)
+    {
+        typedef std::integral_constant<bool,
+            HasRangeQuery<STRUCT_TYPE, Boundary<D, Real> >::value>
+            SupportsRange;
+        typedef std::integral_constant<bool,
+            HasKnn<STRUCT_TYPE, Point<D, Real> >::value> SupportsKnn;
+        times.supported[RANGE_OPERATION] = SupportsRange::value;
+        times.supported[KNN_OPERATION] = SupportsKnn::value;
+
+        // Only take timestamps for a sample of operations, to reduce the
+        // overhead of timing on fast operations
+        const unsigned int interval = options.sampleInterval;
+        uint64_t start = 0;
+        PerfSample before;
+        PerfSample after;
+        bool counting = false;
+        double phaseStart = getMonotonicTime();
+        for (unsigned int i = 0; (i < options.workload.numInitialPoints); i++)
+        {
+            const bool sampled = (i % interval == 0);
+            if (sampled)
+            {
+                counting = readCounters(options, before);
+                start = readTimestamp();
+            }
+            const bool inserted = structure->insert(points[i]);
+            if (sampled)
+            {
+                times.latencies[LOAD_OPERATION].record(readTimestamp() - start);
+                if (counting && readCounters(options, after))
+                {
+                    times.addEvents(LOAD_OPERATION, before, after,
+                                    options.counterOverhead);
+                }
+            }
+            times.numLoaded += inserted;
+        }
+        times.loadSeconds = getMonotonicTime() - phaseStart;
+        times.count[LOAD_OPERATION] += options.workload.numInitialPoints;
+        times.checksum += times.numLoaded;
+        times.memory = structure->memoryUsage();
+
+        Real halfWidths[D];
+        for (unsigned int d = 0; (d < D); d++)
+        {
+            halfWidths[d] = static_cast<Real>(options.rangeWidth * 0.5
+                * (boundary[d].max - boundary[d].min));
+        }
+
+        phaseStart = getMonotonicTime();
+        for (unsigned int i = 0; (i < operations.size()); i++)
+        {
+            const WorkloadOperation& operation = operations[i];
+            const Point<D, Real>& point = points[operation.point];
+            std::size_t found = 0;
+            const bool sampled = (i % interval == 0);
+            if (sampled)
+            {
+                counting = readCounters(options, before);
+                start = readTimestamp();
+            }
+            switch (operation.type)
+            {
+            case INSERT_OPERATION:
+                found = structure->insert(point);
+                break;
+            case QUERY_OPERATION:
+                found = structure->query(point);
+                break;
+            case REMOVE_OPERATION:
+                found = structure->remove(point);
+                break;
+            case RANGE_OPERATION:
+                {
+                    Boundary<D, Real> region;
+                    for (unsigned int d = 0; (d < D); d++)
+                    {
+                        region[d].min = std::max(point[d] - halfWidths[d],
+                                                 boundary[d].min);
+                        region[d].max = std::min(point[d] + halfWidths[d],
+                                                 boundary[d].max);
+                    }
+                    found = runRangeQuery(structure, region, SupportsRange());
+                }
+                break;
+            case KNN_OPERATION:
+                found = runKnn(structure, point, options.k, SupportsKnn());
+                break;
+            default:
+                break;
+            }
+            if (sampled)
+            {
+                times.latencies[operation.type].record(
+                    readTimestamp() - start);
+                if (counting && readCounters(options, after))
+                {
+                    times.addEvents(operation.type, before, after,
+                                    options.counterOverhead);
+                }
+            }
+            times.count[operation.type]++;
+            times.checksum += found;
+        }
+        times.streamSeconds = getMonotonicTime() - phaseStart;
+    }
+
+    template<int D>
+    static bool runStructure(const std::string& structureName,
+                             const BenchmarkOptions& options,
+                             const std::vector< Point<D, Real> >& points,
+                             const Boundary<D, Real>& boundary,
+                             const std::vector<WorkloadOperation>& operations,
+                             OperationTimes& times)
+    {
+        if (structureName == "kd-tree")
+        {
+            KDTree<D, Real> structure;
+            runOperations(&structure, options, points, boundary, operations,
+                          times);
+        }
+        else if (structureName == "bucket_kd-tree")
+        {
+            BucketKDTree<D, Real> structure;
+            runOperations(&structure, options, points, boundary, operations,
+                          times);
+        }
+        else if (structureName == "multigrid")
+        {
+            Multigrid<D, Real> structure(boundary);
+            runOperations(&structure, options, points, boundary, operations,
+                          times);
+        }
+        else if (structureName == "bithash")
+        {
+            BitHash<D, Real> structure;
+            runOperations(&structure, options, points, boundary, operations,
+                          times);
+        }
+        else if (structureName == "pyramid_tree")
+        {
+            // Keep bucket keys ordered, so range queries don't scan every
+            // bucket
+            PyramidTree<D, Real> structure(boundary, true);
+            runOperations(&structure, options, points, boundary, operations,
+                          times);
+        }
+        else
+        {
+            return false;
+        }
+        return true;
+    }
+
+    static const unsigned int NUM_PERCENTILES = 4;
+    static const double PERCENTILES[NUM_PERCENTILES] = {
+        50.0, 90.0, 99.0, 99.9
+    };
+    static const char* PERCENTILE_NAMES[NUM_PERCENTILES] = {
+        "p50", "p90", "p99", "p99.9"
+    };
+
+    static void printHeader(const BenchmarkOptions& options,
+                            PointDistribution distribution)
+    {
+        if (options.csv)
+        {
+            std::cout << "structure,dimensions,points,distribution,popularity,"
+                      << "operation,"
+                      << "count,mean_seconds,min_seconds,operations_per_second";
+            for (unsigned int p = 0; (p < NUM_PERCENTILES); p++)
+                std::cout << "," << PERCENTILE_NAMES[p] << "_ns";
+            std::cout << ",max_ns,checksum,bytes_per_point,node_bytes,"
+                      << "payload_bytes,hash_overhead_bytes,slack_bytes";
+            for (unsigned int e = 0; (e < NUM_PERF_EVENTS); e++)
+                std::cout << "," << perfEventName(static_cast<PerfEvent>(e));
+            std::cout << std::endl;
+        }
+        else
+        {
+            const WorkloadOptions& workload = options.workload;
+            std::cout << workload.numInitialPoints << " "
+                      << distributionName(distribution) << " points, "
+                      << options.numDimensions << " dimensions, "
+                      << workload.numOperations << " operations on "
+                      << POPULARITY_NAMES[workload.popularity] << " points ("
+                      << workload.negativeFraction * 100.0 << "% negative), "
+                      << "seed " << workload.seed << ", "
+                      << options.repetitions << " repetitions, latency of 1 in "
+                      << options.sampleInterval << " operations sampled"
+                      << (options.counters != NULL
+                          ? ", events counted per sampled operation" : "")
+                      << std::endl;
+            std::cout << std::left << std::setw(16) << "structure"
+                      << std::setw(8) << "op" << std::right
+                      << std::setw(10) << "count"
+                      << std::setw(12) << "ops/s";
+            for (unsigned int p = 0; (p < NUM_PERCENTILES); p++)
+                std::cout << std::setw(10) << PERCENTILE_NAMES[p];
+            std::cout << std::setw(12) << "max" << "  (latencies in ns)"
+                      << std::endl;
+        }
+    }
+
+    static uint64_t ticksToNanoseconds(uint64_t ticks)
+    {
+        return static_cast<uint64_t>(ticks * 1000000000.0
+            / timestampTicksPerSecond());
+    }
+
+    /* Print mean number of each hardware event per operation on the line
+     * below an operation's latencies. */
+    static void printEvents(const PerfCounters& counters,
+                            const double events[NUM_PERF_EVENTS])
+    {
+        static const char* LABELS[NUM_PERF_EVENTS] = {
+            "cycles", "instructions", "L1d misses", "LLC misses",
+            "branch misses", "dTLB misses"
+        };
+        std::ostringstream line;
+        line << std::fixed << std::setprecision(1);
+        for (unsigned int e = 0; (e < NUM_PERF_EVENTS); e++)
+        {
+            if (e > 0)
+                line << ", ";
+            if (counters.isCounted(static_cast<PerfEvent>(e)))
+                line << events[e];
+            else
+                line << "n/a";
+            line << " " << LABELS[e];
+            if (e == INSTRUCTIONS_EVENT && events[CYCLES_EVENT] > 0.0
+                && counters.isCounted(CYCLES_EVENT)
+                && counters.isCounted(INSTRUCTIONS_EVENT))
+            {
+                line << std::setprecision(2) << " ("
+                     << events[INSTRUCTIONS_EVENT] / events[CYCLES_EVENT]
+                     << " IPC)" << std::setprecision(1);
+            }
+        }
+        std::cout << std::left << std::setw(16) << "" << std::setw(8)
+                  << "events" << std::right << line.str() << std::endl;
+    }
+
+    /* Return mean number of each hardware event counted per sampled
+     * operation of given type, over every repetition. Returns false if no
+     * events were counted. */
+    static bool meanEvents(const std::vector<OperationTimes>& repetitions,
+                           unsigned int op, double means[NUM_PERF_EVENTS])
+    {
+        unsigned long numCounted = 0;
+        for (unsigned int e = 0; (e < NUM_PERF_EVENTS); e++)
+            means[e] = 0.0;
+        for (unsigned int r = 0; (r < repetitions.size()); r++)
+        {
+            numCounted += repetitions[r].numCounted[op];
+            for (unsigned int e = 0; (e < NUM_PERF_EVENTS); e++)
+                means[e] += repetitions[r].events[op][e];
+        }
+        if (numCounted == 0)
+            return false;
+        for (unsigned int e = 0; (e < NUM_PERF_EVENTS); e++)
+            means[e] /= numCounted;
+        return true;
+    }
+
+    /* Results of a phase or a type of operation, over every repetition. */
+    struct ResultRow
+    {
+        ResultRow(const char* name, unsigned long count)
+        : name(name), count(count), supported(true), timed(false),
+          meanSeconds(0.0), minSeconds(0.0), counted(false)
+        {
+            for (unsigned int e = 0; (e < NUM_PERF_EVENTS); e++)
+                events[e] = 0.0;
+        }
+
+        /* Set mean and minimum time taken from the time the row's phase
+         * took in each repetition. */
+        void setSeconds(const std::vector<double>& seconds)
+        {
+            double totalSeconds = 0.0;
+            minSeconds = seconds[0];
+            for (unsigned int r = 0; (r < seconds.size()); r++)
+            {
+                totalSeconds += seconds[r];
+                minSeconds = std::min(minSeconds, seconds[r]);
+            }
+            meanSeconds = totalSeconds / seconds.size();
+            timed = true;
+        }
+
+        const char* name;
+        unsigned long count;
+        bool supported;
+        /* Throughput is only measured for whole phases, with the wall
+         * clock, since timing every operation would slow the fastest
+         * ones down. Rows of each type of operation in the stream only
+         * have latencies. */
+        bool timed;
+        double meanSeconds;
+        double minSeconds;
+        LatencyHistogram<> latencies;
+        bool counted;
+        double events[NUM_PERF_EVENTS];
+    };
+
+    /* Print a row of results, with the memory used by the structure in
+     * CSV output. */
+    static void printRow(const std::string& structureName,
+                         const BenchmarkOptions& options,
+                         PointDistribution distribution,
+                         const ResultRow& row, unsigned long checksum,
+                         const MemoryUsage& memory, unsigned long numLoaded)
+    {
+        const double opsPerSecond = (row.timed && row.meanSeconds > 0.0)
+            ? row.count / row.meanSeconds : 0.0;
+        if (options.csv)
+        {
+            std::cout << structureName << "," << options.numDimensions
+                      << "," << options.workload.numInitialPoints << ","
+                      << distributionName(distribution) << ","
+                      << POPULARITY_NAMES[options.workload.popularity]
+                      << "," << row.name << "," << row.count << ",";
+            // Leave throughput of rows which weren't timed empty
+            if (row.timed)
+            {
+                std::cout << row.meanSeconds << "," << row.minSeconds << ","
+                          << (row.supported ? opsPerSecond : 0.0);
+            }
+            else
+            {
+                std::cout << ",,";
+            }
+            for (unsigned int p = 0; (p < NUM_PERCENTILES); p++)
+            {
+                std::cout << "," << ticksToNanoseconds(
+                    row.latencies.valueAtPercentile(PERCENTILES[p]));
+            }
+            std::cout << "," << ticksToNanoseconds(row.latencies.max())
+                      << "," << checksum
+                      << "," << memory.bytesPerPoint(numLoaded)
+                      << "," << memory.nodes << "," << memory.payload
+                      << "," << memory.hashOverhead << "," << memory.slack;
+            // Leave events which weren't counted empty
+            for (unsigned int e = 0; (e < NUM_PERF_EVENTS); e++)
+            {
+                std::cout << ",";
+                if (row.counted && options.counters->isCounted(
+                    static_cast<PerfEvent>(e)))
+                {
+                    std::cout << row.events[e];
+                }
+            }
+            std::cout << std::endl;
+        }
+        else if (!row.supported)
+        {
+            std::cout << std::left << std::setw(16) << structureName
+                      << std::setw(8) << row.name << std::right
+                      << std::setw(10) << row.count
+                      << std::setw(12) << "unsupported" << std::endl;
+        }
+        else
+        {
+            std::cout << std::left << std::setw(16) << structureName
+                      << std::setw(8) << row.name << std::right
+                      << std::setw(10) << row.count << std::setw(12);
+            if (row.timed)
+                std::cout << static_cast<unsigned long>(opsPerSecond);
+            else
+                std::cout << "-";
+            for (unsigned int p = 0; (p < NUM_PERCENTILES); p++)
+            {
+                std::cout << std::setw(10) << ticksToNanoseconds(
+                    row.latencies.valueAtPercentile(PERCENTILES[p]));
+            }
+            std::cout << std::setw(12)
+                      << ticksToNanoseconds(row.latencies.max()) << std::endl;
+            if (row.counted)
+                printEvents(*options.counters, row.events);
+        }
+    }
+
+    /* Print the throughput of the load and of the whole stream, averaged
+     * over every repetition, and the percentiles of the latencies sampled
+     * in all of them and hardware events counted per operation for each
+     * type of operation, followed by the memory used per loaded point. */
+    static void printResults(const std::string& structureName,
+                             const BenchmarkOptions& options,
+                             PointDistribution distribution,
+                             const std::vector<OperationTimes>& repetitions)
+    {
+        // Loading is deterministic, so memory is the same in every
+        // repetition
+        const MemoryUsage& memory = repetitions[0].memory;
+        const unsigned long numLoaded = repetitions[0].numLoaded;
+        const unsigned long checksum = repetitions[0].checksum;
+        std::vector<double> loadSeconds(repetitions.size());
+        std::vector<double> streamSeconds(repetitions.size());
+        for (unsigned int r = 0; (r < repetitions.size()); r++)
+        {
+            loadSeconds[r] = repetitions[r].loadSeconds;
+            streamSeconds[r] = repetitions[r].streamSeconds;
+        }
+
+        // Latencies of the whole stream are those of every type of
+        // operation in it. Unsupported operations do nothing, but still
+        // count towards the stream's throughput.
+        ResultRow stream("stream", 0);
+        stream.setSeconds(streamSeconds);
+        for (unsigned int op = 0; (op < NUM_OPERATION_TYPES); op++)
+        {
+            ResultRow row(OPERATION_NAMES[op], repetitions[0].count[op]);
+            if (row.count == 0)
+                continue;
+            for (unsigned int r = 0; (r < repetitions.size()); r++)
+                row.latencies.merge(repetitions[r].latencies[op]);
+            row.supported = repetitions[0].supported[op];
+            row.counted = row.supported
+                && meanEvents(repetitions, op, row.events);
+            if (op == LOAD_OPERATION)
+            {
+                row.setSeconds(loadSeconds);
+            }
+            else
+            {
+                stream.count += row.count;
+                if (row.supported)
+                    stream.latencies.merge(row.latencies);
+            }
+            printRow(structureName, options, distribution, row, checksum,
+                     memory, numLoaded);
+        }
+        if (stream.count > 0)
+        {
+            printRow(structureName, options, distribution, stream, checksum,
+                     memory, numLoaded);
+        }
+
+        if (!options.csv)
+        {
+            const double n = std::max<unsigned long>(numLoaded, 1);
+            std::ostringstream line;
+            line << std::fixed << std::setprecision(1)
+                 << memory.bytesPerPoint(numLoaded) << " bytes/point (nodes "
+                 << memory.nodes / n << ", points " << memory.payload / n
+                 << ", hash overhead " << memory.hashOverhead / n
+                 << ", slack " << memory.slack / n << ")";
+            std::cout << std::left << std::setw(16) << structureName
+                      << std::setw(8) << "memory" << std::right
+                      << line.str() << std::endl;
+        }
+    }
+
+    /* Runs the benchmark with the number of dimensions given in the
+     * options, which must be one of CompiledDimensions. */
+    struct BenchmarkRunner
+    {
+        typedef bool ResultType;
+
+        BenchmarkRunner(const BenchmarkOptions& options) : options(options)
+        {
+        }
+
+        template<int D>
+        bool run()
+        {
+            WorkloadGenerator workload(options.workload);
+            for (unsigned int i = 0; (i < options.distributions.size()); i++)
+            {
+                // Only print the header once in CSV files
+                if (i == 0 || !options.csv)
+                    printHeader(options, options.distributions[i]);
+                runDistribution<D>(options.distributions[i], workload);
+            }
+            return true;
+        }
+
+        /* Run every structure on points from the given distribution. */
+        template<int D>
+        void runDistribution(PointDistribution distribution,
+                             const WorkloadGenerator& workload)
+        {
+            const std::vector<WorkloadOperation>& operations =
+                workload.operations();
+            const std::vector< Point<D, Real> > points =
+                generatePoints<D, Real>(distribution, workload.numPoints(),
+                                        options.workload.seed);
+            BoundaryAccumulator<D, Real> accumulator;
+            accumulator.add(points);
+            const Boundary<D, Real> boundary = accumulator.boundary();
+
+            for (unsigned int s = 0; (s < options.structures.size()); s++)
+            {
+                const std::string& name = options.structures[s];
+                for (unsigned int r = 0; (r < options.warmup); r++)
+                {
+                    OperationTimes ignored;
+                    runStructure(name, options, points, boundary, operations,
+                                 ignored);
+                }
+                std::vector<OperationTimes> repetitions(options.repetitions);
+                for (unsigned int r = 0; (r < options.repetitions); r++)
+                {
+                    runStructure(name, options, points, boundary, operations,
+                                 repetitions[r]);
+                }
+                printResults(name, options, distribution, repetitions);
+            }
+        }
+
+        bool runDynamic(int d)
+        {
+            std::cerr << "Structures aren't compiled for " << d
+                      << " dimensions. Compiled dimensions:";
+            const std::vector<int> dims = listCompiledDimensions();
+            for (unsigned int i = 0; (i < dims.size()); i++)
+                std::cerr << " " << dims[i];
+            std::cerr << std::endl;
+            return false;
+        }
+
+        const BenchmarkOptions& options;
+    };
+
+}
+
+int main(int argc, char* argv[])
+{
+    BenchmarkOptions options;
+    std::string structureList;
+    std::string popularity;
+    std::string distributionList;
+    po::options_description description("Options");
+    description.add_options()
+        ("help,h", "print this message")
+        ("structures,s", po::value<std::string>(&structureList)->default_value(
+            "kd-tree,bucket_kd-tree,multigrid,bithash,pyramid_tree"),
+            "comma-separated list of structures to benchmark")
+        ("dimensions,d", po::value<int>(&options.numDimensions)->default_value(
+            10), "number of dimensions (must be compiled)")
+        ("points,n", po::value<unsigned int>(
+            &options.workload.numInitialPoints)->default_value(100000),
+            "number of points loaded before operations are run")
+        ("operations,o", po::value<unsigned int>(
+            &options.workload.numOperations)->default_value(100000),
+            "number of operations run after loading")
+        ("distributions", po::value<std::string>(
+            &distributionList)->default_value("all"),
+            "comma-separated list of distributions of points (uniform, "
+            "skewed, gaussian_mixture, low_rank, lattice, sorted_sweep, "
+            "heavy_tail), or all")
+        ("seed", po::value<uint64_t>(&options.workload.seed)->default_value(1),
+            "seed for generating points and operations")
+        ("popularity", po::value<std::string>(&popularity)->default_value(
+            "uniform"), "how often each point is chosen for operations "
+            "(uniform, zipfian or hotspot)")
+        ("zipfian-constant", po::value<double>(
+            &options.workload.zipfianConstant)->default_value(0.99),
+            "skew of zipfian popularity, between 0 and 1")
+        ("hot-points", po::value<double>(
+            &options.workload.hotPointFraction)->default_value(0.2),
+            "fraction of points which are hot with hotspot popularity")
+        ("hot-operations", po::value<double>(
+            &options.workload.hotOperationFraction)->default_value(0.8),
+            "fraction of operations on hot points with hotspot popularity")
+        ("negative", po::value<double>(
+            &options.workload.negativeFraction)->default_value(0.0),
+            "fraction of queries and removals of points never inserted")
+        ("insert", po::value<double>(
+            &options.workload.weights[INSERT_OPERATION])->default_value(0.25),
+            "relative frequency of insertions")
+        ("query", po::value<double>(
+            &options.workload.weights[QUERY_OPERATION])->default_value(0.5),
+            "relative frequency of point queries")
+        ("remove", po::value<double>(
+            &options.workload.weights[REMOVE_OPERATION])->default_value(0.25),
+            "relative frequency of removals")
+        ("range", po::value<double>(
+            &options.workload.weights[RANGE_OPERATION])->default_value(0.0),
+            "relative frequency of range queries")
+        ("knn", po::value<double>(
+            &options.workload.weights[KNN_OPERATION])->default_value(0.0),
+            "relative frequency of kNN queries")
+        ("range-width", po::value<double>(
+            &options.rangeWidth)->default_value(0.1),
+            "width of range queries as a fraction of the data's extent")
+        ("k", po::value<unsigned int>(&options.k)->default_value(10),
+            "number of neighbours found by kNN queries")
+        ("repetitions,r", po::value<unsigned int>(
+            &options.repetitions)->default_value(3),
+            "number of timed runs per structure")
+        ("warmup,w", po::value<unsigned int>(&options.warmup)->default_value(1),
+            "number of untimed runs per structure before timing")
+        ("sample-interval", po::value<unsigned int>(
+            &options.sampleInterval)->default_value(1),
+            "measure latency of one in every N operations")
+        ("csv", "print results as comma-separated values")
+        ("perf-counters", "count hardware events (cycles, instructions, "
+            "cache, branch and TLB misses) of sampled operations, if the "
+            "kernel permits it");
+
+    po::variables_map variables;
+    try
+    {
+        po::store(po::parse_command_line(argc, argv, description), variables);
+        po::notify(variables);
+    }
+    catch (po::error& ex)
+    {
+        std::cerr << ex.what() << std::endl << description << std::endl;
+        return 1;
+    }
+    if (variables.count("help"))
+    {
+        std::cout << "Usage: mdsearch_bench [options]" << std::endl
+                  << description << std::endl;
+        return 0;
+    }
+    options.csv = (variables.count("csv") > 0);
+
+    options.structures = splitList(structureList);
+    for (unsigned int s = 0; (s < options.structures.size()); s++)
+    {
+        if (!isOneOf(options.structures[s], STRUCTURE_NAMES, NUM_STRUCTURES))
+        {
+            std::cerr << "Unknown structure: " << options.structures[s]
+                      << std::endl;
+            return 1;
+        }
+    }
+    const std::vector<std::string> distributionNames =
+        splitList(distributionList);
+    for (unsigned int i = 0; (i < distributionNames.size()); i++)
+    {
+        PointDistribution distribution;
+        if (distributionNames[i] == "all")
+        {
+            for (int d = 0; (d < NUM_POINT_DISTRIBUTIONS); d++)
+            {
+                options.distributions.push_back(
+                    static_cast<PointDistribution>(d));
+            }
+        }
+        else if (parseDistribution(distributionNames[i], distribution))
+        {
+            options.distributions.push_back(distribution);
+        }
+        else
+        {
+            std::cerr << "Unknown distribution: " << distributionNames[i]
+                      << std::endl;
+            return 1;
+        }
+    }
+    if (popularity == "zipfian")
+    {
+        options.workload.popularity = ZIPFIAN_POPULARITY;
+    }
+    else if (popularity == "hotspot")
+    {
+        options.workload.popularity = HOTSPOT_POPULARITY;
+    }
+    else if (popularity != "uniform")
+    {
+        std::cerr << "Unknown popularity: " << popularity << std::endl;
+        return 1;
+    }
+    if (options.workload.zipfianConstant <= 0.0
+        || options.workload.zipfianConstant >= 1.0)
+    {
+        std::cerr << "Zipfian constant must be between 0 and 1" << std::endl;
+        return 1;
+    }
+    double totalWeight = 0.0;
+    for (unsigned int op = INSERT_OPERATION; (op < NUM_OPERATION_TYPES); op++)
+    {
+        if (options.workload.weights[op] < 0.0)
+        {
+            std::cerr << "Operation frequencies can't be negative" << std::endl;
+            return 1;
+        }
+        totalWeight += options.workload.weights[op];
+    }
+    if (options.workload.numOperations > 0 && totalWeight <= 0.0)
+    {
+        std::cerr << "At least one operation frequency must be positive"
+                  << std::endl;
+        return 1;
+    }
+    if (options.sampleInterval == 0)
+    {
+        std::cerr << "Sample interval must be positive" << std::endl;
+        return 1;
+    }
+    if (options.structures.empty() || options.distributions.empty()
+        || options.repetitions == 0)
+    {
+        std::cerr << "Nothing to benchmark" << std::endl;
+        return 1;
+    }
+
+    // Counters only count events in this thread, which runs every
+    // operation
+    PerfCounters counters;
+    options.counters = NULL;
+    if (variables.count("perf-counters"))
+    {
+        if (counters.open())
+        {
+            options.counters = &counters;
+            options.counterOverhead = measureCounterOverhead(counters);
+        }
+        else
+        {
+            std::cerr << "Hardware counters unavailable, continuing without "
+                      << "them: " << counters.error() << std::endl;
+        }
+    }
+
+    BenchmarkRunner runner(options);
+    return dispatchDimensions(options.numDimensions, runner) ? 0 : 1;
+}
@@ -39,11 +39,46 @@ THE SOFTWARE.
 #include "types.hpp"
 #include "point.hpp"
 #include "boundary.hpp"
+#include "distance.hpp"
+#include "space_filling_curve.hpp"
+#include "dataset.hpp"
+#include "text_parser.hpp"
+#include "binary_dataset.hpp"
+#include "dataset_reader.hpp"
 #include "timing.hpp"
+#include "latency_histogram.hpp"
+#include "memory_usage.hpp"
+#include "perf_counters.hpp"
+#include "workload.hpp"
+#include "distributions.hpp"
+#include <algorithm>
 #include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <vector>
+#include <unistd.h>
+#ifdef _OPENMP
+    #include <omp.h>
+#endif
 
 using namespace mdsearch;
 
+namespace mdsearch
+{
+
+    // Use aligned and padded storage for some point types, to test the
+    // point alignment policy
+    template<> struct PointAlignment<5, Real> { static const int value = 16; };
+    template<> struct PointAlignment<6, Real> { static const int value = 32; };
+    template<> struct PointAlignment<7, Real> { static const int value = 64; };
+
+}
+
 namespace
 {
 
@@ -70,12 +105,1625 @@ namespace
         std::cout << "-1 < 0 -> " << compare(-1.0f, 0.0f) << std::endl;
     }
 
+    /* Point equality as originally implemented, comparing one coordinate
+     * at a time with early exit. Used as a reference for the vectorised
+     * implementation. */
+    template<int D>
+    static bool referenceEqual(const Point<D, Real>& a, const Point<D, Real>& b)
+    {
+        for (unsigned int d = 0; (d < D); d++)
+        {
+            if (compare(a[d], b[d]) != 0)
+                return false;
+        }
+        return true;
+    }
+
+    /* Checks point equality against the reference implementation, with
+     * differences just inside and outside the error tolerance in each
+     * coordinate. */
+    template<int D>
+    static void testPointEquality()
+    {
+        static const Real DIFFERENCES[] = {
+            0.0f, EPSILON * 0.5f, EPSILON * 2.0f, 1.0f, -EPSILON * 2.0f };
+
+        bool success = true;
+        Point<D, Real> a(0.25f);
+        for (unsigned int d = 0; (d < D); d++)
+        {
+            for (unsigned int i = 0; (i < 5); i++)
+            {
+                Point<D, Real> b = a;
+                b[d] += DIFFERENCES[i];
+                if ((a == b) != referenceEqual(a, b) || (a == b) == (a != b))
+                    success = false;
+            }
+        }
+        std::cout << "Point equality (D = " << D << ") -> "
+                  << (success ? "SUCCESS" : "FAILED") << std::endl;
+    }
+
+    /* Checks points are aligned as given by the alignment policy, in
+     * arrays and vectors, and padding doesn't affect their values. */
+    template<int D>
+    static void testPointAlignment(unsigned int expectedAlignment)
+    {
+        typedef Point<D, Real> PointType;
+        bool success = (alignof(PointType) == expectedAlignment)
+            && (sizeof(PointType) % expectedAlignment == 0)
+            && (PointType::STORAGE_SIZE >= D);
+
+        Real values[D];
+        for (unsigned int d = 0; (d < D); d++)
+            values[d] = static_cast<Real>(d + 1);
+        std::vector<PointType> points(3, PointType(values));
+        points.push_back(PointType(2.0f));
+        for (unsigned int i = 0; (i < points.size()); i++)
+        {
+            const Real* storage = points[i].asArray();
+            if (reinterpret_cast<std::size_t>(storage) % expectedAlignment)
+                success = false;
+            for (unsigned int d = D; (d < PointType::STORAGE_SIZE); d++)
+            {
+                if (storage[d] != 0)
+                    success = false;
+            }
+        }
+        if (points[0].sum() != D * (D + 1) / 2 || points[3].sum() != D * 2
+            || !(points[0] == points[2]) || points[0] == points[3])
+        {
+            success = false;
+        }
+
+        std::cout << "Point alignment (D = " << D << ", "
+                  << expectedAlignment << " bytes) -> "
+                  << (success ? "SUCCESS" : "FAILED") << std::endl;
+        testPointEquality<D>();
+    }
+
+    /* Times comparisons of points that are equal and points that differ in
+     * one random coordinate, using the vectorised and reference
+     * implementations. */
+    template<int D>
+    static void timePointEquality()
+    {
+        static const unsigned int NUM_POINTS = 1024;
+        static const unsigned int NUM_REPETITIONS = 2000;
+
+        std::vector< Point<D, Real> > points(NUM_POINTS);
+        std::vector< Point<D, Real> > others(NUM_POINTS);
+        for (unsigned int i = 0; (i < NUM_POINTS); i++)
+        {
+            for (unsigned int d = 0; (d < D); d++)
+                points[i][d] = static_cast<Real>(rand()) / RAND_MAX;
+            others[i] = points[i];
+            // Half of the other points differ from their point
+            if (i % 2 == 1)
+                others[i][rand() % D] += 1.0f;
+        }
+
+        // Count equal points, so the comparisons can't be optimised away
+        unsigned int numEqual = 0;
+        double start = getTime();
+        for (unsigned int r = 0; (r < NUM_REPETITIONS); r++)
+        {
+            for (unsigned int i = 0; (i < NUM_POINTS); i++)
+                numEqual += (points[i] == others[i]);
+        }
+        double vectorisedTime = getTime() - start;
+        start = getTime();
+        for (unsigned int r = 0; (r < NUM_REPETITIONS); r++)
+        {
+            for (unsigned int i = 0; (i < NUM_POINTS); i++)
+                numEqual -= referenceEqual(points[i], others[i]);
+        }
+        double referenceTime = getTime() - start;
+
+        std::cout << "Point equality (D = " << D << "): " << vectorisedTime
+                  << " seconds, reference took " << referenceTime
+                  << " seconds";
+        if (numEqual != 0)
+            std::cout << " (RESULTS DIFFER)";
+        std::cout << std::endl;
+    }
+
+    template<int D>
+    static std::vector< Point<D, Real> > randomPoints(unsigned int numPoints)
+    {
+        std::vector< Point<D, Real> > points(numPoints);
+        for (unsigned int i = 0; (i < numPoints); i++)
+        {
+            for (unsigned int d = 0; (d < D); d++)
+                points[i][d] = static_cast<Real>(rand()) / RAND_MAX;
+        }
+        return points;
+    }
+
+    /* Store points column by column, as the SoA distance kernels expect. */
+    template<int D>
+    static std::vector<Real> toColumns(
+        const std::vector< Point<D, Real> >& points)
+    {
+        std::vector<Real> columns(D * points.size());
+        for (unsigned int i = 0; (i < points.size()); i++)
+        {
+            for (unsigned int d = 0; (d < D); d++)
+                columns[d * points.size() + i] = points[i][d];
+        }
+        return columns;
+    }
+
+    /* Checks the distance kernels against distance(), which computes
+     * distances one dimension at a time. */
+    template<typename METRIC, int D>
+    static void testDistanceKernels(const std::string& metricName)
+    {
+        static const unsigned int NUM_POINTS = 100;
+        std::vector< Point<D, Real> > points = randomPoints<D>(NUM_POINTS);
+        std::vector<Real> columns = toColumns<D>(points);
+        Point<D, Real> query = randomPoints<D>(1)[0];
+
+        std::vector<Real> aosDistances(NUM_POINTS);
+        std::vector<Real> soaDistances(NUM_POINTS);
+        distancesAoS<METRIC>(query, &points[0], NUM_POINTS, &aosDistances[0]);
+        distancesSoA<METRIC>(query, &columns[0], NUM_POINTS, NUM_POINTS,
+                             &soaDistances[0]);
+
+        bool success = true;
+        unsigned int nearest = 0;
+        Real nearestDistance = std::numeric_limits<Real>::max();
+        for (unsigned int i = 0; (i < NUM_POINTS); i++)
+        {
+            // The kernels can round differently, since they can sum the
+            // dimensions in a different order or use fused multiply-adds
+            Real expected = distance<METRIC>(query, points[i]);
+            if (std::fabs(aosDistances[i] - expected) > 1e-5f * expected
+                || std::fabs(soaDistances[i] - expected) > 1e-5f * expected)
+            {
+                success = false;
+            }
+            if (soaDistances[i] < nearestDistance)
+            {
+                nearest = i;
+                nearestDistance = soaDistances[i];
+            }
+        }
+
+        Real bestDistance = std::numeric_limits<Real>::max();
+        if (nearestSoA<METRIC>(query, &columns[0], NUM_POINTS, NUM_POINTS,
+                               bestDistance) != static_cast<int>(nearest)
+            || std::fabs(bestDistance - nearestDistance)
+                > 1e-5f * nearestDistance)
+        {
+            success = false;
+        }
+        bestDistance = std::numeric_limits<Real>::max();
+        if (nearestAoS<METRIC>(query, &points[0], NUM_POINTS, bestDistance)
+            != static_cast<int>(nearest))
+        {
+            success = false;
+        }
+        // Nothing is closer than the nearest point
+        bestDistance = nearestDistance * 0.999f;
+        if (nearestAoS<METRIC>(query, &points[0], NUM_POINTS, bestDistance)
+            != -1 || nearestSoA<METRIC>(query, &columns[0], NUM_POINTS,
+                                        NUM_POINTS, bestDistance) != -1)
+        {
+            success = false;
+        }
+
+        std::cout << "Distance kernels (" << metricName << ", D = " << D
+                  << ") -> " << (success ? "SUCCESS" : "FAILED") << std::endl;
+    }
+
+    template<int D>
+    static void testDistanceKernels()
+    {
+        testDistanceKernels<SquaredEuclideanDistance, D>("L2");
+        testDistanceKernels<ManhattanDistance, D>("L1");
+        testDistanceKernels<ChebyshevDistance, D>("Linf");
+    }
+
+    /* Times computing squared Euclidean distances from a query point to a
+     * block of points, with and without the kernels. */
+    template<int D>
+    static void timeDistanceKernels()
+    {
+        static const unsigned int NUM_POINTS = 4096;
+        static const unsigned int NUM_REPETITIONS = 200;
+        typedef SquaredEuclideanDistance Metric;
+        std::vector< Point<D, Real> > points = randomPoints<D>(NUM_POINTS);
+        std::vector<Real> columns = toColumns<D>(points);
+        std::vector< Point<D, Real> > queries =
+            randomPoints<D>(NUM_REPETITIONS);
+        std::vector<Real> distances(NUM_POINTS);
+
+        // Accumulate results, so the loops can't be optimised away
+        Real checksum = 0;
+        double start = getTime();
+        for (unsigned int r = 0; (r < NUM_REPETITIONS); r++)
+        {
+            for (unsigned int i = 0; (i < NUM_POINTS); i++)
+                distances[i] = distance<Metric>(queries[r], points[i]);
+            checksum += distances[r];
+        }
+        double scalarTime = getTime() - start;
+
+        start = getTime();
+        for (unsigned int r = 0; (r < NUM_REPETITIONS); r++)
+        {
+            distancesAoS<Metric>(queries[r], &points[0], NUM_POINTS,
+                                 &distances[0]);
+            checksum += distances[r];
+        }
+        double aosTime = getTime() - start;
+
+        start = getTime();
+        for (unsigned int r = 0; (r < NUM_REPETITIONS); r++)
+        {
+            distancesSoA<Metric>(queries[r], &columns[0], NUM_POINTS,
+                                 NUM_POINTS, &distances[0]);
+            checksum += distances[r];
+        }
+        double soaTime = getTime() - start;
+
+        start = getTime();
+        for (unsigned int r = 0; (r < NUM_REPETITIONS); r++)
+        {
+            Real best = std::numeric_limits<Real>::max();
+            checksum += nearestSoA<Metric>(queries[r], &columns[0],
+                NUM_POINTS, NUM_POINTS, best);
+        }
+        double nearestTime = getTime() - start;
+
+        std::cout << "Distances (D = " << D << "): scalar " << scalarTime
+                  << ", AoS " << aosTime << ", SoA " << soaTime
+                  << ", nearest (SoA) " << nearestTime << " seconds"
+                  << (checksum < 0 ? " " : "") << std::endl;
+    }
+
+    /* Reference implementations of the boundary kernels, which return as
+     * soon as the result is known. */
+    template<int D>
+    static bool referenceContains(const Boundary<D, Real>& boundary,
+                                  const Point<D, Real>& p)
+    {
+        for (unsigned int d = 0; (d < D); d++)
+        {
+            if (p[d] < boundary[d].min || p[d] > boundary[d].max)
+                return false;
+        }
+        return true;
+    }
+
+    template<int D>
+    static bool referenceIntersects(const Boundary<D, Real>& a,
+                                    const Boundary<D, Real>& b)
+    {
+        for (unsigned int d = 0; (d < D); d++)
+        {
+            if (a[d].max < b[d].min || b[d].max < a[d].min)
+                return false;
+        }
+        return true;
+    }
+
+    template<int D>
+    static std::vector< Boundary<D, Real> > randomBoundaries(
+        unsigned int numBoundaries, Real width)
+    {
+        std::vector< Boundary<D, Real> > boundaries(numBoundaries);
+        for (unsigned int i = 0; (i < numBoundaries); i++)
+        {
+            for (unsigned int d = 0; (d < D); d++)
+            {
+                Real start = (static_cast<Real>(rand()) / RAND_MAX)
+                    * (1.0f - width);
+                boundaries[i][d] = Interval<Real>(start, start + width);
+            }
+        }
+        return boundaries;
+    }
+
+    /* Checks the boundary kernels against the reference implementations
+     * and, for distances, against the closest point inside the boundary
+     * and the furthest corner. */
+    template<int D>
+    static void testBoundaryKernels()
+    {
+        static const unsigned int NUM_TESTS = 1000;
+        // Wide enough for roughly half of the tests to pass in each case
+        const Real width = std::pow(0.5f, 1.0f / D);
+        std::vector< Boundary<D, Real> > boundaries =
+            randomBoundaries<D>(NUM_TESTS + 1, width);
+        std::vector< Point<D, Real> > points = randomPoints<D>(NUM_TESTS);
+        std::vector<Real> columns = toColumns<D>(points);
+
+        bool success = true;
+        for (unsigned int i = 0; (i < NUM_TESTS); i++)
+        {
+            const Boundary<D, Real>& b = boundaries[i];
+            if (b.contains(points[i]) != referenceContains(b, points[i])
+                || b.intersects(boundaries[i + 1])
+                    != referenceIntersects(b, boundaries[i + 1])
+                || !b.contains(b) || !b.intersects(b))
+            {
+                success = false;
+            }
+
+            Point<D, Real> closest;
+            Point<D, Real> furthest;
+            for (unsigned int d = 0; (d < D); d++)
+            {
+                closest[d] = std::min(std::max(points[i][d], b[d].min),
+                                      b[d].max);
+                furthest[d] = (points[i][d] - b[d].min > b[d].max - points[i][d])
+                    ? b[d].min : b[d].max;
+            }
+            Real expectedMin = distance<SquaredEuclideanDistance>(
+                points[i], closest);
+            Real expectedMax = distance<SquaredEuclideanDistance>(
+                points[i], furthest);
+            if (std::fabs(minDistance<SquaredEuclideanDistance>(b, points[i])
+                    - expectedMin) > 1e-5f * expectedMin
+                || std::fabs(maxDistance<SquaredEuclideanDistance>(b, points[i])
+                    - expectedMax) > 1e-5f * expectedMax
+                || (minDistance<ChebyshevDistance>(b, points[i]) == 0)
+                    != referenceContains(b, points[i]))
+            {
+                success = false;
+            }
+        }
+
+        // Batch kernels, over both layouts of the points
+        std::vector<unsigned char> aosResults(NUM_TESTS);
+        std::vector<unsigned char> soaResults(NUM_TESTS);
+        unsigned int aosInside = containsPoints(boundaries[0], &points[0],
+                                                NUM_TESTS, &aosResults[0]);
+        unsigned int soaInside = containsColumns(boundaries[0], &columns[0],
+            NUM_TESTS, NUM_TESTS, &soaResults[0]);
+        unsigned int expectedInside = 0;
+        for (unsigned int i = 0; (i < NUM_TESTS); i++)
+        {
+            bool expected = referenceContains(boundaries[0], points[i]);
+            expectedInside += expected;
+            if (aosResults[i] != expected || soaResults[i] != expected)
+                success = false;
+        }
+        if (aosInside != expectedInside || soaInside != expectedInside)
+            success = false;
+
+        std::cout << "Boundary kernels (D = " << D << ") -> "
+                  << (success ? "SUCCESS" : "FAILED") << std::endl;
+    }
+
+    /* Times testing whether points are inside boundaries with the kernels
+     * and the reference implementations. */
+    template<int D>
+    static void timeBoundaryKernels()
+    {
+        static const unsigned int NUM_POINTS = 4096;
+        static const unsigned int NUM_REPETITIONS = 200;
+        const Real width = std::pow(0.5f, 1.0f / D);
+        std::vector< Point<D, Real> > points = randomPoints<D>(NUM_POINTS);
+        std::vector<Real> columns = toColumns<D>(points);
+        std::vector< Boundary<D, Real> > boundaries =
+            randomBoundaries<D>(NUM_REPETITIONS, width);
+        std::vector<unsigned char> results(NUM_POINTS);
+
+        // Count results, so the loops can't be optimised away
+        long checksum = 0;
+        double start = getTime();
+        for (unsigned int r = 0; (r < NUM_REPETITIONS); r++)
+        {
+            for (unsigned int i = 0; (i < NUM_POINTS); i++)
+                checksum += referenceContains(boundaries[r], points[i]);
+        }
+        double referenceTime = getTime() - start;
+
+        start = getTime();
+        for (unsigned int r = 0; (r < NUM_REPETITIONS); r++)
+        {
+            for (unsigned int i = 0; (i < NUM_POINTS); i++)
+                checksum -= boundaries[r].contains(points[i]);
+        }
+        double containsTime = getTime() - start;
+
+        start = getTime();
+        for (unsigned int r = 0; (r < NUM_REPETITIONS); r++)
+        {
+            checksum += containsPoints(boundaries[r], &points[0], NUM_POINTS,
+                                       &results[0]);
+        }
+        double aosTime = getTime() - start;
+
+        start = getTime();
+        for (unsigned int r = 0; (r < NUM_REPETITIONS); r++)
+        {
+            checksum -= containsColumns(boundaries[r], &columns[0],
+                NUM_POINTS, NUM_POINTS, &results[0]);
+        }
+        double soaTime = getTime() - start;
+
+        Real distanceSum = 0;
+        start = getTime();
+        for (unsigned int r = 0; (r < NUM_REPETITIONS); r++)
+        {
+            for (unsigned int i = 0; (i < NUM_POINTS); i++)
+            {
+                distanceSum += minDistance<SquaredEuclideanDistance>(
+                    boundaries[r], points[i]);
+            }
+        }
+        double minDistanceTime = getTime() - start;
+
+        std::cout << "Boundary contains (D = " << D << "): reference "
+                  << referenceTime << ", blocked " << containsTime
+                  << ", AoS batch " << aosTime << ", SoA batch " << soaTime
+                  << " seconds; min distance " << minDistanceTime
+                  << " seconds";
+        if (checksum != 0)
+            std::cout << " (RESULTS DIFFER)";
+        std::cout << (distanceSum < 0 ? " " : "") << std::endl;
+    }
+
+    /* Enumerates every cell of a small grid and checks the Morton keys
+     * are the interleaved cell coordinates, and the Hilbert keys visit
+     * each cell once, moving to an adjacent cell at every step. */
+    template<int D>
+    static void testSpaceFillingCurves(unsigned int bitsPerDimension)
+    {
+        const unsigned int cellsPerDim = 1 << bitsPerDimension;
+        const unsigned int numCells = 1 << (bitsPerDimension * D);
+        Boundary<D, Real> boundary(Interval<Real>(0.0f, cellsPerDim));
+        MortonCurve<D, Real> morton(boundary, bitsPerDimension);
+        HilbertCurve<D, Real> hilbert(boundary, bitsPerDimension);
+
+        bool success = (morton.bitsPerDimension() == bitsPerDimension
+            && hilbert.bitsPerDimension() == bitsPerDimension);
+        std::vector<int> hilbertCells(numCells, -1);
+        for (unsigned int c = 0; (c < numCells); c++)
+        {
+            // Use the centre of the cell whose coordinates are the digits
+            // of c in base cellsPerDim
+            Point<D, Real> p;
+            HashType expectedMorton = 0;
+            for (unsigned int d = 0; (d < D); d++)
+            {
+                unsigned int coord = (c >> (d * bitsPerDimension))
+                    & (cellsPerDim - 1);
+                p[d] = coord + 0.5f;
+                for (unsigned int b = 0; (b < bitsPerDimension); b++)
+                {
+                    expectedMorton |= static_cast<HashType>((coord >> b) & 1)
+                        << (b * D + d);
+                }
+            }
+            if (morton.key(p) != expectedMorton)
+                success = false;
+            HashType hilbertKey = hilbert.key(p);
+            if (hilbertKey < 0 || hilbertKey >= static_cast<HashType>(numCells)
+                || hilbertCells[hilbertKey] != -1)
+            {
+                success = false;
+                break;
+            }
+            hilbertCells[hilbertKey] = c;
+        }
+
+        for (unsigned int k = 1; (success && k < numCells); k++)
+        {
+            unsigned int distance = 0;
+            for (unsigned int d = 0; (d < D); d++)
+            {
+                int a = (hilbertCells[k - 1] >> (d * bitsPerDimension))
+                    & (cellsPerDim - 1);
+                int b = (hilbertCells[k] >> (d * bitsPerDimension))
+                    & (cellsPerDim - 1);
+                distance += std::abs(a - b);
+            }
+            if (distance != 1)
+                success = false;
+        }
+
+        std::cout << "Space-filling curves (D = " << D << ", "
+                  << bitsPerDimension << " bits) -> "
+                  << (success ? "SUCCESS" : "FAILED") << std::endl;
+    }
+
+    /* Times computing the keys of points in a dataset on each curve. */
+    template<int D>
+    static void timeSpaceFillingCurves()
+    {
+        static const unsigned int NUM_POINTS = 1000000;
+        Dataset<D, Real> dataset;
+        dataset.load(randomPoints<D>(NUM_POINTS));
+        Boundary<D, Real> boundary = dataset.computeBoundary();
+        MortonCurve<D, Real> morton(boundary);
+        HilbertCurve<D, Real> hilbert(boundary);
+
+        std::vector<HashType> keys;
+        double start = getTime();
+        computeCurveKeys(morton, dataset, keys);
+        double mortonTime = getTime() - start;
+        start = getTime();
+        computeCurveKeys(hilbert, dataset, keys);
+        double hilbertTime = getTime() - start;
+        std::cout << "Curve keys (D = " << D << ", " << NUM_POINTS
+                  << " points" << (cpuSupportsBMI2() ? ", BMI2" : "")
+                  << "): Morton " << mortonTime << ", Hilbert " << hilbertTime
+                  << " seconds" << std::endl;
+    }
+
+    /* Dataset::load as originally implemented, reading one value at a
+     * time from a file stream. Used as a reference for the parser. */
+    template<int D>
+    static void referenceLoad(const std::string& filename,
+                              std::vector< Point<D, Real> >& points)
+    {
+        std::ifstream file(filename.c_str());
+        int numDimensions = 0;
+        int numPoints = 0;
+        if (!(file >> numDimensions >> numPoints))
+            return;
+        points.reserve(points.size() + numPoints);
+        Real temp[D];
+        for (int i = 0; (i < numPoints); i++)
+        {
+            for (int j = 0; (j < numDimensions); j++)
+                file >> temp[j];
+            points.push_back(Point<D, Real>(temp));
+            if (file.eof())
+                break;
+        }
+    }
+
+    /* Return true if both lists contain exactly the same points. */
+    template<int D>
+    static bool identicalPoints(const std::vector< Point<D, Real> >& a,
+                                const std::vector< Point<D, Real> >& b)
+    {
+        if (a.size() != b.size())
+            return false;
+        for (unsigned int i = 0; (i < a.size()); i++)
+        {
+            for (unsigned int d = 0; (d < D); d++)
+            {
+                if (a[i][d] != b[i][d])
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    /* Write points to a text file that Dataset::load can read. Values
+     * have a wide range of magnitudes and are written with enough digits
+     * to be parsed back exactly. If 'varyFormatting' is true, lines also
+     * have varying whitespace, line endings and blank lines between them. */
+    template<int D>
+    static void writePointsFile(const std::string& filename,
+                                const std::vector< Point<D, Real> >& points,
+                                bool varyFormatting)
+    {
+        std::ofstream file(filename.c_str());
+        file << D << " " << points.size() << "\n";
+        file.precision(9);
+        for (unsigned int i = 0; (i < points.size()); i++)
+        {
+            if (varyFormatting && i % 7 == 0)
+                file << "\t ";
+            for (unsigned int d = 0; (d < D); d++)
+            {
+                if (varyFormatting && i % 3 == 0)
+                    file << std::scientific;
+                else
+                    file.unsetf(std::ios::floatfield);
+                file << points[i][d] << ((d + 1 < D) ? " " : "");
+            }
+            if (varyFormatting && i % 4 == 0)
+                file << "\r";
+            file << "\n";
+            if (varyFormatting && i % 5 == 0)
+                file << "  \n";
+        }
+    }
+
+    template<int D>
+    static std::vector< Point<D, Real> > pointsToParse(unsigned int numPoints)
+    {
+        std::vector< Point<D, Real> > points = randomPoints<D>(numPoints);
+        for (unsigned int i = 0; (i < numPoints); i++)
+        {
+            for (unsigned int d = 0; (d < D); d++)
+            {
+                points[i][d] *= std::pow(10.0f, static_cast<int>(i % 9) - 4);
+                if (d % 2 == 1)
+                    points[i][d] = -points[i][d];
+            }
+        }
+        return points;
+    }
+
+    /* Checks points loaded from text files are exactly the points that
+     * were written, with any number of chunks, and that malformed files
+     * are handled like the original loader. */
+    template<int D>
+    static void testTextParsing()
+    {
+        static const unsigned int NUM_POINTS = 10000;
+        static const unsigned int CHUNK_COUNTS[] = { 1, 2, 3, 17, 64, 1000 };
+        static const char* FILENAME = "mdsearch_text_parser_test.txt";
+        std::vector< Point<D, Real> > points = pointsToParse<D>(NUM_POINTS);
+        bool success = true;
+
+        writePointsFile<D>(FILENAME, points, true);
+        Dataset<D, Real> dataset;
+        dataset.load(FILENAME);
+        if (!identicalPoints<D>(dataset.getPoints(), points))
+            success = false;
+        // Loading again appends the points
+        dataset.load(FILENAME);
+        if (dataset.getPoints().size() != 2 * NUM_POINTS)
+            success = false;
+
+        MappedFile file(FILENAME);
+        const char* end = file.data() + file.size();
+        const char* body = findLineEnd(file.data(), end) + 1;
+        for (unsigned int c = 0; (c < 6); c++)
+        {
+            std::vector< Point<D, Real> > parsed;
+            parsePoints(body, end, parsed, NUM_POINTS, CHUNK_COUNTS[c]);
+            if (!identicalPoints<D>(parsed, points))
+                success = false;
+            // The header's point count limits how many points are parsed
+            parsed.clear();
+            if (parsePoints(body, end, parsed, NUM_POINTS / 3,
+                            CHUNK_COUNTS[c]) != NUM_POINTS / 3
+                || !identicalPoints<D>(parsed, std::vector< Point<D, Real> >(
+                    points.begin(), points.begin() + NUM_POINTS / 3)))
+            {
+                success = false;
+            }
+        }
+
+        // Without varied formatting, the file can be read by the original
+        // loader too
+        writePointsFile<D>(FILENAME, points, false);
+        std::vector< Point<D, Real> > referencePoints;
+        referenceLoad<D>(FILENAME, referencePoints);
+        Dataset<D, Real> plainDataset;
+        plainDataset.load(FILENAME);
+        if (!identicalPoints<D>(plainDataset.getPoints(), referencePoints))
+            success = false;
+
+        // Missing values are zero, and lines after the last point the
+        // header specifies are ignored
+        {
+            std::ofstream malformed(FILENAME);
+            malformed << D << " 2\n+1.5\n2 x 3\n4\n";
+        }
+        Dataset<D, Real> malformedDataset;
+        malformedDataset.load(FILENAME);
+        const std::vector< Point<D, Real> >& loaded =
+            malformedDataset.getPoints();
+        if (loaded.size() != 2 || loaded[0][0] != 1.5f || loaded[1][0] != 2)
+            success = false;
+        for (unsigned int d = 1; (d < D && loaded.size() == 2); d++)
+        {
+            if (loaded[0][d] != 0 || loaded[1][d] != ((d == 2) ? 3 : 0))
+                success = false;
+        }
+
+        // Invalid headers and missing files load nothing
+        {
+            std::ofstream invalid(FILENAME);
+            invalid << "d n\n1 2 3\n";
+        }
+        Dataset<D, Real> emptyDataset;
+        emptyDataset.load(FILENAME);
+        std::remove(FILENAME);
+        emptyDataset.load(FILENAME);
+        if (!emptyDataset.getPoints().empty())
+            success = false;
+
+        std::cout << "Text parsing (D = " << D << ") -> "
+                  << (success ? "SUCCESS" : "FAILED") << std::endl;
+    }
+
+    /* Times loading a text file with the original loader and with the
+     * parser, reporting the throughput of each. */
+    template<int D>
+    static void timeTextParsing()
+    {
+        static const unsigned int NUM_POINTS = 200000;
+        static const char* FILENAME = "mdsearch_text_parser_time.txt";
+        writePointsFile<D>(FILENAME, pointsToParse<D>(NUM_POINTS), false);
+        double megabytes = 0.0;
+        {
+            MappedFile file(FILENAME);
+            megabytes = static_cast<double>(file.size()) / (1 << 20);
+        }
+
+        std::vector< Point<D, Real> > referencePoints;
+        double start = getTime();
+        referenceLoad<D>(FILENAME, referencePoints);
+        double referenceTime = getTime() - start;
+        Dataset<D, Real> dataset;
+        start = getTime();
+        dataset.load(FILENAME);
+        double parserTime = getTime() - start;
+        std::remove(FILENAME);
+
+        std::cout << "Text loading (D = " << D << ", " << megabytes
+                  << " MB): stream " << (megabytes / referenceTime)
+                  << " MB/s, parser " << (megabytes / parserTime)
+                  << " MB/s" << std::endl;
+    }
+
+    /* Checks points written to binary datasets in either layout are read
+     * back exactly, in place or copied, and that files for other point
+     * types or with corrupt headers are rejected. */
+    template<int D>
+    static void testBinaryDatasets()
+    {
+        static const unsigned int NUM_POINTS = 10000;
+        static const char* FILENAME = "mdsearch_binary_test.bin";
+        static const char* TEXT_FILENAME = "mdsearch_binary_test.txt";
+        std::vector< Point<D, Real> > points = pointsToParse<D>(NUM_POINTS);
+        Dataset<D, Real> original;
+        original.load(points);
+        const Boundary<D, Real> boundary = original.computeBoundary();
+        bool success = true;
+
+        // Points in AoS layout are used in place if the dataset is empty
+        original.save(FILENAME, AOS_LAYOUT);
+        Dataset<D, Real> mapped;
+        mapped.load(FILENAME);
+        if (!mapped.isMapped() || mapped.size() != NUM_POINTS
+            || !identicalPoints<D>(mapped.getPoints(), points)
+            || !mapped.computeBoundary().contains(boundary)
+            || !boundary.contains(mapped.computeBoundary()))
+        {
+            success = false;
+        }
+        // Loading more points copies the mapped points first
+        mapped.load(FILENAME);
+        if (mapped.isMapped() || mapped.size() != 2 * NUM_POINTS
+            || !(mapped.getPoints()[NUM_POINTS] == points[0]))
+        {
+            success = false;
+        }
+
+        // Points in SoA layout are copied, and can be read as columns
+        original.save(FILENAME, SOA_LAYOUT);
+        Dataset<D, Real> copied;
+        copied.load(FILENAME);
+        if (copied.isMapped()
+            || !identicalPoints<D>(copied.getPoints(), points))
+        {
+            success = false;
+        }
+        BinaryDatasetFile columns(FILENAME);
+        for (unsigned int d = 0; (d < D); d++)
+        {
+            if (reinterpret_cast<uintptr_t>(columns.column<Real>(d))
+                % BINARY_DATASET_ALIGNMENT != 0)
+            {
+                success = false;
+            }
+            for (unsigned int i = 0; (i < NUM_POINTS); i++)
+            {
+                if (columns.column<Real>(d)[i] != points[i][d])
+                    success = false;
+            }
+        }
+
+        // Files storing other point types, and files which aren't valid,
+        // load nothing
+        Dataset<D + 1, Real> otherDimensions;
+        otherDimensions.load(FILENAME);
+        Dataset<D, double> otherType;
+        otherType.load(FILENAME);
+        std::vector<char> truncated(100);
+        {
+            std::ifstream in(FILENAME, std::ios::binary);
+            in.read(&truncated[0], truncated.size());
+        }
+        {
+            std::ofstream out(FILENAME, std::ios::binary);
+            out.write(&truncated[0], truncated.size());
+        }
+        Dataset<D, Real> invalid;
+        invalid.load(FILENAME);
+        if (otherDimensions.size() != 0 || otherType.size() != 0
+            || invalid.size() != 0)
+        {
+            success = false;
+        }
+
+        // Headers whose number of points overflows the size of the
+        // coordinates, or whose element size doesn't match the element
+        // type, are rejected
+        for (unsigned int c = 0; (c < 2); c++)
+        {
+            original.save(FILENAME, AOS_LAYOUT);
+            BinaryDatasetHeader header;
+            {
+                std::ifstream in(FILENAME, std::ios::binary);
+                in.read(reinterpret_cast<char*>(&header), sizeof(header));
+            }
+            if (c == 0)
+                header.numPoints = static_cast<uint64_t>(1) << 62;
+            else
+                header.elementSize = 1;
+            {
+                std::fstream out(FILENAME, std::ios::binary
+                    | std::ios::in | std::ios::out);
+                out.write(reinterpret_cast<const char*>(&header),
+                          sizeof(header));
+            }
+            if (BinaryDatasetFile(FILENAME).isValid())
+                success = false;
+        }
+
+        // Convert text file to binary
+        writePointsFile<D>(TEXT_FILENAME, points, false);
+        Dataset<D, Real> converted;
+        if (!convertTextToBinary<D, Real>(TEXT_FILENAME, FILENAME))
+            success = false;
+        converted.load(FILENAME);
+        if (!identicalPoints<D>(converted.getPoints(), points))
+            success = false;
+        std::remove(TEXT_FILENAME);
+        std::remove(FILENAME);
+
+        std::cout << "Binary datasets (D = " << D << ") -> "
+                  << (success ? "SUCCESS" : "FAILED") << std::endl;
+    }
+
+    /* Times loading the same points from a text file and from binary
+     * files in each layout. */
+    template<int D>
+    static void timeBinaryDatasets()
+    {
+        static const unsigned int NUM_POINTS = 200000;
+        static const char* TEXT_FILENAME = "mdsearch_binary_time.txt";
+        static const char* FILENAME = "mdsearch_binary_time.bin";
+        std::vector< Point<D, Real> > points = pointsToParse<D>(NUM_POINTS);
+        writePointsFile<D>(TEXT_FILENAME, points, false);
+
+        double start = getTime();
+        Dataset<D, Real> text;
+        text.load(TEXT_FILENAME);
+        double textTime = getTime() - start;
+
+        double layoutTimes[2] = { 0.0, 0.0 };
+        for (unsigned int layout = 0; (layout < 2); layout++)
+        {
+            text.save(FILENAME, static_cast<BinaryLayout>(layout));
+            start = getTime();
+            Dataset<D, Real> binary;
+            binary.load(FILENAME);
+            // Read every coordinate, so mapped pages are loaded too
+            Real sum = 0;
+            for (unsigned int i = 0; (i < binary.size()); i++)
+                sum += binary.data()[i].sum();
+            layoutTimes[layout] = getTime() - start;
+            if (sum != sum) // only NaN isn't equal to itself
+                std::cout << "NaN coordinate" << std::endl;
+        }
+        std::remove(TEXT_FILENAME);
+        std::remove(FILENAME);
+
+        std::cout << "Dataset loading (D = " << D << ", " << NUM_POINTS
+                  << " points): text " << textTime << ", binary AoS (mapped) "
+                  << layoutTimes[AOS_LAYOUT] << ", binary SoA (copied) "
+                  << layoutTimes[SOA_LAYOUT] << " seconds" << std::endl;
+    }
+
+    /* Read every chunk of a file, checking no chunk is too large. */
+    template<int D>
+    static bool readAllChunks(DatasetReader<D, Real>& reader,
+                              std::vector< Point<D, Real> >& points)
+    {
+        std::vector< Point<D, Real> > chunk;
+        bool success = true;
+        while (reader.next(chunk))
+        {
+            if (chunk.empty() || chunk.size() > reader.chunkSize())
+                success = false;
+            points.insert(points.end(), chunk.begin(), chunk.end());
+        }
+        return success && chunk.empty() && !reader.next(chunk);
+    }
+
+    /* Checks the chunks read from text and binary files contain every
+     * point in order, for several chunk sizes. */
+    template<int D>
+    static void testDatasetReader()
+    {
+        static const unsigned int NUM_POINTS = 10000;
+        static const std::size_t CHUNK_SIZES[] = { 1, 7, 1000, 100000 };
+        static const char* TEXT_FILENAME = "mdsearch_reader_test.txt";
+        static const char* AOS_FILENAME = "mdsearch_reader_test_aos.bin";
+        static const char* SOA_FILENAME = "mdsearch_reader_test_soa.bin";
+        std::vector< Point<D, Real> > points = pointsToParse<D>(NUM_POINTS);
+        writePointsFile<D>(TEXT_FILENAME, points, true);
+        writeBinaryDataset(AOS_FILENAME, &points[0], NUM_POINTS, AOS_LAYOUT);
+        writeBinaryDataset(SOA_FILENAME, &points[0], NUM_POINTS, SOA_LAYOUT);
+        const char* filenames[] = {
+            TEXT_FILENAME, AOS_FILENAME, SOA_FILENAME
+        };
+        bool success = true;
+
+        for (unsigned int f = 0; (f < 3); f++)
+        {
+            for (unsigned int c = 0; (c < 4); c++)
+            {
+                DatasetReader<D, Real> reader(filenames[f], CHUNK_SIZES[c]);
+                std::vector< Point<D, Real> > read;
+                if (!reader.isOpen() || !readAllChunks<D>(reader, read)
+                    || !identicalPoints<D>(read, points))
+                {
+                    success = false;
+                }
+            }
+            // Readers destroyed before reading every chunk stop reading
+            DatasetReader<D, Real> unfinished(filenames[f], 10);
+            std::vector< Point<D, Real> > chunk;
+            if (!unfinished.next(chunk) || chunk.size() != 10)
+                success = false;
+        }
+
+        // Files for other types of points and missing files can't be read
+        DatasetReader<D + 1, Real> otherDimensions(AOS_FILENAME);
+        std::remove(TEXT_FILENAME);
+        std::remove(AOS_FILENAME);
+        std::remove(SOA_FILENAME);
+        DatasetReader<D, Real> missing(TEXT_FILENAME);
+        std::vector< Point<D + 1, Real> > otherChunk;
+        std::vector< Point<D, Real> > missingChunk;
+        if (otherDimensions.isOpen() || otherDimensions.next(otherChunk)
+            || missing.isOpen() || missing.next(missingChunk))
+        {
+            success = false;
+        }
+
+        std::cout << "Dataset reader (D = " << D << ") -> "
+                  << (success ? "SUCCESS" : "FAILED") << std::endl;
+    }
+
+    /* Dataset::computeBoundary as originally implemented. Used as a
+     * reference for the parallel reduction. */
+    template<int D>
+    static Boundary<D, Real> referenceBoundary(
+        const std::vector< Point<D, Real> >& points)
+    {
+        Boundary<D, Real> boundary(Interval<Real>(0, 0));
+        if (points.empty())
+            return boundary;
+        for (unsigned int d = 0; (d < D); d++)
+        {
+            boundary[d].min = points[0][d];
+            boundary[d].max = points[0][d];
+        }
+        for (unsigned int i = 1; (i < points.size()); i++)
+        {
+            for (unsigned int d = 0; (d < D); d++)
+            {
+                if (points[i][d] < boundary[d].min)
+                    boundary[d].min = points[i][d];
+                else if (points[i][d] > boundary[d].max)
+                    boundary[d].max = points[i][d];
+            }
+        }
+        return boundary;
+    }
+
+    template<int D>
+    static bool identicalBoundaries(const Boundary<D, Real>& a,
+                                    const Boundary<D, Real>& b)
+    {
+        for (unsigned int d = 0; (d < D); d++)
+        {
+            if (a[d].min != b[d].min || a[d].max != b[d].max)
+                return false;
+        }
+        return true;
+    }
+
+    /* Checks the boundaries computed all at once, in parallel and one
+     * chunk at a time match the reference. */
+    template<int D>
+    static void testBoundaryAccumulator()
+    {
+        static const unsigned int NUM_POINTS = 200000;
+        static const std::size_t CHUNK_SIZES[] = { 1, 999, 100000 };
+        std::vector< Point<D, Real> > points = pointsToParse<D>(NUM_POINTS);
+        const Boundary<D, Real> expected = referenceBoundary<D>(points);
+        bool success = true;
+
+        Dataset<D, Real> dataset;
+        if (!identicalBoundaries<D>(dataset.computeBoundary(),
+                                    Boundary<D, Real>(Interval<Real>(0, 0))))
+        {
+            success = false;
+        }
+        dataset.load(points);
+        if (!identicalBoundaries<D>(dataset.computeBoundary(), expected))
+            success = false;
+
+        // Force several threads, so the tree reduction is used even on
+        // machines with a single core
+        #ifdef _OPENMP
+        const int maxThreads = omp_get_max_threads();
+        for (int numThreads = 2; (numThreads <= 7); numThreads++)
+        {
+            omp_set_num_threads(numThreads);
+            if (!identicalBoundaries<D>(dataset.computeBoundary(), expected))
+                success = false;
+        }
+        omp_set_num_threads(maxThreads);
+        #endif
+
+        for (unsigned int c = 0; (c < 3); c++)
+        {
+            BoundaryAccumulator<D, Real> accumulator;
+            BoundaryAccumulator<D, Real> secondHalf;
+            for (std::size_t start = 0; (start < NUM_POINTS);
+                start += CHUNK_SIZES[c])
+            {
+                std::size_t count = std::min<std::size_t>(CHUNK_SIZES[c],
+                    NUM_POINTS - start);
+                if (start < NUM_POINTS / 2)
+                    accumulator.add(&points[start], count);
+                else
+                    secondHalf.add(&points[start], count);
+            }
+            accumulator.add(secondHalf);
+            if (accumulator.empty()
+                || !identicalBoundaries<D>(accumulator.boundary(), expected))
+            {
+                success = false;
+            }
+        }
+
+        std::cout << "Boundary accumulator (D = " << D << ") -> "
+                  << (success ? "SUCCESS" : "FAILED") << std::endl;
+    }
+
+    /* Times computing the boundary of a dataset with the original loop
+     * and with the accumulator. */
+    template<int D>
+    static void timeComputeBoundary(unsigned int numPoints)
+    {
+        static const unsigned int NUM_REPETITIONS = 10;
+        Dataset<D, Real> dataset;
+        dataset.load(pointsToParse<D>(numPoints));
+        Boundary<D, Real> expected;
+        Boundary<D, Real> computed;
+
+        double start = getTime();
+        for (unsigned int r = 0; (r < NUM_REPETITIONS); r++)
+            expected = referenceBoundary<D>(dataset.getPoints());
+        double referenceTime = getTime() - start;
+        start = getTime();
+        for (unsigned int r = 0; (r < NUM_REPETITIONS); r++)
+            computed = dataset.computeBoundary();
+        double accumulatorTime = getTime() - start;
+
+        std::cout << "Compute boundary (D = " << D << ", " << numPoints
+                  << " points x " << NUM_REPETITIONS << "): reference "
+                  << referenceTime << ", accumulator " << accumulatorTime
+                  << " seconds" << (identicalBoundaries<D>(expected, computed)
+                                    ? "" : " (MISMATCH)")
+                  << std::endl;
+    }
+
+    /* Checks every value maps to a bucket containing it, and that
+     * percentiles of known values are within the histogram's error. */
+    static void testLatencyHistogram()
+    {
+        typedef LatencyHistogram<> Histogram;
+        bool success = true;
+
+        uint64_t previousUpperBound = 0;
+        for (unsigned int i = 1; (i < Histogram::NUM_BUCKETS); i++)
+        {
+            const uint64_t upperBound = Histogram::bucketUpperBound(i);
+            if (upperBound <= previousUpperBound
+                || Histogram::bucketIndex(upperBound) != i
+                || Histogram::bucketIndex(previousUpperBound + 1) != i)
+            {
+                success = false;
+            }
+            previousUpperBound = upperBound;
+        }
+        if (Histogram::bucketIndex(std::numeric_limits<uint64_t>::max())
+            != Histogram::NUM_BUCKETS - 1)
+        {
+            success = false;
+        }
+
+        // 1..100000 in a random order, so percentile p is 1000p
+        static const uint64_t NUM_VALUES = 100000;
+        std::vector<uint64_t> values(NUM_VALUES);
+        for (uint64_t i = 0; (i < NUM_VALUES); i++)
+            values[i] = i + 1;
+        std::mt19937 generator(1);
+        std::shuffle(values.begin(), values.end(), generator);
+        Histogram histogram;
+        Histogram firstHalf;
+        for (uint64_t i = 0; (i < NUM_VALUES); i++)
+        {
+            histogram.record(values[i]);
+            if (i < NUM_VALUES / 2)
+                firstHalf.record(values[i]);
+        }
+        static const double PERCENTILES[] = { 0.01, 50.0, 90.0, 99.0, 99.9 };
+        for (unsigned int p = 0; (p < 5); p++)
+        {
+            const double expected = PERCENTILES[p] * NUM_VALUES / 100.0;
+            const double actual = static_cast<double>(
+                histogram.valueAtPercentile(PERCENTILES[p]));
+            if (actual < expected || actual > expected * 1.016)
+                success = false;
+        }
+        if (histogram.count() != NUM_VALUES || histogram.min() != 1
+            || histogram.max() != NUM_VALUES
+            || histogram.valueAtPercentile(100.0) != NUM_VALUES
+            || histogram.mean() != (NUM_VALUES + 1) / 2.0)
+        {
+            success = false;
+        }
+
+        Histogram merged;
+        merged.merge(firstHalf);
+        Histogram secondHalf;
+        for (uint64_t i = NUM_VALUES / 2; (i < NUM_VALUES); i++)
+            secondHalf.record(values[i]);
+        merged.merge(secondHalf);
+        for (unsigned int p = 0; (p < 5); p++)
+        {
+            if (merged.valueAtPercentile(PERCENTILES[p])
+                != histogram.valueAtPercentile(PERCENTILES[p]))
+            {
+                success = false;
+            }
+        }
+        merged.clear();
+        if (merged.count() != 0 || merged.valueAtPercentile(50.0) != 0)
+            success = false;
+
+        std::cout << "Latency histogram -> "
+                  << (success ? "SUCCESS" : "FAILED") << std::endl;
+    }
+
+    static void testCountingAllocator()
+    {
+        typedef CountingAllocator<Real> RealAllocator;
+        bool success = true;
+
+        MemoryCounter counter;
+        {
+            std::vector<Real, RealAllocator> values(
+                (RealAllocator(&counter)));
+            for (unsigned int i = 0; (i < 1000); i++)
+                values.push_back(static_cast<Real>(i));
+            if (counter.bytes != values.capacity() * sizeof(Real)
+                || counter.blocks != 1)
+            {
+                success = false;
+            }
+
+            // Copies and swapped storage stay with the same counter
+            std::vector<Real, RealAllocator> copy(values);
+            if (counter.bytes != (values.capacity() + copy.capacity())
+                * sizeof(Real) || counter.blocks != 2)
+            {
+                success = false;
+            }
+            std::vector<Real, RealAllocator>().swap(copy);
+            if (counter.blocks != 1 || copy.get_allocator().counter() != NULL)
+                success = false;
+        }
+        if (counter.bytes != 0 || counter.blocks != 0)
+            success = false;
+
+        // Aligned storage is counted in the same way
+        MemoryCounter alignedCounter;
+        CountingAllocator<Real, 64> alignedAllocator(&alignedCounter);
+        Real* aligned = alignedAllocator.allocate(10);
+        if (reinterpret_cast<std::size_t>(aligned) % 64 != 0
+            || alignedCounter.bytes != 10 * sizeof(Real))
+        {
+            success = false;
+        }
+        alignedAllocator.deallocate(aligned, 10);
+        if (alignedCounter.bytes != 0)
+            success = false;
+
+        // Allocators without a counter count nothing
+        RealAllocator uncounted;
+        uncounted.deallocate(uncounted.allocate(10), 10);
+        if (uncounted != RealAllocator() || uncounted == RealAllocator(&counter))
+            success = false;
+
+        MemoryUsage usage;
+        usage.nodes = 100;
+        usage.payload = 200;
+        usage.hashOverhead = 300;
+        usage.slack = 400;
+        MemoryUsage sum;
+        sum += usage;
+        sum += usage;
+        if (sum.total() != 2000 || sum.bytesPerPoint(100) != 20.0
+            || MemoryUsage().bytesPerPoint(0) != 0.0)
+        {
+            success = false;
+        }
+
+        std::cout << "Counting allocator -> "
+                  << (success ? "SUCCESS" : "FAILED") << std::endl;
+    }
+
+    /* Counters usually can't be opened in containers and virtual machines,
+     * so only check they fail cleanly there. */
+    static void testPerfCounters()
+    {
+        bool success = true;
+        PerfCounters counters;
+        PerfSample before;
+        PerfSample after;
+        if (counters.open())
+        {
+            // Each iteration retires at least one instruction
+            static const unsigned int NUM_ITERATIONS = 100000;
+            volatile unsigned int sum = 0;
+            if (!counters.read(before))
+                success = false;
+            for (unsigned int i = 0; (i < NUM_ITERATIONS); i++)
+                sum += i;
+            if (!counters.read(after))
+                success = false;
+            if (counters.isCounted(INSTRUCTIONS_EVENT)
+                && after.values[INSTRUCTIONS_EVENT]
+                - before.values[INSTRUCTIONS_EVENT] < NUM_ITERATIONS)
+            {
+                success = false;
+            }
+            counters.close();
+        }
+        else if (counters.error().empty())
+        {
+            success = false;
+        }
+        if (counters.isOpen() || counters.isCounted(CYCLES_EVENT)
+            || counters.read(after))
+        {
+            success = false;
+        }
+        if (std::string(perfEventName(DTLB_MISS_EVENT)) != "dtlb_misses")
+            success = false;
+
+        std::cout << "Performance counters -> "
+                  << (success ? "SUCCESS" : "FAILED") << std::endl;
+    }
+
+    /* Checks workloads are deterministic, follow the operation mix and
+     * only refer to points which exist at that point in the stream. */
+    static bool testWorkload(const WorkloadOptions& options)
+    {
+        WorkloadGenerator workload(options);
+        WorkloadGenerator repeated(options);
+        const std::vector<WorkloadOperation>& operations =
+            workload.operations();
+        if (operations.size() != options.numOperations
+            || workload.numPoints() != repeated.numPoints())
+        {
+            return false;
+        }
+
+        unsigned int counts[NUM_OPERATION_TYPES] = { 0 };
+        unsigned int numInserted = options.numInitialPoints;
+        unsigned int numNegative = 0;
+        for (unsigned int i = 0; (i < operations.size()); i++)
+        {
+            const WorkloadOperation& operation = operations[i];
+            if (operation.type != repeated.operations()[i].type
+                || operation.point != repeated.operations()[i].point)
+            {
+                return false;
+            }
+            counts[operation.type]++;
+            if (operation.type == INSERT_OPERATION)
+            {
+                if (operation.point != numInserted++)
+                    return false;
+            }
+            else if (operation.point >= workload.numInsertedPoints())
+            {
+                if (operation.type != QUERY_OPERATION
+                    && operation.type != REMOVE_OPERATION)
+                {
+                    return false;
+                }
+                numNegative++;
+            }
+            else if (operation.point >= numInserted)
+            {
+                return false;
+            }
+        }
+        if (numInserted != workload.numInsertedPoints()
+            || workload.numPoints() != numInserted + numNegative)
+        {
+            return false;
+        }
+
+        double totalWeight = 0.0;
+        for (unsigned int op = INSERT_OPERATION; (op < NUM_OPERATION_TYPES);
+             op++)
+        {
+            totalWeight += options.weights[op];
+        }
+        for (unsigned int op = INSERT_OPERATION; (op < NUM_OPERATION_TYPES);
+             op++)
+        {
+            const double expected = options.weights[op] / totalWeight;
+            const double actual = static_cast<double>(counts[op])
+                / options.numOperations;
+            if (std::fabs(actual - expected) > 0.01)
+                return false;
+        }
+        const unsigned int numPointOperations = counts[QUERY_OPERATION]
+            + counts[REMOVE_OPERATION];
+        return (std::fabs(static_cast<double>(numNegative) / numPointOperations
+                          - options.negativeFraction) < 0.01);
+    }
+
+    /* Return fraction of operations on existing points which choose the
+     * most popular 1% of points. */
+    static double popularPointFraction(const WorkloadOptions& options)
+    {
+        WorkloadGenerator workload(options);
+        const std::vector<WorkloadOperation>& operations =
+            workload.operations();
+        std::vector<unsigned int> counts(workload.numPoints(), 0);
+        unsigned int total = 0;
+        for (unsigned int i = 0; (i < operations.size()); i++)
+        {
+            if (operations[i].type != INSERT_OPERATION)
+            {
+                counts[operations[i].point]++;
+                total++;
+            }
+        }
+        std::sort(counts.begin(), counts.end(), std::greater<unsigned int>());
+        unsigned int popular = 0;
+        for (unsigned int i = 0; (i < counts.size() / 100); i++)
+            popular += counts[i];
+        return static_cast<double>(popular) / total;
+    }
+
+    static void testWorkloadGenerator()
+    {
+        WorkloadOptions options;
+        options.numInitialPoints = 10000;
+        options.numOperations = 200000;
+        options.negativeFraction = 0.1;
+        options.weights[RANGE_OPERATION] = 0.1;
+        options.weights[KNN_OPERATION] = 0.05;
+        bool success = testWorkload(options);
+
+        options.popularity = ZIPFIAN_POPULARITY;
+        success = success && testWorkload(options);
+        const double zipfianPopular = popularPointFraction(options);
+        options.popularity = HOTSPOT_POPULARITY;
+        success = success && testWorkload(options);
+        options.popularity = UNIFORM_POPULARITY;
+        const double uniformPopular = popularPointFraction(options);
+        // With only insertions at first, every operation still works
+        options.numInitialPoints = 0;
+        success = success && testWorkload(options);
+        options.numInitialPoints = 10000;
+
+        // A different seed gives a different stream
+        WorkloadGenerator first(options);
+        options.seed++;
+        WorkloadGenerator second(options);
+        unsigned int numDifferent = 0;
+        for (unsigned int i = 0; (i < options.numOperations); i++)
+        {
+            numDifferent += (first.operations()[i].point
+                != second.operations()[i].point);
+        }
+
+        // Hot points are the first 20% and get 80% of operations
+        options.popularity = HOTSPOT_POPULARITY;
+        options.weights[INSERT_OPERATION] = 0.0;
+        options.weights[REMOVE_OPERATION] = 0.0;
+        options.negativeFraction = 0.0;
+        WorkloadGenerator hotspot(options);
+        unsigned int numHot = 0;
+        for (unsigned int i = 0; (i < options.numOperations); i++)
+            numHot += (hotspot.operations()[i].point < 2000);
+        const double hotFraction = static_cast<double>(numHot)
+            / options.numOperations;
+
+        success = success && numDifferent > options.numOperations / 2
+            && zipfianPopular > 3 * uniformPopular
+            && std::fabs(hotFraction - 0.8) < 0.01;
+        std::cout << "Workload generator (top 1% of points get "
+                  << zipfianPopular * 100.0 << "% of zipfian and "
+                  << uniformPopular * 100.0 << "% of uniform operations) -> "
+                  << (success ? "SUCCESS" : "FAILED") << std::endl;
+    }
+
+    template<int D>
+    static bool lexicographicallyLessPoint(const Point<D, Real>& a,
+                                           const Point<D, Real>& b)
+    {
+        return std::lexicographical_compare(a.asArray(), a.asArray() + D,
+                                            b.asArray(), b.asArray() + D);
+    }
+
+    /* Checks each distribution is deterministic and has the property it
+     * is meant to have. */
+    template<int D>
+    static void testPointDistributions()
+    {
+        static const unsigned int NUM_POINTS = 10000;
+        const DistributionParameters parameters;
+        bool success = true;
+        for (int i = 0; (i < NUM_POINT_DISTRIBUTIONS); i++)
+        {
+            const PointDistribution distribution =
+                static_cast<PointDistribution>(i);
+            PointDistribution parsed;
+            if (!parseDistribution(distributionName(distribution), parsed)
+                || parsed != distribution)
+            {
+                success = false;
+            }
+            const std::vector< Point<D, Real> > points =
+                generatePoints<D, Real>(distribution, NUM_POINTS, 42);
+            const std::vector< Point<D, Real> > repeated =
+                generatePoints<D, Real>(distribution, NUM_POINTS, 42);
+            const std::vector< Point<D, Real> > reseeded =
+                generatePoints<D, Real>(distribution, NUM_POINTS, 43);
+            if (points.size() != NUM_POINTS || points != repeated
+                || points == reseeded)
+            {
+                success = false;
+            }
+
+            for (unsigned int p = 0; (p < NUM_POINTS); p++)
+            {
+                for (unsigned int d = 0; (d < D); d++)
+                {
+                    const Real value = points[p][d];
+                    bool valid = std::isfinite(value);
+                    switch (distribution)
+                    {
+                    case UNIFORM_DISTRIBUTION:
+                    case SKEWED_DISTRIBUTION:
+                    case SORTED_SWEEP_DISTRIBUTION:
+                        valid = valid && value >= 0 && value < 1;
+                        break;
+                    case LATTICE_DISTRIBUTION:
+                        {
+                            const Real level = value
+                                * (parameters.latticeLevels - 1);
+                            valid = valid && value >= 0 && value <= 1
+                                && std::fabs(level - std::round(level))
+                                < 1e-4;
+                        }
+                        break;
+                    case HEAVY_TAIL_DISTRIBUTION:
+                        valid = valid && value >= 0;
+                        break;
+                    default:
+                        break;
+                    }
+                    if (!valid)
+                        success = false;
+                }
+                if (distribution == SORTED_SWEEP_DISTRIBUTION && p > 0
+                    && points[p][0] < points[p - 1][0])
+                {
+                    success = false;
+                }
+            }
+
+            // With 8 levels per dimension, a 2D lattice has only 64
+            // distinct points
+            if (distribution == LATTICE_DISTRIBUTION && D == 2)
+            {
+                std::vector< Point<D, Real> > distinct = points;
+                std::sort(distinct.begin(), distinct.end(),
+                          lexicographicallyLessPoint<D>);
+                if (std::unique(distinct.begin(), distinct.end())
+                    - distinct.begin() != 64)
+                {
+                    success = false;
+                }
+            }
+            // Heavy tails have a maximum far above the median
+            if (distribution == HEAVY_TAIL_DISTRIBUTION)
+            {
+                std::vector<Real> firstCoordinates(NUM_POINTS);
+                for (unsigned int p = 0; (p < NUM_POINTS); p++)
+                    firstCoordinates[p] = points[p][0];
+                std::sort(firstCoordinates.begin(), firstCoordinates.end());
+                if (firstCoordinates.back()
+                    < 100 * firstCoordinates[NUM_POINTS / 2])
+                {
+                    success = false;
+                }
+            }
+            // Low-rank points are linear in two latent values, so the third
+            // coordinate is predicted by a linear fit of the first two
+            if (distribution == LOW_RANK_DISTRIBUTION && D > 2)
+            {
+                double sums[3][4] = { { 0 } };
+                for (unsigned int p = 0; (p < NUM_POINTS); p++)
+                {
+                    const double row[4] = { 1.0, points[p][0], points[p][1],
+                                            points[p][2] };
+                    for (unsigned int r = 0; (r < 3); r++)
+                    {
+                        for (unsigned int c = 0; (c < 4); c++)
+                            sums[r][c] += row[r] * row[c];
+                    }
+                }
+                const double mean = sums[0][3] / sums[0][0];
+                // Solve the normal equations by Gauss-Jordan elimination
+                for (unsigned int r = 0; (r < 3); r++)
+                {
+                    for (unsigned int other = 0; (other < 3); other++)
+                    {
+                        if (other == r)
+                            continue;
+                        const double factor = sums[other][r] / sums[r][r];
+                        for (unsigned int c = 0; (c < 4); c++)
+                            sums[other][c] -= factor * sums[r][c];
+                    }
+                }
+                double residual = 0.0;
+                double variance = 0.0;
+                for (unsigned int p = 0; (p < NUM_POINTS); p++)
+                {
+                    const double predicted = sums[0][3] / sums[0][0]
+                        + sums[1][3] / sums[1][1] * points[p][0]
+                        + sums[2][3] / sums[2][2] * points[p][1];
+                    residual += (points[p][2] - predicted)
+                        * (points[p][2] - predicted);
+                    variance += (points[p][2] - mean) * (points[p][2] - mean);
+                }
+                if (residual > 0.01 * variance)
+                    success = false;
+            }
+        }
+        std::cout << "Point distributions (D = " << D << ") -> "
+                  << (success ? "SUCCESS" : "FAILED") << std::endl;
+    }
+
     static void testTiming()
     {
         double startTime = getTime();
         sleep(1);
         std::cout << "Slept for " << (getTime() - startTime)
                   << " seconds" << std::endl;
+
+        const uint64_t startTicks = readTimestamp();
+        startTime = getMonotonicTime();
+        sleep(1);
+        std::cout << "Slept for " << (getMonotonicTime() - startTime)
+                  << " seconds (monotonic clock), "
+                  << (readTimestamp() - startTicks) / timestampTicksPerSecond()
+                  << " seconds (timestamp counter)" << std::endl;
     }
 
 }
@@ -84,6 +1732,55 @@ int main(int argc, char* argv[])
 {
     testCoreTypes();
     testFloatComparison();
+    testPointEquality<2>();
+    testPointEquality<3>();
+    testPointEquality<10>();
+    testPointEquality<64>();
+    testPointAlignment<5>(16);
+    testPointAlignment<6>(32);
+    testPointAlignment<7>(64);
+    testDistanceKernels<3>();
+    testDistanceKernels<10>();
+    testDistanceKernels<64>();
+    testBoundaryKernels<3>();
+    testBoundaryKernels<10>();
+    testBoundaryKernels<64>();
+    testSpaceFillingCurves<2>(4);
+    testSpaceFillingCurves<3>(3);
+    testSpaceFillingCurves<5>(2);
+    testTextParsing<3>();
+    testTextParsing<10>();
+    testBinaryDatasets<3>();
+    testBinaryDatasets<5>();
+    testBinaryDatasets<10>();
+    testDatasetReader<3>();
+    testDatasetReader<10>();
+    testBoundaryAccumulator<3>();
+    testBoundaryAccumulator<5>();
+    testBoundaryAccumulator<10>();
+    testBoundaryAccumulator<64>();
+    testLatencyHistogram();
+    testCountingAllocator();
+    testPerfCounters();
+    testWorkloadGenerator();
+    testPointDistributions<2>();
+    testPointDistributions<10>();
+    timePointEquality<2>();
+    timePointEquality<3>();
+    timePointEquality<10>();
+    timePointEquality<64>();
+    timeDistanceKernels<10>();
+    timeDistanceKernels<64>();
+    timeBoundaryKernels<10>();
+    timeBoundaryKernels<64>();
+    timeSpaceFillingCurves<3>();
+    timeSpaceFillingCurves<10>();
+    timeTextParsing<3>();
+    timeTextParsing<10>();
+    timeBinaryDatasets<10>();
+    timeComputeBoundary<3>(1000000);
+    timeComputeBoundary<10>(1000000);
+    timeComputeBoundary<64>(200000);
     testTiming();
 
     return 0;
@@ -41,13 +41,25 @@ THE SOFTWARE.
 
 #include "types.hpp"
 #include "dataset.hpp"
+#include "dataset_reader.hpp"
 #include "timing.hpp"
 #include "kdtree.hpp"
 #include "multigrid.hpp"
 #include "bithash.hpp"
 #include "pyramidtree.hpp"
+#include "growable_index.hpp"
 #include "bucket_kdtree.hpp"
+#include "quantised.hpp"
+#include "space_filling_curve.hpp"
+#include "distance.hpp"
+#include "dispatch.hpp"
+#include "distributions.hpp"
+#include "memory_usage.hpp"
+#include <cstdint>
+#include <algorithm>
 #include <iostream>
+#include <fstream>
+#include <cstdio>
 
 using namespace mdsearch;
 
@@ -70,14 +82,15 @@ namespace
                           static_cast<float>(RAND_MAX / (maximum - minimum)) );
     }
 
-    static PointList generateRandomPoints(unsigned int numPoints)
+    template<int DIMS>
+    static std::vector< Point<DIMS, Real> > generateRandomPoints(
+        unsigned int numPoints)
     {
-        PointList points;
-        Real test = generateRandomNumber(0.0f, 1.0f);
+        std::vector< Point<DIMS, Real> > points;
         for (unsigned int i = 0; (i < numPoints); i++)
         {
-            PointType p;
-            for (unsigned int d = 0; (d < NUM_DIMENSIONS); d++)
+            Point<DIMS, Real> p;
+            for (unsigned int d = 0; (d < DIMS); d++)
             {
                 p[d] = generateRandomNumber(0.0f, 1.0f);
             }
@@ -86,6 +99,25 @@ namespace
         return points;
     }
 
+    /* Generate points clustered towards the origin, by raising uniformly
+     * distributed coordinates to a power. */
+    template<int DIMS>
+    static std::vector< Point<DIMS, Real> > generateSkewedPoints(
+        unsigned int numPoints)
+    {
+        std::vector< Point<DIMS, Real> > points =
+            generateRandomPoints<DIMS>(numPoints);
+        for (unsigned int i = 0; (i < numPoints); i++)
+        {
+            for (unsigned int d = 0; (d < DIMS); d++)
+            {
+                points[i][d] = points[i][d] * points[i][d] * points[i][d]
+                    * points[i][d];
+            }
+        }
+        return points;
+    }
+
     template<typename STRUCT_TYPE>
     static bool testStructureOperations(STRUCT_TYPE* structure,
                                         const PointList& points)
@@ -155,6 +187,944 @@ namespace
             std::cout << "...FAILED." << std::endl;
     }
 
+    /* Functions used to check results of spatial queries against a
+     * brute-force search of the dataset. */
+    static bool lexicographicallyLess(const PointType& a, const PointType& b)
+    {
+        for (unsigned int d = 0; (d < NUM_DIMENSIONS); d++)
+        {
+            if (a[d] != b[d])
+                return (a[d] < b[d]);
+        }
+        return false;
+    }
+
+    static bool inRegion(const PointType& p, const BoundaryType& region)
+    {
+        for (unsigned int d = 0; (d < NUM_DIMENSIONS); d++)
+        {
+            if (p[d] < region[d].min || p[d] > region[d].max)
+                return false;
+        }
+        return true;
+    }
+
+    static Real squaredDistance(const PointType& a, const PointType& b)
+    {
+        Real total = 0;
+        for (unsigned int d = 0; (d < NUM_DIMENSIONS); d++)
+            total += (a[d] - b[d]) * (a[d] - b[d]);
+        return total;
+    }
+
+    template<typename STRUCT_TYPE>
+    static bool testRangeQueries(STRUCT_TYPE* structure,
+                                 const PointList& points)
+    {
+        static const int NUM_QUERIES = 20;
+
+        for (unsigned int i = 0; (i < points.size()); i++)
+            structure->insert(points[i]);
+
+        for (unsigned int q = 0; (q < NUM_QUERIES); q++)
+        {
+            // Restrict half of the dimensions to a random interval, so
+            // each query returns a reasonable number of points. Every
+            // other query is a small hypercube instead.
+            BoundaryType region(Interval<Real>(-1.0f, 2.0f));
+            for (unsigned int d = 0; (d < NUM_DIMENSIONS); d++)
+            {
+                if (q % 2 == 0 && d % 2 == 0)
+                {
+                    Real start = generateRandomNumber(0.0f, 0.5f);
+                    region[d] = Interval<Real>(start, start + 0.5f);
+                }
+                else if (q % 2 == 1)
+                {
+                    Real centre = generateRandomNumber(0.0f, 1.0f);
+                    region[d] = Interval<Real>(centre - 0.35f, centre + 0.35f);
+                }
+            }
+
+            PointList expected;
+            for (unsigned int i = 0; (i < points.size()); i++)
+            {
+                if (inRegion(points[i], region))
+                    expected.push_back(points[i]);
+            }
+            PointList actual = structure->rangeQuery(region);
+
+            std::sort(expected.begin(), expected.end(), lexicographicallyLess);
+            std::sort(actual.begin(), actual.end(), lexicographicallyLess);
+            if (expected.size() != actual.size()
+                || !std::equal(expected.begin(), expected.end(), actual.begin()))
+            {
+                std::cout << "Range query " << region << " returned "
+                          << actual.size() << " points, expected "
+                          << expected.size() << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    template<typename STRUCT_TYPE>
+    static bool testKnnQueries(STRUCT_TYPE* structure,
+                               const PointList& points)
+    {
+        static const int NUM_QUERIES = 20;
+        static const unsigned int K = 10;
+
+        for (unsigned int i = 0; (i < points.size()); i++)
+            structure->insert(points[i]);
+
+        for (unsigned int q = 0; (q < NUM_QUERIES); q++)
+        {
+            PointType queryPoint = generateRandomPoints<NUM_DIMENSIONS>(1)[0];
+
+            std::vector<Real> expected;
+            for (unsigned int i = 0; (i < points.size()); i++)
+                expected.push_back(squaredDistance(queryPoint, points[i]));
+            std::sort(expected.begin(), expected.end());
+            expected.resize(std::min<std::size_t>(K, expected.size()));
+
+            PointList actual = structure->knn(queryPoint, K);
+            if (actual.size() != expected.size())
+            {
+                std::cout << "kNN query " << queryPoint << " returned "
+                          << actual.size() << " points, expected "
+                          << expected.size() << std::endl;
+                return false;
+            }
+            // Compare distances rather than points, since there may be
+            // several points at the same distance from the query point
+            for (unsigned int i = 0; (i < actual.size()); i++)
+            {
+                if (compare(squaredDistance(queryPoint, actual[i]),
+                            expected[i]) != 0)
+                {
+                    std::cout << "kNN query " << queryPoint << " returned "
+                              << actual[i] << " as neighbour " << i
+                              << std::endl;
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    template<typename STRUCT_TYPE>
+    static void testRangeQuery(const std::string& structureName,
+                               STRUCT_TYPE* structure,
+                               const PointList& points)
+    {
+        std::cout << "TESTING " << structureName << " range queries..."
+                  << std::endl;
+        if (testRangeQueries<STRUCT_TYPE>(structure, points))
+            std::cout << "...SUCCESS." << std::endl;
+        else
+            std::cout << "...FAILED." << std::endl;
+    }
+
+    template<typename STRUCT_TYPE>
+    static void testKnnQuery(const std::string& structureName,
+                             STRUCT_TYPE* structure,
+                             const PointList& points)
+    {
+        std::cout << "TESTING " << structureName << " kNN queries..."
+                  << std::endl;
+        if (testKnnQueries<STRUCT_TYPE>(structure, points))
+            std::cout << "...SUCCESS." << std::endl;
+        else
+            std::cout << "...FAILED." << std::endl;
+    }
+
+    template<typename STRUCT_TYPE>
+    static bool testBulkLoadOperations(STRUCT_TYPE* structure,
+                                       const PointList& points)
+    {
+        // NOTE: Tests assume all given points are UNIQUE!!!
+
+        unsigned int numInserted = structure->bulkLoad(points);
+        if (numInserted != points.size())
+        {
+            std::cout << "Bulk load inserted " << numInserted
+                      << " points, expected " << points.size() << std::endl;
+            return false;
+        }
+        for (unsigned int i = 0; (i < points.size()); i++)
+        {
+            if (!structure->query(points[i]))
+            {
+                std::cout << "Failed query with point "
+                          << i << ": " << points[i] << std::endl;
+                return false;
+            }
+        }
+        // Loading the same points again should insert nothing
+        numInserted = structure->bulkLoad(points);
+        if (numInserted != 0)
+        {
+            std::cout << "Bulk load inserted " << numInserted
+                      << " duplicate points" << std::endl;
+            return false;
+        }
+        for (unsigned int i = 0; (i < points.size()); i++)
+        {
+            if (!structure->remove(points[i]) || structure->query(points[i]))
+            {
+                std::cout << "Failed removal with point "
+                          << i << ": " << points[i] << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    template<typename STRUCT_TYPE>
+    static void testBulkLoad(const std::string& structureName,
+                             STRUCT_TYPE* structure,
+                             const PointList& points)
+    {
+        std::cout << "TESTING " << structureName << " bulk load..."
+                  << std::endl;
+        if (testBulkLoadOperations<STRUCT_TYPE>(structure, points))
+            std::cout << "...SUCCESS." << std::endl;
+        else
+            std::cout << "...FAILED." << std::endl;
+    }
+
+    template<typename STRUCT_TYPE>
+    static bool testBatchOperations(STRUCT_TYPE* structure,
+                                    const PointList& points)
+    {
+        if (structure->insertBatch(points) != points.size())
+            return false;
+        // Inserting the points again shouldn't insert anything
+        if (structure->insertBatch(points) != 0)
+            return false;
+
+        // Batch and single point queries should find every point
+        std::vector<bool> results;
+        structure->queryBatch(points, results);
+        for (unsigned int i = 0; (i < points.size()); i++)
+        {
+            if (!results[i] || !structure->query(points[i]))
+                return false;
+        }
+
+        for (unsigned int i = 0; (i < points.size()); i++)
+        {
+            if (!structure->remove(points[i]))
+                return false;
+        }
+        structure->queryBatch(points, results);
+        for (unsigned int i = 0; (i < points.size()); i++)
+        {
+            if (results[i])
+                return false;
+        }
+        return true;
+    }
+
+    template<typename STRUCT_TYPE>
+    static void testBatch(const std::string& structureName,
+                          STRUCT_TYPE* structure,
+                          const PointList& points)
+    {
+        std::cout << "TESTING " << structureName << " batch operations..."
+                  << std::endl;
+        if (testBatchOperations<STRUCT_TYPE>(structure, points))
+            std::cout << "...SUCCESS." << std::endl;
+        else
+            std::cout << "...FAILED." << std::endl;
+    }
+
+    /* Load points into structure in Hilbert curve order and check every
+     * point can be found. */
+    template<typename STRUCT_TYPE>
+    static void testCurveOrderedLoad(const std::string& structureName,
+                                     STRUCT_TYPE* structure,
+                                     const PointList& points,
+                                     const BoundaryType& boundary)
+    {
+        std::cout << "TESTING " << structureName << " curve-ordered load..."
+                  << std::endl;
+        HilbertCurve<NUM_DIMENSIONS, Real> curve(boundary);
+        bool success = (insertInCurveOrder(structure, curve, points)
+            == points.size());
+        for (unsigned int i = 0; (success && i < points.size()); i++)
+            success = structure->query(points[i]);
+        if (success)
+            std::cout << "...SUCCESS." << std::endl;
+        else
+            std::cout << "...FAILED." << std::endl;
+    }
+
+    /* Insert points into structure from a binary file, a chunk at a
+     * time, and check every point can be found. */
+    template<typename STRUCT_TYPE>
+    static void testStreamedLoad(const std::string& structureName,
+                                 STRUCT_TYPE* structure,
+                                 const PointList& points)
+    {
+        static const char* FILENAME = "mdsearch_streamed_load_test.bin";
+        std::cout << "TESTING " << structureName << " streamed load..."
+                  << std::endl;
+        writeBinaryDataset(FILENAME, &points[0], points.size(), AOS_LAYOUT);
+        DatasetReader<NUM_DIMENSIONS, Real> reader(FILENAME, 4096);
+        bool success = (insertStream(structure, reader) == points.size());
+        std::remove(FILENAME);
+        for (unsigned int i = 0; (success && i < points.size()); i++)
+            success = structure->query(points[i]);
+        if (success)
+            std::cout << "...SUCCESS." << std::endl;
+        else
+            std::cout << "...FAILED." << std::endl;
+    }
+
+    /* Run the correctness tests on each structure with points from every
+     * synthetic distribution. Duplicate lattice points are removed, since
+     * the tests assume points are unique. */
+    static void testDistributions()
+    {
+        static const unsigned int NUM_POINTS = 20000;
+        for (int i = 0; (i < NUM_POINT_DISTRIBUTIONS); i++)
+        {
+            const PointDistribution distribution =
+                static_cast<PointDistribution>(i);
+            PointList points = generatePoints<NUM_DIMENSIONS, Real>(
+                distribution, NUM_POINTS, i);
+            if (distribution == LATTICE_DISTRIBUTION)
+            {
+                std::sort(points.begin(), points.end(), lexicographicallyLess);
+                points.erase(std::unique(points.begin(), points.end()),
+                             points.end());
+            }
+            DatasetType dataset;
+            dataset.load(points);
+            const BoundaryType boundary = dataset.computeBoundary();
+            const std::string suffix = std::string(" (")
+                + distributionName(distribution) + ")";
+
+            KDTree<NUM_DIMENSIONS, Real> kdTree;
+            testStructure("kd-tree" + suffix, &kdTree, points);
+            BucketKDTree<NUM_DIMENSIONS, Real> bucketKDTree;
+            testStructure("bucket_kd-tree" + suffix, &bucketKDTree, points);
+            BitHash<NUM_DIMENSIONS, Real> bitHash;
+            testStructure("bithash" + suffix, &bitHash, points);
+            Multigrid<NUM_DIMENSIONS, Real> multigrid(boundary);
+            testStructure("multigrid" + suffix, &multigrid, points);
+            testRangeQuery("multigrid" + suffix, &multigrid, points);
+            PyramidTree<NUM_DIMENSIONS, Real> pyramidTree(boundary, true);
+            testStructure("pyramid_tree" + suffix, &pyramidTree, points);
+            testRangeQuery("pyramid_tree" + suffix, &pyramidTree, points);
+        }
+    }
+
+    /* Write points with 'numDimensions' coordinates each, stored one
+     * after another in 'coords', to a text dataset file. */
+    static void writeTextDataset(const char* filename,
+                                 const std::vector<Real>& coords,
+                                 unsigned int numDimensions)
+    {
+        std::ofstream file(filename);
+        const unsigned int numPoints = coords.size() / numDimensions;
+        file << numDimensions << " " << numPoints << "\n";
+        file.precision(9);
+        for (unsigned int i = 0; (i < numPoints); i++)
+        {
+            for (unsigned int d = 0; (d < numDimensions); d++)
+                file << coords[i * numDimensions + d] << " ";
+            file << "\n";
+        }
+    }
+
+    /* Check every point stored in 'coords' can be found in the index and
+     * that range and kNN queries match a linear scan of the points, if
+     * the index supports them. Removes every point afterwards. */
+    static bool testDynamicIndexOperations(DynamicIndex* index,
+                                           const std::vector<Real>& coords)
+    {
+        const unsigned int D = index->numDimensions();
+        const unsigned int numPoints = coords.size() / D;
+        for (unsigned int i = 0; (i < numPoints); i++)
+        {
+            if (!index->query(&coords[i * D]))
+                return false;
+        }
+
+        std::vector<Real> mins(D);
+        std::vector<Real> maxs(D);
+        std::vector<Real> results;
+        for (unsigned int q = 0; (q < 10); q++)
+        {
+            for (unsigned int d = 0; (d < D); d++)
+            {
+                mins[d] = generateRandomNumber(0.0f, 0.5f);
+                maxs[d] = mins[d] + 0.5f;
+            }
+            results.clear();
+            if (!index->rangeQuery(&mins[0], &maxs[0], results))
+                break;
+            unsigned int expected = 0;
+            for (unsigned int i = 0; (i < numPoints); i++)
+            {
+                bool inside = true;
+                for (unsigned int d = 0; (d < D); d++)
+                {
+                    inside = inside && coords[i * D + d] >= mins[d]
+                        && coords[i * D + d] <= maxs[d];
+                }
+                if (inside)
+                    expected++;
+            }
+            if (results.size() != expected * D)
+                return false;
+        }
+
+        static const unsigned int K = 10;
+        for (unsigned int q = 0; (q < 10); q++)
+        {
+            const Real* queryPoint = &coords[(q * 97 % numPoints) * D];
+            results.clear();
+            if (!index->knn(queryPoint, K, results))
+                break;
+            std::vector<Real> distances(numPoints);
+            for (unsigned int i = 0; (i < numPoints); i++)
+            {
+                distances[i] = 0;
+                for (unsigned int d = 0; (d < D); d++)
+                {
+                    const Real diff = coords[i * D + d] - queryPoint[d];
+                    distances[i] += diff * diff;
+                }
+            }
+            std::sort(distances.begin(), distances.end());
+            if (results.size() != K * D)
+                return false;
+            for (unsigned int r = 0; (r < K); r++)
+            {
+                Real distance = 0;
+                for (unsigned int d = 0; (d < D); d++)
+                {
+                    const Real diff = results[r * D + d] - queryPoint[d];
+                    distance += diff * diff;
+                }
+                if (distance != distances[r])
+                    return false;
+            }
+        }
+
+        for (unsigned int i = 0; (i < numPoints); i++)
+        {
+            if (!index->remove(&coords[i * D]) || index->query(&coords[i * D]))
+                return false;
+        }
+        return true;
+    }
+
+    /* Create indices for datasets whose dimensionality is read from the
+     * file, both compiled (NUM_DIMENSIONS) and not compiled, and check
+     * they store the points in the file. */
+    static void testDynamicDispatch(const PointList& points)
+    {
+        static const char* COMPILED_FILENAME = "mdsearch_dispatch_test.bin";
+        static const char* DYNAMIC_FILENAME = "mdsearch_dispatch_test.txt";
+        static const unsigned int DYNAMIC_DIMENSIONS = 7;
+        static const unsigned int NUM_DYNAMIC_POINTS = 5000;
+        static const char* STRUCTURE_NAMES[] = { "kd-tree", "bucket_kd-tree",
+            "multigrid", "bithash", "pyramid_tree" };
+
+        std::vector<Real> compiledCoords;
+        for (unsigned int i = 0; (i < points.size()); i++)
+        {
+            compiledCoords.insert(compiledCoords.end(), points[i].asArray(),
+                                  points[i].asArray() + NUM_DIMENSIONS);
+        }
+        writeBinaryDataset(COMPILED_FILENAME, &points[0], points.size(),
+                           AOS_LAYOUT);
+        std::vector<Real> dynamicCoords(DYNAMIC_DIMENSIONS * NUM_DYNAMIC_POINTS);
+        for (unsigned int i = 0; (i < dynamicCoords.size()); i++)
+            dynamicCoords[i] = generateRandomNumber(0.0f, 1.0f);
+        writeTextDataset(DYNAMIC_FILENAME, dynamicCoords, DYNAMIC_DIMENSIONS);
+        // Read back what the parser produces, so equality is exact
+        DynamicPointSet parsedPoints(DYNAMIC_DIMENSIONS);
+        parsedPoints.insertDataset(DYNAMIC_FILENAME);
+        dynamicCoords.clear();
+        std::vector<Real> allMins(DYNAMIC_DIMENSIONS, -1.0f);
+        std::vector<Real> allMaxs(DYNAMIC_DIMENSIONS, 2.0f);
+        parsedPoints.rangeQuery(&allMins[0], &allMaxs[0], dynamicCoords);
+
+        for (unsigned int s = 0; (s < 5); s++)
+        {
+            std::cout << "TESTING " << STRUCTURE_NAMES[s]
+                      << " runtime dispatch..." << std::endl;
+            boost::shared_ptr<DynamicIndex> compiled = createIndexForDataset(
+                STRUCTURE_NAMES[s], COMPILED_FILENAME);
+            boost::shared_ptr<DynamicIndex> dynamic = createIndexForDataset(
+                STRUCTURE_NAMES[s], DYNAMIC_FILENAME);
+            bool success = compiled && dynamic
+                && compiled->isCompiled() && !dynamic->isCompiled()
+                && compiled->numDimensions() == NUM_DIMENSIONS
+                && dynamic->numDimensions() == DYNAMIC_DIMENSIONS
+                && testDynamicIndexOperations(dynamic.get(), dynamicCoords)
+                && testDynamicIndexOperations(compiled.get(), compiledCoords);
+            if (success)
+                std::cout << "...SUCCESS." << std::endl;
+            else
+                std::cout << "...FAILED." << std::endl;
+        }
+
+        std::cout << "TESTING runtime dispatch of invalid input..."
+                  << std::endl;
+        if (!createIndexForDataset("unknown", COMPILED_FILENAME)
+            && !createIndexForDataset("kd-tree", "mdsearch_missing_file.txt")
+            && isDimensionCompiled(NUM_DIMENSIONS)
+            && !isDimensionCompiled(DYNAMIC_DIMENSIONS))
+        {
+            std::cout << "...SUCCESS." << std::endl;
+        }
+        else
+        {
+            std::cout << "...FAILED." << std::endl;
+        }
+        std::remove(COMPILED_FILENAME);
+        std::remove(DYNAMIC_FILENAME);
+    }
+
+    static bool lessInFirstDimension(const PointType& a, const PointType& b)
+    {
+        return a[0] < b[0];
+    }
+
+    template<typename STRUCT_TYPE>
+    static bool removeAll(STRUCT_TYPE* structure, const PointList& points)
+    {
+        for (unsigned int i = 0; (i < points.size()); i++)
+        {
+            if (!structure->remove(points[i]) || structure->query(points[i]))
+                return false;
+        }
+        return true;
+    }
+
+    /* Inserts points in order of their first coordinate, simulating a
+     * feed that drifts out of the index's initial boundary, checking
+     * earlier points can still be found while the boundary grows. */
+    template<typename STRUCT_TYPE>
+    static bool testGrowableIndexOperations(const PointList& points)
+    {
+        PointList sortedPoints = points;
+        std::sort(sortedPoints.begin(), sortedPoints.end(),
+                  lessInFirstDimension);
+
+        // Initial boundary only covers the first 1% of points
+        Dataset<NUM_DIMENSIONS, Real> firstPoints;
+        firstPoints.load(PointList(sortedPoints.begin(),
+            sortedPoints.begin() + sortedPoints.size() / 100));
+        GrowableIndex<NUM_DIMENSIONS, Real, STRUCT_TYPE> index(
+            firstPoints.computeBoundary());
+
+        for (unsigned int i = 0; (i < sortedPoints.size()); i++)
+        {
+            if (!index.insert(sortedPoints[i]))
+                return false;
+            if (index.isGrowing()
+                && !index.query(sortedPoints[rand() % (i + 1)]))
+            {
+                std::cout << "Failed query while growing boundary"
+                          << std::endl;
+                return false;
+            }
+        }
+        if (index.numPoints() != sortedPoints.size()
+            || index.numGrowths() == 0)
+        {
+            return false;
+        }
+
+        if (!testRangeQueries(&index, points)
+            || !removeAll(&index, sortedPoints) || index.numPoints() != 0)
+        {
+            return false;
+        }
+
+        // Overflow points are hashed on their exact coordinates, but the
+        // structure may store points closer together than EPSILON as one
+        // point once the boundary grows, which mustn't be counted twice
+        GrowableIndex<NUM_DIMENSIONS, Real, STRUCT_TYPE> merging(
+            BoundaryType(Interval<Real>(0.5f, 1.0f)), 0.5, 0.0, 2);
+        PointType nearPoint(0.1f);
+        PointType nearerPoint(nearPoint);
+        nearerPoint[0] = std::nextafter(nearPoint[0], 1.0f);
+        if (!merging.insert(nearPoint) || !merging.insert(nearerPoint))
+            return false;
+        // Next operation grows the boundary
+        merging.query(nearPoint);
+        const BoundaryType everywhere(Interval<Real>(-1.0f, 2.0f));
+        return merging.numGrowths() == 1
+            && merging.numPoints() == merging.rangeQuery(everywhere).size();
+    }
+
+    template<typename STRUCT_TYPE>
+    static void testGrowableIndex(const std::string& structureName,
+                                  const PointList& points)
+    {
+        std::cout << "TESTING " << structureName << " (growable)..."
+                  << std::endl;
+        if (testGrowableIndexOperations<STRUCT_TYPE>(points))
+            std::cout << "...SUCCESS." << std::endl;
+        else
+            std::cout << "...FAILED." << std::endl;
+    }
+
+    /* Checks memory usage grows with the points inserted, their payload
+     * is counted exactly and it is all released when they're removed. */
+    template<typename STRUCT_TYPE>
+    static bool testMemoryUsageOperations(STRUCT_TYPE* structure,
+                                          const PointList& points,
+                                          std::size_t bytesPerPoint)
+    {
+        const MemoryUsage empty = structure->memoryUsage();
+        if (empty.payload != 0)
+            return false;
+        for (unsigned int i = 0; (i < points.size()); i++)
+            structure->insert(points[i]);
+
+        // Storage reserved but not used shouldn't outweigh the points
+        const MemoryUsage full = structure->memoryUsage();
+        if (full.payload != points.size() * bytesPerPoint
+            || full.nodes == 0 || full.total() <= empty.total()
+            || full.slack > full.payload)
+        {
+            return false;
+        }
+
+        if (!removeAll(structure, points))
+            return false;
+        const MemoryUsage removed = structure->memoryUsage();
+        return (removed.payload == 0 && removed.total() <= full.total());
+    }
+
+    template<typename STRUCT_TYPE>
+    static void testMemoryUsage(const std::string& structureName,
+                                STRUCT_TYPE* structure,
+                                const PointList& points,
+                                std::size_t bytesPerPoint = sizeof(PointType))
+    {
+        std::cout << "TESTING " << structureName << " (memory usage)..."
+                  << std::endl;
+        if (testMemoryUsageOperations(structure, points, bytesPerPoint))
+            std::cout << "...SUCCESS." << std::endl;
+        else
+            std::cout << "...FAILED." << std::endl;
+    }
+
+    /* Check range queries on a quantised index against a brute-force
+     * search of the quantised points. */
+    template<typename QUANTISED_TYPE, typename STRUCT_TYPE>
+    static bool testQuantisedRangeQueries(
+        QuantisedIndex<NUM_DIMENSIONS, QUANTISED_TYPE, STRUCT_TYPE>* index,
+        const PointList& points)
+    {
+        static const int NUM_QUERIES = 20;
+        const Quantiser<NUM_DIMENSIONS, QUANTISED_TYPE>& quantiser =
+            index->quantiser();
+
+        for (unsigned int i = 0; (i < points.size()); i++)
+            index->insert(points[i]);
+
+        for (unsigned int q = 0; (q < NUM_QUERIES); q++)
+        {
+            BoundaryType region(Interval<Real>(-1.0f, 2.0f));
+            for (unsigned int d = 0; (d < NUM_DIMENSIONS); d += 2)
+            {
+                Real start = generateRandomNumber(0.0f, 0.5f);
+                region[d] = Interval<Real>(start, start + 0.5f);
+            }
+            Boundary<NUM_DIMENSIONS, QUANTISED_TYPE> quantisedRegion =
+                quantiser.quantise(region);
+
+            PointList expected;
+            for (unsigned int i = 0; (i < points.size()); i++)
+            {
+                Point<NUM_DIMENSIONS, QUANTISED_TYPE> quantised =
+                    quantiser.quantise(points[i]);
+                bool inside = true;
+                for (unsigned int d = 0; (d < NUM_DIMENSIONS); d++)
+                {
+                    if (quantised[d] < quantisedRegion[d].min
+                        || quantised[d] > quantisedRegion[d].max)
+                    {
+                        inside = false;
+                    }
+                }
+                if (inside)
+                    expected.push_back(quantiser.dequantise(quantised));
+            }
+            // Points that quantise to the same point are only stored once
+            std::sort(expected.begin(), expected.end(), lexicographicallyLess);
+            expected.erase(std::unique(expected.begin(), expected.end()),
+                           expected.end());
+            PointList actual = index->rangeQuery(region);
+            std::sort(actual.begin(), actual.end(), lexicographicallyLess);
+            if (expected.size() != actual.size()
+                || !std::equal(expected.begin(), expected.end(), actual.begin()))
+            {
+                std::cout << "Range query " << q << " returned "
+                          << actual.size() << " points, expected "
+                          << expected.size() << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /* Check kNN queries on a quantised index against a brute-force
+     * search, comparing the distances of the neighbours in quantised
+     * units since points can be equally distant from the query point. */
+    template<typename QUANTISED_TYPE, typename STRUCT_TYPE>
+    static bool testQuantisedKnnQueries(
+        QuantisedIndex<NUM_DIMENSIONS, QUANTISED_TYPE, STRUCT_TYPE>* index,
+        const PointList& points)
+    {
+        typedef Point<NUM_DIMENSIONS, QUANTISED_TYPE> QuantisedPointType;
+        static const int NUM_QUERIES = 20;
+        static const unsigned int K = 10;
+        const Quantiser<NUM_DIMENSIONS, QUANTISED_TYPE>& quantiser =
+            index->quantiser();
+
+        for (unsigned int i = 0; (i < points.size()); i++)
+            index->insert(points[i]);
+
+        for (unsigned int q = 0; (q < NUM_QUERIES); q++)
+        {
+            QuantisedPointType queryPoint = quantiser.quantise(
+                generateRandomPoints<NUM_DIMENSIONS>(1)[0]);
+            std::vector<Real> expected;
+            for (unsigned int i = 0; (i < points.size()); i++)
+            {
+                expected.push_back(distance<SquaredEuclideanDistance>(
+                    queryPoint, quantiser.quantise(points[i])));
+            }
+            std::sort(expected.begin(), expected.end());
+
+            PointList actual = index->knn(quantiser.dequantise(queryPoint), K);
+            if (actual.size() != K)
+            {
+                std::cout << "kNN query " << q << " returned "
+                          << actual.size() << " points" << std::endl;
+                return false;
+            }
+            for (unsigned int i = 0; (i < K); i++)
+            {
+                Real dist = distance<SquaredEuclideanDistance>(
+                    queryPoint, quantiser.quantise(actual[i]));
+                if (std::abs(dist - expected[i]) > 1e-5f * expected[i])
+                {
+                    std::cout << "kNN query " << q << " returned point at "
+                              << "distance " << dist << " instead of "
+                              << expected[i] << std::endl;
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    static void reportResult(bool success)
+    {
+        if (success)
+            std::cout << "...SUCCESS." << std::endl;
+        else
+            std::cout << "...FAILED." << std::endl;
+    }
+
+    /* Run the correctness tests on each structure, storing points
+     * quantised to QUANTISED_TYPE through a QuantisedIndex. */
+    template<typename QUANTISED_TYPE>
+    static void testQuantised(const std::string& typeName,
+                              const PointList& points,
+                              const BoundaryType& boundary)
+    {
+        typedef KDTree<NUM_DIMENSIONS, QUANTISED_TYPE> QKDTree;
+        typedef BucketKDTree<NUM_DIMENSIONS, QUANTISED_TYPE> QBucketKDTree;
+        typedef BitHash<NUM_DIMENSIONS, QUANTISED_TYPE> QBitHash;
+        typedef Multigrid<NUM_DIMENSIONS, QUANTISED_TYPE> QMultigrid;
+        typedef PyramidTree<NUM_DIMENSIONS, QUANTISED_TYPE> QPyramidTree;
+
+        Quantiser<NUM_DIMENSIONS, QUANTISED_TYPE> quantiser(boundary);
+        const std::string suffix = " (" + typeName + ")";
+
+        QKDTree kdTree;
+        QuantisedIndex<NUM_DIMENSIONS, QUANTISED_TYPE, QKDTree>
+            kdTreeIndex(quantiser, &kdTree);
+        testStructure("kd-tree" + suffix, &kdTreeIndex, points);
+        QBucketKDTree bucketKDTree;
+        QuantisedIndex<NUM_DIMENSIONS, QUANTISED_TYPE, QBucketKDTree>
+            bucketKDTreeIndex(quantiser, &bucketKDTree);
+        testStructure("bucket_kd-tree" + suffix, &bucketKDTreeIndex, points);
+        QBitHash bitHash;
+        QuantisedIndex<NUM_DIMENSIONS, QUANTISED_TYPE, QBitHash>
+            bitHashIndex(quantiser, &bitHash);
+        testStructure("bithash" + suffix, &bitHashIndex, points);
+
+        QMultigrid multigrid(quantiser.boundary());
+        QuantisedIndex<NUM_DIMENSIONS, QUANTISED_TYPE, QMultigrid>
+            multigridIndex(quantiser, &multigrid);
+        testStructure("multigrid" + suffix, &multigridIndex, points);
+        std::cout << "TESTING multigrid" << suffix << " range queries..."
+                  << std::endl;
+        reportResult(testQuantisedRangeQueries(&multigridIndex, points));
+        std::cout << "TESTING multigrid" << suffix << " kNN queries..."
+                  << std::endl;
+        reportResult(testQuantisedKnnQueries(&multigridIndex, points));
+
+        QPyramidTree pyramidTree(quantiser.boundary(), true);
+        QuantisedIndex<NUM_DIMENSIONS, QUANTISED_TYPE, QPyramidTree>
+            pyramidTreeIndex(quantiser, &pyramidTree);
+        testStructure("pyramid_tree" + suffix, &pyramidTreeIndex, points);
+        std::cout << "TESTING pyramid_tree" << suffix << " range queries..."
+                  << std::endl;
+        reportResult(testQuantisedRangeQueries(&pyramidTreeIndex, points));
+    }
+
+    template<typename STRUCT_TYPE>
+    static void timeBulkLoad(const std::string& structureName,
+                             STRUCT_TYPE* structure,
+                             const PointList& points)
+    {
+        std::cout << "TIMING " << structureName << " bulk load..."
+                  << std::endl;
+        double start = getTime();
+        structure->bulkLoad(points);
+        std::cout << "\tBulk load took "
+                  << (getTime() - start) << " seconds" << std::endl;
+        std::cout << "...DONE." << std::endl;
+    }
+
+    /* Compares loading a whole text file into a dataset before inserting
+     * its points against inserting them while the file is streamed. */
+    static void timeStreamedLoad(const PointList& points,
+                                 const BoundaryType& boundary)
+    {
+        static const char* FILENAME = "mdsearch_streamed_load_time.txt";
+        std::cout << "TIMING pyramid_tree streamed load..." << std::endl;
+        {
+            std::ofstream file(FILENAME);
+            file << NUM_DIMENSIONS << " " << points.size() << "\n";
+            file.precision(9);
+            for (unsigned int i = 0; (i < points.size()); i++)
+            {
+                for (unsigned int d = 0; (d < NUM_DIMENSIONS); d++)
+                    file << points[i][d] << " ";
+                file << "\n";
+            }
+        }
+
+        PyramidTree<NUM_DIMENSIONS, Real> loadedTree(boundary);
+        double start = getTime();
+        DatasetType dataset;
+        dataset.load(FILENAME);
+        loadedTree.insertBatch(dataset.getPoints());
+        std::cout << "\tLoading dataset then inserting took "
+                  << (getTime() - start) << " seconds" << std::endl;
+
+        PyramidTree<NUM_DIMENSIONS, Real> streamedTree(boundary);
+        start = getTime();
+        DatasetReader<NUM_DIMENSIONS, Real> reader(FILENAME, 8192);
+        insertStream(&streamedTree, reader);
+        std::cout << "\tStreaming took " << (getTime() - start)
+                  << " seconds, buffering at most " << 3 * reader.chunkSize()
+                  << " points" << std::endl;
+        std::remove(FILENAME);
+        std::cout << "...DONE." << std::endl;
+    }
+
+    /* Compares a structure instantiated for the dataset's dimensionality
+     * through runtime dispatch against the dynamic-dimension fallback. */
+    static void timeDynamicDispatch(const PointList& points)
+    {
+        static const char* FILENAME = "mdsearch_dispatch_time.bin";
+        std::cout << "TIMING runtime dispatch..." << std::endl;
+        writeBinaryDataset(FILENAME, &points[0], points.size(), AOS_LAYOUT);
+
+        double start = getTime();
+        boost::shared_ptr<DynamicIndex> compiled = createIndexForDataset(
+            "pyramid_tree", FILENAME);
+        std::cout << "\tCreating compiled index took "
+                  << (getTime() - start) << " seconds" << std::endl;
+        start = getTime();
+        DynamicPointSet dynamic(NUM_DIMENSIONS);
+        dynamic.insertDataset(FILENAME);
+        std::cout << "\tCreating dynamic index took "
+                  << (getTime() - start) << " seconds" << std::endl;
+        std::remove(FILENAME);
+
+        unsigned int numFound = 0;
+        start = getTime();
+        for (unsigned int i = 0; (i < points.size()); i++)
+            numFound += compiled->query(points[i].asArray());
+        std::cout << "\tQuerying compiled index took "
+                  << (getTime() - start) << " seconds (" << numFound
+                  << " points found)" << std::endl;
+        numFound = 0;
+        start = getTime();
+        for (unsigned int i = 0; (i < points.size()); i++)
+            numFound += dynamic.query(points[i].asArray());
+        std::cout << "\tQuerying dynamic index took "
+                  << (getTime() - start) << " seconds (" << numFound
+                  << " points found)" << std::endl;
+
+        std::vector<Real> mins(NUM_DIMENSIONS, 0.2f);
+        std::vector<Real> maxs(NUM_DIMENSIONS, 0.8f);
+        std::vector<Real> results;
+        start = getTime();
+        for (unsigned int q = 0; (q < 100); q++)
+            compiled->rangeQuery(&mins[0], &maxs[0], results);
+        std::cout << "\t100 range queries on compiled index took "
+                  << (getTime() - start) << " seconds" << std::endl;
+        start = getTime();
+        for (unsigned int q = 0; (q < 100); q++)
+            dynamic.rangeQuery(&mins[0], &maxs[0], results);
+        std::cout << "\t100 range queries on dynamic index took "
+                  << (getTime() - start) << " seconds" << std::endl;
+        std::cout << "...DONE." << std::endl;
+    }
+
+    /* Compares inserting points in random order against inserting them
+     * in Morton and Hilbert curve order. */
+    template<typename STRUCT_TYPE>
+    static void timeCurveOrderedLoad(const std::string& structureName,
+                                     const PointList& points,
+                                     const BoundaryType& boundary)
+    {
+        std::cout << "TIMING " << structureName << " curve-ordered load..."
+                  << std::endl;
+        STRUCT_TYPE randomOrder(boundary);
+        double start = getTime();
+        for (unsigned int i = 0; (i < points.size()); i++)
+            randomOrder.insert(points[i]);
+        std::cout << "\tRandom order took " << (getTime() - start)
+                  << " seconds" << std::endl;
+
+        STRUCT_TYPE mortonOrder(boundary);
+        start = getTime();
+        insertInCurveOrder(&mortonOrder,
+            MortonCurve<NUM_DIMENSIONS, Real>(boundary), points);
+        std::cout << "\tMorton order (including sort) took "
+                  << (getTime() - start) << " seconds" << std::endl;
+
+        STRUCT_TYPE hilbertOrder(boundary);
+        start = getTime();
+        insertInCurveOrder(&hilbertOrder,
+            HilbertCurve<NUM_DIMENSIONS, Real>(boundary), points);
+        std::cout << "\tHilbert order (including sort) took "
+                  << (getTime() - start) << " seconds" << std::endl;
+        std::cout << "...DONE." << std::endl;
+    }
+
     template<typename STRUCT_TYPE>
     static void timeStructure(const std::string& structureName,
                        STRUCT_TYPE* structure,
@@ -219,6 +1189,325 @@ namespace
         std::cout << "...DONE." << std::endl;
     }
 
+    /* Compares range queries using the Pyramid Tree's ordered index
+     * against a full scan of its buckets, using hypercube queries with
+     * 16-dimensional data. */
+    static void timePyramidTreeRangeQueries()
+    {
+        static const int DIMS = 16;
+        static const int NUM_QUERIES = 100;
+        static const Real QUERY_WIDTHS[] = { 0.4f, 0.6f, 0.8f };
+        typedef Point<DIMS, Real> QueryPointType;
+
+        Dataset<DIMS, Real> dataset;
+        dataset.load( generateRandomPoints<DIMS>(NUM_TEST_POINTS) );
+        Boundary<DIMS, Real> boundary = dataset.computeBoundary();
+        const std::vector<QueryPointType>& points = dataset.getPoints();
+
+        PyramidTree<DIMS, Real> fullScan(boundary);
+        PyramidTree<DIMS, Real> ordered(boundary, true);
+        for (unsigned int i = 0; (i < points.size()); i++)
+        {
+            fullScan.insert(points[i]);
+            ordered.insert(points[i]);
+        }
+
+        std::cout << "TIMING pyramid_tree range queries (D = " << DIMS
+                  << ")..." << std::endl;
+        for (unsigned int w = 0; (w < 3); w++)
+        {
+            std::vector< Boundary<DIMS, Real> > regions;
+            for (unsigned int q = 0; (q < NUM_QUERIES); q++)
+            {
+                Boundary<DIMS, Real> region;
+                for (unsigned int d = 0; (d < DIMS); d++)
+                {
+                    Real start = generateRandomNumber(
+                        0.0f, 1.0f - QUERY_WIDTHS[w]);
+                    region[d] = Interval<Real>(start, start + QUERY_WIDTHS[w]);
+                }
+                regions.push_back(region);
+            }
+
+            std::size_t numResults = 0;
+            double start = getTime();
+            for (unsigned int q = 0; (q < NUM_QUERIES); q++)
+                numResults += fullScan.rangeQuery(regions[q]).size();
+            double fullScanTime = getTime() - start;
+            start = getTime();
+            for (unsigned int q = 0; (q < NUM_QUERIES); q++)
+                numResults -= ordered.rangeQuery(regions[q]).size();
+            double orderedTime = getTime() - start;
+
+            std::cout << "\tWidth " << QUERY_WIDTHS[w]
+                      << ": full scan took " << fullScanTime
+                      << " seconds, ordered index took " << orderedTime
+                      << " seconds";
+            if (numResults != 0)
+                std::cout << " (RESULTS DIFFER)";
+            std::cout << std::endl;
+        }
+        std::cout << "...DONE." << std::endl;
+    }
+
+    static void reportQueryTimes(const std::string& queryName,
+                                 double bruteForceTime, double indexTime,
+                                 bool matches)
+    {
+        std::cout << "\t" << queryName << ": brute force took "
+                  << bruteForceTime << " seconds, index took " << indexTime
+                  << " seconds";
+        if (!matches)
+            std::cout << " (RESULTS DIFFER)";
+        if (indexTime > bruteForceTime)
+            std::cout << " (SLOWER THAN BRUTE FORCE)";
+        std::cout << std::endl;
+    }
+
+    /* Compares range and kNN queries on the Multigrid Tree against a
+     * brute-force scan of every point, with the low-dimensional data the
+     * Multigrid Tree is meant for. */
+    template<int DIMS>
+    static void timeMultigridSpatialQueries()
+    {
+        static const int NUM_QUERIES = 100;
+        static const Real QUERY_WIDTH = 0.1f;
+        static const unsigned int K = 10;
+        typedef Point<DIMS, Real> QueryPointType;
+        typedef typename DistanceType<Real>::Type DistanceValue;
+
+        Dataset<DIMS, Real> dataset;
+        dataset.load( generateRandomPoints<DIMS>(NUM_TEST_POINTS) );
+        Boundary<DIMS, Real> boundary = dataset.computeBoundary();
+        const std::vector<QueryPointType>& points = dataset.getPoints();
+        Multigrid<DIMS, Real> multigrid(boundary);
+        for (unsigned int i = 0; (i < points.size()); i++)
+            multigrid.insert(points[i]);
+
+        std::vector< Boundary<DIMS, Real> > regions;
+        for (unsigned int q = 0; (q < NUM_QUERIES); q++)
+        {
+            Boundary<DIMS, Real> region;
+            for (unsigned int d = 0; (d < DIMS); d++)
+            {
+                Real start = generateRandomNumber(0.0f, 1.0f - QUERY_WIDTH);
+                region[d] = Interval<Real>(start, start + QUERY_WIDTH);
+            }
+            regions.push_back(region);
+        }
+        const std::vector<QueryPointType> queryPoints =
+            generateRandomPoints<DIMS>(NUM_QUERIES);
+
+        std::cout << "TIMING multigrid spatial queries (D = " << DIMS
+                  << ")..." << std::endl;
+        std::size_t numResults = 0;
+        double start = getTime();
+        for (unsigned int q = 0; (q < NUM_QUERIES); q++)
+        {
+            for (unsigned int i = 0; (i < points.size()); i++)
+                numResults += regions[q].contains(points[i]);
+        }
+        double bruteForceTime = getTime() - start;
+        start = getTime();
+        for (unsigned int q = 0; (q < NUM_QUERIES); q++)
+            numResults -= multigrid.rangeQuery(regions[q]).size();
+        double multigridTime = getTime() - start;
+        reportQueryTimes("Range queries", bruteForceTime, multigridTime,
+                         numResults == 0);
+
+        // Compare distance to the kth nearest neighbour, since points at
+        // the same distance can be returned in any order
+        std::vector<DistanceValue> expected(NUM_QUERIES);
+        std::vector<DistanceValue> distances(points.size());
+        start = getTime();
+        for (unsigned int q = 0; (q < NUM_QUERIES); q++)
+        {
+            distancesAoS<SquaredEuclideanDistance>(queryPoints[q],
+                &points[0], points.size(), &distances[0]);
+            std::nth_element(distances.begin(), distances.begin() + K - 1,
+                             distances.end());
+            expected[q] = distances[K - 1];
+        }
+        bruteForceTime = getTime() - start;
+        std::vector< std::vector<QueryPointType> > neighbours(NUM_QUERIES);
+        start = getTime();
+        for (unsigned int q = 0; (q < NUM_QUERIES); q++)
+            neighbours[q] = multigrid.knn(queryPoints[q], K);
+        multigridTime = getTime() - start;
+        bool matches = true;
+        for (unsigned int q = 0; (q < NUM_QUERIES); q++)
+        {
+            DistanceValue furthest = 0;
+            if (neighbours[q].size() == K)
+            {
+                distancesAoS<SquaredEuclideanDistance>(queryPoints[q],
+                    &neighbours[q][K - 1], 1, &furthest);
+            }
+            if (neighbours[q].size() != K || furthest != expected[q])
+                matches = false;
+        }
+        reportQueryTimes("kNN queries", bruteForceTime, multigridTime,
+                         matches);
+        std::cout << "...DONE." << std::endl;
+    }
+
+    /* Compares single point and batch queries on the Pyramid Tree with
+     * 32-dimensional data, where hashing dominates the cost of queries. */
+    static void timePyramidTreeBatchQueries()
+    {
+        static const int DIMS = 32;
+        typedef std::vector< Point<DIMS, Real> > BatchPointList;
+
+        Dataset<DIMS, Real> dataset;
+        dataset.load( generateRandomPoints<DIMS>(NUM_TEST_POINTS) );
+        const BatchPointList& points = dataset.getPoints();
+        PyramidTree<DIMS, Real> pyramidTree(dataset.computeBoundary());
+
+        std::cout << "TIMING pyramid_tree batch operations (D = " << DIMS
+                  << ")..." << std::endl;
+        double start = getTime();
+        pyramidTree.insertBatch(points);
+        std::cout << "\tBatch insertion took " << (getTime() - start)
+                  << " seconds" << std::endl;
+
+        // Count the points found, so the queries can't be optimised away
+        unsigned int numFound = 0;
+        start = getTime();
+        for (unsigned int i = 0; (i < points.size()); i++)
+        {
+            if (pyramidTree.query(points[i]))
+                numFound++;
+        }
+        std::cout << "\tQueries took " << (getTime() - start)
+                  << " seconds" << std::endl;
+
+        std::vector<bool> results;
+        start = getTime();
+        pyramidTree.queryBatch(points, results);
+        std::cout << "\tBatch queries took " << (getTime() - start)
+                  << " seconds" << std::endl;
+        if (numFound != std::count(results.begin(), results.end(), true))
+            std::cout << "\tBatch queries found different points" << std::endl;
+        std::cout << "...DONE." << std::endl;
+    }
+
+    /* Compares bucket occupancy and query times of the standard and
+     * extended Pyramid Trees on skewed data. */
+    static void timeExtendedPyramidTree()
+    {
+        static const unsigned int MEDIAN_SAMPLE_SIZE = 1000;
+
+        DatasetType dataset;
+        dataset.load( generateSkewedPoints<NUM_DIMENSIONS>(NUM_TEST_POINTS) );
+        BoundaryType boundary = dataset.computeBoundary();
+        const PointList& points = dataset.getPoints();
+
+        PyramidTree<NUM_DIMENSIONS, Real> standard(boundary);
+        PyramidTree<NUM_DIMENSIONS, Real> extended(boundary,
+            dataset.computeMedian(MEDIAN_SAMPLE_SIZE));
+        PyramidTree<NUM_DIMENSIONS, Real>* structures[] = {
+            &standard, &extended };
+        const char* names[] = { "standard", "extended" };
+
+        std::cout << "TIMING pyramid_tree on skewed data..." << std::endl;
+        for (unsigned int s = 0; (s < 2); s++)
+        {
+            for (unsigned int i = 0; (i < points.size()); i++)
+                structures[s]->insert(points[i]);
+            double start = getTime();
+            for (unsigned int i = 0; (i < points.size()); i++)
+                structures[s]->query(points[i]);
+            std::cout << "\t" << names[s] << ": "
+                      << structures[s]->numBuckets() << " buckets, "
+                      << structures[s]->maxPointsPerBucket()
+                      << " max points per bucket, queries took "
+                      << (getTime() - start) << " seconds" << std::endl;
+        }
+        std::cout << "...DONE." << std::endl;
+    }
+
+    /* Reports the memory used to store each point when quantised to
+     * QUANTISED_TYPE, against the precision lost, and times point queries
+     * on a Pyramid Tree storing the quantised points. */
+    template<typename QUANTISED_TYPE>
+    static void timeQuantised(const std::string& typeName,
+                              const PointList& points,
+                              const BoundaryType& boundary)
+    {
+        typedef PyramidTree<NUM_DIMENSIONS, QUANTISED_TYPE> QPyramidTree;
+        Quantiser<NUM_DIMENSIONS, QUANTISED_TYPE> quantiser(boundary);
+        QPyramidTree pyramidTree(quantiser.boundary());
+        QuantisedIndex<NUM_DIMENSIONS, QUANTISED_TYPE, QPyramidTree>
+            index(quantiser, &pyramidTree);
+
+        double maxError = 0;
+        double maxErrorBound = 0;
+        for (unsigned int i = 0; (i < points.size()); i++)
+        {
+            PointType dequantised = quantiser.dequantise(
+                quantiser.quantise(points[i]));
+            for (unsigned int d = 0; (d < NUM_DIMENSIONS); d++)
+            {
+                maxError = std::max(maxError,
+                    std::abs(static_cast<double>(dequantised[d] - points[i][d])));
+            }
+        }
+        for (unsigned int d = 0; (d < NUM_DIMENSIONS); d++)
+            maxErrorBound = std::max(maxErrorBound, quantiser.maxError(d));
+
+        unsigned int numStored = 0;
+        for (unsigned int i = 0; (i < points.size()); i++)
+        {
+            if (index.insert(points[i]))
+                numStored++;
+        }
+        unsigned int numFound = 0;
+        double start = getTime();
+        for (unsigned int i = 0; (i < points.size()); i++)
+        {
+            if (index.query(points[i]))
+                numFound++;
+        }
+        double queryTime = getTime() - start;
+
+        std::cout << "\t" << typeName << ": "
+                  << sizeof(Point<NUM_DIMENSIONS, QUANTISED_TYPE>)
+                  << " bytes per point, max error " << maxError
+                  << " (bound " << maxErrorBound << "), "
+                  << (points.size() - numStored)
+                  << " points merged, queries took " << queryTime
+                  << " seconds";
+        if (numFound != points.size())
+            std::cout << " (POINTS NOT FOUND)";
+        std::cout << std::endl;
+    }
+
+    static void timeQuantisation(const PointList& points,
+                                 const BoundaryType& boundary)
+    {
+        std::cout << "TIMING pyramid_tree with quantised points..."
+                  << std::endl;
+        PyramidTree<NUM_DIMENSIONS, Real> pyramidTree(boundary);
+        for (unsigned int i = 0; (i < points.size()); i++)
+            pyramidTree.insert(points[i]);
+        unsigned int numFound = 0;
+        double start = getTime();
+        for (unsigned int i = 0; (i < points.size()); i++)
+        {
+            if (pyramidTree.query(points[i]))
+                numFound++;
+        }
+        std::cout << "\tfloat: " << sizeof(PointType)
+                  << " bytes per point, queries took " << (getTime() - start)
+                  << " seconds";
+        if (numFound != points.size())
+            std::cout << " (POINTS NOT FOUND)";
+        std::cout << std::endl;
+        timeQuantised<int16_t>("int16", points, boundary);
+        timeQuantised<int8_t>("int8", points, boundary);
+        std::cout << "...DONE." << std::endl;
+    }
+
     static void testCorrectness(const PointList& points,
                                 const BoundaryType& boundary)
     {
@@ -232,12 +1521,134 @@ namespace
         Multigrid<NUM_DIMENSIONS, Real> multigrid(boundary);
         testStructure< Multigrid<NUM_DIMENSIONS, Real> >(
             "multigrid", &multigrid, points);
+        testRangeQuery< Multigrid<NUM_DIMENSIONS, Real> >(
+            "multigrid", &multigrid, points);
+        testKnnQuery< Multigrid<NUM_DIMENSIONS, Real> >(
+            "multigrid", &multigrid, points);
+        // Coarse grid with no fused levels, so leaves are split often
+        Multigrid<NUM_DIMENSIONS, Real> coarseMultigrid(boundary, 4, 8, 1);
+        testStructure< Multigrid<NUM_DIMENSIONS, Real> >(
+            "multigrid (coarse)", &coarseMultigrid, points);
+        testRangeQuery< Multigrid<NUM_DIMENSIONS, Real> >(
+            "multigrid (coarse)", &coarseMultigrid, points);
+        testKnnQuery< Multigrid<NUM_DIMENSIONS, Real> >(
+            "multigrid (coarse)", &coarseMultigrid, points);
+        Multigrid<NUM_DIMENSIONS, Real> bulkMultigrid(boundary);
+        testBulkLoad< Multigrid<NUM_DIMENSIONS, Real> >(
+            "multigrid", &bulkMultigrid, points);
+        Multigrid<NUM_DIMENSIONS, Real> coarseBulkMultigrid(boundary, 4, 8, 1);
+        testBulkLoad< Multigrid<NUM_DIMENSIONS, Real> >(
+            "multigrid (coarse)", &coarseBulkMultigrid, points);
+        testGrowableIndex< Multigrid<NUM_DIMENSIONS, Real> >(
+            "multigrid", points);
         BitHash<NUM_DIMENSIONS, Real> bitHash;
         testStructure< BitHash<NUM_DIMENSIONS, Real> >(
             "bithash", &bitHash, points);
+        testBatch< BitHash<NUM_DIMENSIONS, Real> >(
+            "bithash", &bitHash, points);
+        typedef CurveHash<NUM_DIMENSIONS, Real,
+            MortonCurve<NUM_DIMENSIONS, Real> > MortonHash;
+        typedef CurveHash<NUM_DIMENSIONS, Real,
+            HilbertCurve<NUM_DIMENSIONS, Real> > HilbertHash;
+        MortonHash mortonHash(boundary);
+        testStructure<MortonHash>("morton_hash", &mortonHash, points);
+        MortonHash batchMortonHash(boundary);
+        testBatch<MortonHash>("morton_hash", &batchMortonHash, points);
+        HilbertHash hilbertHash(boundary);
+        testStructure<HilbertHash>("hilbert_hash", &hilbertHash, points);
+        HilbertHash batchHilbertHash(boundary);
+        testBatch<HilbertHash>("hilbert_hash", &batchHilbertHash, points);
         PyramidTree<NUM_DIMENSIONS, Real> pyramidTree(boundary);
         testStructure< PyramidTree<NUM_DIMENSIONS, Real> >(
             "pyramid_tree", &pyramidTree, points);
+        testRangeQuery< PyramidTree<NUM_DIMENSIONS, Real> >(
+            "pyramid_tree", &pyramidTree, points);
+        PyramidTree<NUM_DIMENSIONS, Real> batchPyramidTree(boundary);
+        testBatch< PyramidTree<NUM_DIMENSIONS, Real> >(
+            "pyramid_tree", &batchPyramidTree, points);
+        PyramidTree<NUM_DIMENSIONS, Real> orderedPyramidTree(boundary, true);
+        testStructure< PyramidTree<NUM_DIMENSIONS, Real> >(
+            "pyramid_tree (ordered)", &orderedPyramidTree, points);
+        testRangeQuery< PyramidTree<NUM_DIMENSIONS, Real> >(
+            "pyramid_tree (ordered)", &orderedPyramidTree, points);
+
+        testGrowableIndex< PyramidTree<NUM_DIMENSIONS, Real> >(
+            "pyramid_tree", points);
+
+        DatasetType dataset;
+        dataset.load(points);
+        PyramidTree<NUM_DIMENSIONS, Real> extendedPyramidTree(boundary,
+            dataset.computeMedian(), true);
+        testStructure< PyramidTree<NUM_DIMENSIONS, Real> >(
+            "pyramid_tree (extended)", &extendedPyramidTree, points);
+        testRangeQuery< PyramidTree<NUM_DIMENSIONS, Real> >(
+            "pyramid_tree (extended)", &extendedPyramidTree, points);
+        PyramidTree<NUM_DIMENSIONS, Real> batchExtendedPyramidTree(boundary,
+            dataset.computeMedian(), true);
+        testBatch< PyramidTree<NUM_DIMENSIONS, Real> >(
+            "pyramid_tree (extended)", &batchExtendedPyramidTree, points);
+        DatasetType skewedDataset;
+        skewedDataset.load(
+            generateSkewedPoints<NUM_DIMENSIONS>(NUM_TEST_POINTS) );
+        PyramidTree<NUM_DIMENSIONS, Real> skewedPyramidTree(
+            skewedDataset.computeBoundary(), skewedDataset.computeMedian(),
+            true);
+        testStructure< PyramidTree<NUM_DIMENSIONS, Real> >(
+            "pyramid_tree (extended, skewed)", &skewedPyramidTree,
+            skewedDataset.getPoints());
+        testRangeQuery< PyramidTree<NUM_DIMENSIONS, Real> >(
+            "pyramid_tree (extended, skewed)", &skewedPyramidTree,
+            skewedDataset.getPoints());
+
+        KDTree<NUM_DIMENSIONS, Real> curveKDTree;
+        testCurveOrderedLoad< KDTree<NUM_DIMENSIONS, Real> >(
+            "kd-tree", &curveKDTree, points, boundary);
+        BucketKDTree<NUM_DIMENSIONS, Real> curveBucketKDTree;
+        testCurveOrderedLoad< BucketKDTree<NUM_DIMENSIONS, Real> >(
+            "bucket_kd-tree", &curveBucketKDTree, points, boundary);
+        Multigrid<NUM_DIMENSIONS, Real> curveMultigrid(boundary);
+        testCurveOrderedLoad< Multigrid<NUM_DIMENSIONS, Real> >(
+            "multigrid", &curveMultigrid, points, boundary);
+        BitHash<NUM_DIMENSIONS, Real> curveBitHash;
+        testCurveOrderedLoad< BitHash<NUM_DIMENSIONS, Real> >(
+            "bithash", &curveBitHash, points, boundary);
+        PyramidTree<NUM_DIMENSIONS, Real> curvePyramidTree(boundary);
+        testCurveOrderedLoad< PyramidTree<NUM_DIMENSIONS, Real> >(
+            "pyramid_tree", &curvePyramidTree, points, boundary);
+
+        KDTree<NUM_DIMENSIONS, Real> streamedKDTree;
+        testStreamedLoad< KDTree<NUM_DIMENSIONS, Real> >(
+            "kd-tree", &streamedKDTree, points);
+        Multigrid<NUM_DIMENSIONS, Real> streamedMultigrid(boundary);
+        testStreamedLoad< Multigrid<NUM_DIMENSIONS, Real> >(
+            "multigrid", &streamedMultigrid, points);
+        PyramidTree<NUM_DIMENSIONS, Real> streamedPyramidTree(boundary);
+        testStreamedLoad< PyramidTree<NUM_DIMENSIONS, Real> >(
+            "pyramid_tree", &streamedPyramidTree, points);
+
+        testQuantised<int16_t>("int16", points, boundary);
+        testQuantised<int8_t>("int8", points, boundary);
+
+        KDTree<NUM_DIMENSIONS, Real> memoryKDTree;
+        testMemoryUsage< KDTree<NUM_DIMENSIONS, Real> >(
+            "kd-tree", &memoryKDTree, points);
+        BucketKDTree<NUM_DIMENSIONS, Real> memoryBucketKDTree;
+        testMemoryUsage< BucketKDTree<NUM_DIMENSIONS, Real> >(
+            "bucket_kd-tree", &memoryBucketKDTree, points);
+        // Multigrid stores coordinates without any padding
+        Multigrid<NUM_DIMENSIONS, Real> memoryMultigrid(boundary);
+        testMemoryUsage< Multigrid<NUM_DIMENSIONS, Real> >(
+            "multigrid", &memoryMultigrid, points,
+            NUM_DIMENSIONS * sizeof(Real));
+        BitHash<NUM_DIMENSIONS, Real> memoryBitHash;
+        testMemoryUsage< BitHash<NUM_DIMENSIONS, Real> >(
+            "bithash", &memoryBitHash, points);
+        PyramidTree<NUM_DIMENSIONS, Real> memoryPyramidTree(boundary, true);
+        testMemoryUsage< PyramidTree<NUM_DIMENSIONS, Real> >(
+            "pyramid_tree", &memoryPyramidTree, points);
+
+        testDynamicDispatch(points);
+        testDistributions();
     }
 
     static void testPerformance(const PointList& points,
@@ -253,12 +1664,27 @@ namespace
         Multigrid<NUM_DIMENSIONS, Real> multigrid(boundary);
         timeStructure< Multigrid<NUM_DIMENSIONS, Real> >(
             "multigrid", &multigrid, points);
+        Multigrid<NUM_DIMENSIONS, Real> bulkMultigrid(boundary);
+        timeBulkLoad< Multigrid<NUM_DIMENSIONS, Real> >(
+            "multigrid", &bulkMultigrid, points);
+        timeMultigridSpatialQueries<2>();
+        timeMultigridSpatialQueries<4>();
         BitHash<NUM_DIMENSIONS, Real> bitHash;
         timeStructure< BitHash<NUM_DIMENSIONS, Real> >(
             "bithash", &bitHash, points);
         PyramidTree<NUM_DIMENSIONS, Real> pyramidTree(boundary);
         timeStructure< PyramidTree<NUM_DIMENSIONS, Real> >(
             "pyramid_tree", &pyramidTree, points);
+        timePyramidTreeRangeQueries();
+        timeExtendedPyramidTree();
+        timePyramidTreeBatchQueries();
+        timeQuantisation(points, boundary);
+        timeCurveOrderedLoad< Multigrid<NUM_DIMENSIONS, Real> >(
+            "multigrid", points, boundary);
+        timeCurveOrderedLoad< PyramidTree<NUM_DIMENSIONS, Real> >(
+            "pyramid_tree", points, boundary);
+        timeStreamedLoad(points, boundary);
+        timeDynamicDispatch(points);
     }
 
 }
@@ -268,7 +1694,7 @@ int main(int argc, char* argv[])
     // Generate test data using random number generator
     srand(time(NULL)); // seed generator to get different points every time!!
     DatasetType dataset;
-    dataset.load( generateRandomPoints(NUM_TEST_POINTS) );
+    dataset.load( generateRandomPoints<NUM_DIMENSIONS>(NUM_TEST_POINTS) );
     BoundaryType boundary = dataset.computeBoundary();
 
     testCorrectness(dataset.getPoints(), boundary);